@@ -0,0 +1,85 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2018 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef ESEARCH_TYPES_H
+
+#define ESEARCH_TYPES_H
+
+#include <libetpan/mailimap_types.h>
+#include <libetpan/mailimap_uidset.h>
+
+/* result options of SEARCH RETURN */
+
+enum {
+  MAILIMAP_ESEARCH_RETURN_MIN   = 1 << 0,
+  MAILIMAP_ESEARCH_RETURN_MAX   = 1 << 1,
+  MAILIMAP_ESEARCH_RETURN_ALL   = 1 << 2,
+  MAILIMAP_ESEARCH_RETURN_COUNT = 1 << 3,
+  MAILIMAP_ESEARCH_RETURN_MODSEQ = 1 << 4  /* returned with CONDSTORE */
+};
+
+/*
+  mailimap_esearch_result is the content of an ESEARCH response
+
+  - es_tag is the tag of the command, can be NULL
+
+  - es_is_uid is 1 if the results are UIDs
+
+  - es_returned is the set of results returned by the server,
+    a combination of MAILIMAP_ESEARCH_RETURN_*
+
+  - es_min, es_max and es_count are the returned MIN, MAX and COUNT
+
+  - es_all is the returned ALL, NULL if it was not returned
+
+  - es_modseq is the highest mod-sequence of the matching messages
+    when the CONDSTORE extension is used
+*/
+
+struct mailimap_esearch_result {
+  char * es_tag;
+  int es_is_uid;
+  int es_returned;
+  uint32_t es_min;
+  uint32_t es_max;
+  uint32_t es_count;
+  struct mailimap_uidset * es_all;
+  uint64_t es_modseq;
+};
+
+LIBETPAN_EXPORT
+struct mailimap_esearch_result * mailimap_esearch_result_new(char * es_tag,
+    int es_is_uid);
+
+LIBETPAN_EXPORT
+void mailimap_esearch_result_free(struct mailimap_esearch_result * result);
+
+#endif
@@ -45,6 +45,78 @@ extern "C" {
 
 extern mailmessage_driver * imap_message_driver;
 
+/*
+  imap_fetch_section_decoded() fetches the content of a single MIME part
+  with its Content-Transfer-Encoding removed.
+
+  when the server supports the BINARY extension (RFC 3516), the part
+  is decoded by the server, which saves the encoding overhead on the
+  wire and the decoding on the client. otherwise, the part is fetched
+  as usual and decoded locally.
+
+  msg_info must be a message of the imap or cached imap driver.
+  the result must be freed with mailmime_decoded_part_free().
+*/
+
+LIBETPAN_EXPORT
+int imap_fetch_section_decoded(mailmessage * msg_info,
+			       struct mailmime * mime,
+			       char ** result,
+			       size_t * result_len);
+
+/*
+  imap_fetch_section_ranged() downloads the content of a MIME part
+  (or of the whole message when mime is the root) as a sequence of
+  BODY.PEEK[section]<offset.size> partial fetches. each chunk is given
+  to sink as soon as it is received.
+
+  state records how much has been delivered. when a download fails,
+  for example because the connection was lost, calling the function
+  again with the same state on a new session resumes at the last
+  offset. the state is reset when it belongs to another message or
+  part. when state_filename is not NULL, the state is saved to
+  that file after each chunk, so that it can be loaded with
+  imap_fetch_range_state_read() in a later run.
+
+  the chunk size is adjusted after each fetch from the measured
+  throughput so that a partial fetch takes about one second.
+
+  sink must return MAIL_NO_ERROR to continue, any other value aborts
+  the download and is returned.
+*/
+
+typedef int imap_fetch_sink(const char * data, size_t length,
+    void * context);
+
+struct imap_fetch_range_state {
+  char * rs_msg_uid;     /* message being downloaded */
+  char * rs_section;     /* part being downloaded, "" for the message */
+  size_t rs_offset;      /* number of bytes given to the sink */
+  size_t rs_chunk_size;  /* size of the next partial fetch */
+  int rs_complete;       /* the whole part has been given to the sink */
+};
+
+LIBETPAN_EXPORT
+struct imap_fetch_range_state * imap_fetch_range_state_new(void);
+
+LIBETPAN_EXPORT
+void imap_fetch_range_state_free(struct imap_fetch_range_state * state);
+
+LIBETPAN_EXPORT
+int imap_fetch_range_state_read(const char * filename,
+    struct imap_fetch_range_state ** result);
+
+LIBETPAN_EXPORT
+int imap_fetch_range_state_write(const char * filename,
+    struct imap_fetch_range_state * state);
+
+LIBETPAN_EXPORT
+int imap_fetch_section_ranged(mailmessage * msg_info,
+    struct mailmime * mime,
+    struct imap_fetch_range_state * state,
+    const char * state_filename,
+    imap_fetch_sink * sink, void * sink_context);
+
 #ifdef __cplusplus
 }
 #endif
@@ -47,9 +47,14 @@ extern "C" {
 #include <libetpan/mailfolder.h>
 #include <libetpan/mailstorage.h>
 #include <libetpan/mailthread.h>
+#include <libetpan/mailsearchindex.h>
 #include <libetpan/mailsmtp.h>
 #include <libetpan/charconv.h>
 #include <libetpan/mailsem.h>
+#include <libetpan/mailparallel.h>
+#include <libetpan/mailstream_log.h>
+#include <libetpan/mailmetrics.h>
+#include <libetpan/mailmapview.h>
 #include <libetpan/carray.h>
 #include <libetpan/chash.h>
 #include <libetpan/maillock.h>
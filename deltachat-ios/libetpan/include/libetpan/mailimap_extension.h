@@ -54,6 +54,20 @@ LIBETPAN_EXPORT
 int
 mailimap_extension_register(struct mailimap_extension_api * extension);
 
+/*
+  mailimap_extension_register_keywords() declares the leading keywords
+  (for example "QUOTA" or "X-GM-LABELS") of the items the parser of a
+  registered extension recognizes, as a NULL-terminated list that must
+  remain valid while the extension is registered.
+  mailimap_extension_data_parse() then calls the extension only for
+  these items. An extension without keywords is tried for every item.
+*/
+
+LIBETPAN_EXPORT
+int
+mailimap_extension_register_keywords(struct mailimap_extension_api * extension,
+    const char * const * keywords);
+
 LIBETPAN_EXPORT
 void
 mailimap_extension_unregister_all(void);
@@ -51,6 +51,27 @@ LIBETPAN_EXPORT
 int mailimap_fetch_rfc822_header(mailimap * session,
 				 uint32_t msgid, char ** result);
 
+/*
+  mailimap_uid_fetch_section_to_fd() writes the given section of the
+  message with the given UID to fd while it is downloaded, so that
+  only a buffer of it is in memory at a time.
+
+  - encoding is the encoding of the section. The content is decoded
+    when it is MAILIMAP_BODY_FLD_ENC_BASE64 and written as is otherwise.
+
+  - section is not freed.
+
+  - (* result_len) is the number of bytes written to fd.
+
+  MAILIMAP_ERROR_FETCH is returned if fd could not be written,
+  the session can still be used.
+*/
+
+LIBETPAN_EXPORT
+int mailimap_uid_fetch_section_to_fd(mailimap * session, uint32_t uid,
+    struct mailimap_section * section, int encoding,
+    int fd, size_t * result_len);
+
 LIBETPAN_EXPORT
 int mailimap_fetch_envelope(mailimap * session,
 			    uint32_t first, uint32_t last,
@@ -509,6 +509,7 @@ extern "C" {
 #include <libetpan/libetpan-config.h>
 #include <libetpan/mailstream.h>
 #include <libetpan/clist.h>
+#include <libetpan/mailmetrics.h>
 #include <stdbool.h>
 
 
@@ -2049,7 +2050,11 @@ enum {
   MAILIMAP_MSG_ATT_BODYSTRUCTURE, /* this is the MIME description of the
                                      message with additional information */
   MAILIMAP_MSG_ATT_BODY_SECTION,  /* this is a MIME part content */
-  MAILIMAP_MSG_ATT_UID            /* this is the message unique identifier */
+  MAILIMAP_MSG_ATT_UID,           /* this is the message unique identifier */
+  MAILIMAP_MSG_ATT_BINARY_SECTION, /* this is a decoded MIME part content
+                                      (BINARY extension) */
+  MAILIMAP_MSG_ATT_BINARY_SIZE    /* this is the size of a decoded MIME part
+                                     (BINARY extension) */
 };
 
 /*
@@ -2060,7 +2065,8 @@ enum {
     MAILIMAP_MSG_ATT_RFC822, MAILIMAP_MSG_ATT_RFC822_HEADER,
     MAILIMAP_MSG_ATT_RFC822_TEXT, MAILIMAP_MSG_ATT_RFC822_SIZE,
     MAILIMAP_MSG_ATT_BODY, MAILIMAP_MSG_ATT_BODYSTRUCTURE,
-    MAILIMAP_MSG_ATT_BODY_SECTION, MAILIMAP_MSG_ATT_UID
+    MAILIMAP_MSG_ATT_BODY_SECTION, MAILIMAP_MSG_ATT_UID,
+    MAILIMAP_MSG_ATT_BINARY_SECTION, MAILIMAP_MSG_ATT_BINARY_SIZE
 
   - env is the headers parsed by the server if type is
     MAILIMAP_MSG_ATT_ENVELOPE
@@ -2087,6 +2093,12 @@ enum {
   - body_section is a MIME part content
 
   - uid is a unique message identifier
+
+  - binary_section is a MIME part content with its content transfer
+    encoding removed by the server, sec_body_part can contain NUL bytes
+
+  - binary_size is the size of a MIME part once decoded, it is given
+    in sec_length, sec_body_part is NULL
 */
 
 struct mailimap_msg_att_static {
@@ -2111,6 +2123,8 @@ struct mailimap_msg_att_static {
     struct mailimap_body * att_body;          /* can be NULL */
     struct mailimap_msg_att_body_section * att_body_section; /* can be NULL */
     uint32_t att_uid;
+    struct mailimap_msg_att_body_section * att_binary_section; /* can be NULL */
+    struct mailimap_msg_att_body_section * att_binary_size; /* can be NULL */
   } att_data;
 };
 
@@ -2796,7 +2810,14 @@ enum {
   MAILIMAP_FETCH_ATT_BODY_SECTION,      /* to fetch a given part */
   MAILIMAP_FETCH_ATT_BODY_PEEK_SECTION, /* to fetch a given part without
                                            marking the message as read */
-  MAILIMAP_FETCH_ATT_EXTENSION
+  MAILIMAP_FETCH_ATT_EXTENSION,
+  MAILIMAP_FETCH_ATT_BINARY_SECTION,    /* to fetch a given part decoded
+                                           by the server (BINARY) */
+  MAILIMAP_FETCH_ATT_BINARY_PEEK_SECTION, /* to fetch a given part decoded
+                                             by the server without marking
+                                             the message as read */
+  MAILIMAP_FETCH_ATT_BINARY_SIZE_SECTION  /* to fetch the decoded size of
+                                             a given part */
 };
 
 
@@ -2810,10 +2831,14 @@ enum {
     MAILIMAP_FETCH_ATT_RFC822_TEXT, MAILIMAP_FETCH_ATT_BODY,
     MAILIMAP_FETCH_ATT_BODYSTRUCTURE, MAILIMAP_FETCH_ATT_UID,
     MAILIMAP_FETCH_ATT_BODY_SECTION, MAILIMAP_FETCH_ATT_BODY_PEEK_SECTION,
-    MAILIMAP_FETCH_ATT_EXTENSION
+    MAILIMAP_FETCH_ATT_EXTENSION, MAILIMAP_FETCH_ATT_BINARY_SECTION,
+    MAILIMAP_FETCH_ATT_BINARY_PEEK_SECTION,
+    MAILIMAP_FETCH_ATT_BINARY_SIZE_SECTION
 
   - section is the location of the part to fetch if type is
-    MAILIMAP_FETCH_ATT_BODY_SECTION or MAILIMAP_FETCH_ATT_BODY_PEEK_SECTION
+    MAILIMAP_FETCH_ATT_BODY_SECTION or MAILIMAP_FETCH_ATT_BODY_PEEK_SECTION,
+    or one of the BINARY types. For the BINARY types, the section must
+    only contain a part number (or be empty).
 
   - offset is the first byte to fetch in the given part
 
@@ -3385,6 +3410,7 @@ struct mailimap {
   void * imap_msg_att_handler_context;
   mailimap_msg_body_handler * imap_msg_body_handler;
   void * imap_msg_body_handler_context;
+  size_t imap_msg_body_handler_threshold;
 
   time_t imap_timeout;
   
@@ -3393,6 +3419,8 @@ struct mailimap {
   
   int is_163_workaround_enabled;
   int is_rambler_workaround_enabled;
+
+  struct mailmetrics * imap_metrics;
 };
 
 
@@ -3491,6 +3519,9 @@ mailimap_selection_info_free(struct mailimap_selection_info * sel_info);
 
   - status is a STATUS response
 
+  - status_list is the list of the STATUS responses received before
+    the one in status, when a command gets several of them
+
   - expunged is a list of message numbers
 
   - fetch_list is a list of fetch response
@@ -3510,6 +3541,7 @@ struct mailimap_response_info {
   clist * rsp_extension_list; /* list of (struct mailimap_extension_data *) */
   char * rsp_atom;
   char * rsp_value;
+  clist * rsp_status_list; /* list of (struct mailimap_mailbox_data_status *) */
 };
 
 LIBETPAN_EXPORT
@@ -3579,6 +3611,7 @@ struct mailimap_parser_context {
 
   mailimap_msg_body_handler * msg_body_handler;
   void * msg_body_handler_context;
+  size_t msg_body_handler_threshold;
   struct mailimap_msg_att_body_section * msg_body_section;
   int msg_body_att_type;
   bool msg_body_parse_in_progress;
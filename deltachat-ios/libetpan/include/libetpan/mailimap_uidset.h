@@ -0,0 +1,135 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2018 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#ifndef MAILIMAP_UIDSET_H
+
+#define MAILIMAP_UIDSET_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <libetpan/libetpan-config.h>
+#include <libetpan/mailimap_types.h>
+
+/*
+  mailimap_uidset is a compact set of UIDs (or message numbers),
+  stored as a sorted array of disjoint ranges. Adjacent ranges are
+  always merged, so that a mailbox with no holes takes a single range.
+
+  - set_ranges is the array of ranges, sorted in increasing order.
+
+  - set_count is the number of ranges.
+
+  - set_allocated is the allocated size of the array.
+*/
+
+struct mailimap_uidset_range {
+  uint32_t rg_first;
+  uint32_t rg_last;
+};
+
+struct mailimap_uidset {
+  struct mailimap_uidset_range * set_ranges;
+  unsigned int set_count;
+  unsigned int set_allocated;
+};
+
+LIBETPAN_EXPORT
+struct mailimap_uidset * mailimap_uidset_new(void);
+
+LIBETPAN_EXPORT
+void mailimap_uidset_free(struct mailimap_uidset * uidset);
+
+/*
+  mailimap_uidset_add_range() adds the UIDs from first to last
+  (included). Adding in increasing order is done in constant time.
+*/
+
+LIBETPAN_EXPORT
+int mailimap_uidset_add_range(struct mailimap_uidset * uidset,
+    uint32_t first, uint32_t last);
+
+LIBETPAN_EXPORT
+int mailimap_uidset_add(struct mailimap_uidset * uidset, uint32_t uid);
+
+LIBETPAN_EXPORT
+int mailimap_uidset_remove_range(struct mailimap_uidset * uidset,
+    uint32_t first, uint32_t last);
+
+LIBETPAN_EXPORT
+int mailimap_uidset_remove(struct mailimap_uidset * uidset, uint32_t uid);
+
+LIBETPAN_EXPORT
+int mailimap_uidset_contains(struct mailimap_uidset * uidset, uint32_t uid);
+
+/* number of UIDs in the set */
+
+LIBETPAN_EXPORT
+uint32_t mailimap_uidset_count(struct mailimap_uidset * uidset);
+
+/*
+  set algebra, the result is a new set, NULL is returned if
+  there's not enough memory.
+*/
+
+LIBETPAN_EXPORT
+struct mailimap_uidset * mailimap_uidset_union(struct mailimap_uidset * a,
+    struct mailimap_uidset * b);
+
+LIBETPAN_EXPORT
+struct mailimap_uidset * mailimap_uidset_intersection(struct mailimap_uidset * a,
+    struct mailimap_uidset * b);
+
+LIBETPAN_EXPORT
+struct mailimap_uidset * mailimap_uidset_difference(struct mailimap_uidset * a,
+    struct mailimap_uidset * b);
+
+/*
+  conversions to and from mailimap_set.
+  In a mailimap_set, 0 means "*", it's stored as the largest UID.
+*/
+
+LIBETPAN_EXPORT
+struct mailimap_set * mailimap_uidset_to_set(struct mailimap_uidset * uidset);
+
+LIBETPAN_EXPORT
+struct mailimap_uidset * mailimap_uidset_new_from_set(struct mailimap_set * set);
+
+/* list is a list of (uint32_t *), such as the result of mailimap_search() */
+
+LIBETPAN_EXPORT
+struct mailimap_uidset * mailimap_uidset_new_from_list(clist * list);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,118 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2005 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef MAILMAPVIEW_H
+
+#define MAILMAPVIEW_H
+
+#include <sys/types.h>
+
+#ifndef LIBETPAN_CONFIG_H
+#	include <libetpan/libetpan-config.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+  mailmapview is a read-only, reference counted view on a file mapped
+  in memory.
+
+  Strings given out from a view point directly into the mapping, each
+  of them holds a reference to the view. They are released with
+  mmap_string_unref() like the other strings returned by the library,
+  so data read from a mapped file can be returned without a copy.
+
+  The mapping is unmapped when the last reference is released.
+*/
+
+struct mailmapview {
+  char * mv_data;
+  size_t mv_size;
+  unsigned int mv_ref;
+};
+
+/*
+  mailmapview_new() creates a view on a region given by mmap(),
+  the view then owns the mapping.
+  The view is returned with one reference.
+*/
+
+LIBETPAN_EXPORT
+struct mailmapview * mailmapview_new(char * data, size_t size);
+
+LIBETPAN_EXPORT
+void mailmapview_ref(struct mailmapview * view);
+
+LIBETPAN_EXPORT
+void mailmapview_unref(struct mailmapview * view);
+
+/*
+  mailmapview_is_shared() tells if references other than the one of
+  the caller are held, i.e. strings given out from the view are still
+  in use and the file must not be changed in place.
+*/
+
+LIBETPAN_EXPORT
+int mailmapview_is_shared(struct mailmapview * view);
+
+/*
+  mailmapview_get_str() returns a pointer to the given offset of the
+  view and takes a reference that is released with mmap_string_unref().
+  It returns NULL if there is not enough memory.
+*/
+
+LIBETPAN_EXPORT
+char * mailmapview_get_str(struct mailmapview * view, size_t offset);
+
+/*
+  mailmapview_str_ref() takes a new reference on the view of a string
+  given out by mailmapview_get_str().
+  It returns -1 if the string does not come from a view.
+*/
+
+LIBETPAN_EXPORT
+int mailmapview_str_ref(const char * str);
+
+/*
+  mailmapview_str_unref() releases the reference taken for a string.
+  It returns -1 if the string does not come from a view.
+*/
+
+LIBETPAN_EXPORT
+int mailmapview_str_unref(const char * str);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
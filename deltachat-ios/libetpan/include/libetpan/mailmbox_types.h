@@ -48,6 +48,7 @@ extern "C" {
 #include <libetpan/mailimf.h>
 #include <libetpan/carray.h>
 #include <libetpan/chash.h>
+#include <libetpan/mailmapview.h>
 
 enum {
   MAILMBOX_NO_ERROR = 0,
@@ -76,6 +77,7 @@ struct mailmbox_folder {
   
   char * mb_mapping;
   size_t mb_mapping_size;
+  struct mailmapview * mb_view;
 
   uint32_t mb_written_uid;
   uint32_t mb_max_uid;
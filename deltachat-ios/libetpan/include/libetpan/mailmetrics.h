@@ -0,0 +1,175 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2005 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef MAILMETRICS_H
+
+#define MAILMETRICS_H
+
+#include <libetpan/libetpan-config.h>
+#include <libetpan/mailstream.h>
+#include <libetpan/carray.h>
+
+#include <inttypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+  mailmetrics_histogram is a histogram of durations in microseconds.
+  Values below 16 have their own bucket, each power of two above is
+  divided in 8 buckets, the value of a bucket is known within 12.5%.
+*/
+
+#define MAILMETRICS_HISTOGRAM_SIZE 304
+
+struct mailmetrics_histogram {
+  uint64_t h_count;
+  uint64_t h_total;
+  uint64_t h_max;
+  uint32_t h_buckets[MAILMETRICS_HISTOGRAM_SIZE];
+};
+
+LIBETPAN_EXPORT
+void mailmetrics_histogram_add(struct mailmetrics_histogram * histogram,
+    uint64_t value);
+
+/*
+  mailmetrics_histogram_percentile() returns the value below which are
+  the given percentage (0 to 100) of the values.
+*/
+
+LIBETPAN_EXPORT
+uint64_t mailmetrics_histogram_percentile(struct mailmetrics_histogram * histogram,
+    double percentile);
+
+/*
+  mailmetrics_command is the statistics of a type of command
+
+  - name is the command in upper case (for IMAP, "UID FETCH" for example),
+    commands that contain credentials are counted as "AUTH"
+
+  - count is the number of commands
+
+  - latency is the time from the moment the command is sent to the moment
+    its response is read (the status line for POP3, SMTP and NNTP, the
+    tagged response for IMAP)
+
+  - wait_time is the part of the latency spent waiting for data from the
+    server, parse_time is the rest, spent in the library
+*/
+
+struct mailmetrics_command {
+  char * mc_name;
+  uint64_t mc_count;
+  uint64_t mc_wait_time;
+  uint64_t mc_parse_time;
+  struct mailmetrics_histogram mc_latency;
+};
+
+/* commands sent whose response is not read yet */
+
+struct mailmetrics_pending {
+  struct mailmetrics_command * mp_command;
+  uint64_t mp_name_position;
+  uint64_t mp_begin_time;
+  uint64_t mp_begin_wait_time;
+};
+
+/*
+  mailmetrics is the statistics of the commands of a session
+
+  - commands is an array of (struct mailmetrics_command *)
+*/
+
+struct mailmetrics {
+  carray * m_commands;
+
+  /* internals */
+  struct mailmetrics_pending * m_pending;
+  unsigned int m_pending_first;
+  unsigned int m_pending_count;
+  unsigned int m_pending_size;
+};
+
+LIBETPAN_EXPORT
+struct mailmetrics * mailmetrics_new(void);
+
+LIBETPAN_EXPORT
+void mailmetrics_free(struct mailmetrics * metrics);
+
+/* returns a copy of the statistics that can be kept after the session is freed */
+
+LIBETPAN_EXPORT
+struct mailmetrics * mailmetrics_dup(struct mailmetrics * metrics);
+
+/* returns NULL if no command of this name was sent */
+
+LIBETPAN_EXPORT
+struct mailmetrics_command * mailmetrics_get_command(struct mailmetrics * metrics,
+    const char * name);
+
+/* monotonic time in microseconds */
+
+LIBETPAN_EXPORT
+uint64_t mailmetrics_now(void);
+
+/*
+  the following functions are used by the protocol implementations.
+
+  mailmetrics_command_begin() is called when a command is written to s,
+  the name is the first word of command.
+
+  mailmetrics_command_begin_unnamed() is called when the name of the
+  command is not known yet, it will be found by mailmetrics_data_sent()
+  in the data sent on s, at the current position. The commands found in
+  data that can't be published are counted as "AUTH".
+
+  mailmetrics_command_end() is called when the response of the oldest
+  pending command is read.
+*/
+
+void mailmetrics_command_begin(struct mailmetrics * metrics, mailstream * s,
+    const char * command);
+
+void mailmetrics_command_begin_unnamed(struct mailmetrics * metrics,
+    mailstream * s);
+
+void mailmetrics_data_sent(struct mailmetrics * metrics, mailstream * s,
+    const char * data, size_t size, int can_be_published);
+
+void mailmetrics_command_end(struct mailmetrics * metrics, mailstream * s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
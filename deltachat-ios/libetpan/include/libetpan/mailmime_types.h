@@ -476,6 +476,27 @@ void mailmime_section_free(struct mailmime_section * section);
 LIBETPAN_EXPORT
 void mailmime_decoded_part_free(char * part);
 
+/*
+  content of a single part, once decoded by mailmime_parts_decode().
+  dc_data is NULL when the part could not be decoded, dc_error then
+  gives the reason. dc_data is freed with mailmime_decoded_part_free().
+*/
+
+struct mailmime_decoded_content {
+  struct mailmime * dc_mime;
+  char * dc_data;
+  size_t dc_length;
+  int dc_error;
+};
+
+LIBETPAN_EXPORT
+struct mailmime_decoded_content *
+mailmime_decoded_content_new(struct mailmime * dc_mime,
+    char * dc_data, size_t dc_length, int dc_error);
+
+LIBETPAN_EXPORT
+void mailmime_decoded_content_free(struct mailmime_decoded_content * content);
+
 struct mailmime_single_fields {
   struct mailmime_content * fld_content;
   char * fld_content_charset;
@@ -66,6 +66,16 @@ int mailmime_data_write_driver(int (* do_write)(void *, const char *, size_t), v
     struct mailmime_data * mime_data,
     int istext);
 
+/*
+  mailmime_writer() writes the MIME part given as context (struct mailmime *),
+  it can be given as writer to mailsmtp_data_message_writer() or
+  mailimap_append_message_new_writer().
+  It returns 0 on success.
+*/
+
+int mailmime_writer(int (* do_write)(void *, const char *, size_t), void * data,
+    void * context);
+
 #ifdef __cplusplus
 }
 #endif
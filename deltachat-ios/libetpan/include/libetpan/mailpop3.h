@@ -139,6 +139,19 @@ LIBETPAN_EXPORT
 void mailpop3_set_logger(mailpop3 * session, void (* logger)(mailpop3 * session, int log_type,
     const char * str, size_t size, void * context), void * logger_context);
 
+/*
+  mailpop3_enable_metrics() starts to record the number and the latency
+  of the commands sent on the POP3 session, authentication steps are
+  counted as "AUTH".
+  mailpop3_get_metrics() returns NULL if the metrics were not enabled.
+*/
+
+LIBETPAN_EXPORT
+int mailpop3_enable_metrics(mailpop3 * session);
+
+LIBETPAN_EXPORT
+struct mailmetrics * mailpop3_get_metrics(mailpop3 * session);
+
 #ifdef __cplusplus
 }
 #endif
@@ -46,6 +46,7 @@ extern "C" {
 #include <libetpan/mmapstring.h>
 #include <libetpan/carray.h>
 #include <libetpan/clist.h>
+#include <libetpan/mailmetrics.h>
 
 enum {
   MAILPOP3_NO_ERROR = 0,
@@ -102,6 +103,8 @@ struct mailpop3
   
   void (* pop3_logger)(mailpop3 * session, int log_type, const char * str, size_t size, void * context);
   void * pop3_logger_context;
+
+  struct mailmetrics * pop3_metrics;
 };
 
 struct mailpop3_msg_info
@@ -110,6 +110,22 @@ int mailsmtp_data_message_quit(mailsmtp * session,
                                const char * message,
                                size_t size);
 
+/*
+  mailsmtp_data_message_writer() sends the message produced by writer()
+  instead of a message in memory. writer() is called once and gives
+  the message in pieces to do_write() with data, it returns 0 on success.
+  Line endings are converted and dots are escaped while the message is
+  sent, so that its size doesn't matter.
+  If writer() fails, MAILSMTP_ERROR_STREAM is returned without ending
+  the message and the session must be closed.
+*/
+
+LIBETPAN_EXPORT
+int mailsmtp_data_message_writer(mailsmtp * session,
+    int (* writer)(int (* do_write)(void *, const char *, size_t),
+                   void * data, void * context),
+    void * context);
+
 LIBETPAN_EXPORT
 int mailsmtp_data_message_quit_no_disconnect(mailsmtp * session,
                                              const char * message,
@@ -168,6 +184,19 @@ void mailsmtp_set_progress_callback(mailsmtp * session,
 LIBETPAN_EXPORT
 void mailsmtp_set_logger(mailsmtp * session, void (* logger)(mailsmtp * session, int log_type,
     const char * str, size_t size, void * context), void * logger_context);
+
+/*
+  mailsmtp_enable_metrics() starts to record the number and the latency
+  of the commands sent on the SMTP session, the message itself is counted
+  as "MESSAGE" and authentication steps as "AUTH".
+  mailsmtp_get_metrics() returns NULL if the metrics were not enabled.
+*/
+
+LIBETPAN_EXPORT
+int mailsmtp_enable_metrics(mailsmtp * session);
+
+LIBETPAN_EXPORT
+struct mailmetrics * mailsmtp_get_metrics(mailsmtp * session);
    
 #ifdef __cplusplus
 }
@@ -81,6 +81,32 @@ int mailsmtp_send(mailsmtp * session,
 		   clist * addresses,
 		   const char * message, size_t size);
 
+/*
+  mailesmtp_send_writer() and mailsmtp_send_writer() send the message
+  produced by writer() (see mailsmtp_data_message_writer()), for example
+  mailmime_writer() with a struct mailmime * as context.
+  When the server supports SIZE, writer() is called a first time to
+  compute the size of the message and must give the same output both times.
+*/
+
+LIBETPAN_EXPORT
+int mailesmtp_send_writer(mailsmtp * session,
+    const char * from,
+    int return_full,
+    const char * envid,
+    clist * addresses,
+    int (* writer)(int (* do_write)(void *, const char *, size_t),
+                   void * data, void * context),
+    void * context);
+
+LIBETPAN_EXPORT
+int mailsmtp_send_writer(mailsmtp * session,
+    const char * from,
+    clist * addresses,
+    int (* writer)(int (* do_write)(void *, const char *, size_t),
+                   void * data, void * context),
+    void * context);
+
 LIBETPAN_EXPORT
 clist * esmtp_address_list_new(void);
 
@@ -78,6 +78,36 @@ void mailstorage_disconnect(struct mailstorage * storage);
 LIBETPAN_EXPORT
 int mailstorage_noop(struct mailstorage * storage);
 
+/*
+  mailstorage_set_pool
+
+  The sessions of the folders that have their own connection are kept
+  after mailfolder_disconnect() and given to the next folders to connect.
+  Folders that use the session of the storage, like the IMAP INBOX,
+  do not use the pool.
+  A session that has the folder already selected is preferred, it is
+  checked with a NOOP, otherwise the folder is selected in the session.
+
+  @param max_size  is the number of sessions kept, 0 disables the pool
+    (default).
+  @param idle_timeout  is the number of seconds after which an unused
+    session is closed, 0 keeps the sessions until they are needed
+    for other folders or the storage is disconnected.
+*/
+
+LIBETPAN_EXPORT
+void mailstorage_set_pool(struct mailstorage * storage,
+    unsigned int max_size, time_t idle_timeout);
+
+/*
+  mailstorage_pool_evict closes the sessions of the pool that are
+  unused for more than the idle timeout. It does nothing when the
+  idle timeout is 0.
+*/
+
+LIBETPAN_EXPORT
+void mailstorage_pool_evict(struct mailstorage * storage);
+
 
 /* folder */
 
@@ -101,6 +131,15 @@ int mailfolder_connect(struct mailfolder * folder);
 LIBETPAN_EXPORT
 void mailfolder_disconnect(struct mailfolder * folder);
 
+/*
+  mailfolder_drop_session disconnects the folder like
+  mailfolder_disconnect() but closes its session instead of giving it
+  back to the pool. It should be used when the connection is broken.
+*/
+
+LIBETPAN_EXPORT
+void mailfolder_drop_session(struct mailfolder * folder);
+
 #ifdef __cplusplus
 }
 #endif
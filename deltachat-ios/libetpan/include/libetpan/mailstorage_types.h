@@ -91,6 +91,11 @@ typedef struct mailstorage_driver mailstorage_driver;
       It depends on the efficiency of the mail driver.
 
   - uninitialize() frees the data created with mailstorage constructor.
+
+  - folder_has_own_session() tells if get_folder() would create a new
+      session for the given mailbox instead of using the session of
+      the storage. Only those sessions are kept in the pool of the
+      storage. It can be NULL if get_folder() never creates a session.
 */
 
 struct mailstorage_driver {
@@ -99,6 +104,8 @@ struct mailstorage_driver {
   int (* sto_get_folder_session)(struct mailstorage * storage,
       char * pathname, mailsession ** result);
   void (* sto_uninitialize)(struct mailstorage * storage);
+  int (* sto_folder_has_own_session)(struct mailstorage * storage,
+      char * pathname);
 };
 
 /*
@@ -114,6 +121,12 @@ struct mailstorage_driver {
   - driver is the driver for the storage.
 
   - shared_folders is the list of folders returned by the storage.
+
+  - pool is the list of the sessions of disconnected folders, kept to
+      be reused by the next folders to connect, the most recently used
+      last. It holds at most pool_max_size sessions, none of them idle
+      for more than pool_idle_timeout seconds. A timeout of 0 keeps
+      them until they are needed.
 */
 
 struct mailstorage {
@@ -124,6 +137,10 @@ struct mailstorage {
   clist * sto_shared_folders; /* list of (struct mailfolder *) */
   
   void * sto_user_data;
+  
+  carray * sto_pool; /* array of (struct mailstorage_pool_item *) */
+  unsigned int sto_pool_max_size;
+  time_t sto_pool_idle_timeout;
 };
 
 
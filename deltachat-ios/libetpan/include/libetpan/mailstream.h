@@ -120,6 +120,30 @@ void mailstream_interrupt_idle(mailstream * s);
 LIBETPAN_EXPORT
 carray * mailstream_get_certificate_chain(mailstream * s);
 
+/*
+  mailstream_metrics is the activity of the layers of a stream
+
+  - plaintext is the data exchanged by the protocol
+
+  - compressed is the compressed data when the stream is compressed
+    (compressed_enabled is set), the data exchanged before the compression
+    started is only counted in plaintext
+
+  - tls is the data given to and received from TLS when the stream
+    uses TLS (tls_enabled is set), the counts start when TLS starts
+*/
+
+struct mailstream_metrics {
+  int sm_compressed_enabled;
+  int sm_tls_enabled;
+  struct mailstream_low_metrics sm_plaintext;
+  struct mailstream_low_metrics sm_compressed;
+  struct mailstream_low_metrics sm_tls;
+};
+
+LIBETPAN_EXPORT
+void mailstream_get_metrics(mailstream * s, struct mailstream_metrics * result);
+
 LIBETPAN_EXPORT
 void mailstream_certificate_chain_free(carray * certificate_chain);
 
@@ -81,6 +81,39 @@ int mailstream_send_data_with_context(mailstream * s, const char * message,
 
 size_t mailstream_get_data_crlf_size(const char * message, size_t size);
 
+/*
+  mailstream_data_writer sends content given in any number of pieces,
+  converting line endings to CRLF on the fly, the same way as
+  mailstream_send_data_crlf(). When dw_quoted is set, lines starting
+  with a dot are escaped as for SMTP DATA (mailstream_send_data()),
+  the final "." line is not written.
+  When dw_stream is NULL, nothing is written and only dw_size, the
+  size of the output, is computed.
+*/
+
+struct mailstream_data_writer {
+  mailstream * dw_stream;
+  int dw_quoted;
+  int dw_line_start;
+  int dw_pending_cr;
+  size_t dw_size;
+};
+
+void mailstream_data_writer_init(struct mailstream_data_writer * writer,
+    mailstream * s, int quoted);
+
+/*
+  mailstream_data_writer_write() can be given as do_write() function
+  to the write drivers (mailimf_*_write_driver(), mailmime_*_write_driver()),
+  with the mailstream_data_writer as data. It returns 0 on error.
+*/
+
+int mailstream_data_writer_write(void * writer, const char * str, size_t length);
+
+/* writes what is still pending, returns -1 on error */
+
+int mailstream_data_writer_finish(struct mailstream_data_writer * writer);
+
 #ifdef __cplusplus
 }
 #endif
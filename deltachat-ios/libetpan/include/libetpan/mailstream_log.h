@@ -0,0 +1,107 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2005 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef MAILSTREAM_LOG_H
+
+#define MAILSTREAM_LOG_H
+
+#include <libetpan/libetpan-config.h>
+
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+  Asynchronous stream log.
+
+  When mailstream_debug is set and no logger function is given
+  (mailstream_logger, mailstream_logger_id), the data of all the
+  streams is appended to a log file. Once the asynchronous log is
+  started, the streams only queue the data in memory and a
+  background thread writes it to the file in batches.
+
+  Each run of data of the same stream in the same direction starts
+  with a line giving a monotonic time, the identifier of the stream
+  (mailstream_low_set_identifier()) and the direction.
+
+  When more than max_pending_size bytes are waiting to be written,
+  the data is dropped and counted in the statistics.
+*/
+
+struct mailstream_log_stats {
+  size_t ls_records;          /* number of records written */
+  size_t ls_size;             /* size of the data written */
+  size_t ls_dropped_records;  /* number of records dropped */
+  size_t ls_dropped_size;     /* size of the data dropped */
+};
+
+/*
+  mailstream_log_start() starts the asynchronous log.
+
+  @param filename is the log file, NULL means the default
+    libetpan-stream-debug.log
+  @param max_pending_size is the maximum size of the data waiting to be
+    written, 0 means a default of 4 MB
+  @param compress, when set, the file is written gzip compressed
+
+  @return 0 on success, -1 if the log is already started or can't be
+    started (no thread support, no zlib for compression)
+*/
+
+LIBETPAN_EXPORT
+int mailstream_log_start(const char * filename, size_t max_pending_size,
+    int compress);
+
+/* writes what is still pending and stops the background thread */
+
+LIBETPAN_EXPORT
+void mailstream_log_stop(void);
+
+/*
+  mailstream_log_append() queues a record, it can be called from any
+  thread without blocking.
+  It returns -1 if the asynchronous log is not started.
+*/
+
+LIBETPAN_EXPORT
+int mailstream_log_append(const char * identifier, int direction,
+    const char * buf, size_t size);
+
+LIBETPAN_EXPORT
+void mailstream_log_get_stats(struct mailstream_log_stats * stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
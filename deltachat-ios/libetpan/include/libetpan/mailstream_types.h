@@ -46,6 +46,7 @@ extern "C" {
 #  include <libetpan/libetpan-config.h>
 #endif
 #include <libetpan/carray.h>
+#include <inttypes.h>
 
 struct _mailstream;
 
@@ -77,8 +78,14 @@ struct _mailstream {
   char * write_buffer;
   size_t write_buffer_len;
 
+  /* read_buffer points to the data not consumed yet, in read_buffer_base */
   char * read_buffer;
   size_t read_buffer_len;
+  char * read_buffer_base;
+  /* grows when reads fill it, shrinks back to buffer_max_size when
+     reads stay small */
+  size_t read_buffer_size;
+  unsigned int read_buffer_small_reads;
 
   mailstream_low * low;
   
@@ -103,10 +110,28 @@ struct mailstream_low_driver {
   int (* mailstream_setup_idle)(mailstream_low *);
   int (* mailstream_unsetup_idle)(mailstream_low *);
   int (* mailstream_interrupt_idle)(mailstream_low *);
+  /* Writes the two buffers with a single call, can be NULL */
+  ssize_t (* mailstream_write_buffers)(mailstream_low *, const void *, size_t,
+      const void *, size_t);
 };
 
 typedef struct mailstream_low_driver mailstream_low_driver;
 
+/*
+  mailstream_low_metrics is the activity of a layer of a stream
+
+  - read_time is the time spent in read, waiting for data,
+    in microseconds
+*/
+
+struct mailstream_low_metrics {
+  uint64_t lm_bytes_read;
+  uint64_t lm_bytes_written;
+  uint64_t lm_read_calls;
+  uint64_t lm_write_calls;
+  uint64_t lm_read_time;
+};
+
 struct _mailstream_low {
   void * data;
   mailstream_low_driver * driver;
@@ -116,6 +141,7 @@ struct _mailstream_low {
   void (* logger)(mailstream_low * s, int log_type,
       const char * str, size_t size, void * logger_context);
   void * logger_context;
+  struct mailstream_low_metrics metrics;
 };
 
 typedef void progress_function(size_t current, size_t maximum);
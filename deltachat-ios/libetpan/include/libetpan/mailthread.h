@@ -38,11 +38,73 @@
 #define MAILTHREAD_H
 
 #include <libetpan/mailthread_types.h>
+#include <libetpan/chash.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/*
+  mailthread_index_entry is the state kept for each message of a
+  thread tree maintained with mail_thread_update().
+
+  - msg is the message
+
+  - seq is the position of the message in the arrival order, it is used
+    to reproduce the order in which a full rebuild would see the messages
+
+  - node is the node of the message in the tree, NULL when the message
+    has not been threaded yet
+
+  - base_subject is the extracted subject of the message, only computed
+    when the threading type uses the subject
+*/
+
+struct mailthread_index_entry {
+  mailmessage * ent_msg;
+  uint32_t ent_seq;
+  struct mailmessage_tree * ent_node;
+  char * ent_base_subject;
+};
+
+/*
+  mailthread_index keeps the lookup tables needed to update a thread
+  tree when messages arrive or are expunged without rebuilding the
+  whole tree.
+
+  - type is the type of threading (MAIL_THREAD_XXX)
+
+  - default_from is the default charset used to decode subjects,
+    "US-ASCII" when mailthread_index_new() is given NULL
+
+  - next_seq is the sequence number that will be given to the next
+    message
+
+  - msg_hash maps a (mailmessage *) to its (struct mailthread_index_entry *)
+
+  - id_hash maps a message-id to the array of entries of the messages
+    having this message-id or referencing it
+
+  - subject_hash maps an extracted subject to the array of entries of
+    the messages having this subject
+*/
+
+struct mailthread_index {
+  int idx_type;
+  char * idx_default_from;
+  uint32_t idx_next_seq;
+  chash * idx_msg_hash;
+  chash * idx_id_hash;
+  chash * idx_subject_hash;
+};
+
+LIBETPAN_EXPORT
+struct mailthread_index * mailthread_index_new(int type,
+    char * default_from);
+
+LIBETPAN_EXPORT
+void mailthread_index_free(struct mailthread_index * index);
+
 /*
   mail_build_thread constructs a tree with the message using the 
   given style.
@@ -73,6 +135,70 @@ int mail_build_thread(int type, char * default_from,
      int (* comp_func)(struct mailmessage_tree **,
          struct mailmessage_tree **));
 
+/*
+  mail_build_thread_parallel is the same as mail_build_thread() but
+  the work that is independent for each message (parsing of the header
+  fields, dates and extraction of the subjects) is distributed over
+  several threads. Messages are then linked serially and the resulting
+  tree is the same as the one built by mail_build_thread().
+
+  @param nb_threads is the number of threads to use, 0 means the number
+    of online processors and 1 is the same as mail_build_thread().
+
+  The messages of env_list must not be used by other threads during
+  the call.
+*/
+
+LIBETPAN_EXPORT
+int mail_build_thread_parallel(int type, char * default_from,
+    struct mailmessage_list * env_list,
+    struct mailmessage_tree ** result,
+    int (* comp_func)(struct mailmessage_tree **,
+        struct mailmessage_tree **),
+    unsigned int nb_threads);
+
+/*
+  mail_thread_update updates a message tree maintained with an index
+  when messages are added or removed, without threading again the
+  messages that are not related to the changes.
+
+  Only the threads that share a message-id (or a base subject when the
+  threading type uses the subject) with the added or removed messages
+  are threaded again, the resulting tree is the same as the one
+  mail_build_thread() would build from the whole list of messages.
+
+  @param index is the index created with mailthread_index_new(), it
+    contains the type of threading and the default charset.
+
+  @param ptree (* ptree) is the message tree to update, if it is NULL,
+    a new tree is created.
+
+  @param new_list is the list of new messages (with header fields
+    fetched), it can be NULL. The messages are given in the order
+    they would appear in the message list given to mail_build_thread().
+    A message that is already in the index keeps its place and is
+    threaded again with its current header fields.
+
+  @param expunged_list is the list of messages to remove from the tree,
+    it can be NULL. The messages must not be freed before this function
+    returns.
+
+  @param comp_func is the sort function, if NULL,
+    mailthread_tree_timecomp is used.
+
+  @return MAIL_NO_ERROR is returned on success, MAIL_ERROR_XXX is returned
+    on error. On error, the tree and the index must be freed and built
+    again.
+*/
+
+LIBETPAN_EXPORT
+int mail_thread_update(struct mailthread_index * index,
+    struct mailmessage_tree ** ptree,
+    struct mailmessage_list * new_list,
+    struct mailmessage_list * expunged_list,
+    int (* comp_func)(struct mailmessage_tree **,
+        struct mailmessage_tree **));
+
 /*
   mail_thread_sort sort the messages in the message tree, using the
   given sort function.
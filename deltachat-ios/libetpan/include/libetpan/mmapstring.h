@@ -148,6 +148,12 @@ LIBETPAN_EXPORT
 void mmap_string_set_ceil(size_t ceil);
 
 int mmap_string_ref(MMAPString * string);
+
+/*
+  mmap_string_unref() also releases the strings given out by
+  a mailmapview.
+*/
+
 int mmap_string_unref(char * str);
 
 #ifdef __cplusplus
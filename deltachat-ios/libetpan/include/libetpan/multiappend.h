@@ -0,0 +1,147 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2018 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef MULTIAPPEND_H
+
+#define MULTIAPPEND_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <libetpan/libetpan-config.h>
+#include <libetpan/mailimap_types.h>
+
+#include <sys/types.h>
+
+/*
+  mailimap_append_message is a message to upload with
+  mailimap_multiappend()
+
+  - flag_list is the flags of the message, can be NULL
+
+  - date_time is the internal date of the message, can be NULL
+
+  - literal and literal_size is the content of the message when it
+    is in memory, literal is NULL when the content is read from fd
+
+  - fd, offset and literal_size is the region of a file that contains
+    the message, the file is mapped while the message is sent
+
+  - writer and writer_context produce the message in pieces when it is
+    neither in memory nor in a file, for example mailmime_writer() with
+    a struct mailmime * as context (see mailsmtp_data_message_writer()).
+    writer() is called a first time to compute the size of the literal
+    and a second time to send it, it must give the same output both times.
+*/
+
+struct mailimap_append_message {
+  struct mailimap_flag_list * am_flag_list;
+  struct mailimap_date_time * am_date_time;
+  const char * am_literal;
+  size_t am_literal_size;
+  int am_fd;
+  off_t am_offset;
+  int (* am_writer)(int (* do_write)(void *, const char *, size_t),
+                    void * data, void * context);
+  void * am_writer_context;
+};
+
+LIBETPAN_EXPORT
+struct mailimap_append_message *
+mailimap_append_message_new(struct mailimap_flag_list * am_flag_list,
+    struct mailimap_date_time * am_date_time,
+    const char * am_literal, size_t am_literal_size);
+
+LIBETPAN_EXPORT
+struct mailimap_append_message *
+mailimap_append_message_new_fd(struct mailimap_flag_list * am_flag_list,
+    struct mailimap_date_time * am_date_time,
+    int am_fd, off_t am_offset, size_t am_literal_size);
+
+LIBETPAN_EXPORT
+struct mailimap_append_message *
+mailimap_append_message_new_writer(struct mailimap_flag_list * am_flag_list,
+    struct mailimap_date_time * am_date_time,
+    int (* am_writer)(int (* do_write)(void *, const char *, size_t),
+                      void * data, void * context),
+    void * am_writer_context);
+
+/* the content of the message and the file descriptor are not freed */
+
+LIBETPAN_EXPORT
+void mailimap_append_message_free(struct mailimap_append_message * message);
+
+/*
+  mailimap_multiappend()
+
+  This function will append the given messages to the given mailbox.
+  When the server supports MULTIAPPEND (RFC 3502), all of them are
+  sent with a single APPEND command, otherwise an APPEND command is
+  sent for each message. When the server supports LITERAL+, the
+  messages are sent without waiting for the continuation requests.
+
+  @param session       the IMAP session
+  @param mailbox       name of the mailbox
+  @param message_list  list of (struct mailimap_append_message *)
+
+  @return the return code is one of MAILIMAP_ERROR_XXX or
+    MAILIMAP_NO_ERROR codes, if a writer doesn't give the same
+    output twice, MAILIMAP_ERROR_STREAM is returned and the session
+    must be closed.
+*/
+
+LIBETPAN_EXPORT
+int mailimap_multiappend(mailimap * session, const char * mailbox,
+    clist * message_list);
+
+/*
+  mailimap_append_fd()
+
+  This function is the same as mailimap_append() but the message is
+  read from the region of size literal_size at offset of the file fd.
+  The file is mapped while it is sent instead of being copied in memory.
+*/
+
+LIBETPAN_EXPORT
+int mailimap_append_fd(mailimap * session, const char * mailbox,
+    struct mailimap_flag_list * flag_list,
+    struct mailimap_date_time * date_time,
+    int fd, off_t offset, size_t literal_size);
+
+LIBETPAN_EXPORT
+int mailimap_has_multiappend(mailimap * session);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -97,6 +97,27 @@ LIBETPAN_EXPORT
 void newsnntp_set_logger(newsnntp * session, void (* logger)(newsnntp * session, int log_type,
                                                              const char * str, size_t size, void * context), void * logger_context);
 
+/*
+   newsnntp_enable_metrics() starts to record the number and the latency
+   of the commands sent on the NNTP session, a posted article is counted
+   as "MESSAGE" and authentication steps as "AUTH".
+   
+   @param session         NNTP session
+   @return the return code is one of NEWSNNTP_ERROR_XXX or
+     NEWSNNTP_NO_ERROR codes
+*/
+
+LIBETPAN_EXPORT
+int newsnntp_enable_metrics(newsnntp * session);
+
+/*
+   newsnntp_get_metrics() returns the statistics of the commands of the
+   session, NULL if newsnntp_enable_metrics() was not called.
+*/
+
+LIBETPAN_EXPORT
+struct mailmetrics * newsnntp_get_metrics(newsnntp * session);
+
 /*
    newsnntp_set_progress_callback() set NNTP progression callbacks.
    
@@ -669,6 +690,36 @@ int newsnntp_xover_single(newsnntp * session, uint32_t article,
 LIBETPAN_EXPORT
 int newsnntp_xover_range(newsnntp * session, uint32_t rangeinf, uint32_t rangesup,
 			  clist ** result);
+
+/*
+   newsnntp_xover_range_foreach() retrieves overview information for a
+   range of articles and passes each item to a handler as it is read.
+   The range is split in XOVER requests of step articles and up to
+   depth requests are pipelined, so that memory use does not depend on
+   the size of the range.
+   
+   The item and its strings point into the line buffer of the session
+   and are only valid during the call to the handler. ovr_others is NULL
+   when the line has no additional fields.
+   
+   @param session   NNTP session
+   @param rangeinf  the lower bound of the range
+   @param rangesup  the upper bound of the range
+   @param step      number of articles per request, 0 for the default
+   @param depth     maximum number of requests in flight, 0 for the default
+   @param handler   function called for each item
+   @param context   data passed to the handler
+   
+   @return the return code is one of NEWSNNTP_ERROR_XXX or
+   NEWSNNTP_NO_ERROR codes, or the value returned by the handler
+   if it stopped the iteration
+*/
+
+LIBETPAN_EXPORT
+int newsnntp_xover_range_foreach(newsnntp * session,
+    uint32_t rangeinf, uint32_t rangesup,
+    uint32_t step, unsigned int depth,
+    newsnntp_xover_handler * handler, void * context);
 void xover_resp_item_free(struct newsnntp_xover_resp_item * n);
 
 /*
@@ -49,6 +49,7 @@
 #endif
 #include <errno.h>
 #include <fcntl.h>
+#include <stdlib.h>
 
 #ifdef WIN32
 #	include "win_etpan.h"
@@ -56,6 +57,7 @@
 #	include <netdb.h>
 #	include <netinet/in.h>
 #	include <sys/socket.h>
+#	include <sys/time.h>
 #	ifdef HAVE_SYS_POLL_H
 #		include <sys/poll.h>
 #	endif
@@ -106,6 +108,7 @@ static int verify_sock_errors(int s)
 }
 #endif
 
+#ifndef HAVE_IPV6
 static int wait_connect(int s, int r, time_t timeout_seconds)
 {
 #if defined(WIN32) || !USE_POLL
@@ -166,6 +169,7 @@ static int wait_connect(int s, int r, time_t timeout_seconds)
 
   return 0;
 }
+#endif
 
 int mail_tcp_connect(const char * server, uint16_t port)
 {
@@ -183,16 +187,609 @@ int mail_tcp_connect_with_local_address(const char * server, uint16_t port,
 	return mail_tcp_connect_with_local_address_timeout(server, port, local_address, local_port, 0);
 }
 
+#ifdef HAVE_IPV6
+
+/*
+  Resolved addresses are kept in a small cache so that reconnecting
+  doesn't need a DNS round trip. getaddrinfo() doesn't give the TTL of
+  the records, entries are kept at most dns_cache_ttl seconds.
+*/
+
+#define DNS_CACHE_SIZE 16
+#define DNS_CACHE_DEFAULT_TTL 60
+
+/* delay before starting the next connection attempt (RFC 8305) */
+#define CONNECT_ATTEMPT_DELAY_MS 250
+
+/* number of sockets that can be polled without allocation */
+#define CONNECT_STATIC_FDS 16
+
+struct connect_address {
+  int ca_family;
+  int ca_socktype;
+  int ca_protocol;
+  socklen_t ca_addrlen;
+  struct sockaddr_storage ca_addr;
+};
+
+struct dns_cache_entry {
+  char * dce_server;
+  uint16_t dce_port;
+  time_t dce_expiration;
+  struct connect_address * dce_addr_tab;
+  unsigned int dce_addr_count;
+};
+
+static struct dns_cache_entry dns_cache[DNS_CACHE_SIZE];
+static time_t dns_cache_ttl = DNS_CACHE_DEFAULT_TTL;
+
+#ifdef LIBETPAN_REENTRANT
+#if defined(HAVE_PTHREAD_H) && !defined(IGNORE_PTHREAD_H)
+#include <pthread.h>
+static pthread_mutex_t dns_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+#define DNS_CACHE_LOCK() pthread_mutex_lock(&dns_cache_lock)
+#define DNS_CACHE_UNLOCK() pthread_mutex_unlock(&dns_cache_lock)
+#endif
+#endif
+
+#ifndef DNS_CACHE_LOCK
+#define DNS_CACHE_LOCK() do { } while (0)
+#define DNS_CACHE_UNLOCK() do { } while (0)
+#endif
+
+static void dns_cache_entry_clear(struct dns_cache_entry * entry)
+{
+  free(entry->dce_server);
+  free(entry->dce_addr_tab);
+  memset(entry, 0, sizeof(* entry));
+}
+
+void mail_tcp_dns_cache_set_ttl(time_t ttl)
+{
+  DNS_CACHE_LOCK();
+  dns_cache_ttl = ttl;
+  DNS_CACHE_UNLOCK();
+  if (ttl == 0)
+    mail_tcp_dns_cache_flush();
+}
+
+void mail_tcp_dns_cache_flush(void)
+{
+  unsigned int i;
+
+  DNS_CACHE_LOCK();
+  for(i = 0 ; i < DNS_CACHE_SIZE ; i ++)
+    dns_cache_entry_clear(&dns_cache[i]);
+  DNS_CACHE_UNLOCK();
+}
+
+static struct dns_cache_entry * dns_cache_find(const char * server,
+    uint16_t port)
+{
+  unsigned int i;
+
+  for(i = 0 ; i < DNS_CACHE_SIZE ; i ++) {
+    struct dns_cache_entry * entry;
+
+    entry = &dns_cache[i];
+    if (entry->dce_server == NULL)
+      continue;
+    if ((entry->dce_port == port) && (strcmp(entry->dce_server, server) == 0))
+      return entry;
+  }
+
+  return NULL;
+}
+
+/* the result must be freed */
+
+static int dns_cache_lookup(const char * server, uint16_t port,
+    struct connect_address ** result, unsigned int * result_count)
+{
+  struct dns_cache_entry * entry;
+  struct connect_address * addr_tab;
+  int res;
+
+  res = -1;
+  DNS_CACHE_LOCK();
+  entry = dns_cache_find(server, port);
+  if (entry != NULL) {
+    if (entry->dce_expiration <= time(NULL)) {
+      dns_cache_entry_clear(entry);
+    }
+    else {
+      addr_tab = malloc(sizeof(* addr_tab) * entry->dce_addr_count);
+      if (addr_tab != NULL) {
+        memcpy(addr_tab, entry->dce_addr_tab,
+            sizeof(* addr_tab) * entry->dce_addr_count);
+        * result = addr_tab;
+        * result_count = entry->dce_addr_count;
+        res = 0;
+      }
+    }
+  }
+  DNS_CACHE_UNLOCK();
+
+  return res;
+}
+
+static void dns_cache_store(const char * server, uint16_t port,
+    struct connect_address * addr_tab, unsigned int addr_count)
+{
+  struct dns_cache_entry * entry;
+  struct connect_address * dup_tab;
+  char * dup_server;
+  unsigned int i;
+  time_t now;
+
+  dup_server = strdup(server);
+  dup_tab = malloc(sizeof(* dup_tab) * addr_count);
+  if ((dup_server == NULL) || (dup_tab == NULL)) {
+    free(dup_server);
+    free(dup_tab);
+    return;
+  }
+  memcpy(dup_tab, addr_tab, sizeof(* dup_tab) * addr_count);
+
+  now = time(NULL);
+
+  DNS_CACHE_LOCK();
+  if (dns_cache_ttl == 0) {
+    DNS_CACHE_UNLOCK();
+    free(dup_server);
+    free(dup_tab);
+    return;
+  }
+
+  entry = dns_cache_find(server, port);
+  if (entry == NULL) {
+    /* take a free entry or the one that expires first */
+    entry = &dns_cache[0];
+    for(i = 0 ; i < DNS_CACHE_SIZE ; i ++) {
+      if (dns_cache[i].dce_server == NULL) {
+        entry = &dns_cache[i];
+        break;
+      }
+      if (dns_cache[i].dce_expiration < entry->dce_expiration)
+        entry = &dns_cache[i];
+    }
+  }
+  dns_cache_entry_clear(entry);
+  entry->dce_server = dup_server;
+  entry->dce_port = port;
+  entry->dce_expiration = now + dns_cache_ttl;
+  entry->dce_addr_tab = dup_tab;
+  entry->dce_addr_count = addr_count;
+  DNS_CACHE_UNLOCK();
+}
+
+static void dns_cache_remove(const char * server, uint16_t port)
+{
+  struct dns_cache_entry * entry;
+
+  DNS_CACHE_LOCK();
+  entry = dns_cache_find(server, port);
+  if (entry != NULL)
+    dns_cache_entry_clear(entry);
+  DNS_CACHE_UNLOCK();
+}
+
+/*
+  resolve the server and sort the addresses as described by RFC 8305:
+  the order given by getaddrinfo() is kept for each address family
+  and the families are interleaved, starting with the family of the
+  first address.
+*/
+
+static int resolve_addresses(const char * server, uint16_t port,
+    struct connect_address ** result, unsigned int * result_count)
+{
+  struct addrinfo hints, * res, * ai;
+  char port_str[6];
+  struct connect_address * addr_tab;
+  unsigned int count;
+  unsigned int first_count;
+  unsigned int other_count;
+  unsigned int first_index;
+  unsigned int other_index;
+  int first_family;
+  int r;
+
+  r = dns_cache_lookup(server, port, result, result_count);
+  if (r == 0)
+    return 0;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_protocol = IPPROTO_TCP;
+
+  /* convert port from integer to string. */
+  snprintf(port_str, sizeof(port_str), "%d", port);
+
+  res = NULL;
+  if (getaddrinfo(server, port_str, &hints, &res) != 0)
+    return -1;
+
+  count = 0;
+  for (ai = res; ai != NULL; ai = ai->ai_next)
+    count ++;
+
+  if (count == 0) {
+    freeaddrinfo(res);
+    return -1;
+  }
+
+  addr_tab = malloc(sizeof(* addr_tab) * count);
+  if (addr_tab == NULL) {
+    freeaddrinfo(res);
+    return -1;
+  }
+
+  first_family = res->ai_family;
+  first_count = 0;
+  for (ai = res; ai != NULL; ai = ai->ai_next) {
+    if (ai->ai_family == first_family)
+      first_count ++;
+  }
+  other_count = count - first_count;
+
+  first_index = 0;
+  other_index = 0;
+  for (ai = res; ai != NULL; ai = ai->ai_next) {
+    unsigned int indx;
+    struct connect_address * addr;
+
+    /* position of the address in the interleaved list */
+    if (ai->ai_family == first_family) {
+      if (first_index < other_count)
+        indx = 2 * first_index;
+      else
+        indx = other_count + first_index;
+      first_index ++;
+    }
+    else {
+      if (other_index < first_count)
+        indx = 2 * other_index + 1;
+      else
+        indx = first_count + other_index;
+      other_index ++;
+    }
+
+    addr = &addr_tab[indx];
+    addr->ca_family = ai->ai_family;
+    addr->ca_socktype = ai->ai_socktype;
+    addr->ca_protocol = ai->ai_protocol;
+    addr->ca_addrlen = (socklen_t) ai->ai_addrlen;
+    memcpy(&addr->ca_addr, ai->ai_addr, ai->ai_addrlen);
+  }
+
+  freeaddrinfo(res);
+
+  dns_cache_store(server, port, addr_tab, count);
+
+  * result = addr_tab;
+  * result_count = count;
+
+  return 0;
+}
+
+static void close_fd(int s)
+{
+#ifdef WIN32
+  closesocket(s);
+#else
+  close(s);
+#endif
+}
+
+static int64_t get_time_ms(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+
+  return (int64_t) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+/*
+  start a non-blocking connection to the given address.
+  Returns the socket, -1 on error. * pconnected is set to 1 if the
+  connection is already established.
+*/
+
+static int start_connect(struct connect_address * addr,
+    const char * local_address, uint16_t local_port, int * pconnected)
+{
+  int s;
+  int r;
+
+  s = socket(addr->ca_family, addr->ca_socktype, addr->ca_protocol);
+  if (s == -1)
+    return -1;
+
+  // Christopher Lyon Anderson - prevent SigPipe
+#ifdef SO_NOSIGPIPE
+  int kOne = 1;
+  int err = setsockopt(s, SOL_SOCKET, SO_NOSIGPIPE, &kOne, sizeof(kOne));
+  if (err != 0)
+    goto close_socket;
+#endif
+
+  if ((local_address != NULL) || (local_port != 0)) {
+    struct addrinfo la_hints;
+    char local_port_str[6];
+    char * p_local_port_str;
+    struct addrinfo * la_res;
+
+    memset(&la_hints, 0, sizeof(la_hints));
+    la_hints.ai_family = AF_UNSPEC;
+    la_hints.ai_socktype = SOCK_STREAM;
+    la_hints.ai_flags = AI_PASSIVE;
+
+    if (local_port != 0) {
+      snprintf(local_port_str, sizeof(local_port_str), "%d", local_port);
+      p_local_port_str = local_port_str;
+    }
+    else {
+      p_local_port_str = NULL;
+    }
+    la_res = NULL;
+    r = getaddrinfo(local_address, p_local_port_str, &la_hints, &la_res);
+    if (r != 0)
+      goto close_socket;
+    r = bind(s, (struct sockaddr *) la_res->ai_addr, la_res->ai_addrlen);
+    if (la_res != NULL)
+      freeaddrinfo(la_res);
+    if (r == -1)
+      goto close_socket;
+  }
+
+  r = prepare_fd(s);
+  if (r == -1)
+    goto close_socket;
+
+  r = connect(s, (struct sockaddr *) &addr->ca_addr, addr->ca_addrlen);
+  if (r == 0) {
+    * pconnected = 1;
+    return s;
+  }
+  if (errno != EINPROGRESS)
+    goto close_socket;
+
+  * pconnected = 0;
+  return s;
+
+ close_socket:
+  close_fd(s);
+  return -1;
+}
+
+/*
+  wait until one of the sockets is writable, or timeout_ms elapsed.
+  ready[i] is set to 1 for each writable socket.
+  Returns the number of writable sockets, -1 on error.
+*/
+
+static int wait_writable(int * fds, int * ready, unsigned int count,
+    int64_t timeout_ms)
+{
+#if defined(WIN32) || !USE_POLL
+  fd_set wfds;
+  struct timeval timeout;
+  int max_fd;
+#else
+  struct pollfd pfd[CONNECT_STATIC_FDS];
+  struct pollfd * pfd_tab;
+#endif
+  unsigned int i;
+  int r;
+
+  if (timeout_ms < 0)
+    timeout_ms = 0;
+
+  for(i = 0 ; i < count ; i ++)
+    ready[i] = 0;
+
+#if defined(WIN32) || !USE_POLL
+  FD_ZERO(&wfds);
+  max_fd = -1;
+  for(i = 0 ; i < count ; i ++) {
+    FD_SET(fds[i], &wfds);
+    if (fds[i] > max_fd)
+      max_fd = fds[i];
+  }
+  timeout.tv_sec = (long) (timeout_ms / 1000);
+  timeout.tv_usec = (long) (timeout_ms % 1000) * 1000;
+
+  r = select(max_fd + 1, NULL, &wfds, NULL, &timeout);
+  if (r < 0)
+    return (errno == EINTR) ? 0 : -1;
+
+  for(i = 0 ; i < count ; i ++)
+    ready[i] = FD_ISSET(fds[i], &wfds) ? 1 : 0;
+#else
+  if (count <= CONNECT_STATIC_FDS)
+    pfd_tab = pfd;
+  else {
+    pfd_tab = malloc(sizeof(* pfd_tab) * count);
+    if (pfd_tab == NULL)
+      return -1;
+  }
+  for(i = 0 ; i < count ; i ++) {
+    pfd_tab[i].fd = fds[i];
+    pfd_tab[i].events = POLLOUT;
+    pfd_tab[i].revents = 0;
+  }
+
+  r = poll(pfd_tab, count, (int) timeout_ms);
+  if (r >= 0) {
+    for(i = 0 ; i < count ; i ++)
+      ready[i] = (pfd_tab[i].revents & (POLLOUT | POLLERR | POLLHUP)) ? 1 : 0;
+  }
+  if (pfd_tab != pfd)
+    free(pfd_tab);
+  if (r < 0)
+    return (errno == EINTR) ? 0 : -1;
+#endif
+
+  return r;
+}
+
+/*
+  connect to the addresses as described by RFC 8305 (happy eyeballs):
+  a new attempt is started every CONNECT_ATTEMPT_DELAY_MS, or as soon
+  as an attempt fails, while the previous ones are still pending.
+  The first established connection is returned.
+*/
+
+static int connect_addresses(struct connect_address * addr_tab,
+    unsigned int addr_count,
+    const char * local_address, uint16_t local_port, time_t timeout)
+{
+  int * fds;
+  int * ready;
+  int64_t * deadlines;
+  unsigned int nb_pending;
+  unsigned int next;
+  int64_t timeout_ms;
+  int64_t next_attempt;
+  int result;
+  unsigned int i;
+
+  if (timeout == 0)
+    timeout_ms = (int64_t) mailstream_network_delay.tv_sec * 1000 +
+      mailstream_network_delay.tv_usec / 1000;
+  else
+    timeout_ms = (int64_t) timeout * 1000;
+
+  fds = malloc(sizeof(* fds) * addr_count);
+  ready = malloc(sizeof(* ready) * addr_count);
+  deadlines = malloc(sizeof(* deadlines) * addr_count);
+  if ((fds == NULL) || (ready == NULL) || (deadlines == NULL)) {
+    result = -1;
+    goto free;
+  }
+
+  result = -1;
+  nb_pending = 0;
+  next = 0;
+  next_attempt = get_time_ms();
+
+  while (1) {
+    int64_t now;
+    int64_t wait_ms;
+    int r;
+
+    now = get_time_ms();
+
+    /* start the next attempt */
+    if ((next < addr_count) && ((nb_pending == 0) || (now >= next_attempt))) {
+      int connected;
+      int s;
+
+      s = start_connect(&addr_tab[next], local_address, local_port,
+          &connected);
+      next ++;
+      if (s != -1) {
+        if (connected) {
+          result = s;
+          break;
+        }
+        fds[nb_pending] = s;
+        deadlines[nb_pending] = now + timeout_ms;
+        nb_pending ++;
+        next_attempt = now + CONNECT_ATTEMPT_DELAY_MS;
+      }
+      continue;
+    }
+
+    if (nb_pending == 0)
+      break;
+
+    /* wait for a pending attempt, or until the next attempt has to start */
+    wait_ms = deadlines[0];
+    for(i = 1 ; i < nb_pending ; i ++) {
+      if (deadlines[i] < wait_ms)
+        wait_ms = deadlines[i];
+    }
+    if ((next < addr_count) && (next_attempt < wait_ms))
+      wait_ms = next_attempt;
+    wait_ms -= now;
+
+    r = wait_writable(fds, ready, nb_pending, wait_ms);
+    if (r < 0)
+      break;
+
+    now = get_time_ms();
+    i = 0;
+    while (i < nb_pending) {
+      int done;
+
+      done = 0;
+      if (ready[i]) {
+        if (verify_sock_errors(fds[i]) == 0) {
+          result = fds[i];
+          fds[i] = -1;
+          break;
+        }
+        done = 1;
+        /* the attempt failed, start the next one right away */
+        next_attempt = now;
+      }
+      else if (now >= deadlines[i]) {
+        done = 1;
+      }
+
+      if (done) {
+        close_fd(fds[i]);
+        nb_pending --;
+        fds[i] = fds[nb_pending];
+        deadlines[i] = deadlines[nb_pending];
+        ready[i] = ready[nb_pending];
+      }
+      else {
+        i ++;
+      }
+    }
+    if (result != -1)
+      break;
+  }
+
+  /* cancel the other attempts */
+  for(i = 0 ; i < nb_pending ; i ++) {
+    if (fds[i] != -1)
+      close_fd(fds[i]);
+  }
+
+ free:
+  free(fds);
+  free(ready);
+  free(deadlines);
+
+  return result;
+}
+
+#else
+
+/* without IPv6 support, addresses are not cached */
+
+void mail_tcp_dns_cache_set_ttl(time_t ttl)
+{
+}
+
+void mail_tcp_dns_cache_flush(void)
+{
+}
+
+#endif
+
 int mail_tcp_connect_with_local_address_timeout(const char * server, uint16_t port,
     const char * local_address, uint16_t local_port, time_t timeout)
 {
 #ifndef HAVE_IPV6
   struct hostent * remotehost;
   struct sockaddr_in sa;
-#else /* HAVE_IPV6 */
-  struct addrinfo hints, *res, *ai;
-  struct addrinfo la_hints;
-  char port_str[6];
 #endif
 #ifdef WIN32
   SOCKET s;
@@ -242,106 +839,34 @@ int mail_tcp_connect_with_local_address_timeout(const char * server, uint16_t po
     goto close_socket;
   }
 #else /* HAVE_IPV6 */
-  memset(&hints, 0, sizeof(hints));
-  hints.ai_family = AF_UNSPEC;
-  hints.ai_socktype = SOCK_STREAM;
-  hints.ai_protocol = IPPROTO_TCP;
-  
-  memset(&la_hints, 0, sizeof(la_hints));
-  la_hints.ai_family = AF_UNSPEC;
-  la_hints.ai_socktype = SOCK_STREAM;
-  la_hints.ai_flags = AI_PASSIVE;
-  
-  /* convert port from integer to string. */
-  snprintf(port_str, sizeof(port_str), "%d", port);
-  
-  res = NULL;
-  if (getaddrinfo(server, port_str, &hints, &res) != 0)
-    goto err;
+  {
+    struct connect_address * addr_tab;
+    unsigned int addr_count;
 
-  s = -1;
-  for (ai = res; ai != NULL; ai = ai->ai_next) {
-    s = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    r = resolve_addresses(server, port, &addr_tab, &addr_count);
+    if (r < 0)
+      goto err;
 
-    if (s == -1)
-      continue;
-    
-    // Christopher Lyon Anderson - prevent SigPipe
-#ifdef SO_NOSIGPIPE
-    int kOne = 1;
-    int err = setsockopt(s, SOL_SOCKET, SO_NOSIGPIPE, &kOne, sizeof(kOne));
-    if (err != 0)
-        continue;
-#endif
-
-    if ((local_address != NULL) || (local_port != 0)) {
-      char local_port_str[6];
-      char * p_local_port_str;
-      struct addrinfo * la_res;
-      
-      if (local_port != 0) {
-        snprintf(local_port_str, sizeof(local_port_str), "%d", local_port);
-        p_local_port_str = local_port_str;
-      }
-      else {
-        p_local_port_str = NULL;
-      }
-      la_res = NULL;
-      r = getaddrinfo(local_address, p_local_port_str, &la_hints, &la_res);
-      if (r != 0)
-        goto close_socket;
-      r = bind(s, (struct sockaddr *) la_res->ai_addr, la_res->ai_addrlen);
-      if (la_res != NULL)
-        freeaddrinfo(la_res);
-      if (r == -1)
-        goto close_socket;
-    }
-    
-    r = prepare_fd(s);
-    if (r == -1) {
-      goto close_socket;
-    }
-    
-    r = connect(s, ai->ai_addr, ai->ai_addrlen);
-    r = wait_connect(s, r, timeout);
-    
-    if (r != -1) {
-      r = verify_sock_errors(s);
-    }
+    s = connect_addresses(addr_tab, addr_count,
+        local_address, local_port, timeout);
+    free(addr_tab);
 
-    if (r == -1) {
-      if (ai->ai_next) {
-#ifdef WIN32
-	  closesocket(s);
-#else
-	  close(s);
-#endif
-	  continue;
-      } else {
-        goto close_socket;
-      }
+    if (s == -1) {
+      /* the addresses may have changed */
+      dns_cache_remove(server, port);
+      goto err;
     }
-    /* if we're here, we're good */
-    break;
   }
-  
-  if (res != NULL)
-    freeaddrinfo(res);
-
-  if (ai == NULL)
-    goto err;
 #endif
   return s;
   
+#ifndef HAVE_IPV6
  close_socket:
-#ifdef HAVE_IPV6
-  if (res != NULL)
-    freeaddrinfo(res);
-#endif
 #ifdef WIN32
   closesocket(s);
 #else
   close(s);
+#endif
 #endif
  err:
   return -1;
@@ -54,6 +54,15 @@ int mail_tcp_connect_with_local_address(const char * server, uint16_t port,
 int mail_tcp_connect_with_local_address_timeout(const char * server, uint16_t port,
     const char * local_address, uint16_t local_port, time_t timeout);
 
+/*
+  The addresses of the servers are kept in a cache for ttl seconds
+  (60 by default). A ttl of 0 disables the cache.
+  The addresses of a server are removed from the cache when none of
+  them could be connected.
+*/
+void mail_tcp_dns_cache_set_ttl(time_t ttl);
+void mail_tcp_dns_cache_flush(void);
+
 #ifdef __cplusplus
 }
 #endif
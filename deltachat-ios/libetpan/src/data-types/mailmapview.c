@@ -0,0 +1,258 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2005 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include "mailmapview.h"
+
+#include "chash.h"
+
+#include <stdlib.h>
+#ifdef WIN32
+#	include "win_etpan.h"
+#else
+#	include <sys/mman.h>
+#endif
+#ifdef LIBETPAN_REENTRANT
+#if defined(HAVE_PTHREAD_H) && !defined(IGNORE_PTHREAD_H)
+#include <pthread.h>
+#endif
+#endif
+
+/*
+  the strings given out from the views, so that mmap_string_unref()
+  finds the view of a string with a single lookup. Most strings it is
+  called with do not come from a view.
+*/
+
+#ifdef LIBETPAN_REENTRANT
+#if defined(HAVE_PTHREAD_H) && !defined(IGNORE_PTHREAD_H)
+static pthread_mutex_t views_lock = PTHREAD_MUTEX_INITIALIZER;
+#define VIEWS_LOCK() pthread_mutex_lock(&views_lock)
+#define VIEWS_UNLOCK() pthread_mutex_unlock(&views_lock)
+#endif
+#endif
+#ifndef VIEWS_LOCK
+#define VIEWS_LOCK() do { } while (0)
+#define VIEWS_UNLOCK() do { } while (0)
+#endif
+
+struct mapped_string {
+  struct mailmapview * ms_view;
+  unsigned int ms_ref;
+};
+
+/* (char *) -> (struct mapped_string *) */
+static chash * mapped_strings = NULL;
+
+LIBETPAN_EXPORT
+struct mailmapview * mailmapview_new(char * data, size_t size)
+{
+  struct mailmapview * view;
+
+  view = malloc(sizeof(* view));
+  if (view == NULL)
+    return NULL;
+
+  view->mv_data = data;
+  view->mv_size = size;
+  view->mv_ref = 1;
+
+  return view;
+}
+
+static void view_free(struct mailmapview * view)
+{
+  munmap(view->mv_data, view->mv_size);
+  free(view);
+}
+
+LIBETPAN_EXPORT
+void mailmapview_ref(struct mailmapview * view)
+{
+  VIEWS_LOCK();
+  view->mv_ref ++;
+  VIEWS_UNLOCK();
+}
+
+LIBETPAN_EXPORT
+void mailmapview_unref(struct mailmapview * view)
+{
+  unsigned int ref;
+
+  VIEWS_LOCK();
+  view->mv_ref --;
+  ref = view->mv_ref;
+  VIEWS_UNLOCK();
+
+  if (ref == 0)
+    view_free(view);
+}
+
+LIBETPAN_EXPORT
+int mailmapview_is_shared(struct mailmapview * view)
+{
+  unsigned int ref;
+
+  VIEWS_LOCK();
+  ref = view->mv_ref;
+  VIEWS_UNLOCK();
+
+  return (ref > 1);
+}
+
+/* must be called with the lock held */
+
+static struct mapped_string * find_string(const char * str)
+{
+  chashdatum key;
+  chashdatum value;
+  int r;
+
+  if (mapped_strings == NULL)
+    return NULL;
+
+  key.data = &str;
+  key.len = sizeof(str);
+  r = chash_get(mapped_strings, &key, &value);
+  if (r < 0)
+    return NULL;
+
+  return value.data;
+}
+
+LIBETPAN_EXPORT
+char * mailmapview_get_str(struct mailmapview * view, size_t offset)
+{
+  struct mapped_string * mapped;
+  chashdatum key;
+  chashdatum value;
+  char * str;
+  int r;
+
+  str = view->mv_data + offset;
+
+  VIEWS_LOCK();
+  mapped = find_string(str);
+  if (mapped == NULL) {
+    if (mapped_strings == NULL) {
+      mapped_strings = chash_new(CHASH_DEFAULTSIZE, CHASH_COPYKEY);
+      if (mapped_strings == NULL)
+        goto unlock;
+    }
+
+    mapped = malloc(sizeof(* mapped));
+    if (mapped == NULL)
+      goto unlock;
+    mapped->ms_view = view;
+    mapped->ms_ref = 0;
+
+    key.data = &str;
+    key.len = sizeof(str);
+    value.data = mapped;
+    value.len = 0;
+    r = chash_set(mapped_strings, &key, &value, NULL);
+    if (r < 0) {
+      free(mapped);
+      goto unlock;
+    }
+  }
+  mapped->ms_ref ++;
+  view->mv_ref ++;
+  VIEWS_UNLOCK();
+
+  return str;
+
+ unlock:
+  VIEWS_UNLOCK();
+  return NULL;
+}
+
+LIBETPAN_EXPORT
+int mailmapview_str_ref(const char * str)
+{
+  struct mapped_string * mapped;
+
+  VIEWS_LOCK();
+  mapped = find_string(str);
+  if (mapped != NULL) {
+    mapped->ms_ref ++;
+    mapped->ms_view->mv_ref ++;
+  }
+  VIEWS_UNLOCK();
+
+  if (mapped == NULL)
+    return -1;
+
+  return 0;
+}
+
+LIBETPAN_EXPORT
+int mailmapview_str_unref(const char * str)
+{
+  struct mapped_string * mapped;
+  struct mailmapview * view;
+  unsigned int ref;
+
+  /* the references are released while the lock is held, so that the
+     view can't be freed by another thread in between */
+  VIEWS_LOCK();
+  mapped = find_string(str);
+  if (mapped == NULL) {
+    VIEWS_UNLOCK();
+    return -1;
+  }
+
+  view = mapped->ms_view;
+  mapped->ms_ref --;
+  if (mapped->ms_ref == 0) {
+    chashdatum key;
+
+    key.data = &str;
+    key.len = sizeof(str);
+    chash_delete(mapped_strings, &key, NULL);
+    free(mapped);
+    if (chash_count(mapped_strings) == 0) {
+      chash_free(mapped_strings);
+      mapped_strings = NULL;
+    }
+  }
+  view->mv_ref --;
+  ref = view->mv_ref;
+  VIEWS_UNLOCK();
+
+  if (ref == 0)
+    view_free(view);
+
+  return 0;
+}
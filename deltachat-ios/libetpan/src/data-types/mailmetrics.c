@@ -0,0 +1,444 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2005 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include "mailmetrics.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#ifndef WIN32
+#include <sys/time.h>
+#endif
+
+#define UNKNOWN_COMMAND "UNKNOWN"
+#define PRIVATE_COMMAND "AUTH"
+
+/* longest name of a command that is recorded */
+#define COMMAND_NAME_MAX 32
+
+LIBETPAN_EXPORT
+uint64_t mailmetrics_now(void)
+{
+#if defined(CLOCK_MONOTONIC) && !defined(WIN32)
+  struct timespec ts;
+
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+#ifndef WIN32
+  {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+  }
+#else
+  return (uint64_t) time(NULL) * 1000000;
+#endif
+}
+
+/* histogram */
+
+static unsigned int histogram_index(uint64_t value)
+{
+  unsigned int exponent;
+  unsigned int indx;
+
+  if (value < 16)
+    return (unsigned int) value;
+
+  exponent = 4;
+  while ((value >> (exponent + 1)) != 0)
+    exponent ++;
+
+  indx = 16 + (exponent - 4) * 8 + (unsigned int) ((value >> (exponent - 3)) & 7);
+  if (indx >= MAILMETRICS_HISTOGRAM_SIZE)
+    indx = MAILMETRICS_HISTOGRAM_SIZE - 1;
+
+  return indx;
+}
+
+/* highest value of a bucket */
+
+static uint64_t histogram_bucket_max(unsigned int indx)
+{
+  unsigned int exponent;
+  uint64_t sub;
+
+  if (indx < 16)
+    return indx;
+
+  exponent = (indx - 16) / 8 + 4;
+  sub = (indx - 16) % 8;
+
+  return ((8 + sub + 1) << (exponent - 3)) - 1;
+}
+
+LIBETPAN_EXPORT
+void mailmetrics_histogram_add(struct mailmetrics_histogram * histogram,
+    uint64_t value)
+{
+  histogram->h_buckets[histogram_index(value)] ++;
+  histogram->h_count ++;
+  histogram->h_total += value;
+  if (value > histogram->h_max)
+    histogram->h_max = value;
+}
+
+LIBETPAN_EXPORT
+uint64_t mailmetrics_histogram_percentile(struct mailmetrics_histogram * histogram,
+    double percentile)
+{
+  uint64_t target;
+  uint64_t count;
+  unsigned int i;
+
+  if (histogram->h_count == 0)
+    return 0;
+
+  target = (uint64_t) (histogram->h_count * percentile / 100.0 + 0.5);
+  if (target == 0)
+    target = 1;
+
+  count = 0;
+  for(i = 0 ; i < MAILMETRICS_HISTOGRAM_SIZE ; i ++) {
+    count += histogram->h_buckets[i];
+    if (count >= target) {
+      uint64_t value;
+
+      value = histogram_bucket_max(i);
+      if (value > histogram->h_max)
+        value = histogram->h_max;
+      return value;
+    }
+  }
+
+  return histogram->h_max;
+}
+
+/* commands */
+
+static struct mailmetrics_command * command_new(const char * name)
+{
+  struct mailmetrics_command * command;
+
+  command = calloc(1, sizeof(* command));
+  if (command == NULL)
+    return NULL;
+
+  command->mc_name = strdup(name);
+  if (command->mc_name == NULL) {
+    free(command);
+    return NULL;
+  }
+
+  return command;
+}
+
+static void command_free(struct mailmetrics_command * command)
+{
+  free(command->mc_name);
+  free(command);
+}
+
+LIBETPAN_EXPORT
+struct mailmetrics * mailmetrics_new(void)
+{
+  struct mailmetrics * metrics;
+
+  metrics = malloc(sizeof(* metrics));
+  if (metrics == NULL)
+    goto err;
+
+  metrics->m_commands = carray_new(16);
+  if (metrics->m_commands == NULL)
+    goto free;
+
+  metrics->m_pending = NULL;
+  metrics->m_pending_first = 0;
+  metrics->m_pending_count = 0;
+  metrics->m_pending_size = 0;
+
+  return metrics;
+
+ free:
+  free(metrics);
+ err:
+  return NULL;
+}
+
+LIBETPAN_EXPORT
+void mailmetrics_free(struct mailmetrics * metrics)
+{
+  unsigned int i;
+
+  for(i = 0 ; i < carray_count(metrics->m_commands) ; i ++)
+    command_free(carray_get(metrics->m_commands, i));
+  carray_free(metrics->m_commands);
+  free(metrics->m_pending);
+  free(metrics);
+}
+
+LIBETPAN_EXPORT
+struct mailmetrics * mailmetrics_dup(struct mailmetrics * metrics)
+{
+  struct mailmetrics * dup_metrics;
+  unsigned int i;
+
+  dup_metrics = mailmetrics_new();
+  if (dup_metrics == NULL)
+    goto err;
+
+  for(i = 0 ; i < carray_count(metrics->m_commands) ; i ++) {
+    struct mailmetrics_command * command;
+    struct mailmetrics_command * dup_command;
+
+    command = carray_get(metrics->m_commands, i);
+    dup_command = command_new(command->mc_name);
+    if (dup_command == NULL)
+      goto free;
+    dup_command->mc_count = command->mc_count;
+    dup_command->mc_wait_time = command->mc_wait_time;
+    dup_command->mc_parse_time = command->mc_parse_time;
+    dup_command->mc_latency = command->mc_latency;
+
+    if (carray_add(dup_metrics->m_commands, dup_command, NULL) < 0) {
+      command_free(dup_command);
+      goto free;
+    }
+  }
+
+  return dup_metrics;
+
+ free:
+  mailmetrics_free(dup_metrics);
+ err:
+  return NULL;
+}
+
+LIBETPAN_EXPORT
+struct mailmetrics_command * mailmetrics_get_command(struct mailmetrics * metrics,
+    const char * name)
+{
+  unsigned int i;
+
+  for(i = 0 ; i < carray_count(metrics->m_commands) ; i ++) {
+    struct mailmetrics_command * command;
+
+    command = carray_get(metrics->m_commands, i);
+    if (strcmp(command->mc_name, name) == 0)
+      return command;
+  }
+
+  return NULL;
+}
+
+/*
+  gets the name of the command at the beginning of data,
+  "UID" is followed by the name of the command it applies to.
+*/
+
+static void command_name(const char * data, size_t size, char * name)
+{
+  size_t len;
+  int words;
+
+  len = 0;
+  words = 1;
+  while ((len < size) && (len < COMMAND_NAME_MAX - 1)) {
+    if (data[len] == ' ') {
+      if ((words == 1) && (len == 3) && (strncmp(name, "UID", 3) == 0)) {
+        name[len] = ' ';
+        len ++;
+        words ++;
+        continue;
+      }
+      break;
+    }
+    if ((data[len] == '\r') || (data[len] == '\n'))
+      break;
+    name[len] = (char) toupper((unsigned char) data[len]);
+    len ++;
+  }
+  name[len] = '\0';
+
+  if (len == 0)
+    strcpy(name, UNKNOWN_COMMAND);
+}
+
+static struct mailmetrics_command * get_command(struct mailmetrics * metrics,
+    const char * name)
+{
+  struct mailmetrics_command * command;
+
+  command = mailmetrics_get_command(metrics, name);
+  if (command != NULL)
+    return command;
+
+  command = command_new(name);
+  if (command == NULL)
+    return NULL;
+
+  if (carray_add(metrics->m_commands, command, NULL) < 0) {
+    command_free(command);
+    return NULL;
+  }
+
+  return command;
+}
+
+static uint64_t stream_position(mailstream * s)
+{
+  return s->low->metrics.lm_bytes_written + s->write_buffer_len;
+}
+
+static struct mailmetrics_pending * pending_add(struct mailmetrics * metrics,
+    mailstream * s)
+{
+  struct mailmetrics_pending * pending;
+
+  if (metrics->m_pending_count == metrics->m_pending_size) {
+    struct mailmetrics_pending * new_pending;
+    unsigned int new_size;
+    unsigned int i;
+
+    new_size = metrics->m_pending_size * 2;
+    if (new_size == 0)
+      new_size = 4;
+    new_pending = malloc(new_size * sizeof(* new_pending));
+    if (new_pending == NULL)
+      return NULL;
+    for(i = 0 ; i < metrics->m_pending_count ; i ++)
+      new_pending[i] = metrics->m_pending[(metrics->m_pending_first + i) % metrics->m_pending_size];
+    free(metrics->m_pending);
+    metrics->m_pending = new_pending;
+    metrics->m_pending_first = 0;
+    metrics->m_pending_size = new_size;
+  }
+
+  pending = &metrics->m_pending[(metrics->m_pending_first + metrics->m_pending_count) % metrics->m_pending_size];
+  metrics->m_pending_count ++;
+
+  pending->mp_command = NULL;
+  pending->mp_name_position = stream_position(s);
+  pending->mp_begin_time = mailmetrics_now();
+  pending->mp_begin_wait_time = s->low->metrics.lm_read_time;
+
+  return pending;
+}
+
+void mailmetrics_command_begin(struct mailmetrics * metrics, mailstream * s,
+    const char * command)
+{
+  struct mailmetrics_pending * pending;
+  char name[COMMAND_NAME_MAX];
+
+  pending = pending_add(metrics, s);
+  if (pending == NULL)
+    return;
+
+  command_name(command, strlen(command), name);
+  pending->mp_command = get_command(metrics, name);
+}
+
+void mailmetrics_command_begin_unnamed(struct mailmetrics * metrics,
+    mailstream * s)
+{
+  pending_add(metrics, s);
+}
+
+void mailmetrics_data_sent(struct mailmetrics * metrics, mailstream * s,
+    const char * data, size_t size, int can_be_published)
+{
+  uint64_t position;
+  unsigned int i;
+
+  /* data is being written at the current position of the lowest layer */
+  position = s->low->metrics.lm_bytes_written;
+
+  for(i = 0 ; i < metrics->m_pending_count ; i ++) {
+    struct mailmetrics_pending * pending;
+    char name[COMMAND_NAME_MAX];
+
+    pending = &metrics->m_pending[(metrics->m_pending_first + i) % metrics->m_pending_size];
+    if (pending->mp_command != NULL)
+      continue;
+    if (pending->mp_name_position < position)
+      continue;
+    if (pending->mp_name_position >= position + size)
+      break;
+
+    if (!can_be_published) {
+      pending->mp_command = get_command(metrics, PRIVATE_COMMAND);
+      continue;
+    }
+
+    command_name(data + (pending->mp_name_position - position),
+        size - (size_t) (pending->mp_name_position - position), name);
+    pending->mp_command = get_command(metrics, name);
+  }
+}
+
+void mailmetrics_command_end(struct mailmetrics * metrics, mailstream * s)
+{
+  struct mailmetrics_pending * pending;
+  struct mailmetrics_command * command;
+  uint64_t latency;
+  uint64_t wait_time;
+
+  if (metrics->m_pending_count == 0)
+    return;
+
+  pending = &metrics->m_pending[metrics->m_pending_first];
+  metrics->m_pending_first = (metrics->m_pending_first + 1) % metrics->m_pending_size;
+  metrics->m_pending_count --;
+
+  command = pending->mp_command;
+  if (command == NULL)
+    command = get_command(metrics, UNKNOWN_COMMAND);
+  if (command == NULL)
+    return;
+
+  latency = mailmetrics_now() - pending->mp_begin_time;
+  wait_time = s->low->metrics.lm_read_time - pending->mp_begin_wait_time;
+  if (wait_time > latency)
+    wait_time = latency;
+
+  command->mc_count ++;
+  command->mc_wait_time += wait_time;
+  command->mc_parse_time += latency - wait_time;
+  mailmetrics_histogram_add(&command->mc_latency, latency);
+}
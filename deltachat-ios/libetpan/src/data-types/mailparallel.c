@@ -0,0 +1,172 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2018 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include "mailparallel.h"
+
+#include <stdlib.h>
+#ifndef _MSC_VER
+#include <unistd.h>
+#endif
+
+#ifdef LIBETPAN_REENTRANT
+#if defined(HAVE_PTHREAD_H) && !defined(IGNORE_PTHREAD_H)
+#include <pthread.h>
+#define USE_PARALLEL_THREADS 1
+#endif
+#endif
+
+/* maximum number of indexes taken at once by a thread */
+#define PARALLEL_CHUNK_SIZE 16
+
+#define PARALLEL_MAX_THREADS 64
+
+#ifdef USE_PARALLEL_THREADS
+
+struct parallel_state {
+  pthread_mutex_t lock;
+  unsigned int next;
+  unsigned int count;
+  unsigned int chunk_size;
+  void (* func)(unsigned int indx, void * data);
+  void * data;
+};
+
+static void * parallel_worker(void * arg)
+{
+  struct parallel_state * state;
+
+  state = arg;
+
+  while (1) {
+    unsigned int begin;
+    unsigned int end;
+    unsigned int i;
+
+    pthread_mutex_lock(&state->lock);
+    begin = state->next;
+    end = begin + state->chunk_size;
+    if (end > state->count)
+      end = state->count;
+    state->next = end;
+    pthread_mutex_unlock(&state->lock);
+
+    if (begin >= end)
+      break;
+
+    for(i = begin ; i < end ; i ++)
+      state->func(i, state->data);
+  }
+
+  return NULL;
+}
+
+static unsigned int get_nb_processors(void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+  long nb;
+
+  nb = sysconf(_SC_NPROCESSORS_ONLN);
+  if (nb > 0)
+    return (unsigned int) nb;
+#endif
+  return 1;
+}
+
+#endif
+
+void mail_parallel_run(unsigned int count, unsigned int nb_threads,
+    void (* func)(unsigned int indx, void * data), void * data)
+{
+#ifdef USE_PARALLEL_THREADS
+  struct parallel_state state;
+  pthread_t threads[PARALLEL_MAX_THREADS];
+  unsigned int nb_started;
+  unsigned int chunk_size;
+  unsigned int i;
+
+  if (nb_threads == 0)
+    nb_threads = get_nb_processors();
+  if (nb_threads > PARALLEL_MAX_THREADS)
+    nb_threads = PARALLEL_MAX_THREADS;
+
+  /*
+    big chunks reduce locking when there are many short calls,
+    with few calls, small chunks keep all the threads busy.
+  */
+  chunk_size = PARALLEL_CHUNK_SIZE;
+  if ((nb_threads > 0) && (count / (nb_threads * 4) < chunk_size))
+    chunk_size = count / (nb_threads * 4);
+  if (chunk_size == 0)
+    chunk_size = 1;
+
+  /* don't start threads that would have nothing to do */
+  if (nb_threads > (count + chunk_size - 1) / chunk_size)
+    nb_threads = (count + chunk_size - 1) / chunk_size;
+
+  if (nb_threads > 1) {
+    if (pthread_mutex_init(&state.lock, NULL) == 0) {
+      state.next = 0;
+      state.count = count;
+      state.chunk_size = chunk_size;
+      state.func = func;
+      state.data = data;
+
+      /* the calling thread is one of the workers */
+      nb_started = 0;
+      for(i = 0 ; i < nb_threads - 1 ; i ++) {
+        if (pthread_create(&threads[nb_started], NULL,
+                parallel_worker, &state) != 0)
+          break;
+        nb_started ++;
+      }
+
+      parallel_worker(&state);
+
+      for(i = 0 ; i < nb_started ; i ++)
+        pthread_join(threads[i], NULL);
+
+      pthread_mutex_destroy(&state.lock);
+      return;
+    }
+  }
+#endif
+
+  {
+    unsigned int indx;
+
+    for(indx = 0 ; indx < count ; indx ++)
+      func(indx, data);
+  }
+}
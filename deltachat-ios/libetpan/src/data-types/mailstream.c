@@ -45,6 +45,7 @@
 #include "maillock.h"
 #include "mailstream_cfstream.h"
 #include "mailstream_compress.h"
+#include "mailstream_ssl.h"
 #include "mailstream_cancel.h"
 #include <string.h>
 #include <stdlib.h>
@@ -53,6 +54,11 @@
 
 #define DEFAULT_NETWORK_TIMEOUT 300
 
+/* the read buffer doubles each time a read fills it, up to this size */
+#define READ_BUFFER_MAX_SIZE (256 * 1024)
+/* and halves after this number of reads using less than a quarter of it */
+#define READ_BUFFER_SHRINK_COUNT 16
+
 struct timeval mailstream_network_delay =
 {  DEFAULT_NETWORK_TIMEOUT, 0 };
 
@@ -65,10 +71,13 @@ mailstream * mailstream_new(mailstream_low * low, size_t buffer_size)
   if (s == NULL)
     goto err;
 
-  s->read_buffer = malloc(buffer_size);
-  if (s->read_buffer == NULL)
+  s->read_buffer_base = malloc(buffer_size);
+  if (s->read_buffer_base == NULL)
     goto free_s;
+  s->read_buffer = s->read_buffer_base;
   s->read_buffer_len = 0;
+  s->read_buffer_size = buffer_size;
+  s->read_buffer_small_reads = 0;
 
   s->write_buffer = malloc(buffer_size);
   if (s->write_buffer == NULL)
@@ -89,7 +98,7 @@ mailstream * mailstream_new(mailstream_low * low, size_t buffer_size)
   return s;
 
  free_read_buffer:
-  free(s->read_buffer);
+  free(s->read_buffer_base);
  free_s:
   free(s);
  err:
@@ -130,6 +139,45 @@ static ssize_t write_direct(mailstream * s, const void * buf, size_t count)
   return count;
 }
 
+/* sends the internal buffer together with the beginning of buf */
+
+static ssize_t flush_and_write_direct(mailstream * s,
+    const void * buf, size_t count)
+{
+  size_t cur;
+  ssize_t written;
+  ssize_t r;
+
+  cur = 0;
+  while (cur < s->write_buffer_len) {
+    written = mailstream_low_write_buffers(s->low,
+        s->write_buffer + cur, s->write_buffer_len - cur, buf, count);
+    if (written < 0)
+      goto move_buffer;
+
+    if ((size_t) written > s->write_buffer_len - cur) {
+      written -= s->write_buffer_len - cur;
+      s->write_buffer_len = 0;
+      if ((size_t) written == count)
+        return count;
+
+      r = write_direct(s, (const char *) buf + written, count - written);
+      if (r < 0)
+        return written;
+      return written + r;
+    }
+    cur += written;
+  }
+  s->write_buffer_len = 0;
+
+  return write_direct(s, buf, count);
+
+ move_buffer:
+  memmove(s->write_buffer, s->write_buffer + cur, s->write_buffer_len - cur);
+  s->write_buffer_len -= cur;
+  return -1;
+}
+
 LIBETPAN_EXPORT
 ssize_t mailstream_write(mailstream * s, const void * buf, size_t count)
 {
@@ -139,12 +187,12 @@ ssize_t mailstream_write(mailstream * s, const void * buf, size_t count)
     return -1;
 
   if (count + s->write_buffer_len > s->buffer_max_size) {
+    if (count > s->buffer_max_size)
+      return flush_and_write_direct(s, buf, count);
+
     r = mailstream_flush(s);
     if (r == -1)
       return -1;
-
-    if (count > s->buffer_max_size)
-      return write_direct(s, buf, count);
   }
 
   return write_to_internal_buffer(s, buf, count);
@@ -189,14 +237,67 @@ static ssize_t read_from_internal_buffer(mailstream * s,
   if (count != 0)
     memcpy(buf, s->read_buffer, count);
 
+  /* the remaining data is not moved, the buffer is rewound once empty */
   s->read_buffer_len -= count;
   if (s->read_buffer_len != 0)
-    memmove(s->read_buffer, s->read_buffer + count,
-	    s->read_buffer_len);
+    s->read_buffer += count;
+  else
+    s->read_buffer = s->read_buffer_base;
 
   return count;
 }
 
+static void read_buffer_resize(mailstream * s, size_t size)
+{
+  char * base;
+
+  base = realloc(s->read_buffer_base, size);
+  if (base == NULL)
+    return;
+
+  s->read_buffer_base = base;
+  s->read_buffer = base;
+  s->read_buffer_size = size;
+}
+
+/* called with the data of a single read in the buffer */
+
+static void read_buffer_adapt(mailstream * s, size_t read_bytes)
+{
+  if (read_bytes == s->read_buffer_size) {
+    s->read_buffer_small_reads = 0;
+    if (s->read_buffer_size < READ_BUFFER_MAX_SIZE)
+      read_buffer_resize(s, s->read_buffer_size * 2);
+  }
+  else if (read_bytes < s->read_buffer_size / 4) {
+    s->read_buffer_small_reads ++;
+    if ((s->read_buffer_small_reads >= READ_BUFFER_SHRINK_COUNT) &&
+        (s->read_buffer_size > s->buffer_max_size)) {
+      s->read_buffer_small_reads = 0;
+      read_buffer_resize(s, s->read_buffer_size / 2);
+    }
+  }
+  else {
+    s->read_buffer_small_reads = 0;
+  }
+}
+
+static ssize_t read_to_internal_buffer(mailstream * s)
+{
+  ssize_t read_bytes;
+
+  read_bytes = mailstream_low_read(s->low, s->read_buffer_base,
+      s->read_buffer_size);
+  if (read_bytes < 0)
+    return -1;
+
+  s->read_buffer = s->read_buffer_base;
+  s->read_buffer_len = read_bytes;
+  read_buffer_adapt(s, read_bytes);
+
+  return read_bytes;
+}
+
 LIBETPAN_EXPORT
 ssize_t mailstream_read(mailstream * s, void * buf, size_t count)
 {
@@ -217,7 +318,7 @@ ssize_t mailstream_read(mailstream * s, void * buf, size_t count)
     return read_bytes;
   }
 
-  if (left > s->buffer_max_size) {
+  if (left > s->read_buffer_size) {
     read_bytes = mailstream_low_read(s->low, cur_buf, left);
 
     if (read_bytes == -1) {
@@ -234,7 +335,7 @@ ssize_t mailstream_read(mailstream * s, void * buf, size_t count)
     return count - left;
   }
 
-  read_bytes = mailstream_low_read(s->low, s->read_buffer, s->buffer_max_size);
+  read_bytes = read_to_internal_buffer(s);
   if (read_bytes < 0) {
     if (left == count)
       return -1;
@@ -242,8 +343,6 @@ ssize_t mailstream_read(mailstream * s, void * buf, size_t count)
       return count - left;
     }
   }
-  else
-    s->read_buffer_len += read_bytes;
 
   read_bytes = read_from_internal_buffer(s, cur_buf, left);
   cur_buf += read_bytes;
@@ -284,7 +383,7 @@ int mailstream_close(mailstream * s)
   mailstream_low_close(s->low);
   mailstream_low_free(s->low);
   
-  free(s->read_buffer);
+  free(s->read_buffer_base);
   free(s->write_buffer);
   
   free(s);
@@ -301,11 +400,9 @@ ssize_t mailstream_feed_read_buffer(mailstream * s)
     return -1;
 
   if (s->read_buffer_len == 0) {
-    read_bytes = mailstream_low_read(s->low, s->read_buffer,
-				     s->buffer_max_size);
+    read_bytes = read_to_internal_buffer(s);
     if (read_bytes < 0)
       return -1;
-    s->read_buffer_len += read_bytes;
   }
 
   return s->read_buffer_len;
@@ -406,6 +503,32 @@ carray * mailstream_get_certificate_chain(mailstream * s)
   return mailstream_low_get_certificate_chain(s->low);
 }
 
+LIBETPAN_EXPORT
+void mailstream_get_metrics(mailstream * s, struct mailstream_metrics * result)
+{
+  mailstream_low * low;
+  mailstream_low * compressed_low;
+
+  memset(result, 0, sizeof(* result));
+
+  low = s->low;
+  mailstream_low_get_metrics(low, &result->sm_plaintext);
+
+  compressed_low = mailstream_low_compress_get_low(low);
+  if (compressed_low != NULL) {
+    result->sm_compressed_enabled = 1;
+    mailstream_low_get_metrics(compressed_low, &result->sm_compressed);
+    low = compressed_low;
+  }
+
+#ifdef USE_SSL
+  if (low->driver == mailstream_ssl_driver) {
+    result->sm_tls_enabled = 1;
+    mailstream_low_get_metrics(low, &result->sm_tls);
+  }
+#endif
+}
+
 LIBETPAN_EXPORT
 void mailstream_certificate_chain_free(carray * certificate_chain)
 {
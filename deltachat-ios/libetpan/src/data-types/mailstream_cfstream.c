@@ -152,6 +152,7 @@ static mailstream_low_driver local_mailstream_cfstream_driver = {
   /* mailstream_setup_idle */ mailstream_low_cfstream_setup_idle,
   /* mailstream_unsetup_idle */ mailstream_low_cfstream_unsetup_idle,
   /* mailstream_interrupt_idle */ mailstream_low_cfstream_interrupt_idle,
+  /* mailstream_write_buffers */ NULL,
 };
 
 mailstream_low_driver * mailstream_cfstream_driver =
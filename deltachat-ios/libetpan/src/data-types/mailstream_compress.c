@@ -41,6 +41,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #if HAVE_ZLIB
 #include <zlib.h>
 #endif
@@ -48,6 +49,7 @@
 
 #include "mailstream_low.h"
 #include "mailstream_cancel.h"
+#include "mailmetrics.h"
 
 #define CHUNK_SIZE 1024
 
@@ -89,10 +91,26 @@ static mailstream_low_driver local_mailstream_compress_driver = {
   /* mailstream_setup_idle */ mailstream_low_compress_setup_idle,
   /* mailstream_unsetup_idle */ mailstream_low_compress_unsetup_idle,
   /* mailstream_interrupt_idle */ mailstream_low_compress_interrupt_idle,
+  /* mailstream_write_buffers */ NULL,
 };
 
 mailstream_low_driver * mailstream_compress_driver = &local_mailstream_compress_driver;
 
+mailstream_low * mailstream_low_compress_get_low(mailstream_low * s)
+{
+#if HAVE_ZLIB
+  compress_data * data;
+
+  if (s->driver != mailstream_compress_driver)
+    return NULL;
+
+  data = s->data;
+  return data->ms;
+#else
+  return NULL;
+#endif
+}
+
 mailstream_low * mailstream_low_compress_open(mailstream_low * ms)
 {
 #if HAVE_ZLIB
@@ -137,6 +155,13 @@ mailstream_low * mailstream_low_compress_open(mailstream_low * ms)
   s = mailstream_low_new(compress_data, mailstream_compress_driver);
   if (s == NULL)
     goto free_compress_data;
+
+  /*
+    what was exchanged until now was not compressed, the stream below
+    will only count the compressed data.
+  */
+  s->metrics = ms->metrics;
+  memset(&ms->metrics, 0, sizeof(ms->metrics));
     
   return s;
     
@@ -169,10 +194,14 @@ static ssize_t mailstream_low_compress_read(mailstream_low * s, void * buf, size
   do {
     /* if there is no compressed data, read more */
     if (strm->avail_in == 0) {
+      uint64_t begin = mailmetrics_now();
       int read = (int) data->ms->driver->mailstream_read(data->ms, data->input_buf, CHUNK_SIZE);
+      data->ms->metrics.lm_read_time += mailmetrics_now() - begin;
+      data->ms->metrics.lm_read_calls ++;
       if (read <= 0) {
         return read;
       }
+      data->ms->metrics.lm_bytes_read += read;
       strm->avail_in = read;
       strm->next_in = data->input_buf;
     }
@@ -230,9 +259,11 @@ static ssize_t mailstream_low_compress_write(mailstream_low * s, const void * bu
   size_t remaining = CHUNK_SIZE - strm->avail_out;
   while (remaining > 0) {
     ssize_t wr = data->ms->driver->mailstream_write(data->ms, p, remaining);
+    data->ms->metrics.lm_write_calls ++;
     if (wr < 0) {
       return -1;
     }
+    data->ms->metrics.lm_bytes_written += wr;
     
     p += wr;
     remaining -= wr;
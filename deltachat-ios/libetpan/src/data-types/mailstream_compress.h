@@ -50,6 +50,10 @@ struct mailstream_compress_context;
 LIBETPAN_EXPORT
 mailstream_low * mailstream_low_compress_open(mailstream_low * ms);
 
+/* returns the stream below the compression, NULL if s is not compressed */
+LIBETPAN_EXPORT
+mailstream_low * mailstream_low_compress_get_low(mailstream_low * s);
+
 LIBETPAN_EXPORT
 int mailstream_low_compress_wait_idle(mailstream_low * low,
                                       struct mailstream_cancel * idle,
@@ -148,7 +148,46 @@ char * mailstream_read_multiline(mailstream * s, size_t size,
   count = 0;
   last = 0;
 
-  while ((line = mailstream_read_line_remove_eol(s, stream_buffer)) != NULL) {
+  while (1) {
+    /*
+      the lines that are complete in the read buffer, end with CRLF and
+      don't need to be unstuffed are appended from the read buffer
+      directly, the other ones are read through stream_buffer.
+    */
+    while (s->read_buffer_len > 0) {
+      char * begin;
+      char * end;
+      size_t len;
+
+      begin = s->read_buffer;
+      end = memchr(begin, '\n', s->read_buffer_len);
+      if (end == NULL)
+        break;
+      len = end + 1 - begin;
+      if ((len < 2) || (end[-1] != '\r') || (begin[0] == '.') ||
+          (memchr(begin, '\0', len) != NULL))
+        break;
+
+      if (mmap_string_append_len(multiline_buffer, begin, len) == NULL)
+        return NULL;
+      s->read_buffer += len;
+      s->read_buffer_len -= len;
+
+      count += len - 2;
+      if ((size != 0) && (progr_rate != 0) && (progr_fun != NULL))
+        if (count - last >= progr_rate) {
+          (* progr_fun)(count, size);
+          if (body_progr_fun != NULL) {
+            body_progr_fun(count, size, context);
+          }
+          last = count;
+        }
+    }
+
+    line = mailstream_read_line_remove_eol(s, stream_buffer);
+    if (line == NULL)
+      break;
+
     if (mailstream_is_end_multiline(line))
       return multiline_buffer->str;
 
@@ -576,3 +615,111 @@ size_t mailstream_get_data_crlf_size(const char * message, size_t size)
   
   return fixed_count;
 }
+
+void mailstream_data_writer_init(struct mailstream_data_writer * writer,
+    mailstream * s, int quoted)
+{
+  writer->dw_stream = s;
+  writer->dw_quoted = quoted;
+  writer->dw_line_start = 1;
+  writer->dw_pending_cr = 0;
+  writer->dw_size = 0;
+}
+
+static int data_writer_output(struct mailstream_data_writer * writer,
+    const char * str, size_t length)
+{
+  if (length == 0)
+    return 0;
+
+  if (writer->dw_stream != NULL) {
+    if (mailstream_write(writer->dw_stream, str, length) == -1)
+      return -1;
+  }
+  writer->dw_size += length;
+
+  return 0;
+}
+
+int mailstream_data_writer_write(void * data, const char * str, size_t length)
+{
+  struct mailstream_data_writer * writer;
+  const char * p;
+  const char * end;
+
+  writer = data;
+  p = str;
+  end = str + length;
+
+  /* a CR at the end of the previous piece */
+  if (writer->dw_pending_cr) {
+    if (length == 0)
+      return 1;
+
+    writer->dw_pending_cr = 0;
+    if (data_writer_output(writer, "\r\n", 2) < 0)
+      return 0;
+    writer->dw_line_start = 1;
+    if (* p == '\n')
+      p ++;
+  }
+
+  while (p < end) {
+    const char * eol;
+
+    if (writer->dw_line_start) {
+      writer->dw_line_start = 0;
+      if (writer->dw_quoted && (* p == '.')) {
+        if (data_writer_output(writer, ".", 1) < 0)
+          return 0;
+      }
+    }
+
+    eol = p;
+    while ((eol < end) && (* eol != '\r') && (* eol != '\n'))
+      eol ++;
+
+    if (eol == end) {
+      if (data_writer_output(writer, p, eol - p) < 0)
+        return 0;
+      break;
+    }
+
+    if ((* eol == '\r') && (eol + 1 < end) && (eol[1] == '\n')) {
+      /* already CRLF */
+      if (data_writer_output(writer, p, eol + 2 - p) < 0)
+        return 0;
+      p = eol + 2;
+    }
+    else if ((* eol == '\r') && (eol + 1 == end)) {
+      /* the next piece tells whether it is followed by LF */
+      if (data_writer_output(writer, p, eol - p) < 0)
+        return 0;
+      writer->dw_pending_cr = 1;
+      p = end;
+      break;
+    }
+    else {
+      if (data_writer_output(writer, p, eol - p) < 0)
+        return 0;
+      if (data_writer_output(writer, "\r\n", 2) < 0)
+        return 0;
+      p = eol + 1;
+    }
+    writer->dw_line_start = 1;
+  }
+
+  return 1;
+}
+
+int mailstream_data_writer_finish(struct mailstream_data_writer * writer)
+{
+  if (writer->dw_pending_cr) {
+    writer->dw_pending_cr = 0;
+    if (data_writer_output(writer, "\r\n", 2) < 0)
+      return -1;
+    writer->dw_line_start = 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,543 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2005 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include "mailstream_log.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef HAVE_UNISTD_H
+#	include <unistd.h>
+#endif
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef LIBETPAN_REENTRANT
+#if defined(HAVE_PTHREAD_H) && !defined(IGNORE_PTHREAD_H)
+#if defined(__GNUC__) || defined(__clang__)
+#include <pthread.h>
+#include <sched.h>
+#define USE_ASYNC_LOG 1
+#endif
+#endif
+#endif
+
+#define LOG_FILE "libetpan-stream-debug.log"
+
+#ifdef USE_ASYNC_LOG
+
+/* maximum number of queued records, must be a power of 2 */
+#define LOG_QUEUE_SIZE 16384
+
+#define LOG_DEFAULT_MAX_PENDING_SIZE (4 * 1024 * 1024)
+
+/* the background thread writes at least every 100 ms */
+#define LOG_FLUSH_INTERVAL_NSEC 100000000
+
+#define LOG_BATCH_SIZE (64 * 1024)
+
+struct log_record {
+  size_t record_size;
+  struct timespec time;
+  int direction;
+  char * identifier;
+  size_t size;
+  char data[1];
+};
+
+/*
+  bounded queue with multiple producers and a single consumer,
+  a producer takes a position with a compare and swap and publishes
+  the record by updating the sequence number of the slot.
+*/
+
+struct log_slot {
+  size_t sequence;
+  struct log_record * record;
+};
+
+static struct log_slot * log_queue;
+static size_t log_enqueue_pos;
+static size_t log_dequeue_pos;
+
+static int log_running = 0;
+static size_t log_producers = 0;
+static size_t log_pending_size;
+static size_t log_max_pending_size;
+static struct mailstream_log_stats log_stats;
+
+static pthread_mutex_t log_control_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_cond = PTHREAD_COND_INITIALIZER;
+static int log_stopping;
+static pthread_t log_thread;
+
+/* used only by the background thread */
+static FILE * log_file;
+#if HAVE_ZLIB
+static gzFile log_gzfile;
+#endif
+static char * log_last_identifier;
+static int log_last_direction;
+static int log_line_start;
+static char log_batch[LOG_BATCH_SIZE];
+static size_t log_batch_len;
+
+static int log_enqueue(struct log_record * record)
+{
+  size_t pos;
+
+  pos = __atomic_load_n(&log_enqueue_pos, __ATOMIC_RELAXED);
+  while (1) {
+    struct log_slot * slot;
+    size_t sequence;
+    ssize_t diff;
+
+    slot = &log_queue[pos & (LOG_QUEUE_SIZE - 1)];
+    sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+    diff = (ssize_t) sequence - (ssize_t) pos;
+    if (diff == 0) {
+      /* pos is updated when it fails */
+      if (__atomic_compare_exchange_n(&log_enqueue_pos, &pos, pos + 1, 1,
+              __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        slot->record = record;
+        __atomic_store_n(&slot->sequence, pos + 1, __ATOMIC_RELEASE);
+        return 0;
+      }
+    }
+    else if (diff < 0) {
+      /* full */
+      return -1;
+    }
+    else {
+      pos = __atomic_load_n(&log_enqueue_pos, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+static struct log_record * log_dequeue(void)
+{
+  struct log_slot * slot;
+  struct log_record * record;
+
+  slot = &log_queue[log_dequeue_pos & (LOG_QUEUE_SIZE - 1)];
+  if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != log_dequeue_pos + 1)
+    return NULL;
+
+  record = slot->record;
+  __atomic_store_n(&slot->sequence, log_dequeue_pos + LOG_QUEUE_SIZE,
+      __ATOMIC_RELEASE);
+  log_dequeue_pos ++;
+
+  return record;
+}
+
+static void log_write_batch(const char * data, size_t size)
+{
+  if (size == 0)
+    return;
+
+#if HAVE_ZLIB
+  if (log_gzfile != NULL) {
+    gzwrite(log_gzfile, data, (unsigned int) size);
+    return;
+  }
+#endif
+  fwrite(data, 1, size, log_file);
+}
+
+static void log_flush(void)
+{
+  log_write_batch(log_batch, log_batch_len);
+  log_batch_len = 0;
+
+#if HAVE_ZLIB
+  if (log_gzfile != NULL) {
+    gzflush(log_gzfile, Z_SYNC_FLUSH);
+    return;
+  }
+#endif
+  fflush(log_file);
+}
+
+static void log_write(const char * data, size_t size)
+{
+  if (size == 0)
+    return;
+
+  if (log_batch_len + size > LOG_BATCH_SIZE) {
+    log_write_batch(log_batch, log_batch_len);
+    log_batch_len = 0;
+    if (size > LOG_BATCH_SIZE) {
+      log_write_batch(data, size);
+      log_line_start = (data[size - 1] == '\n');
+      return;
+    }
+  }
+
+  memcpy(log_batch + log_batch_len, data, size);
+  log_batch_len += size;
+  log_line_start = (data[size - 1] == '\n');
+}
+
+static const char * log_direction_name(int direction)
+{
+  switch (direction) {
+  case 0:
+    return "received";
+  case 1:
+    return "sent";
+  case 2:
+    return "sent-private";
+  case 4:
+    return "error-received";
+  case 4 | 1:
+    return "error-sent";
+  default:
+    return "unknown";
+  }
+}
+
+static void log_write_record(struct log_record * record)
+{
+  int same_identifier;
+
+  if ((log_last_identifier == NULL) || (record->identifier == NULL))
+    same_identifier = (log_last_identifier == record->identifier);
+  else
+    same_identifier = (strcmp(log_last_identifier, record->identifier) == 0);
+
+  if (!same_identifier || (record->direction != log_last_direction)) {
+    char header[256];
+
+    if (!log_line_start)
+      log_write("\n", 1);
+    snprintf(header, sizeof(header), "--- %lu.%09lu %s %s ---\n",
+        (unsigned long) record->time.tv_sec,
+        (unsigned long) record->time.tv_nsec,
+        (record->identifier != NULL) ? record->identifier : "-",
+        log_direction_name(record->direction));
+    log_write(header, strlen(header));
+
+    if (!same_identifier) {
+      free(log_last_identifier);
+      log_last_identifier = NULL;
+      if (record->identifier != NULL)
+        log_last_identifier = strdup(record->identifier);
+    }
+    log_last_direction = record->direction;
+  }
+
+  log_write(record->data, record->size);
+
+  __atomic_add_fetch(&log_stats.ls_records, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&log_stats.ls_size, record->size, __ATOMIC_RELAXED);
+}
+
+static void * log_thread_main(void * arg)
+{
+  while (1) {
+    struct log_record * record;
+    struct timespec deadline;
+    int stopping;
+
+    /*
+      once stopping is set, there are no more producers, the last
+      records are written by this iteration.
+    */
+    pthread_mutex_lock(&log_lock);
+    stopping = log_stopping;
+    pthread_mutex_unlock(&log_lock);
+
+    while ((record = log_dequeue()) != NULL) {
+      size_t record_size;
+
+      record_size = record->record_size;
+      log_write_record(record);
+      free(record);
+      __atomic_sub_fetch(&log_pending_size, record_size, __ATOMIC_RELAXED);
+    }
+    log_flush();
+
+    if (stopping)
+      break;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += LOG_FLUSH_INTERVAL_NSEC;
+    if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec ++;
+      deadline.tv_nsec -= 1000000000;
+    }
+    pthread_mutex_lock(&log_lock);
+    if (!log_stopping)
+      pthread_cond_timedwait(&log_cond, &log_lock, &deadline);
+    pthread_mutex_unlock(&log_lock);
+  }
+
+  return NULL;
+}
+
+int mailstream_log_start(const char * filename, size_t max_pending_size,
+    int compress)
+{
+  mode_t old_mask;
+  unsigned int i;
+  int res;
+
+  pthread_mutex_lock(&log_control_lock);
+
+  if (__atomic_load_n(&log_running, __ATOMIC_SEQ_CST)) {
+    res = -1;
+    goto unlock;
+  }
+
+  if (filename == NULL)
+    filename = LOG_FILE;
+  if (max_pending_size == 0)
+    max_pending_size = LOG_DEFAULT_MAX_PENDING_SIZE;
+
+  log_queue = malloc(LOG_QUEUE_SIZE * sizeof(* log_queue));
+  if (log_queue == NULL) {
+    res = -1;
+    goto unlock;
+  }
+
+  log_file = NULL;
+#if HAVE_ZLIB
+  log_gzfile = NULL;
+#endif
+
+  old_mask = umask(0077);
+  if (compress) {
+#if HAVE_ZLIB
+    log_gzfile = gzopen(filename, "ab");
+#endif
+  }
+  else {
+    log_file = fopen(filename, "a");
+  }
+  umask(old_mask);
+
+#if HAVE_ZLIB
+  if ((log_file == NULL) && (log_gzfile == NULL)) {
+#else
+  if (log_file == NULL) {
+#endif
+    res = -1;
+    goto free_queue;
+  }
+
+  for(i = 0 ; i < LOG_QUEUE_SIZE ; i ++) {
+    log_queue[i].sequence = i;
+    log_queue[i].record = NULL;
+  }
+  log_enqueue_pos = 0;
+  log_dequeue_pos = 0;
+  log_pending_size = 0;
+  log_max_pending_size = max_pending_size;
+  memset(&log_stats, 0, sizeof(log_stats));
+  log_stopping = 0;
+  log_last_identifier = NULL;
+  log_last_direction = -1;
+  log_line_start = 1;
+  log_batch_len = 0;
+
+  if (pthread_create(&log_thread, NULL, log_thread_main, NULL) != 0) {
+    res = -1;
+    goto close;
+  }
+
+  __atomic_store_n(&log_running, 1, __ATOMIC_SEQ_CST);
+
+  pthread_mutex_unlock(&log_control_lock);
+
+  return 0;
+
+ close:
+#if HAVE_ZLIB
+  if (log_gzfile != NULL)
+    gzclose(log_gzfile);
+#endif
+  if (log_file != NULL)
+    fclose(log_file);
+ free_queue:
+  free(log_queue);
+  log_queue = NULL;
+ unlock:
+  pthread_mutex_unlock(&log_control_lock);
+  return res;
+}
+
+void mailstream_log_stop(void)
+{
+  pthread_mutex_lock(&log_control_lock);
+
+  if (!__atomic_load_n(&log_running, __ATOMIC_SEQ_CST)) {
+    pthread_mutex_unlock(&log_control_lock);
+    return;
+  }
+
+  /* waits for the producers that have seen the log running */
+  __atomic_store_n(&log_running, 0, __ATOMIC_SEQ_CST);
+  while (__atomic_load_n(&log_producers, __ATOMIC_SEQ_CST) != 0)
+    sched_yield();
+
+  pthread_mutex_lock(&log_lock);
+  log_stopping = 1;
+  pthread_cond_signal(&log_cond);
+  pthread_mutex_unlock(&log_lock);
+
+  pthread_join(log_thread, NULL);
+
+#if HAVE_ZLIB
+  if (log_gzfile != NULL) {
+    gzclose(log_gzfile);
+    log_gzfile = NULL;
+  }
+#endif
+  if (log_file != NULL) {
+    fclose(log_file);
+    log_file = NULL;
+  }
+  free(log_last_identifier);
+  log_last_identifier = NULL;
+  free(log_queue);
+  log_queue = NULL;
+
+  pthread_mutex_unlock(&log_control_lock);
+}
+
+int mailstream_log_append(const char * identifier, int direction,
+    const char * buf, size_t size)
+{
+  struct log_record * record;
+  size_t identifier_size;
+  size_t record_size;
+  size_t pending_size;
+  int res;
+
+  __atomic_add_fetch(&log_producers, 1, __ATOMIC_SEQ_CST);
+
+  if (!__atomic_load_n(&log_running, __ATOMIC_SEQ_CST)) {
+    res = -1;
+    goto done;
+  }
+
+  res = 0;
+
+  identifier_size = 0;
+  if (identifier != NULL)
+    identifier_size = strlen(identifier) + 1;
+  record_size = sizeof(* record) + size + identifier_size;
+
+  pending_size = __atomic_add_fetch(&log_pending_size, record_size,
+      __ATOMIC_RELAXED);
+  if (pending_size > log_max_pending_size)
+    goto unreserve;
+
+  record = malloc(record_size);
+  if (record == NULL)
+    goto unreserve;
+
+  record->record_size = record_size;
+  clock_gettime(CLOCK_MONOTONIC, &record->time);
+  record->direction = direction;
+  record->size = size;
+  memcpy(record->data, buf, size);
+  record->identifier = NULL;
+  if (identifier != NULL) {
+    record->identifier = record->data + size;
+    memcpy(record->identifier, identifier, identifier_size);
+  }
+
+  if (log_enqueue(record) < 0) {
+    free(record);
+    goto unreserve;
+  }
+
+  /* wakes up the background thread early when the queue fills up */
+  if ((pending_size > log_max_pending_size / 2) ||
+      (__atomic_load_n(&log_enqueue_pos, __ATOMIC_RELAXED) -
+          __atomic_load_n(&log_dequeue_pos, __ATOMIC_RELAXED) > LOG_QUEUE_SIZE / 2))
+    pthread_cond_signal(&log_cond);
+
+  goto done;
+
+ unreserve:
+  __atomic_sub_fetch(&log_pending_size, record_size, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&log_stats.ls_dropped_records, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&log_stats.ls_dropped_size, size, __ATOMIC_RELAXED);
+ done:
+  __atomic_sub_fetch(&log_producers, 1, __ATOMIC_SEQ_CST);
+  return res;
+}
+
+void mailstream_log_get_stats(struct mailstream_log_stats * stats)
+{
+  stats->ls_records = __atomic_load_n(&log_stats.ls_records, __ATOMIC_RELAXED);
+  stats->ls_size = __atomic_load_n(&log_stats.ls_size, __ATOMIC_RELAXED);
+  stats->ls_dropped_records =
+    __atomic_load_n(&log_stats.ls_dropped_records, __ATOMIC_RELAXED);
+  stats->ls_dropped_size =
+    __atomic_load_n(&log_stats.ls_dropped_size, __ATOMIC_RELAXED);
+}
+
+#else
+
+int mailstream_log_start(const char * filename, size_t max_pending_size,
+    int compress)
+{
+  return -1;
+}
+
+void mailstream_log_stop(void)
+{
+}
+
+int mailstream_log_append(const char * identifier, int direction,
+    const char * buf, size_t size)
+{
+  return -1;
+}
+
+void mailstream_log_get_stats(struct mailstream_log_stats * stats)
+{
+  memset(stats, 0, sizeof(* stats));
+}
+
+#endif
@@ -39,6 +39,8 @@
 
 #include "mailstream_low.h"
 #include <stdlib.h>
+#include <string.h>
+#include "mailmetrics.h"
 
 #ifdef LIBETPAN_MAILSTREAM_DEBUG
 
@@ -52,6 +54,7 @@
 #	include <unistd.h>
 #endif
 #include "maillock.h"
+#include "mailstream_log.h"
 #ifdef WIN32
 #	include "win_etpan.h"
 #endif
@@ -82,6 +85,33 @@ void (* mailstream_logger_id)(mailstream_low * s, int is_stream_data, int direct
 static inline void mailstream_logger_internal(mailstream_low * s, int is_stream_data, int direction,
     const char * buffer, size_t size);
 
+/*
+  appends to the log file, through the asynchronous log when it is
+  started (mailstream_log_start()), otherwise the file is locked,
+  opened and closed for each write.
+*/
+
+static void stream_log_file(mailstream_low * low, int direction,
+    const char * buf, size_t size)
+{
+  FILE * f;
+  mode_t old_mask;
+
+  if (mailstream_log_append(mailstream_low_get_identifier(low), direction,
+          buf, size) == 0)
+    return;
+
+  old_mask = umask(0077);
+  f = fopen(LOG_FILE, "a");
+  umask(old_mask);
+  if (f != NULL) {
+    maillock_write_lock(LOG_FILE, fileno(f));
+    fwrite(buf, 1, size, f);
+    maillock_write_unlock(LOG_FILE, fileno(f));
+    fclose(f);
+  }
+}
+
 // Will log a buffer.
 #define STREAM_LOG_ERROR(low, direction, buf, size) \
   mailstream_logger_internal(low, 2, direction, buf, size); \
@@ -93,18 +123,7 @@ static inline void mailstream_logger_internal(mailstream_low * s, int is_stream_
       mailstream_logger(direction, buf, size); \
     } \
     else { \
-      FILE * f; \
-      mode_t old_mask; \
-      \
-      old_mask = umask(0077); \
-      f = fopen(LOG_FILE, "a"); \
-      umask(old_mask); \
-      if (f != NULL) { \
-        maillock_write_lock(LOG_FILE, fileno(f)); \
-        fwrite((buf), 1, (size), f); \
-        maillock_write_unlock(LOG_FILE, fileno(f)); \
-        fclose(f); \
-      } \
+      stream_log_file(low, direction, buf, size); \
     } \
   }
 
@@ -119,18 +138,7 @@ static inline void mailstream_logger_internal(mailstream_low * s, int is_stream_
       mailstream_logger(direction, buf, size); \
     } \
     else { \
-      FILE * f; \
-      mode_t old_mask; \
-      \
-      old_mask = umask(0077); \
-      f = fopen(LOG_FILE, "a"); \
-      umask(old_mask); \
-      if (f != NULL) { \
-        maillock_write_lock(LOG_FILE, fileno(f)); \
-        fwrite((buf), 1, (size), f); \
-        maillock_write_unlock(LOG_FILE, fileno(f)); \
-        fclose(f); \
-      } \
+      stream_log_file(low, direction, buf, size); \
     } \
   }
 
@@ -145,18 +153,7 @@ static inline void mailstream_logger_internal(mailstream_low * s, int is_stream_
       mailstream_logger(direction, str, strlen(str)); \
     } \
     else { \
-      FILE * f; \
-      mode_t old_mask; \
-      \
-      old_mask = umask(0077); \
-      f = fopen(LOG_FILE, "a"); \
-      umask(old_mask); \
-      if (f != NULL) { \
-        maillock_write_lock(LOG_FILE, fileno(f)); \
-        fputs((str), f); \
-        maillock_write_unlock(LOG_FILE, fileno(f)); \
-        fclose(f); \
-      } \
+      stream_log_file(low, direction, str, strlen(str)); \
     } \
   }
 
@@ -187,6 +184,7 @@ mailstream_low * mailstream_low_new(void * data,
 	s->timeout = 0;
   s->logger = NULL;
   s->logger_context = NULL;
+  memset(&s->metrics, 0, sizeof(s->metrics));
   
   return s;
 }
@@ -226,10 +224,16 @@ void mailstream_low_free(mailstream_low * s)
 ssize_t mailstream_low_read(mailstream_low * s, void * buf, size_t count)
 {
   ssize_t r;
+  uint64_t begin;
   
   if (s == NULL)
     return -1;
+  begin = mailmetrics_now();
   r = s->driver->mailstream_read(s, buf, count);
+  s->metrics.lm_read_time += mailmetrics_now() - begin;
+  s->metrics.lm_read_calls ++;
+  if (r > 0)
+    s->metrics.lm_bytes_read += r;
   
 #ifdef STREAM_DEBUG
   if (r > 0) {
@@ -268,6 +272,9 @@ ssize_t mailstream_low_write(mailstream_low * s,
 #endif
 
   r = s->driver->mailstream_write(s, buf, count);
+  s->metrics.lm_write_calls ++;
+  if (r > 0)
+    s->metrics.lm_bytes_written += r;
   
   if (r < 0) {
     STREAM_LOG_ERROR(s, 4 | 1, buf, 0);
@@ -276,6 +283,58 @@ ssize_t mailstream_low_write(mailstream_low * s,
   return r;
 }
 
+ssize_t mailstream_low_write_buffers(mailstream_low * s,
+    const void * buf1, size_t count1, const void * buf2, size_t count2)
+{
+  ssize_t r;
+  
+  if (s == NULL)
+    return -1;
+  
+  if (s->driver->mailstream_write_buffers == NULL)
+    return mailstream_low_write(s, buf1, count1);
+
+#ifdef STREAM_DEBUG
+  STREAM_LOG(s, 1, ">>>>>>> send >>>>>>\n");
+  /*
+    loggers locate the data in the stream with the count of bytes
+    written, the second buffer is logged at the position where it
+    will be written.
+  */
+  if (s->privacy) {
+    STREAM_LOG_BUF(s, 1, buf1, count1);
+    s->metrics.lm_bytes_written += count1;
+    STREAM_LOG_BUF(s, 1, buf2, count2);
+    s->metrics.lm_bytes_written -= count1;
+  }
+  else {
+    STREAM_LOG_BUF(s, 2, buf1, count1);
+    s->metrics.lm_bytes_written += count1;
+    STREAM_LOG_BUF(s, 2, buf2, count2);
+    s->metrics.lm_bytes_written -= count1;
+  }
+  STREAM_LOG(s, 1, "\n");
+  STREAM_LOG(s, 1, ">>>>>>> end send >>>>>>\n");
+#endif
+
+  r = s->driver->mailstream_write_buffers(s, buf1, count1, buf2, count2);
+  s->metrics.lm_write_calls ++;
+  if (r > 0)
+    s->metrics.lm_bytes_written += r;
+  
+  if (r < 0) {
+    STREAM_LOG_ERROR(s, 4 | 1, buf1, 0);
+  }
+  
+  return r;
+}
+
+void mailstream_low_get_metrics(mailstream_low * s,
+    struct mailstream_low_metrics * result)
+{
+  * result = s->metrics;
+}
+
 void mailstream_low_cancel(mailstream_low * s)
 {
   if (s == NULL)
@@ -55,6 +55,15 @@ ssize_t mailstream_low_write(mailstream_low * s,
 
 ssize_t mailstream_low_read(mailstream_low * s, void * buf, size_t count);
 
+/*
+  mailstream_low_write_buffers() writes buf1 followed by buf2 and returns
+  the number of bytes written from both. Only buf1 is written when the
+  driver cannot write both with a single call.
+*/
+
+ssize_t mailstream_low_write_buffers(mailstream_low * s,
+    const void * buf1, size_t count1, const void * buf2, size_t count2);
+
 LIBETPAN_EXPORT
 int mailstream_low_close(mailstream_low * s);
 
@@ -70,6 +79,10 @@ void mailstream_low_free(mailstream_low * s);
 LIBETPAN_EXPORT
 void mailstream_low_cancel(mailstream_low * s);
 
+LIBETPAN_EXPORT
+void mailstream_low_get_metrics(mailstream_low * s,
+    struct mailstream_low_metrics * result);
+
 LIBETPAN_EXPORT
 void mailstream_low_log_error(mailstream_low * s,
 	const void * buf, size_t count);
@@ -62,6 +62,8 @@
 #else
 #	include <sys/time.h>
 #	include <sys/types.h>
+#	include <sys/uio.h>
+#	include <errno.h>
 #   if USE_POLL
 #       ifdef HAVE_SYS_POLL_H
 #           include <sys/poll.h>
@@ -79,6 +81,8 @@ struct mailstream_socket_data {
   int fd;
   struct mailstream_cancel * cancel;
   int use_read;
+  /* the last read filled the buffer, more data is probably pending */
+  int read_pending;
 };
 
 /* mailstream_low, socket */
@@ -92,6 +96,10 @@ static void mailstream_low_socket_free(mailstream_low * s);
 static int mailstream_low_socket_get_fd(mailstream_low * s);
 static void mailstream_low_socket_cancel(mailstream_low * s);
 static struct mailstream_cancel * mailstream_low_socket_get_cancel(mailstream_low * s);
+#ifndef WIN32
+static ssize_t mailstream_low_socket_write_buffers(mailstream_low * s,
+    const void * buf1, size_t count1, const void * buf2, size_t count2);
+#endif
 
 static mailstream_low_driver local_mailstream_socket_driver = {
   /* mailstream_read */ mailstream_low_socket_read,
@@ -105,6 +113,11 @@ static mailstream_low_driver local_mailstream_socket_driver = {
   /* mailstream_setup_idle */ NULL,
   /* mailstream_unsetup_idle */ NULL,
   /* mailstream_interrupt_idle */ NULL,
+#ifndef WIN32
+  /* mailstream_write_buffers */ mailstream_low_socket_write_buffers,
+#else
+  /* mailstream_write_buffers */ NULL,
+#endif
 };
 
 mailstream_low_driver * mailstream_socket_driver =
@@ -122,6 +135,7 @@ static struct mailstream_socket_data * socket_data_new(int fd)
   
   socket_data->fd = fd;
   socket_data->use_read = 0;
+  socket_data->read_pending = 0;
   socket_data->cancel = mailstream_cancel_new();
   if (socket_data->cancel == NULL)
     goto free;
@@ -212,6 +226,22 @@ static ssize_t mailstream_low_socket_read(mailstream_low * s,
   if (mailstream_cancel_cancelled(socket_data->cancel))
     return -1;
   
+#ifdef MSG_DONTWAIT
+  /* no need to wait for data that has already arrived */
+  if (socket_data->read_pending && !socket_data->use_read) {
+    ssize_t r;
+    
+    socket_data->read_pending = 0;
+    r = recv(socket_data->fd, buf, count, MSG_DONTWAIT);
+    if (r >= 0) {
+      socket_data->read_pending = ((size_t) r == count);
+      return r;
+    }
+    if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+      return -1;
+  }
+#endif
+  
   /* timeout */
   {
     struct timeval timeout;
@@ -299,12 +329,17 @@ static ssize_t mailstream_low_socket_read(mailstream_low * s,
     return read(socket_data->fd, buf, count);
   }
   else {
-    return recv(socket_data->fd, buf, count, 0);
+    ssize_t r;
+    
+    r = recv(socket_data->fd, buf, count, 0);
+    socket_data->read_pending = (r > 0) && ((size_t) r == count);
+    return r;
   }
 }
 
-static ssize_t mailstream_low_socket_write(mailstream_low * s,
-					   const void * buf, size_t count)
+/* returns 1 when the socket is writable, 0 if it is not, -1 on error */
+
+static int socket_wait_write(mailstream_low * s)
 {
   struct mailstream_socket_data * socket_data;
 
@@ -399,9 +434,47 @@ static ssize_t mailstream_low_socket_write(mailstream_low * s,
       return 0;
   }
   
+  return 1;
+}
+
+static ssize_t mailstream_low_socket_write(mailstream_low * s,
+					   const void * buf, size_t count)
+{
+  struct mailstream_socket_data * socket_data;
+  int r;
+  
+  socket_data = (struct mailstream_socket_data *) s->data;
+  
+  r = socket_wait_write(s);
+  if (r <= 0)
+    return r;
+  
   return send(socket_data->fd, buf, count, 0);
 }
 
+#ifndef WIN32
+static ssize_t mailstream_low_socket_write_buffers(mailstream_low * s,
+    const void * buf1, size_t count1, const void * buf2, size_t count2)
+{
+  struct mailstream_socket_data * socket_data;
+  struct iovec iov[2];
+  int r;
+  
+  socket_data = (struct mailstream_socket_data *) s->data;
+  
+  r = socket_wait_write(s);
+  if (r <= 0)
+    return r;
+  
+  iov[0].iov_base = (void *) buf1;
+  iov[0].iov_len = count1;
+  iov[1].iov_base = (void *) buf2;
+  iov[1].iov_len = count2;
+  
+  return writev(socket_data->fd, iov, 2);
+}
+#endif
+
 
 /* mailstream */
 
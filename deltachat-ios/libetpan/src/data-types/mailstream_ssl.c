@@ -393,6 +393,7 @@ static mailstream_low_driver local_mailstream_ssl_driver = {
   /* mailstream_setup_idle */ NULL,
   /* mailstream_unsetup_idle */ NULL,
   /* mailstream_interrupt_idle */ NULL,
+  /* mailstream_write_buffers */ NULL,
 };
 
 mailstream_low_driver * mailstream_ssl_driver = &local_mailstream_ssl_driver;
@@ -41,6 +41,7 @@
 #include "mmapstring_private.h"
 
 #include "chash.h"
+#include "mailmapview.h"
 
 #include <stdlib.h>
 #ifdef WIN32
@@ -170,7 +171,7 @@ int mmap_string_unref(char * str)
   if (ht == NULL) {
 
 	MUTEX_UNLOCK(&mmapstring_lock);
-    return -1;
+    return mailmapview_str_unref(str);
   }
   
   key.data = &str;
@@ -196,8 +197,10 @@ int mmap_string_unref(char * str)
     mmap_string_free(string);
     return 0;
   }
-  else
-    return -1;
+  else {
+    /* the string can point into a mapped file */
+    return mailmapview_str_unref(str);
+  }
 }
 
 
@@ -115,7 +115,7 @@ time_t mail_mkgmtime(struct tm * tmp)
   register int			bits;
   register int			saved_seconds;
   time_t				t;
-  struct tm			yourtm, *mytm;
+  struct tm			yourtm, *mytm, gmt;
   
   yourtm = *tmp;
   saved_seconds = yourtm.tm_sec;
@@ -139,7 +139,8 @@ time_t mail_mkgmtime(struct tm * tmp)
   if(bits > 40) bits = 40;
   
   for ( ; ; ) {
-    mytm = gmtime(&t);
+    /* gmtime_r() since messages can be threaded from several threads */
+    mytm = gmtime_r(&t, &gmt);
     
     if(!mytm) return WRONG;
     
@@ -57,10 +57,11 @@ db_mailstorage_get_folder_session(struct mailstorage * storage,
 static void db_mailstorage_uninitialize(struct mailstorage * storage);
 
 static mailstorage_driver db_mailstorage_driver = {
-  /* sto_name               */ "db",
-  /* sto_connect            */ db_mailstorage_connect,
-  /* sto_get_folder_session */ db_mailstorage_get_folder_session,
-  /* sto_uninitialize       */ db_mailstorage_uninitialize
+  /* sto_name                   */ "db",
+  /* sto_connect                */ db_mailstorage_connect,
+  /* sto_get_folder_session     */ db_mailstorage_get_folder_session,
+  /* sto_uninitialize           */ db_mailstorage_uninitialize,
+  /* sto_folder_has_own_session */ NULL
 };
 
 LIBETPAN_EXPORT
@@ -58,10 +58,11 @@ static int feed_mailstorage_get_folder_session(struct mailstorage * storage,
 static void feed_mailstorage_uninitialize(struct mailstorage * storage);
 
 static mailstorage_driver feed_mailstorage_driver = {
-  /* sto_name               */ "feed",
-  /* sto_connect            */ feed_mailstorage_connect,
-  /* sto_get_folder_session */ feed_mailstorage_get_folder_session,
-  /* sto_uninitialize       */ feed_mailstorage_uninitialize,
+  /* sto_name                   */ "feed",
+  /* sto_connect                */ feed_mailstorage_connect,
+  /* sto_get_folder_session     */ feed_mailstorage_get_folder_session,
+  /* sto_uninitialize           */ feed_mailstorage_uninitialize,
+  /* sto_folder_has_own_session */ NULL
 };
 
 int feed_mailstorage_init(struct mailstorage * storage,
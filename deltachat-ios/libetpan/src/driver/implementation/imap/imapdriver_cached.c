@@ -63,6 +63,7 @@
 #include "imfcache.h"
 #include "maildriver_tools.h"
 #include "imapdriver.h"
+#include "mailsearchindex.h"
 
 static int imapdriver_cached_initialize(mailsession * session);
 static void imapdriver_cached_uninitialize(mailsession * session);
@@ -242,6 +243,9 @@ static int imapdriver_cached_initialize(mailsession * session)
   if (data->imap_uid_list == NULL)
     goto free_session;
   data->imap_uidvalidity = 0;
+  data->imap_search_index_enabled = 0;
+  data->imap_search_index = NULL;
+  data->imap_body_cache = NULL;
   
   session->sess_data = data;
   
@@ -255,9 +259,67 @@ static int imapdriver_cached_initialize(mailsession * session)
   return MAIL_ERROR_MEMORY;
 }
 
+static void
+close_search_index(struct imap_cached_session_state_data * imap_cached_data)
+{
+  if (imap_cached_data->imap_search_index != NULL) {
+    mail_search_index_close(imap_cached_data->imap_search_index);
+    imap_cached_data->imap_search_index = NULL;
+  }
+}
+
+static void
+open_search_index(struct imap_cached_session_state_data * imap_cached_data)
+{
+  char filename[PATH_MAX];
+  int r;
+
+  close_search_index(imap_cached_data);
+
+  if (!imap_cached_data->imap_search_index_enabled)
+    return;
+  if (imap_cached_data->imap_quoted_mb == NULL)
+    return;
+
+  /* the index is only an optimization, the session works without it */
+  snprintf(filename, PATH_MAX, "%s/%s",
+      imap_cached_data->imap_quoted_mb, MAIL_SEARCH_INDEX_NAME);
+  r = mail_search_index_open(filename, &imap_cached_data->imap_search_index);
+  if (r != MAIL_NO_ERROR)
+    imap_cached_data->imap_search_index = NULL;
+}
+
+static void
+close_body_cache(struct imap_cached_session_state_data * imap_cached_data)
+{
+  if (imap_cached_data->imap_body_cache != NULL) {
+    generic_cache_log_close(imap_cached_data->imap_body_cache);
+    imap_cached_data->imap_body_cache = NULL;
+  }
+}
+
+static void
+open_body_cache(struct imap_cached_session_state_data * imap_cached_data)
+{
+  int r;
+
+  close_body_cache(imap_cached_data);
+
+  if (imap_cached_data->imap_quoted_mb == NULL)
+    return;
+
+  /* messages are fetched from the server when the cache can't be used */
+  r = generic_cache_log_open(imap_cached_data->imap_quoted_mb,
+      &imap_cached_data->imap_body_cache);
+  if (r != MAIL_NO_ERROR)
+    imap_cached_data->imap_body_cache = NULL;
+}
+
 static void
 free_quoted_mb(struct imap_cached_session_state_data * imap_cached_data)
 {
+  close_search_index(imap_cached_data);
+  close_body_cache(imap_cached_data);
   if (imap_cached_data->imap_quoted_mb != NULL) {
     free(imap_cached_data->imap_quoted_mb);
     imap_cached_data->imap_quoted_mb = NULL;
@@ -437,6 +499,12 @@ static int imapdriver_cached_parameters(mailsession * session,
       return r;
 
     return MAIL_NO_ERROR;
+
+  case IMAPDRIVER_CACHED_SET_SEARCH_INDEX:
+    data->imap_search_index_enabled = * (int *) value;
+    open_search_index(data);
+
+    return MAIL_NO_ERROR;
     
   default:
     return mailsession_parameters(data->imap_ancestor, id, value);
@@ -675,9 +743,10 @@ static int imapdriver_cached_select_folder(mailsession * session, const char * m
     return r;
 
   data = get_cached_data(session);
-  if (data->imap_quoted_mb != NULL)
-    free(data->imap_quoted_mb);
+  free_quoted_mb(data);
   data->imap_quoted_mb = quoted_mb;
+  open_search_index(data);
+  open_body_cache(data);
 
   /* clear UID cache */
   carray_set_size(data->imap_uid_list, 0);
@@ -857,6 +926,9 @@ static void get_uid_from_filename(char * filename)
   p = strstr(filename, "-rfc822");
   if (p != NULL)
     * p = 0;
+  p = strstr(filename, "-bodystructure");
+  if (p != NULL)
+    * p = 0;
 }  
 
 #define ENV_NAME "env.db"
@@ -1429,6 +1501,24 @@ imapdriver_cached_get_envelopes_list(mailsession * session,
 
   maildriver_message_cache_clean_up(data->imap_quoted_mb, env_list,
       get_uid_from_filename);
+  if (data->imap_body_cache != NULL)
+    generic_cache_log_clean_up(data->imap_body_cache, env_list,
+        get_uid_from_filename);
+
+  /* index headers and forget about expunged messages */
+
+  if (data->imap_search_index != NULL) {
+    for(i = 0 ; i < carray_count(env_list->msg_tab) ; i ++) {
+      mailmessage * msg;
+
+      msg = carray_get(env_list->msg_tab, i);
+      if ((msg->msg_fields != NULL) && (msg->msg_uid != NULL))
+        mail_search_index_add_fields(data->imap_search_index,
+            msg->msg_uid, msg->msg_fields);
+    }
+    mail_search_index_clean_up(data->imap_search_index, env_list);
+    mail_search_index_save(data->imap_search_index);
+  }
   
   return MAIL_NO_ERROR;
 
@@ -1540,3 +1630,15 @@ static int imapdriver_cached_login_sasl(mailsession * session,
       login, auth_name,
       password, realm);
 }
+
+int imapdriver_cached_search(mailsession * session,
+    struct mail_search_key * key, clist ** result)
+{
+  struct imap_cached_session_state_data * data;
+
+  data = get_cached_data(session);
+  if (data->imap_search_index == NULL)
+    return MAIL_ERROR_BAD_STATE;
+
+  return mail_search_index_search(data->imap_search_index, key, result);
+}
@@ -45,6 +45,26 @@ extern "C" {
 
 extern mailsession_driver * imap_cached_session_driver;
 
+/*
+  imapdriver_cached_search() searches the messages of the selected
+  folder in the local search index, without connecting to the server.
+  The index must have been enabled with IMAPDRIVER_CACHED_SET_SEARCH_INDEX
+  and only contains the messages whose envelope or content has been
+  fetched.
+
+  @param session the cached IMAP session
+  @param key the search criteria
+  @param result a list of (char *) uid of messages, to be freed with
+    mail_search_index_result_free()
+
+  @return MAIL_NO_ERROR on success, MAIL_ERROR_NOT_IMPLEMENTED if a
+    criterion cannot be answered by the index
+*/
+
+LIBETPAN_EXPORT
+int imapdriver_cached_search(mailsession * session,
+    struct mail_search_key * key, clist ** result);
+
 #ifdef __cplusplus
 }
 #endif
@@ -48,6 +48,7 @@
 #include "mailmessage.h"
 #include "generic_cache.h"
 #include "mail_cache_db.h"
+#include "mailsearchindex.h"
 
 #include <string.h>
 #include <stdlib.h>
@@ -267,14 +268,28 @@ static void generate_key_from_message(char * key, size_t size,
   }
 }
 
-static void build_cache_name(char * filename, size_t size,
-			     mailmessage * msg, char * key)
+static int cache_read(mailmessage * msg, char * key,
+    char ** result, size_t * result_len)
 {
-  char * quoted_mb;
+  struct generic_cache_log * cache;
 
-  quoted_mb = get_cached_session_data(msg)->imap_quoted_mb;
+  cache = get_cached_session_data(msg)->imap_body_cache;
+  if (cache == NULL)
+    return MAIL_ERROR_CACHE_MISS;
 
-  snprintf(filename, size, "%s/%s", quoted_mb, key);
+  return generic_cache_log_read(cache, key, result, result_len);
+}
+
+static void cache_store(mailmessage * msg, char * key,
+    char * content, size_t length)
+{
+  struct generic_cache_log * cache;
+
+  cache = get_cached_session_data(msg)->imap_body_cache;
+  if (cache == NULL)
+    return;
+
+  generic_cache_log_store(cache, key, content, length);
 }
 
 static int imap_initialize(mailmessage * msg_info)
@@ -340,12 +355,28 @@ static void imap_fetch_result_free(mailmessage * msg_info,
   mailmessage_fetch_result_free(get_ancestor(msg_info), msg);
 }
 
+static void index_message(mailmessage * msg_info,
+    const char * message, size_t length)
+{
+  struct mail_search_index * index;
+
+  index = get_cached_session_data(msg_info)->imap_search_index;
+  if ((index == NULL) || (msg_info->msg_uid == NULL))
+    return;
+
+  if ((mail_search_index_get_flags(index, msg_info->msg_uid) &
+          MAIL_SEARCH_INDEX_BODY) != 0)
+    return;
+
+  /* the index is written with the envelopes list */
+  mail_search_index_add_message(index, msg_info->msg_uid, message, length);
+}
+
 static int imap_fetch(mailmessage * msg_info,
 		      char ** result,
 		      size_t * result_len)
 {
   char key[PATH_MAX];
-  char filename[PATH_MAX];
   int r;
   char * str;
   size_t len;
@@ -353,10 +384,10 @@ static int imap_fetch(mailmessage * msg_info,
   generate_key_from_message(key, PATH_MAX,
 			    msg_info, MAILIMAP_MSG_ATT_RFC822);
 
-  build_cache_name(filename, PATH_MAX, msg_info, key);
-
-  r = generic_cache_read(filename, &str, &len);
+  r = cache_read(msg_info, key, &str, &len);
   if (r == MAIL_NO_ERROR) {
+    index_message(msg_info, str, len);
+
     * result = str;
     * result_len = len;
 
@@ -365,8 +396,10 @@ static int imap_fetch(mailmessage * msg_info,
 
   r = mailmessage_fetch(get_ancestor(msg_info),
 			result, result_len);
-  if (r == MAIL_NO_ERROR)
-    generic_cache_store(filename, * result, strlen(* result));
+  if (r == MAIL_NO_ERROR) {
+    cache_store(msg_info, key, * result, strlen(* result));
+    index_message(msg_info, * result, * result_len);
+  }
 
   return r;
 }
@@ -376,7 +409,6 @@ static int imap_fetch_header(mailmessage * msg_info,
 			     size_t * result_len)
 {
   char key[PATH_MAX];
-  char filename[PATH_MAX];
   int r;
   char * str;
   size_t len;
@@ -384,9 +416,7 @@ static int imap_fetch_header(mailmessage * msg_info,
   generate_key_from_message(key, PATH_MAX,
 			    msg_info, MAILIMAP_MSG_ATT_RFC822_HEADER);
 
-  build_cache_name(filename, PATH_MAX, msg_info, key);
-
-  r = generic_cache_read(filename, &str, &len);
+  r = cache_read(msg_info, key, &str, &len);
   if (r == MAIL_NO_ERROR) {
     * result = str;
     * result_len = len;
@@ -397,7 +427,7 @@ static int imap_fetch_header(mailmessage * msg_info,
   r = mailmessage_fetch_header(get_ancestor(msg_info), result,
 			       result_len);
   if (r == MAIL_NO_ERROR)
-    generic_cache_store(filename, * result, * result_len);
+    cache_store(msg_info, key, * result, * result_len);
 
   return r;
 }
@@ -406,7 +436,6 @@ static int imap_fetch_body(mailmessage * msg_info,
 			   char ** result, size_t * result_len)
 {
   char key[PATH_MAX];
-  char filename[PATH_MAX];
   int r;
   char * str;
   size_t len;
@@ -414,9 +443,7 @@ static int imap_fetch_body(mailmessage * msg_info,
   generate_key_from_message(key, PATH_MAX,
 			    msg_info, MAILIMAP_MSG_ATT_RFC822_TEXT);
 
-  build_cache_name(filename, PATH_MAX, msg_info, key);
-
-  r = generic_cache_read(filename, &str, &len);
+  r = cache_read(msg_info, key, &str, &len);
   if (r == MAIL_NO_ERROR) {
     * result = str;
     * result_len = len;
@@ -426,7 +453,7 @@ static int imap_fetch_body(mailmessage * msg_info,
   r = mailmessage_fetch_body(get_ancestor(msg_info), result,
 			     result_len);
   if (r == MAIL_NO_ERROR)
-    generic_cache_store(filename, * result, * result_len);
+    cache_store(msg_info, key, * result, * result_len);
 
   return r;
 }
@@ -474,7 +501,6 @@ static int imap_get_bodystructure(mailmessage * msg_info,
 {
   int r;
   char key[PATH_MAX];
-  char filename[PATH_MAX];
   char * str;
   size_t len;
   
@@ -487,9 +513,7 @@ static int imap_get_bodystructure(mailmessage * msg_info,
   generate_key_from_message(key, PATH_MAX,
       msg_info, MAILIMAP_MSG_ATT_BODYSTRUCTURE);
   
-  build_cache_name(filename, PATH_MAX, msg_info, key);
-  
-  r = generic_cache_read(filename, &str, &len);
+  r = cache_read(msg_info, key, &str, &len);
   if (r == MAIL_NO_ERROR) {
     size_t cur_index;
     struct mailmime * mime;
@@ -512,22 +536,23 @@ static int imap_get_bodystructure(mailmessage * msg_info,
       result);
   if (r == MAIL_NO_ERROR) {
     int col;
-    FILE * f;
+    MMAPString * mmapstr;
     
     msg_info->msg_mime = get_ancestor(msg_info)->msg_mime;
     get_ancestor(msg_info)->msg_mime = NULL;
     
-    f = fopen(filename, "w");
-    if (f == NULL) {
-      return MAIL_ERROR_FILE;
+    mmapstr = mmap_string_new("");
+    if (mmapstr == NULL) {
+      return MAIL_ERROR_MEMORY;
     }
     col = 0;
-    r = mailmime_write(f, &col, msg_info->msg_mime);
+    r = mailmime_write_mem(mmapstr, &col, msg_info->msg_mime);
     if (r != MAILIMF_NO_ERROR) {
-      fclose(f);
+      mmap_string_free(mmapstr);
       return MAIL_ERROR_FILE;
     }
-    fclose(f);
+    cache_store(msg_info, key, mmapstr->str, mmapstr->len);
+    mmap_string_free(mmapstr);
   }
   
   return r;
@@ -538,7 +563,6 @@ static int imap_fetch_section(mailmessage * msg_info,
 			      char ** result, size_t * result_len)
 {
   char key[PATH_MAX];
-  char filename[PATH_MAX];
   int r;
   char * str;
   size_t len;
@@ -546,9 +570,7 @@ static int imap_fetch_section(mailmessage * msg_info,
   generate_key_from_section(key, PATH_MAX,
 			    msg_info, mime, IMAP_SECTION_MESSAGE);
 
-  build_cache_name(filename, PATH_MAX, msg_info, key);
-
-  r = generic_cache_read(filename, &str, &len);
+  r = cache_read(msg_info, key, &str, &len);
   if (r == MAIL_NO_ERROR) {
     * result = str;
     * result_len = len;
@@ -559,7 +581,7 @@ static int imap_fetch_section(mailmessage * msg_info,
   r = mailmessage_fetch_section(get_ancestor(msg_info),
 				mime, result, result_len);
   if (r == MAIL_NO_ERROR)
-    generic_cache_store(filename, * result, * result_len);
+    cache_store(msg_info, key, * result, * result_len);
 
   return r;
 }
@@ -570,7 +592,6 @@ static int imap_fetch_section_header(mailmessage * msg_info,
 				     size_t * result_len)
 {
   char key[PATH_MAX];
-  char filename[PATH_MAX];
   int r;
   char * str;
   size_t len;
@@ -578,9 +599,7 @@ static int imap_fetch_section_header(mailmessage * msg_info,
   generate_key_from_section(key, PATH_MAX,
 			    msg_info, mime, IMAP_SECTION_HEADER);
 
-  build_cache_name(filename, PATH_MAX, msg_info, key);
-
-  r = generic_cache_read(filename, &str, &len);
+  r = cache_read(msg_info, key, &str, &len);
   if (r == MAIL_NO_ERROR) {
     * result = str;
     * result_len = len;
@@ -591,7 +610,7 @@ static int imap_fetch_section_header(mailmessage * msg_info,
   r = mailmessage_fetch_section_header(get_ancestor(msg_info),
 				       mime, result, result_len);
   if (r == MAIL_NO_ERROR)
-    generic_cache_store(filename, * result, * result_len);
+    cache_store(msg_info, key, * result, * result_len);
 
   return r;
 }
@@ -602,7 +621,6 @@ static int imap_fetch_section_mime(mailmessage * msg_info,
 				   size_t * result_len)
 {
   char key[PATH_MAX];
-  char filename[PATH_MAX];
   int r;
   char * str;
   size_t len;
@@ -610,9 +628,7 @@ static int imap_fetch_section_mime(mailmessage * msg_info,
   generate_key_from_section(key, PATH_MAX,
 			    msg_info, mime, IMAP_SECTION_MIME);
 
-  build_cache_name(filename, PATH_MAX, msg_info, key);
-
-  r = generic_cache_read(filename, &str, &len);
+  r = cache_read(msg_info, key, &str, &len);
   if (r == MAIL_NO_ERROR) {
     * result = str;
     * result_len = len;
@@ -623,7 +639,7 @@ static int imap_fetch_section_mime(mailmessage * msg_info,
   r = mailmessage_fetch_section_mime(get_ancestor(msg_info),
 				     mime, result, result_len);
   if (r == MAIL_NO_ERROR)
-    generic_cache_store(filename, * result, * result_len);
+    cache_store(msg_info, key, * result, * result_len);
 
   return r;
 }
@@ -634,7 +650,6 @@ static int imap_fetch_section_body(mailmessage * msg_info,
 				   size_t * result_len)
 {
   char key[PATH_MAX];
-  char filename[PATH_MAX];
   int r;
   char * str;
   size_t len;
@@ -642,9 +657,7 @@ static int imap_fetch_section_body(mailmessage * msg_info,
   generate_key_from_section(key, PATH_MAX,
 			    msg_info, mime, IMAP_SECTION_BODY);
 
-  build_cache_name(filename, PATH_MAX, msg_info, key);
-
-  r = generic_cache_read(filename, &str, &len);
+  r = cache_read(msg_info, key, &str, &len);
   if (r == MAIL_NO_ERROR) {
 
     * result = str;
@@ -656,7 +669,7 @@ static int imap_fetch_section_body(mailmessage * msg_info,
   r = mailmessage_fetch_section_body(get_ancestor(msg_info),
 				     mime, result, result_len);
   if (r == MAIL_NO_ERROR)
-    generic_cache_store(filename, * result, * result_len);
+    cache_store(msg_info, key, * result, * result_len);
 
   return r;
 }
@@ -43,12 +43,21 @@
 #include "imapdriver_tools_private.h"
 #include "imapdriver.h"
 #include "imapdriver_types.h"
+#include "imapdriver_cached_message.h"
 #include "mailimap.h"
 #include "maildriver_tools.h"
 #include "generic_cache.h"
+#include "mailmime_content.h"
+#include "mailmime_types_helper.h"
 
 #include <stdlib.h>
 #include <string.h>
+#include <stdio.h>
+#ifdef WIN32
+#	include "win_etpan.h"
+#else
+#	include <sys/time.h>
+#endif
 
 static int imap_initialize(mailmessage * msg_info);
 
@@ -879,6 +888,13 @@ fetch_imap(mailmessage * msg,
 	text_length =
 	  msg_att_item->att_data.att_static->att_data.att_body_section->sec_length;
       }
+      else if (msg_att_item->att_data.att_static->att_type ==
+	  MAILIMAP_MSG_ATT_BINARY_SECTION) {
+	text = msg_att_item->att_data.att_static->att_data.att_binary_section->sec_body_part;
+	msg_att_item->att_data.att_static->att_data.att_binary_section->sec_body_part = NULL;
+	text_length =
+	  msg_att_item->att_data.att_static->att_data.att_binary_section->sec_length;
+      }
     }
   }
 
@@ -1100,6 +1116,529 @@ static int imap_fetch_section_body(mailmessage * msg_info,
   return MAIL_NO_ERROR;
 }
 
+static int imap_fetch_section_binary(mailmessage * msg_info,
+				     struct mailmime * mime,
+				     char ** result,
+				     size_t * result_len)
+{
+  struct mailimap_section * section;
+  struct mailimap_fetch_att * fetch_att;
+  int r;
+  struct mailimap_fetch_type * fetch_type;
+  char * text;
+  size_t text_length;
+  struct mailmime_section * part;
+
+  r = mailmime_get_section_id(mime, &part);
+  if (r != MAILIMF_NO_ERROR)
+    return maildriver_imf_error_to_mail_error(r);
+
+  r = imap_section_to_imap_section(part, IMAP_SECTION_MESSAGE, &section);
+  mailmime_section_free(part);
+  if (r != MAIL_NO_ERROR)
+    return r;
+
+  fetch_att = mailimap_fetch_att_new_binary_peek_section(section);
+  if (fetch_att == NULL) {
+    mailimap_section_free(section);
+    return MAIL_ERROR_MEMORY;
+  }
+
+  fetch_type = mailimap_fetch_type_new_fetch_att(fetch_att);
+  if (fetch_type == NULL) {
+    mailimap_fetch_att_free(fetch_att);
+    return MAIL_ERROR_MEMORY;
+  }
+
+  r = fetch_imap(msg_info, fetch_type, &text, &text_length);
+
+  mailimap_fetch_type_free(fetch_type);
+
+  if (r != MAIL_NO_ERROR)
+    return r;
+
+  * result = text;
+  * result_len = text_length;
+
+  return MAIL_NO_ERROR;
+}
+
+static int imap_fetch_section_local_decode(mailmessage * msg_info,
+					   struct mailmime * mime,
+					   char ** result,
+					   size_t * result_len)
+{
+  char * text;
+  size_t text_length;
+  char * decoded;
+  size_t decoded_length;
+  size_t cur_token;
+  int encoding;
+  int r;
+
+  r = imap_fetch_section(msg_info, mime, &text, &text_length);
+  if (r != MAIL_NO_ERROR)
+    return r;
+
+  if (mime->mm_mime_fields != NULL)
+    encoding = mailmime_transfer_encoding_get(mime->mm_mime_fields);
+  else
+    encoding = MAILMIME_MECHANISM_8BIT;
+
+  cur_token = 0;
+  r = mailmime_part_parse(text, text_length, &cur_token, encoding,
+      &decoded, &decoded_length);
+  imap_fetch_result_free(msg_info, text);
+  if (r != MAILIMF_NO_ERROR)
+    return maildriver_imf_error_to_mail_error(r);
+
+  * result = decoded;
+  * result_len = decoded_length;
+
+  return MAIL_NO_ERROR;
+}
+
+LIBETPAN_EXPORT
+int imap_fetch_section_decoded(mailmessage * msg_info,
+			       struct mailmime * mime,
+			       char ** result,
+			       size_t * result_len)
+{
+  int r;
+
+  if (msg_info->msg_driver == imap_cached_message_driver)
+    return imap_fetch_section_decoded(msg_info->msg_data, mime,
+        result, result_len);
+
+  if (msg_info->msg_driver != imap_message_driver)
+    return MAIL_ERROR_INVAL;
+
+  if (mime->mm_type != MAILMIME_SINGLE)
+    return MAIL_ERROR_INVAL;
+
+  if ((mime->mm_parent != NULL) &&
+      mailimap_has_extension(get_imap_session(msg_info), "BINARY")) {
+    r = imap_fetch_section_binary(msg_info, mime, result, result_len);
+    /* the server could not decode the part (UNKNOWN-CTE) */
+    if (r != MAIL_ERROR_FETCH)
+      return r;
+  }
+
+  return imap_fetch_section_local_decode(msg_info, mime, result, result_len);
+}
+
+/* ranged fetch of a section */
+
+#define RANGE_DEFAULT_CHUNK_SIZE (64 * 1024)
+#define RANGE_MIN_CHUNK_SIZE (16 * 1024)
+#define RANGE_MAX_CHUNK_SIZE (4 * 1024 * 1024)
+/* duration aimed at for one partial fetch, in milliseconds */
+#define RANGE_TARGET_DURATION 1000
+
+static int64_t get_time_ms(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+
+  return (int64_t) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+LIBETPAN_EXPORT
+struct imap_fetch_range_state * imap_fetch_range_state_new(void)
+{
+  struct imap_fetch_range_state * state;
+
+  state = malloc(sizeof(* state));
+  if (state == NULL)
+    return NULL;
+
+  state->rs_msg_uid = NULL;
+  state->rs_section = NULL;
+  state->rs_offset = 0;
+  state->rs_chunk_size = RANGE_DEFAULT_CHUNK_SIZE;
+  state->rs_complete = 0;
+
+  return state;
+}
+
+LIBETPAN_EXPORT
+void imap_fetch_range_state_free(struct imap_fetch_range_state * state)
+{
+  free(state->rs_section);
+  free(state->rs_msg_uid);
+  free(state);
+}
+
+static int range_state_set(struct imap_fetch_range_state * state,
+    const char * msg_uid, const char * section)
+{
+  char * dup_msg_uid;
+  char * dup_section;
+
+  dup_msg_uid = strdup(msg_uid);
+  if (dup_msg_uid == NULL)
+    goto err;
+
+  dup_section = strdup(section);
+  if (dup_section == NULL)
+    goto free_msg_uid;
+
+  free(state->rs_msg_uid);
+  free(state->rs_section);
+  state->rs_msg_uid = dup_msg_uid;
+  state->rs_section = dup_section;
+  state->rs_offset = 0;
+  state->rs_complete = 0;
+  if (state->rs_chunk_size == 0)
+    state->rs_chunk_size = RANGE_DEFAULT_CHUNK_SIZE;
+
+  return MAIL_NO_ERROR;
+
+ free_msg_uid:
+  free(dup_msg_uid);
+ err:
+  return MAIL_ERROR_MEMORY;
+}
+
+/*
+  the state is stored as text, one value per line:
+  message uid, section, offset, chunk size, complete.
+*/
+
+LIBETPAN_EXPORT
+int imap_fetch_range_state_write(const char * filename,
+    struct imap_fetch_range_state * state)
+{
+  MMAPString * mmapstr;
+  char buf[64];
+  int r;
+  int res;
+
+  mmapstr = mmap_string_new("");
+  if (mmapstr == NULL) {
+    res = MAIL_ERROR_MEMORY;
+    goto err;
+  }
+
+  if (mmap_string_append(mmapstr, state->rs_msg_uid) == NULL) {
+    res = MAIL_ERROR_MEMORY;
+    goto free_mmapstr;
+  }
+  if (mmap_string_append_c(mmapstr, '\n') == NULL) {
+    res = MAIL_ERROR_MEMORY;
+    goto free_mmapstr;
+  }
+  if (mmap_string_append(mmapstr, state->rs_section) == NULL) {
+    res = MAIL_ERROR_MEMORY;
+    goto free_mmapstr;
+  }
+  snprintf(buf, sizeof(buf), "\n%lu\n%lu\n%i\n",
+      (unsigned long) state->rs_offset,
+      (unsigned long) state->rs_chunk_size, state->rs_complete);
+  if (mmap_string_append(mmapstr, buf) == NULL) {
+    res = MAIL_ERROR_MEMORY;
+    goto free_mmapstr;
+  }
+
+  r = generic_cache_store((char *) filename, mmapstr->str, mmapstr->len);
+  if (r != MAIL_NO_ERROR) {
+    res = r;
+    goto free_mmapstr;
+  }
+
+  mmap_string_free(mmapstr);
+
+  return MAIL_NO_ERROR;
+
+ free_mmapstr:
+  mmap_string_free(mmapstr);
+ err:
+  return res;
+}
+
+static char * range_state_next_line(char ** cur, char * end)
+{
+  char * line;
+  char * p;
+
+  line = * cur;
+  for(p = line ; p < end ; p ++)
+    if (* p == '\n')
+      break;
+  if (p == end)
+    return NULL;
+
+  * p = '\0';
+  * cur = p + 1;
+
+  return line;
+}
+
+LIBETPAN_EXPORT
+int imap_fetch_range_state_read(const char * filename,
+    struct imap_fetch_range_state ** result)
+{
+  struct imap_fetch_range_state * state;
+  char * content;
+  size_t content_len;
+  char * cur;
+  char * end;
+  char * msg_uid;
+  char * section;
+  char * offset;
+  char * chunk_size;
+  char * complete;
+  int r;
+  int res;
+
+  r = generic_cache_read((char *) filename, &content, &content_len);
+  if (r != MAIL_NO_ERROR) {
+    res = r;
+    goto err;
+  }
+
+  cur = content;
+  end = content + content_len;
+  msg_uid = range_state_next_line(&cur, end);
+  section = range_state_next_line(&cur, end);
+  offset = range_state_next_line(&cur, end);
+  chunk_size = range_state_next_line(&cur, end);
+  complete = range_state_next_line(&cur, end);
+  if (complete == NULL) {
+    res = MAIL_ERROR_CACHE_MISS;
+    goto free_content;
+  }
+
+  state = imap_fetch_range_state_new();
+  if (state == NULL) {
+    res = MAIL_ERROR_MEMORY;
+    goto free_content;
+  }
+
+  r = range_state_set(state, msg_uid, section);
+  if (r != MAIL_NO_ERROR) {
+    res = r;
+    goto free_state;
+  }
+  state->rs_offset = strtoul(offset, NULL, 10);
+  state->rs_chunk_size = strtoul(chunk_size, NULL, 10);
+  if (state->rs_chunk_size == 0)
+    state->rs_chunk_size = RANGE_DEFAULT_CHUNK_SIZE;
+  state->rs_complete = (int) strtol(complete, NULL, 10);
+
+  mmap_string_unref(content);
+
+  * result = state;
+
+  return MAIL_NO_ERROR;
+
+ free_state:
+  imap_fetch_range_state_free(state);
+ free_content:
+  mmap_string_unref(content);
+ err:
+  return res;
+}
+
+static int section_to_string(struct mailmime_section * part, char ** result)
+{
+  MMAPString * mmapstr;
+  clistiter * cur;
+  char buf[16];
+  char * str;
+
+  mmapstr = mmap_string_new("");
+  if (mmapstr == NULL)
+    return MAIL_ERROR_MEMORY;
+
+  for(cur = clist_begin(part->sec_list) ; cur != NULL ;
+      cur = clist_next(cur)) {
+    snprintf(buf, sizeof(buf), "%s%u",
+        cur == clist_begin(part->sec_list) ? "" : ".",
+        * (uint32_t *) clist_content(cur));
+    if (mmap_string_append(mmapstr, buf) == NULL) {
+      mmap_string_free(mmapstr);
+      return MAIL_ERROR_MEMORY;
+    }
+  }
+
+  str = strdup(mmapstr->str);
+  mmap_string_free(mmapstr);
+  if (str == NULL)
+    return MAIL_ERROR_MEMORY;
+
+  * result = str;
+
+  return MAIL_NO_ERROR;
+}
+
+/*
+  estimates the size of the next partial fetch from the throughput
+  measured on the last one.
+*/
+
+static size_t range_next_chunk_size(size_t chunk_size,
+    size_t length, int64_t duration)
+{
+  uint64_t estimate;
+
+  if (duration <= 0)
+    duration = 1;
+
+  estimate = (uint64_t) length * RANGE_TARGET_DURATION / duration;
+  /* smooth the variations of the link */
+  estimate = (estimate + chunk_size) / 2;
+  /* a short fetch is not precise enough to grow faster */
+  if (estimate > (uint64_t) chunk_size * 4)
+    estimate = (uint64_t) chunk_size * 4;
+
+  if (estimate < RANGE_MIN_CHUNK_SIZE)
+    estimate = RANGE_MIN_CHUNK_SIZE;
+  if (estimate > RANGE_MAX_CHUNK_SIZE)
+    estimate = RANGE_MAX_CHUNK_SIZE;
+
+  return (size_t) estimate;
+}
+
+static int imap_fetch_section_partial(mailmessage * msg_info,
+    struct mailmime_section * part, size_t offset, size_t size,
+    char ** result, size_t * result_len)
+{
+  struct mailimap_section * section;
+  struct mailimap_fetch_att * fetch_att;
+  struct mailimap_fetch_type * fetch_type;
+  int r;
+
+  if (clist_begin(part->sec_list) == NULL) {
+    section = mailimap_section_new(NULL);
+    if (section == NULL)
+      return MAIL_ERROR_MEMORY;
+  }
+  else {
+    r = imap_section_to_imap_section(part, IMAP_SECTION_MESSAGE, &section);
+    if (r != MAIL_NO_ERROR)
+      return r;
+  }
+
+  fetch_att = mailimap_fetch_att_new_body_peek_section_partial(section,
+      (uint32_t) offset, (uint32_t) size);
+  if (fetch_att == NULL) {
+    mailimap_section_free(section);
+    return MAIL_ERROR_MEMORY;
+  }
+
+  fetch_type = mailimap_fetch_type_new_fetch_att(fetch_att);
+  if (fetch_type == NULL) {
+    mailimap_fetch_att_free(fetch_att);
+    return MAIL_ERROR_MEMORY;
+  }
+
+  r = fetch_imap(msg_info, fetch_type, result, result_len);
+
+  mailimap_fetch_type_free(fetch_type);
+
+  return r;
+}
+
+LIBETPAN_EXPORT
+int imap_fetch_section_ranged(mailmessage * msg_info,
+    struct mailmime * mime,
+    struct imap_fetch_range_state * state,
+    const char * state_filename,
+    imap_fetch_sink * sink, void * sink_context)
+{
+  struct mailmime_section * part;
+  char * section_str;
+  int r;
+  int res;
+
+  if (msg_info->msg_driver == imap_cached_message_driver)
+    return imap_fetch_section_ranged(msg_info->msg_data, mime,
+        state, state_filename, sink, sink_context);
+
+  if (msg_info->msg_driver != imap_message_driver)
+    return MAIL_ERROR_INVAL;
+
+  if (msg_info->msg_uid == NULL)
+    return MAIL_ERROR_INVAL;
+
+  r = mailmime_get_section_id(mime, &part);
+  if (r != MAILIMF_NO_ERROR) {
+    res = maildriver_imf_error_to_mail_error(r);
+    goto err;
+  }
+
+  r = section_to_string(part, &section_str);
+  if (r != MAIL_NO_ERROR) {
+    res = r;
+    goto free_part;
+  }
+
+  /* the saved offset is only valid for the same part of the same message */
+  if ((state->rs_msg_uid == NULL) || (state->rs_section == NULL) ||
+      (strcmp(state->rs_msg_uid, msg_info->msg_uid) != 0) ||
+      (strcmp(state->rs_section, section_str) != 0)) {
+    r = range_state_set(state, msg_info->msg_uid, section_str);
+    if (r != MAIL_NO_ERROR) {
+      res = r;
+      goto free_section_str;
+    }
+  }
+
+  while (!state->rs_complete) {
+    char * text;
+    size_t text_length;
+    size_t chunk_size;
+    int64_t start;
+    int64_t duration;
+
+    chunk_size = state->rs_chunk_size;
+    start = get_time_ms();
+    r = imap_fetch_section_partial(msg_info, part, state->rs_offset,
+        chunk_size, &text, &text_length);
+    if (r != MAIL_NO_ERROR) {
+      res = r;
+      goto free_section_str;
+    }
+    duration = get_time_ms() - start;
+
+    r = sink(text, text_length, sink_context);
+    imap_fetch_result_free(msg_info, text);
+    if (r != MAIL_NO_ERROR) {
+      res = r;
+      goto free_section_str;
+    }
+
+    state->rs_offset += text_length;
+    if (text_length < chunk_size)
+      state->rs_complete = 1;
+    else
+      state->rs_chunk_size = range_next_chunk_size(chunk_size,
+          text_length, duration);
+
+    if (state_filename != NULL) {
+      r = imap_fetch_range_state_write(state_filename, state);
+      if (r != MAIL_NO_ERROR) {
+        res = r;
+        goto free_section_str;
+      }
+    }
+  }
+
+  free(section_str);
+  mailmime_section_free(part);
+
+  return MAIL_NO_ERROR;
+
+ free_section_str:
+  free(section_str);
+ free_part:
+  mailmime_section_free(part);
+ err:
+  return res;
+}
+
 static int imap_get_flags(mailmessage * msg_info,
 			  struct mail_flags ** result)
 {
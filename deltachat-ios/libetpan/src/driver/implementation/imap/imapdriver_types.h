@@ -43,6 +43,7 @@
 #include <libetpan/maildriver_types.h>
 #include <libetpan/generic_cache_types.h>
 #include <libetpan/mailstorage_types.h>
+#include <libetpan/mailsearchindex.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -71,7 +72,9 @@ enum {
   IMAPDRIVER_CACHED_SET_SSL_CALLBACK = 1,
   IMAPDRIVER_CACHED_SET_SSL_CALLBACK_DATA = 2,
   /* cache */
-  IMAPDRIVER_CACHED_SET_CACHE_DIRECTORY = 1001
+  IMAPDRIVER_CACHED_SET_CACHE_DIRECTORY = 1001,
+  /* value is a pointer to an int, non-zero to keep a search index */
+  IMAPDRIVER_CACHED_SET_SEARCH_INDEX = 1002
 };
 
 struct imap_cached_session_state_data {
@@ -80,6 +83,9 @@ struct imap_cached_session_state_data {
   char imap_cache_directory[PATH_MAX];
   carray * imap_uid_list;
   uint32_t imap_uidvalidity;
+  int imap_search_index_enabled;
+  struct mail_search_index * imap_search_index;
+  struct generic_cache_log * imap_body_cache;
 };
 
 
@@ -58,12 +58,16 @@ static int
 imap_mailstorage_get_folder_session(struct mailstorage * storage,
     char * pathname, mailsession ** result);
 static void imap_mailstorage_uninitialize(struct mailstorage * storage);
+static int
+imap_mailstorage_folder_has_own_session(struct mailstorage * storage,
+    char * pathname);
 
 static mailstorage_driver imap_mailstorage_driver = {
-  /* sto_name               */ "imap",
-  /* sto_connect            */ imap_mailstorage_connect,
-  /* sto_get_folder_session */ imap_mailstorage_get_folder_session,
-  /* sto_uninitialize       */ imap_mailstorage_uninitialize
+  /* sto_name                   */ "imap",
+  /* sto_connect                */ imap_mailstorage_connect,
+  /* sto_get_folder_session     */ imap_mailstorage_get_folder_session,
+  /* sto_uninitialize           */ imap_mailstorage_uninitialize,
+  /* sto_folder_has_own_session */ imap_mailstorage_folder_has_own_session
 };
 
 LIBETPAN_EXPORT
@@ -440,6 +444,15 @@ static int imap_mailstorage_connect(struct mailstorage * storage)
   return res;
 }
 
+/* INBOX uses the session of the storage */
+
+static int
+imap_mailstorage_folder_has_own_session(struct mailstorage * storage,
+    char * pathname)
+{
+  return (strcasecmp(pathname, "INBOX") != 0);
+}
+
 static int
 imap_mailstorage_get_folder_session(struct mailstorage * storage,
     char * pathname, mailsession ** result)
@@ -448,7 +461,7 @@ imap_mailstorage_get_folder_session(struct mailstorage * storage,
   int r;
   int res;
 
-  if (strcasecmp(pathname, "INBOX") == 0) {
+  if (!imap_mailstorage_folder_has_own_session(storage, pathname)) {
     session = storage->sto_session;
   }
   else {
@@ -58,10 +58,11 @@ maildir_mailstorage_get_folder_session(struct mailstorage * storage,
 static void maildir_mailstorage_uninitialize(struct mailstorage * storage);
 
 static mailstorage_driver maildir_mailstorage_driver = {
-  /* sto_name               */ "maildir",
-  /* sto_connect            */ maildir_mailstorage_connect,
-  /* sto_get_folder_session */ maildir_mailstorage_get_folder_session,
-  /* sto_uninitialize       */ maildir_mailstorage_uninitialize
+  /* sto_name                   */ "maildir",
+  /* sto_connect                */ maildir_mailstorage_connect,
+  /* sto_get_folder_session     */ maildir_mailstorage_get_folder_session,
+  /* sto_uninitialize           */ maildir_mailstorage_uninitialize,
+  /* sto_folder_has_own_session */ NULL
 };
 
 LIBETPAN_EXPORT
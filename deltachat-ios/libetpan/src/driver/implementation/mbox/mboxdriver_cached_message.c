@@ -139,7 +139,7 @@ static int mbox_prefetch(mailmessage * msg_info)
   char * msg_content;
   size_t msg_length;
 
-  r = mboxdriver_fetch_msg(get_ancestor_session(msg_info),
+  r = mboxdriver_fetch_msg_mapped(get_ancestor_session(msg_info),
       msg_info->msg_index,
       &msg_content, &msg_length);
   if (r != MAIL_NO_ERROR)
@@ -114,7 +114,7 @@ static int mbox_prefetch(mailmessage * msg_info)
   char * msg_content;
   size_t msg_length;
 
-  r = mboxdriver_fetch_msg(msg_info->msg_session, msg_info->msg_index,
+  r = mboxdriver_fetch_msg_mapped(msg_info->msg_session, msg_info->msg_index,
 			   &msg_content, &msg_length);
   if (r != MAIL_NO_ERROR)
     return r;
@@ -149,6 +149,28 @@ int mboxdriver_fetch_msg(mailsession * session, uint32_t indx,
   return MAIL_NO_ERROR;
 }
 
+int mboxdriver_fetch_msg_mapped(mailsession * session, uint32_t indx,
+    char ** result, size_t * result_len)
+{
+  int r;
+  char * msg_content;
+  size_t msg_length;
+  struct mailmbox_folder * folder;
+
+  folder = session_get_mbox_session(session);
+  if (folder == NULL)
+    return MAIL_ERROR_BAD_STATE;
+
+  r = mailmbox_fetch_msg_mapped(folder, indx, &msg_content, &msg_length);
+  if (r != MAILMBOX_NO_ERROR)
+    return mboxdriver_mbox_error_to_mail_error(r);
+
+  * result = msg_content;
+  * result_len = msg_length;
+
+  return MAIL_NO_ERROR;
+}
+
 
 int mboxdriver_fetch_size(mailsession * session, uint32_t indx,
 			  size_t * result)
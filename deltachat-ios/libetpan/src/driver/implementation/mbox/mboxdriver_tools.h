@@ -50,6 +50,15 @@ int mboxdriver_mbox_error_to_mail_error(int error);
 int mboxdriver_fetch_msg(mailsession * session, uint32_t indx,
 			 char ** result, size_t * result_len);
 
+/*
+  the message of mboxdriver_fetch_msg_mapped() can point into the
+  mapping of the mailbox, it is not terminated by '\0' and is only
+  used for the prefetched message.
+*/
+
+int mboxdriver_fetch_msg_mapped(mailsession * session, uint32_t indx,
+    char ** result, size_t * result_len);
+
 int mboxdriver_fetch_size(mailsession * session, uint32_t indx,
 			  size_t * result);
 
@@ -57,10 +57,11 @@ mbox_mailstorage_get_folder_session(struct mailstorage * storage,
 static void mbox_mailstorage_uninitialize(struct mailstorage * storage);
 
 static mailstorage_driver mbox_mailstorage_driver = {
-  /* sto_name               */ "mbox",
-  /* sto_connect            */ mbox_mailstorage_connect,
-  /* sto_get_folder_session */ mbox_mailstorage_get_folder_session,
-  /* sto_uninitialize       */ mbox_mailstorage_uninitialize
+  /* sto_name                   */ "mbox",
+  /* sto_connect                */ mbox_mailstorage_connect,
+  /* sto_get_folder_session     */ mbox_mailstorage_get_folder_session,
+  /* sto_uninitialize           */ mbox_mailstorage_uninitialize,
+  /* sto_folder_has_own_session */ NULL
 };
 
 LIBETPAN_EXPORT
@@ -54,10 +54,11 @@ static int mh_mailstorage_get_folder_session(struct mailstorage * storage,
 static void mh_mailstorage_uninitialize(struct mailstorage * storage);
 
 static mailstorage_driver mh_mailstorage_driver = {
-  /* sto_name               */ "mh",
-  /* sto_connect            */ mh_mailstorage_connect,
-  /* sto_get_folder_session */ mh_mailstorage_get_folder_session,
-  /* sto_uninitialize       */ mh_mailstorage_uninitialize
+  /* sto_name                   */ "mh",
+  /* sto_connect                */ mh_mailstorage_connect,
+  /* sto_get_folder_session     */ mh_mailstorage_get_folder_session,
+  /* sto_uninitialize           */ mh_mailstorage_uninitialize,
+  /* sto_folder_has_own_session */ NULL
 };
 
 LIBETPAN_EXPORT
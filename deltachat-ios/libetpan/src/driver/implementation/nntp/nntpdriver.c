@@ -650,6 +650,50 @@ static int nntpdriver_append_message_flags(mailsession * session,
 static int xover_resp_to_fields(struct newsnntp_xover_resp_item * item,
 				struct mailimf_fields ** result);
 
+struct envelopes_list_context {
+  struct mailmessage_list * env_list;
+  unsigned int index;
+  uint32_t next_seq;
+};
+
+static int envelopes_list_xover_handler(struct newsnntp_xover_resp_item * item,
+    void * data)
+{
+  struct envelopes_list_context * ctx;
+  struct mailmessage_list * env_list;
+  struct mailimf_fields * fields;
+  int r;
+
+  ctx = data;
+  env_list = ctx->env_list;
+  ctx->next_seq = item->ovr_article + 1;
+
+  while (ctx->index < carray_count(env_list->msg_tab)) {
+    mailmessage * info;
+
+    info = carray_get(env_list->msg_tab, ctx->index);
+
+    if (item->ovr_article == info->msg_index) {
+
+      if (info->msg_fields == NULL) {
+        fields = NULL;
+        r = xover_resp_to_fields(item, &fields);
+        if (r == MAIL_NO_ERROR) {
+          info->msg_fields = fields;
+        }
+        
+        info->msg_size = item->ovr_size;
+
+        ctx->index ++;
+        break;
+      }
+    }
+    
+    ctx->index ++;
+  }
+
+  return NEWSNNTP_NO_ERROR;
+}
 
 static int
 nntpdriver_get_envelopes_list(mailsession * session,
@@ -658,11 +702,10 @@ nntpdriver_get_envelopes_list(mailsession * session,
   newsnntp * nntp;
   int r;
   struct nntp_session_state_data * data;
-  clist * list;
   int done;
-  clistiter * cur;
   uint32_t first_seq;
   unsigned int i;
+  struct envelopes_list_context ctx;
 
   nntp = get_nntp_session(session);
 
@@ -700,183 +743,39 @@ nntpdriver_get_envelopes_list(mailsession * session,
     }
   }
 
-  if (first_seq > data->nntp_group_info->grp_last) {
-    list = NULL;
-  }
-  else {
-    done = FALSE;
-    do {
-      r = newsnntp_xover_range(nntp, first_seq,
-          data->nntp_group_info->grp_last, &list);
-      
-      switch (r) {
-      case NEWSNNTP_ERROR_REQUEST_AUTHORIZATION_USERNAME:
-	r = nntpdriver_authenticate_user(session);
-	if (r != MAIL_NO_ERROR)
-	  return r;
-	break;
-	
-      case NEWSNNTP_WARNING_REQUEST_AUTHORIZATION_PASSWORD:
-	r = nntpdriver_authenticate_password(session);
-	if (r != MAIL_NO_ERROR)
-	  return r;
-	break;
-	
-      case NEWSNNTP_NO_ERROR:
-	done = TRUE;
-	break;
-	
-      default:
-	return nntpdriver_nntp_error_to_mail_error(r);
-      }
-    }
-    while (!done);
-  }
-
-#if 0
-  i = 0;
-  j = 0;
-
-  if (list != NULL) {
-    for(cur = clist_begin(list) ; cur != NULL ; cur = clist_next(cur)) {
-      struct newsnntp_xover_resp_item * item;
-      struct mailimf_fields * fields;
-
-      item = clist_content(cur);
-
-      while (i < carray_count(env_list->msg_tab)) {
-	mailmessage * info;
-
-	info = carray_get(env_list->msg_tab, i);
-
-	if (item->ovr_article == info->msg_index) {
-
-	  if (info->fields == NULL) {
-	    r = xover_resp_to_fields(item, &fields);
-	    if (r == MAIL_NO_ERROR) {
-	      info->fields = fields;
-	    }
-            
-	    info->size = item->ovr_size;
-
-	    carray_set(env_list->msg_tab, j, info);
-	    j ++;
-	    i ++;
-	    break;
-	  }
-	  else {
-	    carray_set(env_list->msg_tab, j, info);
-	    j ++;
-	  }
-	}
-	else {
-	  if (info->fields != NULL) {
-	    carray_set(env_list->msg_tab, j, info);
-	    j ++;
-	  }
-	  else {
-            if (info->flags != NULL) {
-              info->flags->flags &= ~MAIL_FLAG_NEW;
-              info->flags->flags |= MAIL_FLAG_SEEN | MAIL_FLAG_DELETED;
-              mailmessage_check(info);
-            }
-	    mailmessage_free(info);
-	    carray_set(env_list->msg_tab, i, NULL);
-	  }
-	}
-
-	i ++;
-      }
-    }
-  }
+  /* overview lines are matched against the messages as they arrive,
+     the whole range is never held in memory. */
+  ctx.env_list = env_list;
+  ctx.index = 0;
+  ctx.next_seq = first_seq;
 
-  while (i < carray_count(env_list->msg_tab)) {
-    mailmessage * info;
-    
-    info = carray_get(env_list->msg_tab, i);
-    if (info->fields != NULL) {
-      carray_set(env_list->msg_tab, j, info);
-      j ++;
-    }
-    else {
-      if (info->flags != NULL) {
-        info->flags->flags &= ~MAIL_FLAG_NEW;
-        info->flags->flags |= MAIL_FLAG_SEEN | MAIL_FLAG_DELETED;
-        mailmessage_check(info);
-      }
-      mailmessage_free(info);
-      carray_set(env_list->msg_tab, i, NULL);
-    }
-    
-    i ++;
-  }
-
-  r = carray_set_size(env_list->msg_tab, j);
-  if (r < 0) {
-    if (list != NULL)
-      newsnntp_xover_resp_list_free(list);
-    return MAIL_ERROR_MEMORY;
-  }
-#endif
-  i = 0;
-
-  if (list != NULL) {
-    for(cur = clist_begin(list) ; cur != NULL ; cur = clist_next(cur)) {
-      struct newsnntp_xover_resp_item * item;
-      struct mailimf_fields * fields;
-
-      item = clist_content(cur);
-
-      while (i < carray_count(env_list->msg_tab)) {
-	mailmessage * info;
-
-	info = carray_get(env_list->msg_tab, i);
-
-	if (item->ovr_article == info->msg_index) {
-
-	  if (info->msg_fields == NULL) {
-            fields = NULL;
-	    r = xover_resp_to_fields(item, &fields);
-	    if (r == MAIL_NO_ERROR) {
-	      info->msg_fields = fields;
-	    }
-            
-	    info->msg_size = item->ovr_size;
-
-	    i ++;
-	    break;
-	  }
-	}
-#if 0
-	else if ((info->fields == NULL) && (info->flags != NULL)) {
-          info->flags->flags &= ~MAIL_FLAG_NEW;
-          info->flags->flags |= MAIL_FLAG_CANCELLED;
-          mailmessage_check(info);
-	}
-#endif
-        
-	i ++;
-      }
-    }
-  }
-
-#if 0
-  while (i < env_list->msg_tab->len) {
-    mailmessage * info;
-    
-    info = carray_get(env_list->msg_tab, i);
-    if ((info->fields == NULL) && (info->flags != NULL)) {
-      info->flags->flags &= ~MAIL_FLAG_NEW;
-      info->flags->flags |= MAIL_FLAG_CANCELLED;
-      mailmessage_check(info);
+  done = FALSE;
+  while (!done && (ctx.next_seq <= data->nntp_group_info->grp_last)) {
+    r = newsnntp_xover_range_foreach(nntp, ctx.next_seq,
+        data->nntp_group_info->grp_last, 0, 0,
+        envelopes_list_xover_handler, &ctx);
+      
+    switch (r) {
+    case NEWSNNTP_ERROR_REQUEST_AUTHORIZATION_USERNAME:
+      r = nntpdriver_authenticate_user(session);
+      if (r != MAIL_NO_ERROR)
+        return r;
+      break;
+      
+    case NEWSNNTP_WARNING_REQUEST_AUTHORIZATION_PASSWORD:
+      r = nntpdriver_authenticate_password(session);
+      if (r != MAIL_NO_ERROR)
+        return r;
+      break;
+      
+    case NEWSNNTP_NO_ERROR:
+      done = TRUE;
+      break;
+      
+    default:
+      return nntpdriver_nntp_error_to_mail_error(r);
     }
-    
-    i ++;
   }
-#endif
-
-  if (list != NULL)
-    newsnntp_xover_resp_list_free(list);
 
   return MAIL_NO_ERROR;
 }
@@ -241,6 +241,8 @@ static int nntpdriver_cached_initialize(mailsession * session)
   if (data->nntp_ancestor == NULL)
     goto free_store;
 
+  data->nntp_body_cache = NULL;
+
   session->sess_data = data;
 
   return MAIL_NO_ERROR;
@@ -306,6 +308,15 @@ static int nntp_flags_store_process(char * flags_directory, char * group_name,
   return res;
 }
 
+static void
+close_body_cache(struct nntp_cached_session_state_data * cached_data)
+{
+  if (cached_data->nntp_body_cache != NULL) {
+    generic_cache_log_close(cached_data->nntp_body_cache);
+    cached_data->nntp_body_cache = NULL;
+  }
+}
+
 static void nntpdriver_cached_uninitialize(mailsession * session)
 {
   struct nntp_cached_session_state_data * cached_data;
@@ -320,6 +331,8 @@ static void nntpdriver_cached_uninitialize(mailsession * session)
 
   mail_flags_store_free(cached_data->nntp_flags_store); 
 
+  close_body_cache(cached_data);
+
   mailsession_free(cached_data->nntp_ancestor);
   free(cached_data);
   
@@ -402,6 +415,8 @@ static int nntpdriver_cached_select_folder(mailsession * session, const char * m
       ancestor_data->nntp_group_name,
       cached_data->nntp_flags_store);
 
+  close_body_cache(cached_data);
+
   r = mailsession_select_folder(get_ancestor(session), mb);
   if (r != MAIL_NO_ERROR)
     return r;
@@ -418,6 +433,11 @@ static int nntpdriver_cached_select_folder(mailsession * session, const char * m
     goto err;
   }
 
+  /* articles are fetched from the server when the cache can't be used */
+  r = generic_cache_log_open(key, &cached_data->nntp_body_cache);
+  if (r != MAIL_NO_ERROR)
+    cached_data->nntp_body_cache = NULL;
+
   snprintf(key, PATH_MAX, "%s/%s", cached_data->nntp_flags_directory,
       ancestor_data->nntp_group_name);
 
@@ -1006,6 +1026,9 @@ nntpdriver_cached_get_envelopes_list(mailsession * session,
 
   maildriver_message_cache_clean_up(cache_dir, env_list,
       get_uid_from_filename);
+  if (cached_data->nntp_body_cache != NULL)
+    generic_cache_log_clean_up(cached_data->nntp_body_cache, env_list,
+        get_uid_from_filename);
 
   return MAIL_NO_ERROR;
 
@@ -132,26 +132,25 @@ static int nntp_prefetch(mailmessage * msg_info)
   struct generic_message_t * msg;
   int r;
   struct nntp_cached_session_state_data * cached_data;
-  struct nntp_session_state_data * ancestor_data;
-  char filename[PATH_MAX];
+  char key[PATH_MAX];
 
   /* we try the cached message */
 
   cached_data = get_cached_session_data(msg_info);
 
-  ancestor_data = get_ancestor_session_data(msg_info);
+  snprintf(key, PATH_MAX, "%i", msg_info->msg_index);
 
-  snprintf(filename, PATH_MAX, "%s/%s/%i", cached_data->nntp_cache_directory,
-      ancestor_data->nntp_group_name, msg_info->msg_index);
-  
-  r = generic_cache_read(filename, &msg_content, &msg_length);
-  if (r == MAIL_NO_ERROR) {
-    msg = msg_info->msg_data;
+  if (cached_data->nntp_body_cache != NULL) {
+    r = generic_cache_log_read(cached_data->nntp_body_cache, key,
+        &msg_content, &msg_length);
+    if (r == MAIL_NO_ERROR) {
+      msg = msg_info->msg_data;
 
-    msg->msg_message = msg_content;
-    msg->msg_length = msg_length;
+      msg->msg_message = msg_content;
+      msg->msg_length = msg_length;
 
-    return MAIL_NO_ERROR;
+      return MAIL_NO_ERROR;
+    }
   }
 
   /* we get the message through the network */
@@ -165,7 +164,9 @@ static int nntp_prefetch(mailmessage * msg_info)
 
   /* we write the message cache */
 
-  generic_cache_store(filename, msg_content, msg_length);
+  if (cached_data->nntp_body_cache != NULL)
+    generic_cache_log_store(cached_data->nntp_body_cache, key,
+        msg_content, msg_length);
 
   msg = msg_info->msg_data;
 
@@ -240,9 +241,8 @@ static int nntp_fetch_header(mailmessage * msg_info,
   char * headers;
   size_t headers_length;
   struct nntp_cached_session_state_data * cached_data;
-  struct nntp_session_state_data * ancestor_data;
   int r;
-  char filename[PATH_MAX];
+  char key[PATH_MAX];
 
   msg = msg_info->msg_data;
 
@@ -254,18 +254,17 @@ static int nntp_fetch_header(mailmessage * msg_info,
   
   cached_data = get_cached_session_data(msg_info);
 
-  ancestor_data = get_ancestor_session_data(msg_info);
+  snprintf(key, PATH_MAX, "%i-header", msg_info->msg_index);
 
-  snprintf(filename, PATH_MAX, "%s/%s/%i-header",
-      cached_data->nntp_cache_directory,
-      ancestor_data->nntp_group_name, msg_info->msg_index);
+  if (cached_data->nntp_body_cache != NULL) {
+    r = generic_cache_log_read(cached_data->nntp_body_cache, key,
+        &headers, &headers_length);
+    if (r == MAIL_NO_ERROR) {
+      * result = headers;
+      * result_len = headers_length;
 
-  r = generic_cache_read(filename, &headers, &headers_length);
-  if (r == MAIL_NO_ERROR) {
-    * result = headers;
-    * result_len = headers_length;
-
-    return MAIL_NO_ERROR;
+      return MAIL_NO_ERROR;
+    }
   }
 
   /* we get the message through the network */
@@ -277,7 +276,9 @@ static int nntp_fetch_header(mailmessage * msg_info,
 
   /* we write the message cache */
 
-  generic_cache_store(filename, headers, headers_length);
+  if (cached_data->nntp_body_cache != NULL)
+    generic_cache_log_store(cached_data->nntp_body_cache, key,
+        headers, headers_length);
 
   * result = headers;
   * result_len = headers_length;
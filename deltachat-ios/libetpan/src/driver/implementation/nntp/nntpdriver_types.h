@@ -85,6 +85,7 @@ struct nntp_cached_session_state_data {
   char nntp_cache_directory[PATH_MAX];
   char nntp_flags_directory[PATH_MAX];
   struct mail_flags_store * nntp_flags_store;
+  struct generic_cache_log * nntp_body_cache;
 };
 
 
@@ -59,10 +59,11 @@ static int nntp_mailstorage_get_folder_session(struct mailstorage * storage,
 static void nntp_mailstorage_uninitialize(struct mailstorage * storage);
 
 static mailstorage_driver nntp_mailstorage_driver = {
-  /* sto_name               */ "nntp",
-  /* sto_connect            */ nntp_mailstorage_connect,
-  /* sto_get_folder_session */ nntp_mailstorage_get_folder_session,
-  /* sto_uninitialize       */ nntp_mailstorage_uninitialize
+  /* sto_name                   */ "nntp",
+  /* sto_connect                */ nntp_mailstorage_connect,
+  /* sto_get_folder_session     */ nntp_mailstorage_get_folder_session,
+  /* sto_uninitialize           */ nntp_mailstorage_uninitialize,
+  /* sto_folder_has_own_session */ NULL
 };
 
 LIBETPAN_EXPORT
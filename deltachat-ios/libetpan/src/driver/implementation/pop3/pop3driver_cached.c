@@ -225,6 +225,8 @@ static int pop3driver_cached_initialize(mailsession * session)
   if (data->pop3_flags_hash == NULL)
     goto free_session;
 
+  data->pop3_body_cache = NULL;
+
   session->sess_data = data;
 
   return MAIL_NO_ERROR;
@@ -300,6 +302,9 @@ static void pop3driver_cached_uninitialize(mailsession * session)
 
   mail_flags_store_free(data->pop3_flags_store); 
 
+  if (data->pop3_body_cache != NULL)
+    generic_cache_log_close(data->pop3_body_cache);
+
   chash_free(data->pop3_flags_hash);
   mailsession_free(data->pop3_ancestor);
   free(data);
@@ -336,6 +341,14 @@ static int pop3driver_cached_parameters(mailsession * session,
     if (r != MAIL_NO_ERROR)
       return r;
 
+    /* messages are fetched from the server when the cache can't be used */
+    if (data->pop3_body_cache != NULL)
+      generic_cache_log_close(data->pop3_body_cache);
+    r = generic_cache_log_open(data->pop3_cache_directory,
+        &data->pop3_body_cache);
+    if (r != MAIL_NO_ERROR)
+      data->pop3_body_cache = NULL;
+
     return MAIL_NO_ERROR;
 
   case POP3DRIVER_CACHED_SET_FLAGS_DIRECTORY:
@@ -858,6 +871,9 @@ pop3driver_cached_get_envelopes_list(mailsession * session,
   
   maildriver_message_cache_clean_up(cached_data->pop3_cache_directory,
       env_list, get_uid_from_filename);
+  if (cached_data->pop3_body_cache != NULL)
+    generic_cache_log_clean_up(cached_data->pop3_body_cache,
+        env_list, get_uid_from_filename);
   
   return MAIL_NO_ERROR;
 
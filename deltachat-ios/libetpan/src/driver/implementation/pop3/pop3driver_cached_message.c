@@ -133,23 +133,22 @@ static int pop3_prefetch(mailmessage * msg_info)
   struct generic_message_t * msg;
   int r;
   struct pop3_cached_session_state_data * cached_data;
-  char filename[PATH_MAX];
 
   /* we try the cached message */
 
   cached_data = get_cached_session_data(msg_info);
 
-  snprintf(filename, PATH_MAX, "%s/%s",
-	   cached_data->pop3_cache_directory, msg_info->msg_uid);
+  if (cached_data->pop3_body_cache != NULL) {
+    r = generic_cache_log_read(cached_data->pop3_body_cache,
+        msg_info->msg_uid, &msg_content, &msg_length);
+    if (r == MAIL_NO_ERROR) {
+      msg = msg_info->msg_data;
 
-  r = generic_cache_read(filename, &msg_content, &msg_length);
-  if (r == MAIL_NO_ERROR) {
-    msg = msg_info->msg_data;
+      msg->msg_message = msg_content;
+      msg->msg_length = msg_length;
 
-    msg->msg_message = msg_content;
-    msg->msg_length = msg_length;
-
-    return MAIL_NO_ERROR;
+      return MAIL_NO_ERROR;
+    }
   }
 
   /* we get the message through the network */
@@ -161,7 +160,9 @@ static int pop3_prefetch(mailmessage * msg_info)
 
   /* we write the message cache */
 
-  generic_cache_store(filename, msg_content, msg_length);
+  if (cached_data->pop3_body_cache != NULL)
+    generic_cache_log_store(cached_data->pop3_body_cache,
+        msg_info->msg_uid, msg_content, msg_length);
 
   msg = msg_info->msg_data;
 
@@ -245,7 +246,7 @@ static int pop3_fetch_header(mailmessage * msg_info,
   size_t headers_length;
   int r;
   struct pop3_cached_session_state_data * cached_data;
-  char filename[PATH_MAX];
+  char key[PATH_MAX];
 
   msg = msg_info->msg_data;
 
@@ -257,15 +258,17 @@ static int pop3_fetch_header(mailmessage * msg_info,
 
   cached_data = get_cached_session_data(msg_info);
 
-  snprintf(filename, PATH_MAX, "%s/%s-header",
-	   cached_data->pop3_cache_directory, msg_info->msg_uid);
+  snprintf(key, PATH_MAX, "%s-header", msg_info->msg_uid);
 
-  r = generic_cache_read(filename, &headers, &headers_length);
-  if (r == MAIL_NO_ERROR) {
-    * result = headers;
-    * result_len = headers_length;
+  if (cached_data->pop3_body_cache != NULL) {
+    r = generic_cache_log_read(cached_data->pop3_body_cache, key,
+        &headers, &headers_length);
+    if (r == MAIL_NO_ERROR) {
+      * result = headers;
+      * result_len = headers_length;
 
-    return MAIL_NO_ERROR;
+      return MAIL_NO_ERROR;
+    }
   }
 
   /* we get the message trough the network */
@@ -275,7 +278,9 @@ static int pop3_fetch_header(mailmessage * msg_info,
   if (r != MAIL_NO_ERROR)
     return r;
   
-  generic_cache_store(filename, headers, headers_length);
+  if (cached_data->pop3_body_cache != NULL)
+    generic_cache_log_store(cached_data->pop3_body_cache, key,
+        headers, headers_length);
 
   * result = headers;
   * result_len = headers_length;
@@ -87,6 +87,7 @@ struct pop3_cached_session_state_data {
   chash * pop3_flags_hash;
   carray * pop3_flags_array;
   struct mail_flags_store * pop3_flags_store;
+  struct generic_cache_log * pop3_body_cache;
 };
 
 /* pop3 storage */
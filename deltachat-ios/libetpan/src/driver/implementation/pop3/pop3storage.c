@@ -57,10 +57,11 @@ static int pop3_mailstorage_get_folder_session(struct mailstorage * storage,
 static void pop3_mailstorage_uninitialize(struct mailstorage * storage);
 
 static mailstorage_driver pop3_mailstorage_driver = {
-  /* sto_name               */ "pop3",
-  /* sto_connect            */ pop3_mailstorage_connect,
-  /* sto_get_folder_session */ pop3_mailstorage_get_folder_session,
-  /* sto_uninitialize       */ pop3_mailstorage_uninitialize
+  /* sto_name                   */ "pop3",
+  /* sto_connect                */ pop3_mailstorage_connect,
+  /* sto_get_folder_session     */ pop3_mailstorage_get_folder_session,
+  /* sto_uninitialize           */ pop3_mailstorage_uninitialize,
+  /* sto_folder_has_own_session */ NULL
 };
 
 LIBETPAN_EXPORT
@@ -57,6 +57,8 @@
 #include "mailstream.h"
 #include "mailmime.h"
 #include "mail_cache_db.h"
+#include "generic_cache.h"
+#include "mailsearchindex.h"
 
 /* ********************************************************************* */
 /* tools */
@@ -765,6 +767,16 @@ int maildriver_message_cache_clean_up(char * cache_dir,
     if (strstr(ent->d_name, ".db") != NULL)
       continue;
     
+    /* the entries of the cache log are cleaned up by the log */
+    if (strncmp(ent->d_name, GENERIC_CACHE_LOG_PREFIX,
+            strlen(GENERIC_CACHE_LOG_PREFIX)) == 0)
+      continue;
+    
+    /* the search index and its temporary file are not message entries */
+    if (strncmp(ent->d_name, MAIL_SEARCH_INDEX_NAME,
+            strlen(MAIL_SEARCH_INDEX_NAME)) == 0)
+      continue;
+    
     strncpy(keyname, ent->d_name, sizeof(keyname));
     keyname[sizeof(keyname) - 1] = '\0';
     
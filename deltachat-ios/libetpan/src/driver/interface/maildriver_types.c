@@ -114,7 +114,7 @@ int32_t mailimf_date_time_comp(struct mailimf_date_time * date1,
 
 
 
-#if 0
+LIBETPAN_EXPORT
 struct mail_search_key *
 mail_search_key_new(int sk_type,
 		    char * sk_bcc,
@@ -166,6 +166,7 @@ mail_search_key_new(int sk_type,
 }
 
 
+LIBETPAN_EXPORT
 void mail_search_key_free(struct mail_search_key * key)
 {
   if (key->sk_bcc)
@@ -206,7 +207,7 @@ void mail_search_key_free(struct mail_search_key * key)
   free(key);
 }
 
-
+#if 0
 struct mail_search_result * mail_search_result_new(clist * list)
 {
   struct mail_search_result * search_result;
@@ -257,32 +257,30 @@ enum {
   - multiple is a set of message when type is MAILIMAP_SEARCH_KEY_MULTIPLE
 */
 
-#if 0
 struct mail_search_key {
   int sk_type;
-  union {
-    char * sk_bcc;
-    struct mailimf_date_time * sk_before;
-    char * sk_body;
-    char * sk_cc;
-    char * sk_from;
-    struct mailimf_date_time * sk_on;
-    struct mailimf_date_time * sk_since;
-    char * sk_subject;
-    char * sk_text;
-    char * sk_to;
-    char * sk_header_name;
-    char * sk_header_value;
-    size_t sk_larger;
-    struct mail_search_key * sk_not;
-    struct mail_search_key * sk_or1;
-    struct mail_search_key * sk_or2;
-    size_t sk_smaller;
-    clist * sk_multiple; /* list of (struct mailimap_search_key *) */
-  } sk_data;
+  char * sk_bcc;
+  struct mailimf_date_time * sk_before;
+  char * sk_body;
+  char * sk_cc;
+  char * sk_from;
+  struct mailimf_date_time * sk_on;
+  struct mailimf_date_time * sk_since;
+  char * sk_subject;
+  char * sk_text;
+  char * sk_to;
+  char * sk_header_name;
+  char * sk_header_value;
+  size_t sk_larger;
+  struct mail_search_key * sk_not;
+  struct mail_search_key * sk_or1;
+  struct mail_search_key * sk_or2;
+  size_t sk_smaller;
+  clist * sk_multiple; /* list of (struct mail_search_key *) */
 };
 
 
+LIBETPAN_EXPORT
 struct mail_search_key *
 mail_search_key_new(int sk_type,
     char * sk_bcc, struct mailimf_date_time * sk_before,
@@ -294,8 +292,8 @@ mail_search_key_new(int sk_type,
     struct mail_search_key * sk_or2, size_t sk_smaller,
     clist * sk_multiple);
 
+LIBETPAN_EXPORT
 void mail_search_key_free(struct mail_search_key * key);
-#endif
 
 /*
   mail_search_result is a list of message numbers that is returned
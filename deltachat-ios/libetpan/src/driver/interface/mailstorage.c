@@ -43,9 +43,17 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 static int mailstorage_get_folder(struct mailstorage * storage,
     char * pathname, mailsession ** result);
+static int mailstorage_folder_has_own_session(struct mailstorage * storage,
+    char * pathname);
+static int pool_get_session(struct mailstorage * storage,
+    const char * pathname, mailsession ** result);
+static int pool_put_session(struct mailstorage * storage,
+    const char * pathname, mailsession * session);
+static void pool_flush(struct mailstorage * storage);
 
 LIBETPAN_EXPORT
 struct mailfolder * mailfolder_new(struct mailstorage * storage,
@@ -159,11 +167,22 @@ int mailfolder_connect(struct mailfolder * folder)
     return MAIL_NO_ERROR;
   }
   
-  r = mailstorage_get_folder(folder->fld_storage, folder->fld_pathname,
-      &session);
-  if (r != MAIL_NO_ERROR) {
-    res = r;
-    goto err;
+  session = NULL;
+  if (mailstorage_folder_has_own_session(folder->fld_storage,
+          folder->fld_pathname)) {
+    r = pool_get_session(folder->fld_storage, folder->fld_pathname, &session);
+    if (r != MAIL_NO_ERROR) {
+      res = r;
+      goto err;
+    }
+  }
+  if (session == NULL) {
+    r = mailstorage_get_folder(folder->fld_storage, folder->fld_pathname,
+        &session);
+    if (r != MAIL_NO_ERROR) {
+      res = r;
+      goto err;
+    }
   }
   folder->fld_session = session;
   folder->fld_shared_session = (session == folder->fld_storage->sto_session);
@@ -183,8 +202,7 @@ err:
   return res;
 }
 
-LIBETPAN_EXPORT
-void mailfolder_disconnect(struct mailfolder * folder)
+static void folder_disconnect(struct mailfolder * folder, int use_pool)
 {
   if (folder->fld_session == NULL)
     return;
@@ -194,13 +212,33 @@ void mailfolder_disconnect(struct mailfolder * folder)
     folder->fld_pos = NULL;
   }
   else {
-    mailsession_logout(folder->fld_session);
-    mailsession_free(folder->fld_session);
+    int r;
+    
+    r = MAIL_ERROR_INVAL;
+    if (use_pool)
+      r = pool_put_session(folder->fld_storage, folder->fld_pathname,
+          folder->fld_session);
+    if (r != MAIL_NO_ERROR) {
+      mailsession_logout(folder->fld_session);
+      mailsession_free(folder->fld_session);
+    }
   }
 
   folder->fld_session = NULL;
 }
 
+LIBETPAN_EXPORT
+void mailfolder_disconnect(struct mailfolder * folder)
+{
+  folder_disconnect(folder, 1);
+}
+
+LIBETPAN_EXPORT
+void mailfolder_drop_session(struct mailfolder * folder)
+{
+  folder_disconnect(folder, 0);
+}
+
 LIBETPAN_EXPORT
 int mailfolder_add_child(struct mailfolder * parent,
     struct mailfolder * child)
@@ -268,6 +306,9 @@ struct mailstorage * mailstorage_new(const char * sto_id)
   storage->sto_shared_folders = clist_new();
   if (storage->sto_shared_folders == NULL)
     goto free_id;
+  storage->sto_pool = NULL;
+  storage->sto_pool_max_size = 0;
+  storage->sto_pool_idle_timeout = 0;
 
   return storage;
 
@@ -285,6 +326,9 @@ void mailstorage_free(struct mailstorage * storage)
 {
   if (storage->sto_session != NULL)
     mailstorage_disconnect(storage);
+  pool_flush(storage);
+  if (storage->sto_pool != NULL)
+    carray_free(storage->sto_pool);
   
   if (storage->sto_driver != NULL) {
     if (storage->sto_driver->sto_uninitialize != NULL)
@@ -327,6 +371,8 @@ void mailstorage_disconnect(struct mailstorage * storage)
     mailfolder_disconnect(folder);
   }
 
+  pool_flush(storage);
+
   if (storage->sto_session == NULL)
     return;
 
@@ -353,3 +399,244 @@ static int mailstorage_get_folder(struct mailstorage * storage,
   return storage->sto_driver->sto_get_folder_session(storage,
       pathname, result);
 }
+
+
+/* folders that use the session of the storage are never pooled */
+
+static int mailstorage_folder_has_own_session(struct mailstorage * storage,
+    char * pathname)
+{
+  if (pathname == NULL)
+    return 0;
+  if (storage->sto_driver->sto_folder_has_own_session == NULL)
+    return 0;
+
+  return storage->sto_driver->sto_folder_has_own_session(storage, pathname);
+}
+
+
+/* pool of sessions */
+
+/* INBOX is case-insensitive, the other names are not */
+
+static int pool_same_folder(const char * pathname1, const char * pathname2)
+{
+  if ((strcasecmp(pathname1, "INBOX") == 0) &&
+      (strcasecmp(pathname2, "INBOX") == 0))
+    return 1;
+
+  return (strcmp(pathname1, pathname2) == 0);
+}
+
+struct mailstorage_pool_item {
+  mailsession * session;
+  char * pathname;
+  time_t last_used;
+};
+
+static void pool_item_close(struct mailstorage_pool_item * item)
+{
+  mailsession_logout(item->session);
+  mailsession_free(item->session);
+  free(item->pathname);
+  free(item);
+}
+
+static void pool_flush(struct mailstorage * storage)
+{
+  if (storage->sto_pool == NULL)
+    return;
+
+  while (carray_count(storage->sto_pool) > 0) {
+    pool_item_close(carray_get(storage->sto_pool, 0));
+    carray_delete_slow(storage->sto_pool, 0);
+  }
+}
+
+LIBETPAN_EXPORT
+void mailstorage_pool_evict(struct mailstorage * storage)
+{
+  time_t now;
+  unsigned int i;
+
+  if (storage->sto_pool == NULL)
+    return;
+
+  now = time(NULL);
+  i = 0;
+  while (i < carray_count(storage->sto_pool)) {
+    struct mailstorage_pool_item * item;
+
+    item = carray_get(storage->sto_pool, i);
+    if ((storage->sto_pool_idle_timeout != 0) &&
+        (now - item->last_used > storage->sto_pool_idle_timeout)) {
+      pool_item_close(item);
+      carray_delete_slow(storage->sto_pool, i);
+    }
+    else {
+      i ++;
+    }
+  }
+}
+
+LIBETPAN_EXPORT
+void mailstorage_set_pool(struct mailstorage * storage,
+    unsigned int max_size, time_t idle_timeout)
+{
+  storage->sto_pool_max_size = max_size;
+  storage->sto_pool_idle_timeout = idle_timeout;
+
+  if (storage->sto_pool == NULL)
+    return;
+
+  while (carray_count(storage->sto_pool) > max_size) {
+    pool_item_close(carray_get(storage->sto_pool, 0));
+    carray_delete_slow(storage->sto_pool, 0);
+  }
+}
+
+static int pool_put_session(struct mailstorage * storage,
+    const char * pathname, mailsession * session)
+{
+  struct mailstorage_pool_item * item;
+  int r;
+
+  if (storage->sto_pool_max_size == 0)
+    return MAIL_ERROR_INVAL;
+
+  if (storage->sto_pool == NULL) {
+    storage->sto_pool = carray_new(storage->sto_pool_max_size);
+    if (storage->sto_pool == NULL)
+      goto err;
+  }
+
+  mailstorage_pool_evict(storage);
+
+  item = malloc(sizeof(* item));
+  if (item == NULL)
+    goto err;
+
+  item->pathname = NULL;
+  if (pathname != NULL) {
+    item->pathname = strdup(pathname);
+    if (item->pathname == NULL)
+      goto free_item;
+  }
+  item->session = session;
+  item->last_used = time(NULL);
+
+  /* the least recently used session makes room for the new one */
+  if (carray_count(storage->sto_pool) >= storage->sto_pool_max_size) {
+    pool_item_close(carray_get(storage->sto_pool, 0));
+    carray_delete_slow(storage->sto_pool, 0);
+  }
+
+  r = carray_add(storage->sto_pool, item, NULL);
+  if (r < 0)
+    goto free_pathname;
+
+  return MAIL_NO_ERROR;
+
+ free_pathname:
+  free(item->pathname);
+ free_item:
+  free(item);
+ err:
+  return MAIL_ERROR_MEMORY;
+}
+
+/* takes the session out of the pool if it can be used for the folder */
+
+static int pool_take_session(struct mailstorage * storage, unsigned int indx,
+    const char * pathname, mailsession ** result)
+{
+  struct mailstorage_pool_item * item;
+  int r;
+
+  item = carray_get(storage->sto_pool, indx);
+
+  if ((item->pathname != NULL) && pool_same_folder(item->pathname, pathname)) {
+    r = mailsession_noop(item->session);
+    if (r == MAIL_ERROR_NOT_IMPLEMENTED)
+      r = MAIL_NO_ERROR;
+    if (r != MAIL_NO_ERROR) {
+      /* the session is lost */
+      carray_delete_slow(storage->sto_pool, indx);
+      pool_item_close(item);
+      return r;
+    }
+  }
+  else {
+    r = mailsession_select_folder(item->session, (char *) pathname);
+    if (r == MAIL_ERROR_STREAM) {
+      carray_delete_slow(storage->sto_pool, indx);
+      pool_item_close(item);
+      return r;
+    }
+    if (r != MAIL_NO_ERROR) {
+      /* the session stays in the pool, without a folder selected */
+      free(item->pathname);
+      item->pathname = NULL;
+      return r;
+    }
+  }
+
+  carray_delete_slow(storage->sto_pool, indx);
+  * result = item->session;
+  free(item->pathname);
+  free(item);
+
+  return MAIL_NO_ERROR;
+}
+
+/*
+  (* result) is set to NULL when the pool has no session to give,
+  an error is returned when the folder could not be selected.
+*/
+
+static int pool_get_session(struct mailstorage * storage,
+    const char * pathname, mailsession ** result)
+{
+  unsigned int i;
+  int r;
+
+  * result = NULL;
+
+  if ((storage->sto_pool == NULL) || (pathname == NULL))
+    return MAIL_NO_ERROR;
+
+  mailstorage_pool_evict(storage);
+
+  /* a session with the folder already selected is preferred */
+  i = carray_count(storage->sto_pool);
+  while (i > 0) {
+    struct mailstorage_pool_item * item;
+
+    i --;
+    item = carray_get(storage->sto_pool, i);
+    if ((item->pathname != NULL) && pool_same_folder(item->pathname, pathname)) {
+      r = pool_take_session(storage, i, pathname, result);
+      if (r == MAIL_NO_ERROR)
+        return MAIL_NO_ERROR;
+    }
+  }
+
+  /* then the most recently used one that can select the folder */
+  i = carray_count(storage->sto_pool);
+  while (i > 0) {
+    struct mailstorage_pool_item * item;
+
+    i --;
+    item = carray_get(storage->sto_pool, i);
+    if (item->session->sess_driver->sess_select_folder == NULL)
+      continue;
+
+    r = pool_take_session(storage, i, pathname, result);
+    if (r == MAIL_NO_ERROR)
+      return MAIL_NO_ERROR;
+    if (r != MAIL_ERROR_STREAM)
+      return r;
+  }
+
+  return MAIL_NO_ERROR;
+}
@@ -56,12 +56,18 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <stdlib.h>
+#ifndef WIN32
+#	include <dirent.h>
+#	include <sys/uio.h>
+#	include <sys/file.h>
+#endif
 
 #include "maildriver_types.h"
 #include "imfcache.h"
 #include "chash.h"
 #include "mailmessage.h"
 #include "mail_cache_db.h"
+#include "mailmapview.h"
 
 int generic_cache_create_dir(char * dirname)
 {
@@ -117,12 +123,19 @@ int generic_cache_store(char * filename, char * content, size_t length)
   return MAIL_NO_ERROR;
 }
 
+/*
+  the file is returned as a private mapping, that can be modified like
+  a copy. The zeros that fill the last page of the mapping terminate
+  the string, a file that ends on a page boundary is copied instead.
+*/
+
 int generic_cache_read(char * filename, char ** result, size_t * result_len)
 {
   int fd;
   char * str;
   struct stat buf;
   MMAPString * mmapstr;
+  struct mailmapview * view;
   char * content;
   int res;
 
@@ -137,12 +150,33 @@ int generic_cache_read(char * filename, char ** result, size_t * result_len)
     goto err;
   }
 
-  str = mmap(NULL, buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  str = mmap(NULL, buf.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
   if (str == (char *)MAP_FAILED) {
     res = MAIL_ERROR_FILE;
     goto close;
   }
 
+  if ((buf.st_size % sysconf(_SC_PAGESIZE)) != 0) {
+    view = mailmapview_new(str, buf.st_size);
+    if (view == NULL) {
+      res = MAIL_ERROR_MEMORY;
+      goto unmap;
+    }
+
+    content = mailmapview_get_str(view, 0);
+    mailmapview_unref(view);
+    if (content == NULL) {
+      res = MAIL_ERROR_MEMORY;
+      goto close;
+    }
+    close(fd);
+
+    * result = content;
+    * result_len = buf.st_size;
+
+    return MAIL_NO_ERROR;
+  }
+
   mmapstr = mmap_string_new_len(str, buf.st_size);
   if (mmapstr == NULL) {
     res = MAIL_ERROR_MEMORY;
@@ -174,6 +208,869 @@ int generic_cache_read(char * filename, char ** result, size_t * result_len)
   return res;
 }
 
+/* cache log */
+
+#define CACHE_LOG_SUFFIX ".seg"
+#define CACHE_LOG_LOCK GENERIC_CACHE_LOG_PREFIX "lock"
+
+/* bigger entries get a segment of their own */
+#define CACHE_LOG_SEGMENT_SIZE (16 * 1024 * 1024)
+
+#define CACHE_LOG_MAGIC 0x4c434745
+#define CACHE_LOG_TOMBSTONE 0xffffffff
+
+/* records are aligned on 8 bytes so that headers can be read in place */
+#define CACHE_LOG_ALIGN(size) (((size) + 7) & ~((size_t) 7))
+
+/*
+  a record is a header, the key, the data followed by a '\0' so that it
+  can be used as a string, and a padding.
+  A tombstone has no data, it tells that the key was deleted.
+*/
+
+struct cache_log_record {
+  uint32_t r_magic;
+  uint32_t r_key_len;
+  uint32_t r_data_len;
+  uint32_t r_checksum;
+};
+
+/*
+  the whole segment size is mapped once, entries that are appended with
+  write() are visible in the mapping.
+*/
+
+struct generic_cache_segment {
+  unsigned int seg_id;
+  int seg_fd;
+  char * seg_map;
+  size_t seg_map_size;
+  size_t seg_size;
+  size_t seg_dead;
+};
+
+struct cache_log_entry {
+  struct generic_cache_segment * e_segment;
+  size_t e_offset;
+};
+
+static size_t record_size(uint32_t key_len, uint32_t data_len)
+{
+  if (data_len == CACHE_LOG_TOMBSTONE)
+    return CACHE_LOG_ALIGN(sizeof(struct cache_log_record) + key_len);
+  else
+    return CACHE_LOG_ALIGN(sizeof(struct cache_log_record) + key_len +
+        (size_t) data_len + 1);
+}
+
+/* FNV-1a */
+
+static uint32_t record_checksum(const char * key, size_t key_len,
+    const char * data, size_t data_len)
+{
+  uint32_t hash;
+  size_t i;
+
+  hash = 2166136261U;
+  for(i = 0 ; i < key_len ; i ++) {
+    hash ^= (unsigned char) key[i];
+    hash *= 16777619U;
+  }
+  for(i = 0 ; i < data_len ; i ++) {
+    hash ^= (unsigned char) data[i];
+    hash *= 16777619U;
+  }
+
+  return hash;
+}
+
+static void segment_filename(struct generic_cache_log * log,
+    unsigned int id, char * filename, size_t size)
+{
+  snprintf(filename, size, "%s/%s%06u%s", log->cl_dirname,
+      GENERIC_CACHE_LOG_PREFIX, id, CACHE_LOG_SUFFIX);
+}
+
+static int segment_open(struct generic_cache_log * log, unsigned int id,
+    int create, size_t map_size, struct generic_cache_segment ** result)
+{
+  struct generic_cache_segment * segment;
+  char filename[PATH_MAX];
+  struct stat buf;
+  int res;
+
+  segment = malloc(sizeof(* segment));
+  if (segment == NULL) {
+    res = MAIL_ERROR_MEMORY;
+    goto err;
+  }
+
+  segment_filename(log, id, filename, sizeof(filename));
+  if (create)
+    segment->seg_fd = open(filename, O_CREAT | O_TRUNC | O_RDWR,
+        S_IRUSR | S_IWUSR);
+  else
+    segment->seg_fd = open(filename, O_RDWR);
+  if (segment->seg_fd == -1) {
+    res = MAIL_ERROR_FILE;
+    goto free;
+  }
+
+  if (fstat(segment->seg_fd, &buf) < 0) {
+    res = MAIL_ERROR_FILE;
+    goto close;
+  }
+
+  if (map_size < CACHE_LOG_SEGMENT_SIZE)
+    map_size = CACHE_LOG_SEGMENT_SIZE;
+  if (map_size < (size_t) buf.st_size)
+    map_size = buf.st_size;
+
+  segment->seg_map = mmap(NULL, map_size, PROT_READ, MAP_SHARED,
+      segment->seg_fd, 0);
+  if (segment->seg_map == (char *) MAP_FAILED) {
+    res = MAIL_ERROR_FILE;
+    goto close;
+  }
+
+  segment->seg_id = id;
+  segment->seg_map_size = map_size;
+  segment->seg_size = buf.st_size;
+  segment->seg_dead = 0;
+
+  * result = segment;
+
+  return MAIL_NO_ERROR;
+
+ close:
+  close(segment->seg_fd);
+ free:
+  free(segment);
+ err:
+  return res;
+}
+
+static void segment_free(struct generic_cache_segment * segment)
+{
+  munmap(segment->seg_map, segment->seg_map_size);
+  close(segment->seg_fd);
+  free(segment);
+}
+
+static size_t entry_record_size(struct cache_log_entry * entry)
+{
+  struct cache_log_record * record;
+
+  record = (struct cache_log_record *) (entry->e_segment->seg_map + entry->e_offset);
+
+  return record_size(record->r_key_len, record->r_data_len);
+}
+
+/* records the location of the latest entry of a key */
+
+static int index_set(struct generic_cache_log * log,
+    const char * key, size_t key_len,
+    struct generic_cache_segment * segment, size_t offset, size_t size,
+    int tombstone)
+{
+  chashdatum hkey;
+  chashdatum hvalue;
+  struct cache_log_entry * entry;
+  int r;
+
+  hkey.data = (void *) key;
+  hkey.len = (unsigned int) key_len;
+
+  entry = NULL;
+  r = chash_get(log->cl_index, &hkey, &hvalue);
+  if (r == 0) {
+    entry = hvalue.data;
+    entry->e_segment->seg_dead += entry_record_size(entry);
+  }
+
+  if (tombstone) {
+    segment->seg_dead += size;
+    if (entry != NULL) {
+      chash_delete(log->cl_index, &hkey, NULL);
+      free(entry);
+    }
+    return MAIL_NO_ERROR;
+  }
+
+  if (entry == NULL) {
+    entry = malloc(sizeof(* entry));
+    if (entry == NULL)
+      return MAIL_ERROR_MEMORY;
+
+    hvalue.data = entry;
+    hvalue.len = 0;
+    r = chash_set(log->cl_index, &hkey, &hvalue, NULL);
+    if (r < 0) {
+      free(entry);
+      return MAIL_ERROR_MEMORY;
+    }
+  }
+
+  entry->e_segment = segment;
+  entry->e_offset = offset;
+
+  return MAIL_NO_ERROR;
+}
+
+/*
+  adds the records of a segment to the index, returns the size of the
+  valid records. Only the last segment can be partially written.
+*/
+
+static size_t segment_scan(struct generic_cache_log * log,
+    struct generic_cache_segment * segment, int check)
+{
+  size_t offset;
+
+  offset = 0;
+  while (offset + sizeof(struct cache_log_record) <= segment->seg_size) {
+    struct cache_log_record * record;
+    const char * key;
+    size_t size;
+    int tombstone;
+
+    record = (struct cache_log_record *) (segment->seg_map + offset);
+    if (record->r_magic != CACHE_LOG_MAGIC)
+      break;
+    if ((record->r_key_len == 0) || (record->r_key_len > segment->seg_size))
+      break;
+    tombstone = (record->r_data_len == CACHE_LOG_TOMBSTONE);
+    if (!tombstone && (record->r_data_len > segment->seg_size))
+      break;
+
+    size = record_size(record->r_key_len, record->r_data_len);
+    if (size > segment->seg_size - offset)
+      break;
+
+    key = (const char *) (record + 1);
+    if (check) {
+      uint32_t checksum;
+
+      if (tombstone)
+        checksum = record_checksum(key, record->r_key_len, NULL, 0);
+      else
+        checksum = record_checksum(key, record->r_key_len,
+            key + record->r_key_len, record->r_data_len);
+      if (checksum != record->r_checksum)
+        break;
+    }
+
+    if (index_set(log, key, record->r_key_len, segment, offset, size,
+            tombstone) != MAIL_NO_ERROR)
+      break;
+
+    offset += size;
+  }
+
+  return offset;
+}
+
+static int compare_id(const void * a, const void * b)
+{
+  unsigned int id_a;
+  unsigned int id_b;
+
+  id_a = * (const unsigned int *) a;
+  id_b = * (const unsigned int *) b;
+
+  if (id_a < id_b)
+    return -1;
+  if (id_a > id_b)
+    return 1;
+  return 0;
+}
+
+/* gets the numbers of the segment files of the directory, sorted */
+
+static int list_segments(const char * dirname,
+    unsigned int ** result, unsigned int * result_count)
+{
+  DIR * d;
+  struct dirent * ent;
+  unsigned int * ids;
+  unsigned int count;
+  unsigned int size;
+  size_t prefix_len;
+
+  d = opendir(dirname);
+  if (d == NULL)
+    return MAIL_ERROR_FILE;
+
+  prefix_len = strlen(GENERIC_CACHE_LOG_PREFIX);
+  ids = NULL;
+  count = 0;
+  size = 0;
+  while ((ent = readdir(d)) != NULL) {
+    unsigned long id;
+    char * end;
+
+    if (strncmp(ent->d_name, GENERIC_CACHE_LOG_PREFIX, prefix_len) != 0)
+      continue;
+    id = strtoul(ent->d_name + prefix_len, &end, 10);
+    if ((end == ent->d_name + prefix_len) ||
+        (strcmp(end, CACHE_LOG_SUFFIX) != 0))
+      continue;
+
+    if (count == size) {
+      unsigned int * new_ids;
+
+      size = (size == 0) ? 16 : size * 2;
+      new_ids = realloc(ids, size * sizeof(* ids));
+      if (new_ids == NULL) {
+        free(ids);
+        closedir(d);
+        return MAIL_ERROR_MEMORY;
+      }
+      ids = new_ids;
+    }
+    ids[count] = (unsigned int) id;
+    count ++;
+  }
+  closedir(d);
+
+  if (count > 0)
+    qsort(ids, count, sizeof(* ids), compare_id);
+
+  * result = ids;
+  * result_count = count;
+
+  return MAIL_NO_ERROR;
+}
+
+static void log_free(struct generic_cache_log * log)
+{
+  chashiter * iter;
+  unsigned int i;
+
+  for(iter = chash_begin(log->cl_index) ; iter != NULL ;
+      iter = chash_next(log->cl_index, iter)) {
+    chashdatum value;
+
+    chash_value(iter, &value);
+    free(value.data);
+  }
+  chash_free(log->cl_index);
+
+  for(i = 0 ; i < carray_count(log->cl_segments) ; i ++)
+    segment_free(carray_get(log->cl_segments, i));
+  carray_free(log->cl_segments);
+
+  close(log->cl_lock_fd);
+  free(log->cl_dirname);
+  free(log);
+}
+
+/*
+  the lock is taken on an open file and not by process, so that a second
+  log of the same directory can't be opened by another session of the
+  same process.
+*/
+
+static int lock_dir(const char * dirname, int * result)
+{
+  char filename[PATH_MAX];
+  int fd;
+
+  snprintf(filename, sizeof(filename), "%s/%s", dirname, CACHE_LOG_LOCK);
+  fd = open(filename, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+  if (fd == -1)
+    return MAIL_ERROR_FILE;
+
+  if (flock(fd, LOCK_EX | LOCK_NB) < 0) {
+    close(fd);
+    return MAIL_ERROR_FILE;
+  }
+
+  * result = fd;
+
+  return MAIL_NO_ERROR;
+}
+
+int generic_cache_log_open(const char * dirname,
+    struct generic_cache_log ** result)
+{
+  struct generic_cache_log * log;
+  unsigned int * ids;
+  unsigned int count;
+  unsigned int i;
+  int res;
+  int r;
+
+  log = malloc(sizeof(* log));
+  if (log == NULL) {
+    res = MAIL_ERROR_MEMORY;
+    goto err;
+  }
+
+  log->cl_dirname = strdup(dirname);
+  if (log->cl_dirname == NULL) {
+    res = MAIL_ERROR_MEMORY;
+    goto free_log;
+  }
+
+  r = lock_dir(dirname, &log->cl_lock_fd);
+  if (r != MAIL_NO_ERROR) {
+    res = r;
+    goto free_dirname;
+  }
+
+  log->cl_segments = carray_new(16);
+  if (log->cl_segments == NULL) {
+    res = MAIL_ERROR_MEMORY;
+    goto unlock;
+  }
+
+  log->cl_index = chash_new(CHASH_DEFAULTSIZE, CHASH_COPYKEY);
+  if (log->cl_index == NULL) {
+    res = MAIL_ERROR_MEMORY;
+    goto free_segments;
+  }
+
+  log->cl_next_id = 1;
+
+  r = list_segments(dirname, &ids, &count);
+  if (r != MAIL_NO_ERROR) {
+    res = r;
+    goto free_index;
+  }
+
+  for(i = 0 ; i < count ; i ++) {
+    struct generic_cache_segment * segment;
+    size_t valid_size;
+    int last;
+
+    r = segment_open(log, ids[i], 0, 0, &segment);
+    if (r != MAIL_NO_ERROR) {
+      res = r;
+      goto free_ids;
+    }
+
+    if (carray_add(log->cl_segments, segment, NULL) < 0) {
+      segment_free(segment);
+      res = MAIL_ERROR_MEMORY;
+      goto free_ids;
+    }
+
+    last = (i == count - 1);
+
+    /* only the last segment may have been written when the process ended */
+    valid_size = segment_scan(log, segment, last);
+    if (valid_size < segment->seg_size) {
+      if (last) {
+        if (ftruncate(segment->seg_fd, valid_size) < 0) {
+          res = MAIL_ERROR_FILE;
+          goto free_ids;
+        }
+        segment->seg_size = valid_size;
+      }
+      else {
+        segment->seg_dead += segment->seg_size - valid_size;
+      }
+    }
+
+    log->cl_next_id = ids[i] + 1;
+  }
+  free(ids);
+
+  * result = log;
+
+  return MAIL_NO_ERROR;
+
+ free_ids:
+  free(ids);
+  log_free(log);
+  return res;
+ free_index:
+  chash_free(log->cl_index);
+ free_segments:
+  carray_free(log->cl_segments);
+ unlock:
+  close(log->cl_lock_fd);
+ free_dirname:
+  free(log->cl_dirname);
+ free_log:
+  free(log);
+ err:
+  return res;
+}
+
+/* returns the segment where a record of the given size can be appended */
+
+static int get_active_segment(struct generic_cache_log * log, size_t size,
+    struct generic_cache_segment ** result)
+{
+  struct generic_cache_segment * segment;
+  int r;
+
+  if (carray_count(log->cl_segments) > 0) {
+    segment = carray_get(log->cl_segments,
+        carray_count(log->cl_segments) - 1);
+    if (segment->seg_size + size <= segment->seg_map_size) {
+      * result = segment;
+      return MAIL_NO_ERROR;
+    }
+
+    /* a full segment is synced once for all its entries */
+    fsync(segment->seg_fd);
+  }
+
+  r = segment_open(log, log->cl_next_id, 1, size, &segment);
+  if (r != MAIL_NO_ERROR)
+    return r;
+
+  if (carray_add(log->cl_segments, segment, NULL) < 0) {
+    char filename[PATH_MAX];
+
+    segment_filename(log, segment->seg_id, filename, sizeof(filename));
+    unlink(filename);
+    segment_free(segment);
+    return MAIL_ERROR_MEMORY;
+  }
+  log->cl_next_id ++;
+
+  * result = segment;
+
+  return MAIL_NO_ERROR;
+}
+
+static int append_record(struct generic_cache_log * log,
+    const char * key, size_t key_len, const char * data, size_t data_len,
+    int tombstone)
+{
+  struct generic_cache_segment * segment;
+  struct cache_log_record record;
+  struct iovec iov[4];
+  char padding[8];
+  size_t size;
+  int iovcnt;
+  ssize_t written;
+  int r;
+
+  if ((key_len == 0) || (key_len >= CACHE_LOG_TOMBSTONE) ||
+      (data_len >= CACHE_LOG_TOMBSTONE))
+    return MAIL_ERROR_INVAL;
+
+  record.r_magic = CACHE_LOG_MAGIC;
+  record.r_key_len = (uint32_t) key_len;
+  if (tombstone) {
+    record.r_data_len = CACHE_LOG_TOMBSTONE;
+    record.r_checksum = record_checksum(key, key_len, NULL, 0);
+  }
+  else {
+    record.r_data_len = (uint32_t) data_len;
+    record.r_checksum = record_checksum(key, key_len, data, data_len);
+  }
+  size = record_size(record.r_key_len, record.r_data_len);
+
+  r = get_active_segment(log, size, &segment);
+  if (r != MAIL_NO_ERROR)
+    return r;
+
+  memset(padding, 0, sizeof(padding));
+  iovcnt = 0;
+  iov[iovcnt].iov_base = (void *) &record;
+  iov[iovcnt].iov_len = sizeof(record);
+  iovcnt ++;
+  iov[iovcnt].iov_base = (void *) key;
+  iov[iovcnt].iov_len = key_len;
+  iovcnt ++;
+  if (!tombstone) {
+    iov[iovcnt].iov_base = (void *) data;
+    iov[iovcnt].iov_len = data_len;
+    iovcnt ++;
+  }
+  /* the padding includes the terminating '\0' of the data */
+  iov[iovcnt].iov_base = padding;
+  iov[iovcnt].iov_len = size - sizeof(record) - key_len -
+      (tombstone ? 0 : data_len);
+  iovcnt ++;
+
+  if (lseek(segment->seg_fd, segment->seg_size, SEEK_SET) < 0)
+    return MAIL_ERROR_FILE;
+  written = writev(segment->seg_fd, iov, iovcnt);
+  if ((written < 0) || ((size_t) written != size)) {
+    if (ftruncate(segment->seg_fd, segment->seg_size) < 0) {
+      /* the next open will discard the partial record */
+    }
+    return MAIL_ERROR_FILE;
+  }
+  segment->seg_size += size;
+
+  return index_set(log, key, key_len, segment, segment->seg_size - size,
+      size, tombstone);
+}
+
+int generic_cache_log_store(struct generic_cache_log * log,
+    const char * key, const char * content, size_t length)
+{
+  return append_record(log, key, strlen(key), content, length, 0);
+}
+
+int generic_cache_log_read(struct generic_cache_log * log,
+    const char * key, char ** result, size_t * result_len)
+{
+  chashdatum hkey;
+  chashdatum hvalue;
+  struct cache_log_entry * entry;
+  struct cache_log_record * record;
+  MMAPString * mmapstr;
+  int r;
+
+  hkey.data = (void *) key;
+  hkey.len = (unsigned int) strlen(key);
+  r = chash_get(log->cl_index, &hkey, &hvalue);
+  if (r < 0)
+    return MAIL_ERROR_CACHE_MISS;
+
+  entry = hvalue.data;
+  record = (struct cache_log_record *) (entry->e_segment->seg_map + entry->e_offset);
+
+  /* the segment is shared with the file, the result is a copy so that
+     it can be modified */
+  mmapstr = mmap_string_new_len((char *) (record + 1) + record->r_key_len,
+      record->r_data_len);
+  if (mmapstr == NULL)
+    return MAIL_ERROR_MEMORY;
+
+  if (mmap_string_ref(mmapstr) < 0) {
+    mmap_string_free(mmapstr);
+    return MAIL_ERROR_MEMORY;
+  }
+
+  * result = mmapstr->str;
+  * result_len = record->r_data_len;
+
+  return MAIL_NO_ERROR;
+}
+
+int generic_cache_log_delete(struct generic_cache_log * log,
+    const char * key)
+{
+  chashdatum hkey;
+  chashdatum hvalue;
+
+  hkey.data = (void *) key;
+  hkey.len = (unsigned int) strlen(key);
+  if (chash_get(log->cl_index, &hkey, &hvalue) < 0)
+    return MAIL_NO_ERROR;
+
+  return append_record(log, key, strlen(key), NULL, 0, 1);
+}
+
+/*
+  copies the entries of a segment that are still used to the end of the
+  log and removes the segment.
+  The tombstones of the oldest segment can be dropped, the tombstones of
+  the others are kept since an older segment can have an entry for the
+  same key.
+*/
+
+static void compact_segment(struct generic_cache_log * log,
+    unsigned int indx)
+{
+  struct generic_cache_segment * segment;
+  struct generic_cache_segment * last;
+  char filename[PATH_MAX];
+  size_t offset;
+  int oldest;
+
+  segment = carray_get(log->cl_segments, indx);
+  oldest = (indx == 0);
+
+  offset = 0;
+  while (offset + sizeof(struct cache_log_record) <= segment->seg_size) {
+    struct cache_log_record * record;
+    const char * key;
+    chashdatum hkey;
+    chashdatum hvalue;
+    int found;
+    int r;
+
+    record = (struct cache_log_record *) (segment->seg_map + offset);
+    if (record->r_magic != CACHE_LOG_MAGIC)
+      break;
+
+    key = (const char *) (record + 1);
+    hkey.data = (void *) key;
+    hkey.len = record->r_key_len;
+    found = (chash_get(log->cl_index, &hkey, &hvalue) == 0);
+
+    if (record->r_data_len == CACHE_LOG_TOMBSTONE) {
+      if (!oldest && !found) {
+        r = append_record(log, key, record->r_key_len, NULL, 0, 1);
+        if (r != MAIL_NO_ERROR)
+          return;
+      }
+    }
+    else if (found) {
+      struct cache_log_entry * entry;
+
+      entry = hvalue.data;
+      if ((entry->e_segment == segment) && (entry->e_offset == offset)) {
+        r = append_record(log, key, record->r_key_len,
+            key + record->r_key_len, record->r_data_len, 0);
+        if (r != MAIL_NO_ERROR)
+          return;
+      }
+    }
+
+    offset += record_size(record->r_key_len, record->r_data_len);
+  }
+
+  /* the copies must be on disk before the segment is removed */
+  last = carray_get(log->cl_segments, carray_count(log->cl_segments) - 1);
+  if (fsync(last->seg_fd) < 0)
+    return;
+
+  segment_filename(log, segment->seg_id, filename, sizeof(filename));
+  unlink(filename);
+  carray_delete_slow(log->cl_segments, indx);
+  segment_free(segment);
+}
+
+/*
+  compacts the first full segment that is more than half unused,
+  one segment at a time to bound the work done at once.
+*/
+
+static void compact(struct generic_cache_log * log)
+{
+  unsigned int i;
+
+  for(i = 0 ; i + 1 < carray_count(log->cl_segments) ; i ++) {
+    struct generic_cache_segment * segment;
+
+    segment = carray_get(log->cl_segments, i);
+    if (segment->seg_dead * 2 > segment->seg_size) {
+      compact_segment(log, i);
+      break;
+    }
+  }
+}
+
+void generic_cache_log_close(struct generic_cache_log * log)
+{
+  if (carray_count(log->cl_segments) > 0) {
+    struct generic_cache_segment * last;
+
+    last = carray_get(log->cl_segments, carray_count(log->cl_segments) - 1);
+    fsync(last->seg_fd);
+  }
+
+  compact(log);
+
+  log_free(log);
+}
+
+int generic_cache_log_clean_up(struct generic_cache_log * log,
+    struct mailmessage_list * env_list,
+    void (* get_uid_from_key)(char *))
+{
+  chash * hash_exist;
+  carray * deleted;
+  chashiter * iter;
+  unsigned int i;
+  int res;
+  int r;
+
+  hash_exist = chash_new(CHASH_DEFAULTSIZE, CHASH_COPYALL);
+  if (hash_exist == NULL) {
+    res = MAIL_ERROR_MEMORY;
+    goto err;
+  }
+
+  for(i = 0 ; i < carray_count(env_list->msg_tab) ; i ++) {
+    mailmessage * msg;
+    chashdatum key;
+    chashdatum value;
+
+    msg = carray_get(env_list->msg_tab, i);
+
+    key.data = msg->msg_uid;
+    key.len = (unsigned int) strlen(msg->msg_uid);
+    value.data = NULL;
+    value.len = 0;
+    r = chash_set(hash_exist, &key, &value, NULL);
+    if (r < 0) {
+      res = MAIL_ERROR_MEMORY;
+      goto free_hash;
+    }
+  }
+
+  /* the index can't be modified while it's iterated */
+  deleted = carray_new(16);
+  if (deleted == NULL) {
+    res = MAIL_ERROR_MEMORY;
+    goto free_hash;
+  }
+
+  for(iter = chash_begin(log->cl_index) ; iter != NULL ;
+      iter = chash_next(log->cl_index, iter)) {
+    chashdatum key;
+    chashdatum value;
+    char keyname[PATH_MAX];
+    char * dup_key;
+
+    chash_key(iter, &key);
+    if (key.len >= sizeof(keyname))
+      continue;
+    memcpy(keyname, key.data, key.len);
+    keyname[key.len] = '\0';
+
+    get_uid_from_key(keyname);
+
+    value.data = keyname;
+    value.len = (unsigned int) strlen(keyname);
+    if (chash_get(hash_exist, &value, &value) == 0)
+      continue;
+
+    dup_key = malloc(key.len + 1);
+    if (dup_key == NULL) {
+      res = MAIL_ERROR_MEMORY;
+      goto free_deleted;
+    }
+    memcpy(dup_key, key.data, key.len);
+    dup_key[key.len] = '\0';
+
+    if (carray_add(deleted, dup_key, NULL) < 0) {
+      free(dup_key);
+      res = MAIL_ERROR_MEMORY;
+      goto free_deleted;
+    }
+  }
+
+  for(i = 0 ; i < carray_count(deleted) ; i ++) {
+    r = generic_cache_log_delete(log, carray_get(deleted, i));
+    if (r != MAIL_NO_ERROR) {
+      res = r;
+      goto free_deleted;
+    }
+  }
+
+  for(i = 0 ; i < carray_count(deleted) ; i ++)
+    free(carray_get(deleted, i));
+  carray_free(deleted);
+  chash_free(hash_exist);
+
+  compact(log);
+
+  return MAIL_NO_ERROR;
+
+ free_deleted:
+  for(i = 0 ; i < carray_count(deleted) ; i ++)
+    free(carray_get(deleted, i));
+  carray_free(deleted);
+ free_hash:
+  chash_free(hash_exist);
+ err:
+  return res;
+}
+
 static int flags_extension_read(MMAPString * mmapstr, size_t * indx,
 				clist ** result)
 {
@@ -52,6 +52,51 @@ int generic_cache_create_dir(char * dirname);
 int generic_cache_store(char * filename, char * content, size_t length);
 int generic_cache_read(char * filename, char ** result, size_t * result_len);
 
+/*
+  the cache log stores the message contents of a folder in a few
+  append-only segment files instead of one file per entry.
+  Entries are not synced one by one, a segment is synced once, when it is
+  full or when the log is closed. The index is rebuilt from the segments
+  when the log is opened, a partially written entry at the end of the
+  last segment is discarded.
+  A directory has a single writer: generic_cache_log_open() fails with
+  MAIL_ERROR_FILE while the log of the same directory is open, in this
+  process or in another one.
+*/
+
+#define GENERIC_CACHE_LOG_PREFIX "cache-log."
+
+int generic_cache_log_open(const char * dirname,
+    struct generic_cache_log ** result);
+
+/* syncs the log and compacts a segment if there's too much unused data */
+
+void generic_cache_log_close(struct generic_cache_log * log);
+
+int generic_cache_log_store(struct generic_cache_log * log,
+    const char * key, const char * content, size_t length);
+
+/*
+  generic_cache_log_read() returns a copy of the entry that must be
+  released with mmap_string_unref().
+*/
+
+int generic_cache_log_read(struct generic_cache_log * log,
+    const char * key, char ** result, size_t * result_len);
+
+int generic_cache_log_delete(struct generic_cache_log * log,
+    const char * key);
+
+/*
+  generic_cache_log_clean_up() removes the entries of the messages that
+  are not in env_list, get_uid_from_key() truncates a key to the
+  uid of its message.
+*/
+
+int generic_cache_log_clean_up(struct generic_cache_log * log,
+    struct mailmessage_list * env_list,
+    void (* get_uid_from_key)(char *));
+
 int generic_cache_fields_read(struct mail_cache_db * cache_db,
     MMAPString * mmapstr,
     char * keyname, struct mailimf_fields ** result);
@@ -49,6 +49,32 @@ struct mail_flags_store {
   chash * fls_hash;
 };
 
+/*
+  generic_cache_log is a log-structured cache of message contents,
+  stored in segment files in a directory.
+
+  - dirname is the directory of the segments
+
+  - segments is an array of (struct generic_cache_segment *),
+    the oldest first, the last one is where new entries are appended
+
+  - index maps a key to the location of its latest entry
+
+  - next_id is the number of the next segment file
+
+  - lock_fd is the lock file of the directory, held while the log is open
+*/
+
+struct generic_cache_segment;
+
+struct generic_cache_log {
+  char * cl_dirname;
+  carray * cl_segments;
+  chash * cl_index;
+  unsigned int cl_next_id;
+  int cl_lock_fd;
+};
+
 #ifdef __cplusplus
 }
 #endif
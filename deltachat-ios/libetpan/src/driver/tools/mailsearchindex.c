@@ -0,0 +1,1781 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2005 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include "mailsearchindex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#ifdef HAVE_UNISTD_H
+#	include <unistd.h>
+#endif
+#ifdef WIN32
+#	include "win_etpan.h"
+#endif
+
+#include "maildriver_types.h"
+#include "maildriver_errors.h"
+#include "mailmime.h"
+#include "mailmime_decode.h"
+#include "charconv.h"
+#include "generic_cache.h"
+#include "mmapstring.h"
+
+#define INDEX_MAGIC "LEPSIDX1"
+#define INDEX_MAGIC_LENGTH 8
+
+/* words shorter than this are not indexed, longer ones are truncated */
+#define TERM_MIN_LENGTH 2
+#define TERM_MAX_LENGTH 64
+
+/*
+  the key of a term is the field, written as one character starting
+  at 'a', followed by the word and a terminating NUL, so that keys
+  can be compared with strcmp().
+*/
+
+struct posting {
+  uint32_t * pst_ids;
+  unsigned int pst_count;
+  unsigned int pst_size;
+};
+
+/* set of document numbers, in ascending order */
+
+struct docset {
+  uint32_t * ds_ids;
+  unsigned int ds_count;
+};
+
+static struct posting * posting_new(void)
+{
+  struct posting * posting;
+
+  posting = malloc(sizeof(* posting));
+  if (posting == NULL)
+    return NULL;
+  posting->pst_ids = NULL;
+  posting->pst_count = 0;
+  posting->pst_size = 0;
+
+  return posting;
+}
+
+static void posting_free(struct posting * posting)
+{
+  free(posting->pst_ids);
+  free(posting);
+}
+
+static int posting_add(struct posting * posting, uint32_t docid)
+{
+  unsigned int left;
+  unsigned int right;
+
+  /* documents are usually indexed in ascending order */
+  if ((posting->pst_count > 0) &&
+      (posting->pst_ids[posting->pst_count - 1] >= docid)) {
+    left = 0;
+    right = posting->pst_count;
+    while (left < right) {
+      unsigned int middle;
+
+      middle = (left + right) / 2;
+      if (posting->pst_ids[middle] < docid)
+        left = middle + 1;
+      else
+        right = middle;
+    }
+    if (posting->pst_ids[left] == docid)
+      return 0;
+  }
+  else {
+    left = posting->pst_count;
+  }
+
+  if (posting->pst_count == posting->pst_size) {
+    unsigned int size;
+    uint32_t * ids;
+
+    size = posting->pst_size * 2;
+    if (size == 0)
+      size = 4;
+    ids = realloc(posting->pst_ids, size * sizeof(* ids));
+    if (ids == NULL)
+      return -1;
+    posting->pst_ids = ids;
+    posting->pst_size = size;
+  }
+
+  memmove(posting->pst_ids + left + 1, posting->pst_ids + left,
+      (posting->pst_count - left) * sizeof(* posting->pst_ids));
+  posting->pst_ids[left] = docid;
+  posting->pst_count ++;
+
+  return 0;
+}
+
+static void doc_free(struct mail_search_index_doc * doc)
+{
+  free(doc->doc_uid);
+  free(doc);
+}
+
+static struct mail_search_index * index_new(const char * filename)
+{
+  struct mail_search_index * index;
+
+  index = malloc(sizeof(* index));
+  if (index == NULL)
+    goto err;
+
+  index->idx_filename = strdup(filename);
+  if (index->idx_filename == NULL)
+    goto free;
+  index->idx_docs = carray_new(128);
+  if (index->idx_docs == NULL)
+    goto free_filename;
+  index->idx_uid_hash = chash_new(CHASH_DEFAULTSIZE, CHASH_COPYKEY);
+  if (index->idx_uid_hash == NULL)
+    goto free_docs;
+  index->idx_terms = chash_new(CHASH_DEFAULTSIZE, CHASH_COPYKEY);
+  if (index->idx_terms == NULL)
+    goto free_uid_hash;
+  index->idx_sorted_terms = NULL;
+  index->idx_dirty = 0;
+
+  return index;
+
+ free_uid_hash:
+  chash_free(index->idx_uid_hash);
+ free_docs:
+  carray_free(index->idx_docs);
+ free_filename:
+  free(index->idx_filename);
+ free:
+  free(index);
+ err:
+  return NULL;
+}
+
+static void index_free(struct mail_search_index * index)
+{
+  chashiter * iter;
+  unsigned int i;
+
+  for(iter = chash_begin(index->idx_terms) ; iter != NULL ;
+      iter = chash_next(index->idx_terms, iter)) {
+    chashdatum value;
+
+    chash_value(iter, &value);
+    posting_free(value.data);
+  }
+  chash_free(index->idx_terms);
+  chash_free(index->idx_uid_hash);
+  for(i = 0 ; i < carray_count(index->idx_docs) ; i ++)
+    doc_free(carray_get(index->idx_docs, i));
+  carray_free(index->idx_docs);
+  if (index->idx_sorted_terms != NULL)
+    carray_free(index->idx_sorted_terms);
+  free(index->idx_filename);
+  free(index);
+}
+
+static int index_add_doc(struct mail_search_index * index,
+    const char * uid, int flags, uint32_t * result)
+{
+  struct mail_search_index_doc * doc;
+  chashdatum key;
+  chashdatum value;
+  unsigned int docid;
+  int r;
+
+  doc = malloc(sizeof(* doc));
+  if (doc == NULL)
+    goto err;
+  doc->doc_uid = strdup(uid);
+  if (doc->doc_uid == NULL)
+    goto free;
+  doc->doc_flags = flags;
+
+  r = carray_add(index->idx_docs, doc, &docid);
+  if (r < 0)
+    goto free_uid;
+
+  key.data = doc->doc_uid;
+  key.len = (unsigned int) strlen(doc->doc_uid);
+  value.data = NULL;
+  value.len = docid;
+  r = chash_set(index->idx_uid_hash, &key, &value, NULL);
+  if (r < 0)
+    goto delete;
+
+  * result = docid;
+
+  return MAIL_NO_ERROR;
+
+ delete:
+  carray_delete_fast(index->idx_docs, docid);
+ free_uid:
+  free(doc->doc_uid);
+ free:
+  free(doc);
+ err:
+  return MAIL_ERROR_MEMORY;
+}
+
+static struct mail_search_index_doc *
+index_find_doc(struct mail_search_index * index, const char * uid,
+    uint32_t * pdocid)
+{
+  chashdatum key;
+  chashdatum value;
+  int r;
+
+  key.data = (void *) uid;
+  key.len = (unsigned int) strlen(uid);
+  r = chash_get(index->idx_uid_hash, &key, &value);
+  if (r < 0)
+    return NULL;
+
+  * pdocid = value.len;
+  return carray_get(index->idx_docs, value.len);
+}
+
+/* returns the document of the given uid, adding it if needed */
+
+static int index_get_doc(struct mail_search_index * index,
+    const char * uid, uint32_t * pdocid,
+    struct mail_search_index_doc ** pdoc)
+{
+  struct mail_search_index_doc * doc;
+  uint32_t docid;
+  int r;
+
+  doc = index_find_doc(index, uid, &docid);
+  if ((doc != NULL) && ((doc->doc_flags & MAIL_SEARCH_INDEX_DELETED) != 0)) {
+    /* the uid came back, its old postings are ignored from now on */
+    chashdatum key;
+
+    key.data = (void *) uid;
+    key.len = (unsigned int) strlen(uid);
+    chash_delete(index->idx_uid_hash, &key, NULL);
+    doc = NULL;
+  }
+
+  if (doc == NULL) {
+    r = index_add_doc(index, uid, 0, &docid);
+    if (r != MAIL_NO_ERROR)
+      return r;
+    doc = carray_get(index->idx_docs, docid);
+  }
+
+  * pdocid = docid;
+  * pdoc = doc;
+
+  return MAIL_NO_ERROR;
+}
+
+static struct posting * index_get_posting(struct mail_search_index * index,
+    const char * term_key, size_t key_len, int create)
+{
+  chashdatum key;
+  chashdatum value;
+  struct posting * posting;
+  int r;
+
+  key.data = (void *) term_key;
+  key.len = (unsigned int) key_len;
+  r = chash_get(index->idx_terms, &key, &value);
+  if (r == 0)
+    return value.data;
+
+  if (!create)
+    return NULL;
+
+  posting = posting_new();
+  if (posting == NULL)
+    return NULL;
+
+  value.data = posting;
+  value.len = 0;
+  r = chash_set(index->idx_terms, &key, &value, NULL);
+  if (r < 0) {
+    posting_free(posting);
+    return NULL;
+  }
+
+  if (index->idx_sorted_terms != NULL) {
+    carray_free(index->idx_sorted_terms);
+    index->idx_sorted_terms = NULL;
+  }
+
+  return posting;
+}
+
+/*
+  drops the removed documents and their postings, the remaining
+  documents are numbered again. Nothing is changed on error.
+*/
+
+static int index_compact(struct mail_search_index * index)
+{
+  chash * uid_hash;
+  chashiter * iter;
+  uint32_t * remap;
+  unsigned int count;
+  unsigned int live;
+  unsigned int i;
+
+  count = carray_count(index->idx_docs);
+  remap = malloc((count + 1) * sizeof(* remap));
+  if (remap == NULL)
+    goto err;
+
+  uid_hash = chash_new(CHASH_DEFAULTSIZE, CHASH_COPYKEY);
+  if (uid_hash == NULL)
+    goto free_remap;
+
+  live = 0;
+  for(i = 0 ; i < count ; i ++) {
+    struct mail_search_index_doc * doc;
+    chashdatum key;
+    chashdatum value;
+
+    doc = carray_get(index->idx_docs, i);
+    if ((doc->doc_flags & MAIL_SEARCH_INDEX_DELETED) != 0) {
+      remap[i] = (uint32_t) -1;
+      continue;
+    }
+    remap[i] = live;
+    key.data = doc->doc_uid;
+    key.len = (unsigned int) strlen(doc->doc_uid);
+    value.data = NULL;
+    value.len = live;
+    if (chash_set(uid_hash, &key, &value, NULL) < 0)
+      goto free_uid_hash;
+    live ++;
+  }
+
+  if (live == count) {
+    chash_free(uid_hash);
+    free(remap);
+    return MAIL_NO_ERROR;
+  }
+
+  /* from here, nothing can fail */
+  iter = chash_begin(index->idx_terms);
+  while (iter != NULL) {
+    chashiter * next;
+    chashdatum value;
+    struct posting * posting;
+    unsigned int j;
+    unsigned int kept;
+
+    next = chash_next(index->idx_terms, iter);
+    chash_value(iter, &value);
+    posting = value.data;
+
+    /* numbers keep their order, the list stays sorted */
+    kept = 0;
+    for(j = 0 ; j < posting->pst_count ; j ++)
+      if (remap[posting->pst_ids[j]] != (uint32_t) -1)
+        posting->pst_ids[kept ++] = remap[posting->pst_ids[j]];
+    posting->pst_count = kept;
+
+    if (kept == 0) {
+      chashdatum key;
+
+      chash_key(iter, &key);
+      posting_free(posting);
+      chash_delete(index->idx_terms, &key, NULL);
+    }
+    iter = next;
+  }
+  if (index->idx_sorted_terms != NULL) {
+    carray_free(index->idx_sorted_terms);
+    index->idx_sorted_terms = NULL;
+  }
+
+  for(i = 0 ; i < count ; i ++) {
+    struct mail_search_index_doc * doc;
+
+    doc = carray_get(index->idx_docs, i);
+    if (remap[i] == (uint32_t) -1)
+      doc_free(doc);
+    else
+      carray_set(index->idx_docs, remap[i], doc);
+  }
+  carray_set_size(index->idx_docs, live);
+
+  chash_free(index->idx_uid_hash);
+  index->idx_uid_hash = uid_hash;
+  free(remap);
+
+  return MAIL_NO_ERROR;
+
+ free_uid_hash:
+  chash_free(uid_hash);
+ free_remap:
+  free(remap);
+ err:
+  return MAIL_ERROR_MEMORY;
+}
+
+/*
+  calls the given function for each word of a UTF-8 text.
+  Letters and digits of ASCII and all non-ASCII bytes are part of
+  words, letters of ASCII and Latin-1 are converted to lower case.
+  In HTML mode, the content of tags is skipped.
+*/
+
+typedef int term_handler(const char * term, size_t length, void * context);
+
+static int foreach_term(const char * text, size_t length, int html,
+    term_handler * handler, void * context)
+{
+  char term[TERM_MAX_LENGTH + 1];
+  size_t term_len;
+  int in_tag;
+  size_t i;
+  int r;
+
+  term_len = 0;
+  in_tag = 0;
+  for(i = 0 ; i <= length ; i ++) {
+    unsigned char ch;
+
+    if (i < length)
+      ch = (unsigned char) text[i];
+    else
+      ch = ' ';
+
+    if (html) {
+      if (ch == '<')
+        in_tag = 1;
+      else if (ch == '>') {
+        in_tag = 0;
+        ch = ' ';
+      }
+    }
+
+    if (!in_tag && ((ch >= 0x80) || isalnum(ch))) {
+      /* U+00C0 to U+00DE, except U+00D7, are upper case letters */
+      if ((i > 0) && ((unsigned char) text[i - 1] == 0xC3) &&
+          (ch >= 0x80) && (ch <= 0x9E) && (ch != 0x97))
+        ch += 0x20;
+      if (term_len < TERM_MAX_LENGTH)
+        term[term_len ++] = (char) tolower(ch);
+      continue;
+    }
+
+    if (term_len >= TERM_MIN_LENGTH) {
+      /* do not cut an UTF-8 sequence */
+      if (term_len == TERM_MAX_LENGTH) {
+        while ((term_len > 0) &&
+            (((unsigned char) term[term_len - 1] & 0xC0) == 0x80))
+          term_len --;
+        if ((term_len > 0) && ((unsigned char) term[term_len - 1] >= 0xC0))
+          term_len --;
+      }
+      r = handler(term, term_len, context);
+      if (r != MAIL_NO_ERROR)
+        return r;
+    }
+    term_len = 0;
+  }
+
+  return MAIL_NO_ERROR;
+}
+
+struct add_context {
+  struct mail_search_index * index;
+  uint32_t docid;
+  int field;
+};
+
+static int add_term(const char * term, size_t length, void * data)
+{
+  struct add_context * ctx;
+  char key[TERM_MAX_LENGTH + 2];
+  struct posting * posting;
+
+  ctx = data;
+  key[0] = (char) ('a' + ctx->field);
+  memcpy(key + 1, term, length);
+  key[length + 1] = '\0';
+
+  posting = index_get_posting(ctx->index, key, length + 2, 1);
+  if (posting == NULL)
+    return MAIL_ERROR_MEMORY;
+  if (posting_add(posting, ctx->docid) < 0)
+    return MAIL_ERROR_MEMORY;
+
+  return MAIL_NO_ERROR;
+}
+
+static int index_text(struct mail_search_index * index, uint32_t docid,
+    int field, const char * text, size_t length, int html)
+{
+  struct add_context ctx;
+
+  ctx.index = index;
+  ctx.docid = docid;
+  ctx.field = field;
+
+  return foreach_term(text, length, html, add_term, &ctx);
+}
+
+/* indexes a header value that may contain RFC 2047 encoded words */
+
+static int index_encoded_text(struct mail_search_index * index,
+    uint32_t docid, int field, const char * text)
+{
+  size_t cur_token;
+  char * decoded;
+  int r;
+
+  cur_token = 0;
+  r = mailmime_encoded_phrase_parse("iso-8859-1", text, strlen(text),
+      &cur_token, "utf-8", &decoded);
+  if (r != MAILIMF_NO_ERROR)
+    return index_text(index, docid, field, text, strlen(text), 0);
+
+  r = index_text(index, docid, field, decoded, strlen(decoded), 0);
+  free(decoded);
+
+  return r;
+}
+
+static int index_mailbox(struct mail_search_index * index,
+    uint32_t docid, int field, struct mailimf_mailbox * mb)
+{
+  int r;
+
+  if (mb->mb_display_name != NULL) {
+    r = index_encoded_text(index, docid, field, mb->mb_display_name);
+    if (r != MAIL_NO_ERROR)
+      return r;
+  }
+  if (mb->mb_addr_spec != NULL) {
+    r = index_text(index, docid, field, mb->mb_addr_spec,
+        strlen(mb->mb_addr_spec), 0);
+    if (r != MAIL_NO_ERROR)
+      return r;
+  }
+
+  return MAIL_NO_ERROR;
+}
+
+static int index_mailbox_list(struct mail_search_index * index,
+    uint32_t docid, int field, struct mailimf_mailbox_list * mb_list)
+{
+  clistiter * cur;
+  int r;
+
+  for(cur = clist_begin(mb_list->mb_list) ; cur != NULL ;
+      cur = clist_next(cur)) {
+    r = index_mailbox(index, docid, field, clist_content(cur));
+    if (r != MAIL_NO_ERROR)
+      return r;
+  }
+
+  return MAIL_NO_ERROR;
+}
+
+static int index_address_list(struct mail_search_index * index,
+    uint32_t docid, int field, struct mailimf_address_list * addr_list)
+{
+  clistiter * cur;
+  int r;
+
+  for(cur = clist_begin(addr_list->ad_list) ; cur != NULL ;
+      cur = clist_next(cur)) {
+    struct mailimf_address * addr;
+
+    addr = clist_content(cur);
+    switch (addr->ad_type) {
+    case MAILIMF_ADDRESS_MAILBOX:
+      r = index_mailbox(index, docid, field, addr->ad_data.ad_mailbox);
+      break;
+
+    case MAILIMF_ADDRESS_GROUP:
+      r = index_encoded_text(index, docid, field,
+          addr->ad_data.ad_group->grp_display_name);
+      if ((r == MAIL_NO_ERROR) &&
+          (addr->ad_data.ad_group->grp_mb_list != NULL))
+        r = index_mailbox_list(index, docid, field,
+            addr->ad_data.ad_group->grp_mb_list);
+      break;
+
+    default:
+      r = MAIL_NO_ERROR;
+      break;
+    }
+    if (r != MAIL_NO_ERROR)
+      return r;
+  }
+
+  return MAIL_NO_ERROR;
+}
+
+static int index_fields(struct mail_search_index * index, uint32_t docid,
+    struct mailimf_fields * fields)
+{
+  clistiter * cur;
+  int r;
+
+  for(cur = clist_begin(fields->fld_list) ; cur != NULL ;
+      cur = clist_next(cur)) {
+    struct mailimf_field * field;
+
+    field = clist_content(cur);
+    switch (field->fld_type) {
+    case MAILIMF_FIELD_SUBJECT:
+      r = index_encoded_text(index, docid, MAIL_SEARCH_INDEX_FIELD_SUBJECT,
+          field->fld_data.fld_subject->sbj_value);
+      break;
+
+    case MAILIMF_FIELD_FROM:
+      r = index_mailbox_list(index, docid, MAIL_SEARCH_INDEX_FIELD_FROM,
+          field->fld_data.fld_from->frm_mb_list);
+      break;
+
+    case MAILIMF_FIELD_TO:
+      r = index_address_list(index, docid, MAIL_SEARCH_INDEX_FIELD_TO,
+          field->fld_data.fld_to->to_addr_list);
+      break;
+
+    case MAILIMF_FIELD_CC:
+      r = index_address_list(index, docid, MAIL_SEARCH_INDEX_FIELD_CC,
+          field->fld_data.fld_cc->cc_addr_list);
+      break;
+
+    case MAILIMF_FIELD_BCC:
+      if (field->fld_data.fld_bcc->bcc_addr_list != NULL)
+        r = index_address_list(index, docid, MAIL_SEARCH_INDEX_FIELD_BCC,
+            field->fld_data.fld_bcc->bcc_addr_list);
+      else
+        r = MAIL_NO_ERROR;
+      break;
+
+    default:
+      r = MAIL_NO_ERROR;
+      break;
+    }
+    if (r != MAIL_NO_ERROR)
+      return r;
+  }
+
+  return MAIL_NO_ERROR;
+}
+
+/* indexes a text part once decoded and converted to UTF-8 */
+
+static int index_text_part(struct mail_search_index * index, uint32_t docid,
+    struct mailmime * mime)
+{
+  struct mailmime_data * data;
+  struct mailmime_content * content;
+  const char * charset;
+  size_t cur_token;
+  char * decoded;
+  size_t decoded_len;
+  char * converted;
+  size_t converted_len;
+  int encoding;
+  int html;
+  int r;
+
+  content = mime->mm_content_type;
+  if (content != NULL) {
+    if (content->ct_type->tp_type != MAILMIME_TYPE_DISCRETE_TYPE)
+      return MAIL_NO_ERROR;
+    if (content->ct_type->tp_data.tp_discrete_type->dt_type !=
+        MAILMIME_DISCRETE_TYPE_TEXT)
+      return MAIL_NO_ERROR;
+    html = (strcasecmp(content->ct_subtype, "html") == 0);
+    charset = mailmime_content_charset_get(content);
+  }
+  else {
+    html = 0;
+    charset = "us-ascii";
+  }
+
+  data = mime->mm_data.mm_single;
+  if ((data == NULL) || (data->dt_type != MAILMIME_DATA_TEXT))
+    return MAIL_NO_ERROR;
+
+  encoding = MAILMIME_MECHANISM_8BIT;
+  if (mime->mm_mime_fields != NULL)
+    encoding = mailmime_transfer_encoding_get(mime->mm_mime_fields);
+
+  cur_token = 0;
+  r = mailmime_part_parse(data->dt_data.dt_text.dt_data,
+      data->dt_data.dt_text.dt_length, &cur_token, encoding,
+      &decoded, &decoded_len);
+  if (r != MAILIMF_NO_ERROR)
+    return MAIL_NO_ERROR;
+
+  r = charconv_buffer("utf-8", charset, decoded, decoded_len,
+      &converted, &converted_len);
+  if (r == MAIL_CHARCONV_NO_ERROR) {
+    r = index_text(index, docid, MAIL_SEARCH_INDEX_FIELD_BODY,
+        converted, converted_len, html);
+    charconv_buffer_free(converted);
+  }
+  else {
+    r = index_text(index, docid, MAIL_SEARCH_INDEX_FIELD_BODY,
+        decoded, decoded_len, html);
+  }
+  mmap_string_unref(decoded);
+
+  return r;
+}
+
+static int index_mime(struct mail_search_index * index, uint32_t docid,
+    struct mailmime * mime, int with_fields)
+{
+  clistiter * cur;
+  int r;
+
+  switch (mime->mm_type) {
+  case MAILMIME_SINGLE:
+    return index_text_part(index, docid, mime);
+
+  case MAILMIME_MULTIPLE:
+    for(cur = clist_begin(mime->mm_data.mm_multipart.mm_mp_list) ;
+        cur != NULL ; cur = clist_next(cur)) {
+      r = index_mime(index, docid, clist_content(cur), 1);
+      if (r != MAIL_NO_ERROR)
+        return r;
+    }
+    return MAIL_NO_ERROR;
+
+  case MAILMIME_MESSAGE:
+    /* the fields of the main message are indexed as headers,
+       the ones of attached messages as text */
+    if (mime->mm_data.mm_message.mm_fields != NULL) {
+      if (with_fields) {
+        r = index_fields(index, docid, mime->mm_data.mm_message.mm_fields);
+        if (r != MAIL_NO_ERROR)
+          return r;
+      }
+    }
+    if (mime->mm_data.mm_message.mm_msg_mime != NULL)
+      return index_mime(index, docid, mime->mm_data.mm_message.mm_msg_mime, 1);
+    return MAIL_NO_ERROR;
+
+  default:
+    return MAIL_NO_ERROR;
+  }
+}
+
+int mail_search_index_get_flags(struct mail_search_index * index,
+    const char * uid)
+{
+  struct mail_search_index_doc * doc;
+  uint32_t docid;
+
+  doc = index_find_doc(index, uid, &docid);
+  if (doc == NULL)
+    return 0;
+  if ((doc->doc_flags & MAIL_SEARCH_INDEX_DELETED) != 0)
+    return 0;
+
+  return doc->doc_flags;
+}
+
+int mail_search_index_add_fields(struct mail_search_index * index,
+    const char * uid, struct mailimf_fields * fields)
+{
+  struct mail_search_index_doc * doc;
+  uint32_t docid;
+  int r;
+
+  r = index_get_doc(index, uid, &docid, &doc);
+  if (r != MAIL_NO_ERROR)
+    return r;
+
+  if ((doc->doc_flags & MAIL_SEARCH_INDEX_HEADERS) != 0)
+    return MAIL_NO_ERROR;
+
+  r = index_fields(index, docid, fields);
+  index->idx_dirty = 1;
+  if (r != MAIL_NO_ERROR)
+    return r;
+
+  doc->doc_flags |= MAIL_SEARCH_INDEX_HEADERS;
+
+  return MAIL_NO_ERROR;
+}
+
+int mail_search_index_add_message(struct mail_search_index * index,
+    const char * uid, const char * message, size_t length)
+{
+  struct mail_search_index_doc * doc;
+  struct mailmime * mime;
+  size_t cur_token;
+  uint32_t docid;
+  int r;
+
+  r = index_get_doc(index, uid, &docid, &doc);
+  if (r != MAIL_NO_ERROR)
+    return r;
+
+  if ((doc->doc_flags & MAIL_SEARCH_INDEX_BODY) != 0)
+    return MAIL_NO_ERROR;
+
+  cur_token = 0;
+  r = mailmime_parse(message, length, &cur_token, &mime);
+  if (r != MAILIMF_NO_ERROR) {
+    if (r == MAILIMF_ERROR_MEMORY)
+      return MAIL_ERROR_MEMORY;
+    return MAIL_ERROR_PARSE;
+  }
+
+  /* the root of the parsed message is a message part, holding the
+     header fields */
+  if (mime->mm_type == MAILMIME_MESSAGE) {
+    if (((doc->doc_flags & MAIL_SEARCH_INDEX_HEADERS) == 0) &&
+        (mime->mm_data.mm_message.mm_fields != NULL)) {
+      r = index_fields(index, docid, mime->mm_data.mm_message.mm_fields);
+      if (r != MAIL_NO_ERROR)
+        goto free;
+    }
+    doc->doc_flags |= MAIL_SEARCH_INDEX_HEADERS;
+    if (mime->mm_data.mm_message.mm_msg_mime != NULL)
+      r = index_mime(index, docid, mime->mm_data.mm_message.mm_msg_mime, 1);
+    else
+      r = MAIL_NO_ERROR;
+  }
+  else {
+    r = index_mime(index, docid, mime, 1);
+  }
+  if (r != MAIL_NO_ERROR)
+    goto free;
+
+  doc->doc_flags |= MAIL_SEARCH_INDEX_BODY;
+
+ free:
+  index->idx_dirty = 1;
+  mailmime_free(mime);
+  return r;
+}
+
+void mail_search_index_remove(struct mail_search_index * index,
+    const char * uid)
+{
+  struct mail_search_index_doc * doc;
+  chashdatum key;
+  uint32_t docid;
+
+  doc = index_find_doc(index, uid, &docid);
+  if (doc == NULL)
+    return;
+
+  /* the postings of the document are dropped when the index is saved */
+  doc->doc_flags |= MAIL_SEARCH_INDEX_DELETED;
+  key.data = (void *) uid;
+  key.len = (unsigned int) strlen(uid);
+  chash_delete(index->idx_uid_hash, &key, NULL);
+  index->idx_dirty = 1;
+}
+
+int mail_search_index_clean_up(struct mail_search_index * index,
+    struct mailmessage_list * env_list)
+{
+  chash * exist;
+  unsigned int i;
+  int removed;
+  int r;
+
+  exist = chash_new(CHASH_DEFAULTSIZE, CHASH_COPYKEY);
+  if (exist == NULL)
+    return MAIL_ERROR_MEMORY;
+
+  removed = 0;
+  for(i = 0 ; i < carray_count(env_list->msg_tab) ; i ++) {
+    mailmessage * msg;
+    chashdatum key;
+    chashdatum value;
+
+    msg = carray_get(env_list->msg_tab, i);
+    if (msg->msg_uid == NULL)
+      continue;
+
+    key.data = msg->msg_uid;
+    key.len = (unsigned int) strlen(msg->msg_uid);
+    value.data = NULL;
+    value.len = 0;
+    r = chash_set(exist, &key, &value, NULL);
+    if (r < 0) {
+      chash_free(exist);
+      return MAIL_ERROR_MEMORY;
+    }
+  }
+
+  for(i = 0 ; i < carray_count(index->idx_docs) ; i ++) {
+    struct mail_search_index_doc * doc;
+    chashdatum key;
+    chashdatum value;
+
+    doc = carray_get(index->idx_docs, i);
+    if ((doc->doc_flags & MAIL_SEARCH_INDEX_DELETED) != 0)
+      continue;
+
+    key.data = doc->doc_uid;
+    key.len = (unsigned int) strlen(doc->doc_uid);
+    if (chash_get(exist, &key, &value) < 0) {
+      mail_search_index_remove(index, doc->doc_uid);
+      removed = 1;
+    }
+  }
+
+  chash_free(exist);
+
+  if (!removed)
+    return MAIL_NO_ERROR;
+
+  return index_compact(index);
+}
+
+/* file format */
+
+static int write_varint(MMAPString * str, uint32_t value)
+{
+  char buf[5];
+  size_t len;
+
+  len = 0;
+  while (value >= 0x80) {
+    buf[len ++] = (char) ((value & 0x7F) | 0x80);
+    value >>= 7;
+  }
+  buf[len ++] = (char) value;
+
+  if (mmap_string_append_len(str, buf, len) == NULL)
+    return -1;
+
+  return 0;
+}
+
+static int read_varint(const char * data, size_t length, size_t * indx,
+    uint32_t * result)
+{
+  size_t cur_token;
+  uint32_t value;
+  unsigned int shift;
+
+  cur_token = * indx;
+  value = 0;
+  shift = 0;
+  while (1) {
+    unsigned char ch;
+
+    if ((cur_token >= length) || (shift > 28))
+      return -1;
+    ch = (unsigned char) data[cur_token ++];
+    value |= (uint32_t) (ch & 0x7F) << shift;
+    if ((ch & 0x80) == 0)
+      break;
+    shift += 7;
+  }
+
+  * indx = cur_token;
+  * result = value;
+
+  return 0;
+}
+
+static int index_load(struct mail_search_index * index,
+    const char * data, size_t length)
+{
+  size_t cur_token;
+  uint32_t count;
+  uint32_t i;
+  uint32_t docid;
+
+  if ((length < INDEX_MAGIC_LENGTH) ||
+      (memcmp(data, INDEX_MAGIC, INDEX_MAGIC_LENGTH) != 0))
+    return MAIL_ERROR_FILE;
+  cur_token = INDEX_MAGIC_LENGTH;
+
+  if (read_varint(data, length, &cur_token, &count) < 0)
+    return MAIL_ERROR_FILE;
+  for(i = 0 ; i < count ; i ++) {
+    uint32_t flags;
+    uint32_t uid_len;
+    char * uid;
+    int r;
+
+    if (read_varint(data, length, &cur_token, &flags) < 0)
+      return MAIL_ERROR_FILE;
+    if (read_varint(data, length, &cur_token, &uid_len) < 0)
+      return MAIL_ERROR_FILE;
+    if (length - cur_token < uid_len)
+      return MAIL_ERROR_FILE;
+
+    uid = malloc(uid_len + 1);
+    if (uid == NULL)
+      return MAIL_ERROR_MEMORY;
+    memcpy(uid, data + cur_token, uid_len);
+    uid[uid_len] = '\0';
+    cur_token += uid_len;
+
+    r = index_add_doc(index, uid, (int) flags, &docid);
+    free(uid);
+    if (r != MAIL_NO_ERROR)
+      return r;
+  }
+
+  if (read_varint(data, length, &cur_token, &count) < 0)
+    return MAIL_ERROR_FILE;
+  for(i = 0 ; i < count ; i ++) {
+    uint32_t key_len;
+    uint32_t ids_count;
+    uint32_t j;
+    struct posting * posting;
+    chashdatum key;
+    chashdatum value;
+
+    if (read_varint(data, length, &cur_token, &key_len) < 0)
+      return MAIL_ERROR_FILE;
+    if ((key_len < 2) || (length - cur_token < key_len) ||
+        (data[cur_token + key_len - 1] != '\0'))
+      return MAIL_ERROR_FILE;
+    key.data = (void *) (data + cur_token);
+    key.len = key_len;
+    cur_token += key_len;
+
+    if (read_varint(data, length, &cur_token, &ids_count) < 0)
+      return MAIL_ERROR_FILE;
+    if (ids_count > length - cur_token)
+      return MAIL_ERROR_FILE;
+
+    posting = posting_new();
+    if (posting == NULL)
+      return MAIL_ERROR_MEMORY;
+    posting->pst_ids = malloc(ids_count * sizeof(* posting->pst_ids));
+    if ((posting->pst_ids == NULL) && (ids_count > 0)) {
+      posting_free(posting);
+      return MAIL_ERROR_MEMORY;
+    }
+    posting->pst_size = ids_count;
+
+    /* document numbers are stored as deltas */
+    docid = 0;
+    for(j = 0 ; j < ids_count ; j ++) {
+      uint32_t delta;
+
+      if (read_varint(data, length, &cur_token, &delta) < 0) {
+        posting_free(posting);
+        return MAIL_ERROR_FILE;
+      }
+      docid += delta;
+      if (docid >= carray_count(index->idx_docs)) {
+        posting_free(posting);
+        return MAIL_ERROR_FILE;
+      }
+      posting->pst_ids[j] = docid;
+    }
+    posting->pst_count = ids_count;
+
+    value.data = posting;
+    value.len = 0;
+    if (chash_set(index->idx_terms, &key, &value, NULL) < 0) {
+      posting_free(posting);
+      return MAIL_ERROR_MEMORY;
+    }
+  }
+
+  return MAIL_NO_ERROR;
+}
+
+int mail_search_index_open(const char * filename,
+    struct mail_search_index ** result)
+{
+  struct mail_search_index * index;
+  char * data;
+  size_t length;
+  int r;
+
+  index = index_new(filename);
+  if (index == NULL)
+    return MAIL_ERROR_MEMORY;
+
+  r = generic_cache_read(index->idx_filename, &data, &length);
+  if (r == MAIL_NO_ERROR) {
+    r = index_load(index, data, length);
+    mmap_string_unref(data);
+    if (r != MAIL_NO_ERROR) {
+      index_free(index);
+      if (r != MAIL_ERROR_FILE)
+        return r;
+
+      /* a damaged index is rebuilt from scratch */
+      index = index_new(filename);
+      if (index == NULL)
+        return MAIL_ERROR_MEMORY;
+      index->idx_dirty = 1;
+    }
+  }
+
+  * result = index;
+
+  return MAIL_NO_ERROR;
+}
+
+int mail_search_index_save(struct mail_search_index * index)
+{
+  MMAPString * str;
+  unsigned int i;
+  chashiter * iter;
+  char tmp_filename[PATH_MAX];
+  FILE * f;
+  int r;
+  int res;
+
+  /* removed documents are dropped, the others are numbered again */
+  r = index_compact(index);
+  if (r != MAIL_NO_ERROR) {
+    res = r;
+    goto err;
+  }
+
+  str = mmap_string_new("");
+  if (str == NULL) {
+    res = MAIL_ERROR_MEMORY;
+    goto err;
+  }
+
+  if (mmap_string_append_len(str, INDEX_MAGIC, INDEX_MAGIC_LENGTH) == NULL)
+    goto free_str_memory;
+  if (write_varint(str, carray_count(index->idx_docs)) < 0)
+    goto free_str_memory;
+  for(i = 0 ; i < carray_count(index->idx_docs) ; i ++) {
+    struct mail_search_index_doc * doc;
+    size_t uid_len;
+
+    doc = carray_get(index->idx_docs, i);
+    uid_len = strlen(doc->doc_uid);
+    if (write_varint(str, (uint32_t) doc->doc_flags) < 0)
+      goto free_str_memory;
+    if (write_varint(str, (uint32_t) uid_len) < 0)
+      goto free_str_memory;
+    if (mmap_string_append_len(str, doc->doc_uid, uid_len) == NULL)
+      goto free_str_memory;
+  }
+
+  /* postings are never empty once the index is compacted */
+  if (write_varint(str, chash_count(index->idx_terms)) < 0)
+    goto free_str_memory;
+
+  for(iter = chash_begin(index->idx_terms) ; iter != NULL ;
+      iter = chash_next(index->idx_terms, iter)) {
+    chashdatum key;
+    chashdatum value;
+    struct posting * posting;
+    uint32_t last;
+    unsigned int j;
+
+    chash_key(iter, &key);
+    chash_value(iter, &value);
+    posting = value.data;
+
+    if (write_varint(str, key.len) < 0)
+      goto free_str_memory;
+    if (mmap_string_append_len(str, key.data, key.len) == NULL)
+      goto free_str_memory;
+    if (write_varint(str, posting->pst_count) < 0)
+      goto free_str_memory;
+    last = 0;
+    for(j = 0 ; j < posting->pst_count ; j ++) {
+      if (write_varint(str, posting->pst_ids[j] - last) < 0)
+        goto free_str_memory;
+      last = posting->pst_ids[j];
+    }
+  }
+
+  /* the new index replaces the old one only once it is complete */
+  snprintf(tmp_filename, PATH_MAX, "%s.tmp", index->idx_filename);
+  f = fopen(tmp_filename, "wb");
+  if (f == NULL) {
+    res = MAIL_ERROR_FILE;
+    goto free_str;
+  }
+  if (fwrite(str->str, 1, str->len, f) != str->len) {
+    fclose(f);
+    unlink(tmp_filename);
+    res = MAIL_ERROR_FILE;
+    goto free_str;
+  }
+  if (fclose(f) != 0) {
+    unlink(tmp_filename);
+    res = MAIL_ERROR_FILE;
+    goto free_str;
+  }
+  if (rename(tmp_filename, index->idx_filename) < 0) {
+    unlink(tmp_filename);
+    res = MAIL_ERROR_FILE;
+    goto free_str;
+  }
+
+  mmap_string_free(str);
+  index->idx_dirty = 0;
+
+  return MAIL_NO_ERROR;
+
+ free_str_memory:
+  res = MAIL_ERROR_MEMORY;
+ free_str:
+  mmap_string_free(str);
+ err:
+  return res;
+}
+
+void mail_search_index_close(struct mail_search_index * index)
+{
+  if (index->idx_dirty)
+    mail_search_index_save(index);
+  index_free(index);
+}
+
+/* search */
+
+static void docset_free(struct docset * set)
+{
+  free(set->ds_ids);
+  free(set);
+}
+
+static struct docset * docset_new(unsigned int size)
+{
+  struct docset * set;
+
+  set = malloc(sizeof(* set));
+  if (set == NULL)
+    return NULL;
+  set->ds_ids = malloc((size + 1) * sizeof(* set->ds_ids));
+  if (set->ds_ids == NULL) {
+    free(set);
+    return NULL;
+  }
+  set->ds_count = 0;
+
+  return set;
+}
+
+static struct docset * docset_all(struct mail_search_index * index)
+{
+  struct docset * set;
+  unsigned int i;
+
+  set = docset_new(carray_count(index->idx_docs));
+  if (set == NULL)
+    return NULL;
+  for(i = 0 ; i < carray_count(index->idx_docs) ; i ++) {
+    struct mail_search_index_doc * doc;
+
+    doc = carray_get(index->idx_docs, i);
+    if ((doc->doc_flags & MAIL_SEARCH_INDEX_DELETED) == 0)
+      set->ds_ids[set->ds_count ++] = i;
+  }
+
+  return set;
+}
+
+static struct docset * docset_and(struct docset * a, struct docset * b)
+{
+  struct docset * set;
+  unsigned int i;
+  unsigned int j;
+
+  set = docset_new(a->ds_count < b->ds_count ? a->ds_count : b->ds_count);
+  if (set == NULL)
+    return NULL;
+  i = 0;
+  j = 0;
+  while ((i < a->ds_count) && (j < b->ds_count)) {
+    if (a->ds_ids[i] < b->ds_ids[j])
+      i ++;
+    else if (a->ds_ids[i] > b->ds_ids[j])
+      j ++;
+    else {
+      set->ds_ids[set->ds_count ++] = a->ds_ids[i];
+      i ++;
+      j ++;
+    }
+  }
+
+  return set;
+}
+
+static struct docset * docset_or(struct docset * a, struct docset * b)
+{
+  struct docset * set;
+  unsigned int i;
+  unsigned int j;
+
+  set = docset_new(a->ds_count + b->ds_count);
+  if (set == NULL)
+    return NULL;
+  i = 0;
+  j = 0;
+  while ((i < a->ds_count) || (j < b->ds_count)) {
+    if ((j >= b->ds_count) ||
+        ((i < a->ds_count) && (a->ds_ids[i] < b->ds_ids[j])))
+      set->ds_ids[set->ds_count ++] = a->ds_ids[i ++];
+    else if ((i >= a->ds_count) || (a->ds_ids[i] > b->ds_ids[j]))
+      set->ds_ids[set->ds_count ++] = b->ds_ids[j ++];
+    else {
+      set->ds_ids[set->ds_count ++] = a->ds_ids[i];
+      i ++;
+      j ++;
+    }
+  }
+
+  return set;
+}
+
+/* documents of a that are not in b */
+
+static struct docset * docset_minus(struct docset * a, struct docset * b)
+{
+  struct docset * set;
+  unsigned int i;
+  unsigned int j;
+
+  set = docset_new(a->ds_count);
+  if (set == NULL)
+    return NULL;
+  j = 0;
+  for(i = 0 ; i < a->ds_count ; i ++) {
+    while ((j < b->ds_count) && (b->ds_ids[j] < a->ds_ids[i]))
+      j ++;
+    if ((j < b->ds_count) && (b->ds_ids[j] == a->ds_ids[i]))
+      continue;
+    set->ds_ids[set->ds_count ++] = a->ds_ids[i];
+  }
+
+  return set;
+}
+
+static int compare_ids(const void * a, const void * b)
+{
+  uint32_t id_a;
+  uint32_t id_b;
+
+  id_a = * (const uint32_t *) a;
+  id_b = * (const uint32_t *) b;
+  if (id_a < id_b)
+    return -1;
+  if (id_a > id_b)
+    return 1;
+  return 0;
+}
+
+/* sorts the documents and removes the duplicates */
+
+static void docset_sort(struct docset * set)
+{
+  unsigned int i;
+  unsigned int count;
+
+  if (set->ds_count == 0)
+    return;
+
+  qsort(set->ds_ids, set->ds_count, sizeof(* set->ds_ids), compare_ids);
+  count = 1;
+  for(i = 1 ; i < set->ds_count ; i ++)
+    if (set->ds_ids[i] != set->ds_ids[count - 1])
+      set->ds_ids[count ++] = set->ds_ids[i];
+  set->ds_count = count;
+}
+
+static int compare_terms(const void * a, const void * b)
+{
+  return strcmp(* (const char **) a, * (const char **) b);
+}
+
+static int index_sort_terms(struct mail_search_index * index)
+{
+  chashiter * iter;
+  carray * sorted;
+
+  if (index->idx_sorted_terms != NULL)
+    return MAIL_NO_ERROR;
+
+  sorted = carray_new(chash_count(index->idx_terms) + 1);
+  if (sorted == NULL)
+    return MAIL_ERROR_MEMORY;
+
+  for(iter = chash_begin(index->idx_terms) ; iter != NULL ;
+      iter = chash_next(index->idx_terms, iter)) {
+    chashdatum key;
+
+    chash_key(iter, &key);
+    if (carray_add(sorted, key.data, NULL) < 0) {
+      carray_free(sorted);
+      return MAIL_ERROR_MEMORY;
+    }
+  }
+  qsort(carray_data(sorted), carray_count(sorted), sizeof(void *),
+      compare_terms);
+
+  index->idx_sorted_terms = sorted;
+
+  return MAIL_NO_ERROR;
+}
+
+struct query_context {
+  struct mail_search_index * index;
+  int field;
+  struct docset * set;
+  int error;
+};
+
+/* documents having a word of the field that starts with term */
+
+static int query_term(const char * term, size_t length, void * data)
+{
+  struct query_context * ctx;
+  struct mail_search_index * index;
+  char key[TERM_MAX_LENGTH + 2];
+  struct docset * term_set;
+  struct docset * set;
+  unsigned int left;
+  unsigned int right;
+  unsigned int first;
+  unsigned int total;
+  unsigned int j;
+  int r;
+
+  ctx = data;
+  index = ctx->index;
+
+  r = index_sort_terms(index);
+  if (r != MAIL_NO_ERROR)
+    return r;
+
+  key[0] = (char) ('a' + ctx->field);
+  memcpy(key + 1, term, length);
+  key[length + 1] = '\0';
+
+  left = 0;
+  right = carray_count(index->idx_sorted_terms);
+  while (left < right) {
+    unsigned int middle;
+
+    middle = (left + right) / 2;
+    if (strcmp(carray_get(index->idx_sorted_terms, middle), key) < 0)
+      left = middle + 1;
+    else
+      right = middle;
+  }
+
+  /* all the words starting with the term are next to each other */
+  first = left;
+  total = 0;
+  for( ; left < carray_count(index->idx_sorted_terms) ; left ++) {
+    const char * term_key;
+    struct posting * posting;
+
+    term_key = carray_get(index->idx_sorted_terms, left);
+    if (strncmp(term_key, key, length + 1) != 0)
+      break;
+
+    posting = index_get_posting(index, term_key, strlen(term_key) + 1, 0);
+    if (posting != NULL)
+      total += posting->pst_count;
+  }
+
+  term_set = docset_new(total);
+  if (term_set == NULL)
+    return MAIL_ERROR_MEMORY;
+  for( ; first < left ; first ++) {
+    const char * term_key;
+    struct posting * posting;
+
+    term_key = carray_get(index->idx_sorted_terms, first);
+    posting = index_get_posting(index, term_key, strlen(term_key) + 1, 0);
+    if (posting == NULL)
+      continue;
+    for(j = 0 ; j < posting->pst_count ; j ++) {
+      struct mail_search_index_doc * doc;
+
+      /* removed documents keep their postings until the index is
+         compacted */
+      doc = carray_get(index->idx_docs, posting->pst_ids[j]);
+      if ((doc->doc_flags & MAIL_SEARCH_INDEX_DELETED) != 0)
+        continue;
+      term_set->ds_ids[term_set->ds_count ++] = posting->pst_ids[j];
+    }
+  }
+  docset_sort(term_set);
+
+  if (ctx->set == NULL) {
+    ctx->set = term_set;
+    return MAIL_NO_ERROR;
+  }
+
+  set = docset_and(ctx->set, term_set);
+  docset_free(term_set);
+  if (set == NULL)
+    return MAIL_ERROR_MEMORY;
+  docset_free(ctx->set);
+  ctx->set = set;
+
+  return MAIL_NO_ERROR;
+}
+
+static int query_field(struct mail_search_index * index, int field,
+    const char * text, struct docset ** result)
+{
+  struct query_context ctx;
+  int r;
+
+  ctx.index = index;
+  ctx.field = field;
+  ctx.set = NULL;
+
+  r = foreach_term(text, strlen(text), 0, query_term, &ctx);
+  if (r != MAIL_NO_ERROR) {
+    if (ctx.set != NULL)
+      docset_free(ctx.set);
+    return r;
+  }
+
+  /* a text without words matches all the messages */
+  if (ctx.set == NULL) {
+    ctx.set = docset_all(index);
+    if (ctx.set == NULL)
+      return MAIL_ERROR_MEMORY;
+  }
+
+  * result = ctx.set;
+
+  return MAIL_NO_ERROR;
+}
+
+static int header_name_to_field(const char * name)
+{
+  if (strcasecmp(name, "Subject") == 0)
+    return MAIL_SEARCH_INDEX_FIELD_SUBJECT;
+  if (strcasecmp(name, "From") == 0)
+    return MAIL_SEARCH_INDEX_FIELD_FROM;
+  if (strcasecmp(name, "To") == 0)
+    return MAIL_SEARCH_INDEX_FIELD_TO;
+  if (strcasecmp(name, "Cc") == 0)
+    return MAIL_SEARCH_INDEX_FIELD_CC;
+  if (strcasecmp(name, "Bcc") == 0)
+    return MAIL_SEARCH_INDEX_FIELD_BCC;
+  return -1;
+}
+
+static int query_key(struct mail_search_index * index,
+    struct mail_search_key * key, struct docset ** result)
+{
+  struct docset * set;
+  struct docset * other;
+  struct docset * combined;
+  clistiter * cur;
+  int field;
+  int r;
+
+  switch (key->sk_type) {
+  case MAIL_SEARCH_KEY_ALL:
+    set = docset_all(index);
+    if (set == NULL)
+      return MAIL_ERROR_MEMORY;
+    * result = set;
+    return MAIL_NO_ERROR;
+
+  case MAIL_SEARCH_KEY_BCC:
+    return query_field(index, MAIL_SEARCH_INDEX_FIELD_BCC, key->sk_bcc, result);
+
+  case MAIL_SEARCH_KEY_CC:
+    return query_field(index, MAIL_SEARCH_INDEX_FIELD_CC, key->sk_cc, result);
+
+  case MAIL_SEARCH_KEY_FROM:
+    return query_field(index, MAIL_SEARCH_INDEX_FIELD_FROM, key->sk_from, result);
+
+  case MAIL_SEARCH_KEY_SUBJECT:
+    return query_field(index, MAIL_SEARCH_INDEX_FIELD_SUBJECT,
+        key->sk_subject, result);
+
+  case MAIL_SEARCH_KEY_TO:
+    return query_field(index, MAIL_SEARCH_INDEX_FIELD_TO, key->sk_to, result);
+
+  case MAIL_SEARCH_KEY_BODY:
+    return query_field(index, MAIL_SEARCH_INDEX_FIELD_BODY, key->sk_body, result);
+
+  case MAIL_SEARCH_KEY_HEADER:
+    field = header_name_to_field(key->sk_header_name);
+    if (field < 0)
+      return MAIL_ERROR_NOT_IMPLEMENTED;
+    return query_field(index, field, key->sk_header_value, result);
+
+  case MAIL_SEARCH_KEY_TEXT:
+    /* the words may be in any of the fields */
+    set = docset_new(0);
+    if (set == NULL)
+      return MAIL_ERROR_MEMORY;
+    for(field = MAIL_SEARCH_INDEX_FIELD_SUBJECT ;
+        field <= MAIL_SEARCH_INDEX_FIELD_BODY ; field ++) {
+      r = query_field(index, field, key->sk_text, &other);
+      if (r != MAIL_NO_ERROR) {
+        docset_free(set);
+        return r;
+      }
+      combined = docset_or(set, other);
+      docset_free(other);
+      docset_free(set);
+      if (combined == NULL)
+        return MAIL_ERROR_MEMORY;
+      set = combined;
+    }
+    * result = set;
+    return MAIL_NO_ERROR;
+
+  case MAIL_SEARCH_KEY_NOT:
+    r = query_key(index, key->sk_not, &other);
+    if (r != MAIL_NO_ERROR)
+      return r;
+    set = docset_all(index);
+    if (set == NULL) {
+      docset_free(other);
+      return MAIL_ERROR_MEMORY;
+    }
+    combined = docset_minus(set, other);
+    docset_free(set);
+    docset_free(other);
+    if (combined == NULL)
+      return MAIL_ERROR_MEMORY;
+    * result = combined;
+    return MAIL_NO_ERROR;
+
+  case MAIL_SEARCH_KEY_OR:
+    r = query_key(index, key->sk_or1, &set);
+    if (r != MAIL_NO_ERROR)
+      return r;
+    r = query_key(index, key->sk_or2, &other);
+    if (r != MAIL_NO_ERROR) {
+      docset_free(set);
+      return r;
+    }
+    combined = docset_or(set, other);
+    docset_free(set);
+    docset_free(other);
+    if (combined == NULL)
+      return MAIL_ERROR_MEMORY;
+    * result = combined;
+    return MAIL_NO_ERROR;
+
+  case MAIL_SEARCH_KEY_MULTIPLE:
+    set = docset_all(index);
+    if (set == NULL)
+      return MAIL_ERROR_MEMORY;
+    for(cur = clist_begin(key->sk_multiple) ; cur != NULL ;
+        cur = clist_next(cur)) {
+      r = query_key(index, clist_content(cur), &other);
+      if (r != MAIL_NO_ERROR) {
+        docset_free(set);
+        return r;
+      }
+      combined = docset_and(set, other);
+      docset_free(set);
+      docset_free(other);
+      if (combined == NULL)
+        return MAIL_ERROR_MEMORY;
+      set = combined;
+    }
+    * result = set;
+    return MAIL_NO_ERROR;
+
+  default:
+    return MAIL_ERROR_NOT_IMPLEMENTED;
+  }
+}
+
+int mail_search_index_search(struct mail_search_index * index,
+    struct mail_search_key * key, clist ** result)
+{
+  struct docset * set;
+  clist * list;
+  unsigned int i;
+  int r;
+
+  r = query_key(index, key, &set);
+  if (r != MAIL_NO_ERROR)
+    return r;
+
+  list = clist_new();
+  if (list == NULL) {
+    docset_free(set);
+    return MAIL_ERROR_MEMORY;
+  }
+
+  for(i = 0 ; i < set->ds_count ; i ++) {
+    struct mail_search_index_doc * doc;
+    char * uid;
+
+    doc = carray_get(index->idx_docs, set->ds_ids[i]);
+    uid = strdup(doc->doc_uid);
+    if (uid == NULL)
+      goto free_list;
+    if (clist_append(list, uid) < 0) {
+      free(uid);
+      goto free_list;
+    }
+  }
+
+  docset_free(set);
+  * result = list;
+
+  return MAIL_NO_ERROR;
+
+ free_list:
+  mail_search_index_result_free(list);
+  docset_free(set);
+  return MAIL_ERROR_MEMORY;
+}
+
+void mail_search_index_result_free(clist * result)
+{
+  clist_foreach(result, (clist_func) free, NULL);
+  clist_free(result);
+}
@@ -0,0 +1,221 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2005 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef MAILSEARCHINDEX_H
+
+#define MAILSEARCHINDEX_H
+
+#include <libetpan/maildriver_types.h>
+#include <libetpan/carray.h>
+#include <libetpan/chash.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+  name of the index file in the cache directory of a mailbox, the
+  clean up of the message cache leaves it alone
+*/
+
+#define MAIL_SEARCH_INDEX_NAME "search-index"
+
+/*
+  fields of a message that are indexed
+*/
+
+enum {
+  MAIL_SEARCH_INDEX_FIELD_SUBJECT,
+  MAIL_SEARCH_INDEX_FIELD_FROM,
+  MAIL_SEARCH_INDEX_FIELD_TO,
+  MAIL_SEARCH_INDEX_FIELD_CC,
+  MAIL_SEARCH_INDEX_FIELD_BCC,
+  MAIL_SEARCH_INDEX_FIELD_BODY
+};
+
+/*
+  parts of a message that have been indexed
+*/
+
+enum {
+  MAIL_SEARCH_INDEX_HEADERS = 1 << 0,
+  MAIL_SEARCH_INDEX_BODY = 1 << 1,
+  MAIL_SEARCH_INDEX_DELETED = 1 << 2
+};
+
+/*
+  mail_search_index_doc is a message known by the index.
+
+  - uid is the unique identifier of the message (msg_uid)
+
+  - flags tells which parts of the message have been indexed
+    (MAIL_SEARCH_INDEX_XXX)
+*/
+
+struct mail_search_index_doc {
+  char * doc_uid;
+  int doc_flags;
+};
+
+/*
+  mail_search_index is an inverted index of the words of a set of
+  messages, kept in a file.
+
+  - filename is the file where the index is saved
+
+  - docs is the array of (struct mail_search_index_doc *), the position
+    of a message in this array is its document number
+
+  - uid_hash maps a uid to its document number
+
+  - terms maps a field and a word to the ascending array of the
+    document numbers of the messages that contain this word
+
+  - sorted_terms is the sorted array of the keys of terms, used to find
+    the words starting with a given prefix. NULL when it has to be
+    computed again.
+
+  - dirty is set when the index has changes that are not saved yet
+*/
+
+struct mail_search_index {
+  char * idx_filename;
+  carray * idx_docs;
+  chash * idx_uid_hash;
+  chash * idx_terms;
+  carray * idx_sorted_terms;
+  int idx_dirty;
+};
+
+/*
+  mail_search_index_open() loads the index saved in the given file.
+  A new empty index is returned if the file does not exist.
+*/
+
+LIBETPAN_EXPORT
+int mail_search_index_open(const char * filename,
+    struct mail_search_index ** result);
+
+/*
+  mail_search_index_close() saves the index if it was modified and
+  releases it.
+*/
+
+LIBETPAN_EXPORT
+void mail_search_index_close(struct mail_search_index * index);
+
+/*
+  mail_search_index_save() writes the index to its file. Messages
+  removed from the index are dropped from the file.
+*/
+
+LIBETPAN_EXPORT
+int mail_search_index_save(struct mail_search_index * index);
+
+/*
+  mail_search_index_get_flags() returns which parts of the message
+  have been indexed (MAIL_SEARCH_INDEX_XXX), 0 if the message is unknown.
+*/
+
+LIBETPAN_EXPORT
+int mail_search_index_get_flags(struct mail_search_index * index,
+    const char * uid);
+
+/*
+  mail_search_index_add_fields() indexes the Subject, From, To, Cc and
+  Bcc fields of a message, after decoding them to UTF-8.
+  Nothing is done if the headers of the message are already indexed.
+*/
+
+LIBETPAN_EXPORT
+int mail_search_index_add_fields(struct mail_search_index * index,
+    const char * uid, struct mailimf_fields * fields);
+
+/*
+  mail_search_index_add_message() indexes a whole RFC 822 message,
+  its header fields and the text parts of the body, once their
+  transfer encoding has been decoded and their charset converted
+  to UTF-8.
+  Nothing is done if the body of the message is already indexed.
+*/
+
+LIBETPAN_EXPORT
+int mail_search_index_add_message(struct mail_search_index * index,
+    const char * uid, const char * message, size_t length);
+
+/*
+  mail_search_index_remove() removes a message from the index.
+*/
+
+LIBETPAN_EXPORT
+void mail_search_index_remove(struct mail_search_index * index,
+    const char * uid);
+
+/*
+  mail_search_index_clean_up() removes from the index the messages
+  that are not in the given list.
+*/
+
+LIBETPAN_EXPORT
+int mail_search_index_clean_up(struct mail_search_index * index,
+    struct mailmessage_list * env_list);
+
+/*
+  mail_search_index_search() returns the uids of the messages that
+  match the given condition, as a list of (char *).
+
+  Words are compared after conversion to lower case, a word of the
+  condition matches the words of the message that start with it. All
+  the words of a condition have to be found in the message.
+
+  MAIL_SEARCH_KEY_ALL, BCC, BODY, CC, FROM, SUBJECT, TEXT, TO, HEADER
+  (on one of these fields), NOT, OR and MULTIPLE are supported.
+  MAIL_ERROR_NOT_IMPLEMENTED is returned if the condition uses another
+  criteria, the search has to be done on the messages in that case.
+
+  Messages whose body is not indexed yet are not returned by the BODY
+  criteria.
+
+  The result has to be freed with mail_search_index_result_free().
+*/
+
+LIBETPAN_EXPORT
+int mail_search_index_search(struct mail_search_index * index,
+    struct mail_search_key * key, clist ** result);
+
+LIBETPAN_EXPORT
+void mail_search_index_result_free(clist * result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -51,6 +51,7 @@
 #include "clist.h"
 #include "mailmessage.h"
 #include "timeutils.h"
+#include "mailparallel.h"
 #ifdef WIN32
 #	include "win_etpan.h"
 #endif
@@ -403,7 +404,26 @@ static char * extract_subject(char * default_from,
   return subj;
 }
 
-static int get_extracted_subject(char * default_from,
+/*
+  per-message data that can be computed before threading, independently
+  for each message, see mail_build_thread_parallel().
+*/
+
+struct thread_prepared_msg {
+  time_t date;
+  int subject_res;
+  char * base_subject;
+  int is_reply;
+};
+
+struct thread_prepared {
+  char * default_from;
+  carray * msg_tab;
+  struct thread_prepared_msg * tab; /* same indexes as msg_tab */
+  chash * msg_hash; /* (mailmessage *) -> (struct thread_prepared_msg *) */
+};
+
+static int compute_extracted_subject(char * default_from,
     struct mailmessage_tree * tree,
     char ** result)
 {
@@ -423,7 +443,44 @@ static int get_extracted_subject(char * default_from,
   return MAIL_ERROR_SUBJECT_NOT_FOUND;
 }
 
+static int get_extracted_subject(char * default_from,
+    struct thread_prepared * prepared,
+    struct mailmessage_tree * tree,
+    char ** result)
+{
+  struct thread_prepared_msg * info;
+  chashdatum key;
+  chashdatum value;
+  char * subj;
+  int r;
+
+  if (prepared == NULL)
+    return compute_extracted_subject(default_from, tree, result);
+
+  key.data = &tree->node_msg;
+  key.len = sizeof(tree->node_msg);
+  r = chash_get(prepared->msg_hash, &key, &value);
+  if (r < 0)
+    return compute_extracted_subject(default_from, tree, result);
+
+  info = value.data;
+  if (info->is_reply)
+    tree->node_is_reply = TRUE;
+
+  if (info->subject_res != MAIL_NO_ERROR)
+    return info->subject_res;
+
+  subj = strdup(info->base_subject);
+  if (subj == NULL)
+    return MAIL_ERROR_MEMORY;
+
+  * result = subj;
+
+  return MAIL_NO_ERROR;
+}
+
 static int get_thread_subject(char * default_from,
+    struct thread_prepared * prepared,
     struct mailmessage_tree * tree,
     char ** result)
 {
@@ -433,7 +490,8 @@ static int get_thread_subject(char * default_from,
 
   if (tree->node_msg != NULL) {
     if (tree->node_msg->msg_fields != NULL) {
-      r = get_extracted_subject(default_from, tree, &thread_subject);
+      r = get_extracted_subject(default_from, prepared,
+          tree, &thread_subject);
 
       if (r != MAIL_NO_ERROR)
 	return r;
@@ -448,7 +506,7 @@ static int get_thread_subject(char * default_from,
     
     child = carray_get(tree->node_children, i);
 
-    r = get_thread_subject(default_from, child, &thread_subject);
+    r = get_thread_subject(default_from, prepared, child, &thread_subject);
     
     switch (r) {
     case MAIL_NO_ERROR:
@@ -498,17 +556,15 @@ static inline time_t get_date(mailmessage * msg)
 static inline int is_descendant(struct mailmessage_tree * node,
 			 struct mailmessage_tree * maybe_child)
 {
-  unsigned int i;
-
-  for(i = 0 ; i < carray_count(node->node_children) ; i++) {
-    struct mailmessage_tree * tree;
+  struct mailmessage_tree * cur;
 
-    tree = carray_get(node->node_children, i);
-    if (tree == maybe_child)
+  /*
+    walk up from the candidate using the parent pointers, this costs
+    the depth of the candidate instead of the size of the subtree.
+  */
+  for(cur = maybe_child->node_parent ; cur != NULL ; cur = cur->node_parent) {
+    if (cur == node)
       return TRUE;
-    if (carray_count(tree->node_children) != 0)
-      if (is_descendant(tree, maybe_child))
-	return TRUE;
   }
 
   return FALSE;
@@ -681,7 +737,7 @@ int mail_thread_sort(struct mailmessage_tree * tree,
 
     subtree = carray_get(tree->node_children, cur);
 
-    if (sort_sub) {
+    if (sort_sub && (carray_count(subtree->node_children) > 0)) {
       r = mail_thread_sort(subtree, comp_func, sort_sub);
       if (r != MAIL_NO_ERROR) {
 	res = r;
@@ -690,6 +746,9 @@ int mail_thread_sort(struct mailmessage_tree * tree,
     }
   }
 
+  if (carray_count(tree->node_children) < 2)
+    return MAIL_NO_ERROR;
+
   qsort(carray_data(tree->node_children), carray_count(tree->node_children),
       sizeof(struct mailmessage_tree *),
 	(int (*)(const void *, const void *)) comp_func);
@@ -703,6 +762,7 @@ int mail_thread_sort(struct mailmessage_tree * tree,
 
 static int
 mail_build_thread_references(char * default_from,
+    struct thread_prepared * prepared,
     struct mailmessage_list * env_list,
     struct mailmessage_tree ** result,
     int use_subject, 
@@ -718,8 +778,17 @@ mail_build_thread_references(char * default_from,
   carray * msg_list;
   unsigned int i;
   chash * subject_hash;
+  unsigned int msg_count;
+
+  /*
+    size the tables from the number of envelopes so that they don't
+    get resized while threading large folders.
+  */
+  msg_count = carray_count(env_list->msg_tab);
+  if (msg_count < 128)
+    msg_count = 128;
 
-  msg_id_hash = chash_new(128, CHASH_COPYNONE);
+  msg_id_hash = chash_new(msg_count, CHASH_COPYNONE);
   if (msg_id_hash == NULL) {
     res = MAIL_ERROR_MEMORY;
     goto err;
@@ -732,7 +801,7 @@ mail_build_thread_references(char * default_from,
   }
   rootlist = root->node_children;
 
-  msg_list = carray_new(128);
+  msg_list = carray_new(msg_count);
   if (msg_list == NULL) {
     res = MAIL_ERROR_MEMORY;
     goto free_root;
@@ -774,7 +843,10 @@ mail_build_thread_references(char * default_from,
 	goto free_list;
       }
       
-      date = get_date(msg);
+      if (prepared != NULL)
+        date = prepared->tab[i].date;
+      else
+        date = get_date(msg);
       
       env_tree = mailmessage_tree_new(msgid, date, msg);
       if (env_tree == NULL) {
@@ -841,13 +913,15 @@ mail_build_thread_references(char * default_from,
       for(cur_ref = clist_begin(ref) ; cur_ref != NULL ;
 	  cur_ref = clist_next(cur_ref)) {
 	char * msgid;
+	size_t msgid_len;
 
 	last_env_cur_tree = env_cur_tree;
 
 	msgid = clist_content(cur_ref);
+	msgid_len = strlen(msgid);
 
 	hashkey.data = msgid;
-	hashkey.len = (unsigned int) strlen(msgid);
+	hashkey.len = (unsigned int) msgid_len;
 	
 	r = chash_get(msg_id_hash, &hashkey, &hashdata);
 	if (r < 0) {
@@ -872,8 +946,8 @@ mail_build_thread_references(char * default_from,
 	    goto free_list;
 	  }
 
+	  /* the hash key now points to the string owned by the tree node */
 	  hashkey.data = msgid;
-	  hashkey.len = (unsigned int) strlen(msgid);
 	    
 	  hashdata.data = env_cur_tree;
 	  hashdata.len = 0;
@@ -1017,7 +1091,8 @@ mail_build_thread_references(char * default_from,
 	if the current message is a dummy.
       */
 
-      r = get_thread_subject(default_from, env_tree, &base_subject);
+      r = get_thread_subject(default_from, prepared,
+          env_tree, &base_subject);
 
       /*
 	(ii) If the extracted subject is empty, skip this
@@ -1396,8 +1471,30 @@ mail_build_thread_references(char * default_from,
 
 
 
+/* removes the NULL entries left by carray_delete_fast() */
+
+static void compact_tree_list(carray * list)
+{
+  unsigned int cur;
+  unsigned int i;
+
+  i = 0;
+  for(cur = 0 ; cur < carray_count(list) ; cur ++) {
+    struct mailmessage_tree * env_tree;
+
+    env_tree = carray_get(list, cur);
+    if (env_tree == NULL)
+      continue;
+
+    carray_set(list, i, env_tree);
+    i ++;
+  }
+  carray_set_size(list, i);
+}
+
 static int
 mail_build_thread_orderedsubject(char * default_from,
+    struct thread_prepared * prepared,
     struct mailmessage_list * env_list,
     struct mailmessage_tree ** result,
     int (* comp_func)(struct mailmessage_tree **,
@@ -1436,7 +1533,10 @@ mail_build_thread_orderedsubject(char * default_from,
 
     if (msg->msg_fields != NULL) {
 
-      date = get_date(msg);
+      if (prepared != NULL)
+        date = prepared->tab[i].date;
+      else
+        date = get_date(msg);
 
       env_tree = mailmessage_tree_new(NULL, date, msg);
       if (env_tree == NULL) {
@@ -1453,7 +1553,8 @@ mail_build_thread_orderedsubject(char * default_from,
 	goto free;
       }
 
-      r = get_extracted_subject(default_from, env_tree, &base_subject);
+      r = get_extracted_subject(default_from, prepared,
+          env_tree, &base_subject);
       switch (r) {
       case MAIL_NO_ERROR:
 	env_tree->node_base_subject = base_subject;
@@ -1514,16 +1615,18 @@ mail_build_thread_orderedsubject(char * default_from,
       r = carray_add(current_thread->node_children, cur_env_tree, NULL);
       if (r < 0) {
 	res = MAIL_ERROR_MEMORY;
-	goto free;
+	goto compact;
       }
       
-      carray_delete(rootlist, cur);
+      /* keep the order of the remaining messages */
+      carray_delete_fast(rootlist, cur);
     }
-    else
-      cur ++;
+    cur ++;
     current_thread = cur_env_tree;
   }
 
+  compact_tree_list(rootlist);
+
   /*
     Finally, the threads are
     sorted by the sent date of the first message in the thread.
@@ -1554,6 +1657,8 @@ mail_build_thread_orderedsubject(char * default_from,
 
   return MAIL_NO_ERROR;
 
+ compact:
+  compact_tree_list(rootlist);
  free:
   mailmessage_tree_free_recursive(root);
  err:
@@ -1563,6 +1668,7 @@ mail_build_thread_orderedsubject(char * default_from,
 
 static int
 mail_build_thread_none(char * default_from,
+    struct thread_prepared * prepared,
     struct mailmessage_list * env_list,
     struct mailmessage_tree ** result,
     int (* comp_func)(struct mailmessage_tree **,
@@ -1594,7 +1700,10 @@ mail_build_thread_none(char * default_from,
 
     if (msg->msg_fields != NULL) {
 
-      date = get_date(msg);
+      if (prepared != NULL)
+        date = prepared->tab[i].date;
+      else
+        date = get_date(msg);
 
       env_tree = mailmessage_tree_new(NULL, date, msg);
       if (env_tree == NULL) {
@@ -1611,7 +1720,8 @@ mail_build_thread_none(char * default_from,
 	goto free;
       }
 
-      r = get_extracted_subject(default_from, env_tree, &base_subject);
+      r = get_extracted_subject(default_from, prepared,
+          env_tree, &base_subject);
       switch (r) {
       case MAIL_NO_ERROR:
 	env_tree->node_base_subject = base_subject;
@@ -1647,35 +1757,925 @@ mail_build_thread_none(char * default_from,
 }
 
 
-int mail_build_thread(int type, char * default_from,
+static int build_thread(int type, char * default_from,
+    struct thread_prepared * prepared,
     struct mailmessage_list * env_list,
     struct mailmessage_tree ** result,
      int (* comp_func)(struct mailmessage_tree **,
          struct mailmessage_tree **))
 {
-  unsigned int i;
-
-  for(i = 0 ; i < carray_count(env_list->msg_tab) ; i ++)
-    mailmessage_resolve_single_fields(carray_get(env_list->msg_tab, i));
-
   switch (type) {
   case MAIL_THREAD_REFERENCES:
-    return mail_build_thread_references(default_from,
+    return mail_build_thread_references(default_from, prepared,
         env_list, result, TRUE, comp_func);
 
   case MAIL_THREAD_REFERENCES_NO_SUBJECT:
-    return mail_build_thread_references(default_from,
+    return mail_build_thread_references(default_from, prepared,
         env_list, result, FALSE, comp_func);
 
   case MAIL_THREAD_ORDEREDSUBJECT:
-    return mail_build_thread_orderedsubject(default_from,
+    return mail_build_thread_orderedsubject(default_from, prepared,
         env_list, result, comp_func);
     
   case MAIL_THREAD_NONE:
-    return mail_build_thread_none(default_from,
+    return mail_build_thread_none(default_from, prepared,
         env_list, result, comp_func);
     
   default:
     return MAIL_ERROR_NOT_IMPLEMENTED;
   }
 }
+
+int mail_build_thread(int type, char * default_from,
+    struct mailmessage_list * env_list,
+    struct mailmessage_tree ** result,
+     int (* comp_func)(struct mailmessage_tree **,
+         struct mailmessage_tree **))
+{
+  unsigned int i;
+
+  for(i = 0 ; i < carray_count(env_list->msg_tab) ; i ++)
+    mailmessage_resolve_single_fields(carray_get(env_list->msg_tab, i));
+
+  return build_thread(type, default_from, NULL, env_list, result, comp_func);
+}
+
+/*
+  called from the worker threads, only the data of the given message
+  is written.
+*/
+
+static void prepare_msg(unsigned int indx, void * data)
+{
+  struct thread_prepared * prepared;
+  struct thread_prepared_msg * info;
+  struct mailmessage_tree tree;
+  mailmessage * msg;
+
+  prepared = data;
+  info = &prepared->tab[indx];
+
+  info->date = (time_t) -1;
+  info->subject_res = MAIL_ERROR_SUBJECT_NOT_FOUND;
+  info->base_subject = NULL;
+  info->is_reply = FALSE;
+
+  msg = carray_get(prepared->msg_tab, indx);
+  if (msg == NULL)
+    return;
+
+  mailmessage_resolve_single_fields(msg);
+  if (msg->msg_fields == NULL)
+    return;
+
+  info->date = get_date(msg);
+
+  /* only the reply flag is written to the tree */
+  tree.node_msg = msg;
+  tree.node_is_reply = FALSE;
+  info->subject_res = compute_extracted_subject(prepared->default_from,
+      &tree, &info->base_subject);
+  info->is_reply = tree.node_is_reply;
+}
+
+int mail_build_thread_parallel(int type, char * default_from,
+    struct mailmessage_list * env_list,
+    struct mailmessage_tree ** result,
+    int (* comp_func)(struct mailmessage_tree **,
+        struct mailmessage_tree **),
+    unsigned int nb_threads)
+{
+  struct thread_prepared prepared;
+  unsigned int count;
+  unsigned int i;
+  int r;
+  int res;
+
+  if (nb_threads == 1)
+    return mail_build_thread(type, default_from, env_list,
+        result, comp_func);
+
+  count = carray_count(env_list->msg_tab);
+
+  prepared.default_from = default_from;
+  prepared.msg_tab = env_list->msg_tab;
+  prepared.tab = malloc(sizeof(* prepared.tab) * (count + 1));
+  if (prepared.tab == NULL) {
+    res = MAIL_ERROR_MEMORY;
+    goto err;
+  }
+
+  mail_parallel_run(count, nb_threads, prepare_msg, &prepared);
+
+  prepared.msg_hash = chash_new(count, CHASH_COPYKEY);
+  if (prepared.msg_hash == NULL) {
+    res = MAIL_ERROR_MEMORY;
+    goto free_tab;
+  }
+
+  for(i = 0 ; i < count ; i ++) {
+    mailmessage * msg;
+    chashdatum key;
+    chashdatum value;
+
+    msg = carray_get(env_list->msg_tab, i);
+    if (msg == NULL)
+      continue;
+
+    key.data = &msg;
+    key.len = sizeof(msg);
+    value.data = &prepared.tab[i];
+    value.len = 0;
+    r = chash_set(prepared.msg_hash, &key, &value, NULL);
+    if (r < 0) {
+      res = MAIL_ERROR_MEMORY;
+      goto free_hash;
+    }
+  }
+
+  /* linking is done serially, the result is the same as mail_build_thread() */
+  r = build_thread(type, default_from, &prepared, env_list,
+      result, comp_func);
+  if (r != MAIL_NO_ERROR) {
+    res = r;
+    goto free_hash;
+  }
+
+  chash_free(prepared.msg_hash);
+  for(i = 0 ; i < count ; i ++)
+    free(prepared.tab[i].base_subject);
+  free(prepared.tab);
+
+  return MAIL_NO_ERROR;
+
+ free_hash:
+  chash_free(prepared.msg_hash);
+ free_tab:
+  for(i = 0 ; i < count ; i ++)
+    free(prepared.tab[i].base_subject);
+  free(prepared.tab);
+ err:
+  return res;
+}
+
+
+struct mailthread_index * mailthread_index_new(int type,
+    char * default_from)
+{
+  struct mailthread_index * index;
+
+  index = malloc(sizeof(* index));
+  if (index == NULL)
+    goto err;
+
+  index->idx_type = type;
+  index->idx_next_seq = 0;
+
+  if (default_from == NULL)
+    default_from = "US-ASCII";
+  index->idx_default_from = strdup(default_from);
+  if (index->idx_default_from == NULL)
+    goto free;
+
+  index->idx_msg_hash = chash_new(CHASH_DEFAULTSIZE, CHASH_COPYKEY);
+  if (index->idx_msg_hash == NULL)
+    goto free_default_from;
+
+  index->idx_id_hash = chash_new(CHASH_DEFAULTSIZE, CHASH_COPYKEY);
+  if (index->idx_id_hash == NULL)
+    goto free_msg_hash;
+
+  index->idx_subject_hash = chash_new(CHASH_DEFAULTSIZE, CHASH_COPYKEY);
+  if (index->idx_subject_hash == NULL)
+    goto free_id_hash;
+
+  return index;
+
+ free_id_hash:
+  chash_free(index->idx_id_hash);
+ free_msg_hash:
+  chash_free(index->idx_msg_hash);
+ free_default_from:
+  free(index->idx_default_from);
+ free:
+  free(index);
+ err:
+  return NULL;
+}
+
+static void free_entry_array_hash(chash * hash)
+{
+  chashiter * iter;
+
+  for(iter = chash_begin(hash) ; iter != NULL ;
+      iter = chash_next(hash, iter)) {
+    chashdatum value;
+
+    chash_value(iter, &value);
+    carray_free(value.data);
+  }
+  chash_free(hash);
+}
+
+void mailthread_index_free(struct mailthread_index * index)
+{
+  chashiter * iter;
+
+  for(iter = chash_begin(index->idx_msg_hash) ; iter != NULL ;
+      iter = chash_next(index->idx_msg_hash, iter)) {
+    chashdatum value;
+    struct mailthread_index_entry * entry;
+
+    chash_value(iter, &value);
+    entry = value.data;
+    free(entry->ent_base_subject);
+    free(entry);
+  }
+  chash_free(index->idx_msg_hash);
+
+  free_entry_array_hash(index->idx_id_hash);
+  free_entry_array_hash(index->idx_subject_hash);
+
+  free(index->idx_default_from);
+  free(index);
+}
+
+/* incremental update of a message tree */
+
+static int entry_array_add(chash * hash, char * key_str,
+    struct mailthread_index_entry * entry)
+{
+  chashdatum key;
+  chashdatum value;
+  carray * array;
+  int r;
+
+  key.data = key_str;
+  key.len = (unsigned int) strlen(key_str);
+
+  r = chash_get(hash, &key, &value);
+  if (r < 0) {
+    array = carray_new(4);
+    if (array == NULL)
+      return MAIL_ERROR_MEMORY;
+
+    value.data = array;
+    value.len = 0;
+    r = chash_set(hash, &key, &value, NULL);
+    if (r < 0) {
+      carray_free(array);
+      return MAIL_ERROR_MEMORY;
+    }
+  }
+  else {
+    array = value.data;
+
+    /* a message can reference the same message-id several times */
+    if (carray_get(array, carray_count(array) - 1) == entry)
+      return MAIL_NO_ERROR;
+  }
+
+  r = carray_add(array, entry, NULL);
+  if (r < 0)
+    return MAIL_ERROR_MEMORY;
+
+  return MAIL_NO_ERROR;
+}
+
+static void entry_array_remove(chash * hash, char * key_str,
+    struct mailthread_index_entry * entry)
+{
+  chashdatum key;
+  chashdatum value;
+  carray * array;
+  unsigned int i;
+  int r;
+
+  key.data = key_str;
+  key.len = (unsigned int) strlen(key_str);
+
+  r = chash_get(hash, &key, &value);
+  if (r < 0)
+    return;
+
+  array = value.data;
+  i = 0;
+  while (i < carray_count(array)) {
+    if (carray_get(array, i) == entry)
+      carray_delete(array, i);
+    else
+      i ++;
+  }
+
+  if (carray_count(array) == 0) {
+    chash_delete(hash, &key, NULL);
+    carray_free(array);
+  }
+}
+
+static carray * entry_array_get(chash * hash, char * key_str)
+{
+  chashdatum key;
+  chashdatum value;
+  int r;
+
+  key.data = key_str;
+  key.len = (unsigned int) strlen(key_str);
+
+  r = chash_get(hash, &key, &value);
+  if (r < 0)
+    return NULL;
+
+  return value.data;
+}
+
+/*
+  the message-ids used to link a message are its own message-id and
+  the ones of References, or In-Reply-To when there is no References.
+*/
+
+static inline clist * get_link_ref(mailmessage * msg)
+{
+  clist * ref;
+
+  ref = get_ref(msg);
+  if (ref == NULL)
+    ref = get_in_reply_to(msg);
+
+  return ref;
+}
+
+static inline int index_use_id(struct mailthread_index * index)
+{
+  return (index->idx_type == MAIL_THREAD_REFERENCES) ||
+    (index->idx_type == MAIL_THREAD_REFERENCES_NO_SUBJECT);
+}
+
+static inline int index_use_subject(struct mailthread_index * index)
+{
+  return (index->idx_type == MAIL_THREAD_REFERENCES) ||
+    (index->idx_type == MAIL_THREAD_ORDEREDSUBJECT);
+}
+
+static struct mailthread_index_entry *
+index_get_entry(struct mailthread_index * index, mailmessage * msg)
+{
+  chashdatum key;
+  chashdatum value;
+  int r;
+
+  key.data = &msg;
+  key.len = sizeof(msg);
+
+  r = chash_get(index->idx_msg_hash, &key, &value);
+  if (r < 0)
+    return NULL;
+
+  return value.data;
+}
+
+static void index_remove_entry(struct mailthread_index * index,
+    struct mailthread_index_entry * entry)
+{
+  mailmessage * msg;
+  chashdatum key;
+
+  msg = entry->ent_msg;
+
+  if (index_use_id(index)) {
+    char * msgid;
+    clist * ref;
+
+    msgid = get_msg_id(msg);
+    if (msgid != NULL)
+      entry_array_remove(index->idx_id_hash, msgid, entry);
+
+    ref = get_link_ref(msg);
+    if (ref != NULL) {
+      clistiter * cur;
+
+      for(cur = clist_begin(ref) ; cur != NULL ; cur = clist_next(cur))
+        entry_array_remove(index->idx_id_hash, clist_content(cur), entry);
+    }
+  }
+
+  if (entry->ent_base_subject != NULL)
+    entry_array_remove(index->idx_subject_hash,
+        entry->ent_base_subject, entry);
+
+  key.data = &msg;
+  key.len = sizeof(msg);
+  chash_delete(index->idx_msg_hash, &key, NULL);
+
+  free(entry->ent_base_subject);
+  free(entry);
+}
+
+static int index_add_entry(struct mailthread_index * index,
+    mailmessage * msg, struct mailthread_index_entry ** result)
+{
+  struct mailthread_index_entry * entry;
+  chashdatum key;
+  chashdatum value;
+  int r;
+  int res;
+
+  entry = malloc(sizeof(* entry));
+  if (entry == NULL) {
+    res = MAIL_ERROR_MEMORY;
+    goto err;
+  }
+  entry->ent_msg = msg;
+  entry->ent_seq = index->idx_next_seq ++;
+  entry->ent_node = NULL;
+  entry->ent_base_subject = NULL;
+
+  if (index_use_subject(index)) {
+    struct mailmessage_tree tree;
+
+    /* only the reply flag is written to the tree */
+    tree.node_msg = msg;
+    tree.node_is_reply = FALSE;
+    r = compute_extracted_subject(index->idx_default_from, &tree,
+        &entry->ent_base_subject);
+    if ((r != MAIL_NO_ERROR) && (r != MAIL_ERROR_SUBJECT_NOT_FOUND)) {
+      res = r;
+      goto free;
+    }
+  }
+
+  key.data = &msg;
+  key.len = sizeof(msg);
+  value.data = entry;
+  value.len = 0;
+  r = chash_set(index->idx_msg_hash, &key, &value, NULL);
+  if (r < 0) {
+    res = MAIL_ERROR_MEMORY;
+    goto free;
+  }
+
+  if (index_use_id(index)) {
+    char * msgid;
+    clist * ref;
+
+    msgid = get_msg_id(msg);
+    if (msgid != NULL) {
+      r = entry_array_add(index->idx_id_hash, msgid, entry);
+      if (r != MAIL_NO_ERROR) {
+        res = r;
+        goto remove;
+      }
+    }
+
+    ref = get_link_ref(msg);
+    if (ref != NULL) {
+      clistiter * cur;
+
+      for(cur = clist_begin(ref) ; cur != NULL ; cur = clist_next(cur)) {
+        r = entry_array_add(index->idx_id_hash, clist_content(cur), entry);
+        if (r != MAIL_NO_ERROR) {
+          res = r;
+          goto remove;
+        }
+      }
+    }
+  }
+
+  if (entry->ent_base_subject != NULL) {
+    r = entry_array_add(index->idx_subject_hash,
+        entry->ent_base_subject, entry);
+    if (r != MAIL_NO_ERROR) {
+      res = r;
+      goto remove;
+    }
+  }
+
+  * result = entry;
+
+  return MAIL_NO_ERROR;
+
+ remove:
+  /* removes the partially registered entry and frees it */
+  index_remove_entry(index, entry);
+  goto err;
+ free:
+  free(entry->ent_base_subject);
+  free(entry);
+ err:
+  return res;
+}
+
+static inline struct mailmessage_tree *
+get_thread_top(struct mailmessage_tree * root,
+    struct mailmessage_tree * node)
+{
+  while (node->node_parent != root)
+    node = node->node_parent;
+
+  return node;
+}
+
+static int collect_thread_entries(struct mailthread_index * index,
+    struct mailmessage_tree * node, carray * entry_list)
+{
+  unsigned int i;
+  int r;
+
+  if (node->node_msg != NULL) {
+    struct mailthread_index_entry * entry;
+
+    /* expunged messages are no more in the index */
+    entry = index_get_entry(index, node->node_msg);
+    if (entry != NULL) {
+      r = carray_add(entry_list, entry, NULL);
+      if (r < 0)
+        return MAIL_ERROR_MEMORY;
+    }
+  }
+
+  for(i = 0 ; i < carray_count(node->node_children) ; i ++) {
+    r = collect_thread_entries(index, carray_get(node->node_children, i),
+        entry_list);
+    if (r != MAIL_NO_ERROR)
+      return r;
+  }
+
+  return MAIL_NO_ERROR;
+}
+
+static int mark_thread(struct mailthread_index * index,
+    struct mailmessage_tree * root, struct mailmessage_tree * node,
+    chash * thread_hash, carray * entry_list)
+{
+  struct mailmessage_tree * top;
+  chashdatum key;
+  chashdatum value;
+  int r;
+
+  top = get_thread_top(root, node);
+
+  key.data = &top;
+  key.len = sizeof(top);
+  if (chash_get(thread_hash, &key, &value) == 0)
+    return MAIL_NO_ERROR;
+
+  value.data = top;
+  value.len = 0;
+  r = chash_set(thread_hash, &key, &value, NULL);
+  if (r < 0)
+    return MAIL_ERROR_MEMORY;
+
+  return collect_thread_entries(index, top, entry_list);
+}
+
+static void entry_list_remove(carray * entry_list,
+    struct mailthread_index_entry * entry)
+{
+  unsigned int i;
+
+  for(i = 0 ; i < carray_count(entry_list) ; i ++) {
+    if (carray_get(entry_list, i) == entry) {
+      carray_delete_slow(entry_list, i);
+      break;
+    }
+  }
+}
+
+static int mark_entry_array(struct mailthread_index * index,
+    struct mailmessage_tree * root, carray * array,
+    chash * thread_hash, carray * entry_list)
+{
+  unsigned int i;
+  int r;
+
+  if (array == NULL)
+    return MAIL_NO_ERROR;
+
+  for(i = 0 ; i < carray_count(array) ; i ++) {
+    struct mailthread_index_entry * entry;
+
+    entry = carray_get(array, i);
+    /* new messages are not in the tree yet */
+    if (entry->ent_node == NULL)
+      continue;
+
+    r = mark_thread(index, root, entry->ent_node, thread_hash, entry_list);
+    if (r != MAIL_NO_ERROR)
+      return r;
+  }
+
+  return MAIL_NO_ERROR;
+}
+
+static int entry_seq_comp(struct mailthread_index_entry ** pentry1,
+    struct mailthread_index_entry ** pentry2)
+{
+  if ((* pentry1)->ent_seq < (* pentry2)->ent_seq)
+    return -1;
+  if ((* pentry1)->ent_seq > (* pentry2)->ent_seq)
+    return 1;
+  return 0;
+}
+
+static void update_entry_nodes(struct mailthread_index * index,
+    struct mailmessage_tree * node)
+{
+  unsigned int i;
+
+  if (node->node_msg != NULL) {
+    struct mailthread_index_entry * entry;
+
+    entry = index_get_entry(index, node->node_msg);
+    if (entry != NULL)
+      entry->ent_node = node;
+  }
+
+  for(i = 0 ; i < carray_count(node->node_children) ; i ++)
+    update_entry_nodes(index, carray_get(node->node_children, i));
+}
+
+int mail_thread_update(struct mailthread_index * index,
+    struct mailmessage_tree ** ptree,
+    struct mailmessage_list * new_list,
+    struct mailmessage_list * expunged_list,
+    int (* comp_func)(struct mailmessage_tree **,
+        struct mailmessage_tree **))
+{
+  struct mailmessage_tree * root;
+  struct mailmessage_tree * sub_root;
+  struct mailmessage_list sub_list;
+  chash * thread_hash;
+  carray * entry_list;
+  carray * msg_tab;
+  unsigned int cur;
+  unsigned int i;
+  uint32_t seq;
+  int r;
+  int res;
+
+  root = * ptree;
+  if (root == NULL) {
+    root = mailmessage_tree_new(NULL, (time_t) -1, NULL);
+    if (root == NULL) {
+      res = MAIL_ERROR_MEMORY;
+      goto err;
+    }
+  }
+
+  thread_hash = chash_new(CHASH_DEFAULTSIZE, CHASH_COPYKEY);
+  if (thread_hash == NULL) {
+    res = MAIL_ERROR_MEMORY;
+    goto free_root;
+  }
+
+  entry_list = carray_new(128);
+  if (entry_list == NULL) {
+    res = MAIL_ERROR_MEMORY;
+    goto free_thread_hash;
+  }
+
+  if (new_list != NULL) {
+    for(i = 0 ; i < carray_count(new_list->msg_tab) ; i ++) {
+      mailmessage * msg;
+      struct mailthread_index_entry * entry;
+
+      msg = carray_get(new_list->msg_tab, i);
+      if (msg == NULL)
+        continue;
+
+      if (msg->msg_fields == NULL)
+        continue;
+
+      mailmessage_resolve_single_fields(msg);
+
+      /*
+        a message that is already in the index is replaced, keeping its
+        place, its fields may have changed and its thread is threaded again.
+      */
+      seq = index->idx_next_seq;
+      entry = index_get_entry(index, msg);
+      if (entry != NULL) {
+        seq = entry->ent_seq;
+        if (entry->ent_node != NULL) {
+          r = mark_thread(index, root, entry->ent_node,
+              thread_hash, entry_list);
+          if (r != MAIL_NO_ERROR) {
+            res = r;
+            goto free_entry_list;
+          }
+        }
+        entry_list_remove(entry_list, entry);
+        index_remove_entry(index, entry);
+      }
+
+      entry = NULL;
+      r = index_add_entry(index, msg, &entry);
+      if (r != MAIL_NO_ERROR) {
+        res = r;
+        goto free_entry_list;
+      }
+      entry->ent_seq = seq;
+
+      r = carray_add(entry_list, entry, NULL);
+      if (r < 0) {
+        res = MAIL_ERROR_MEMORY;
+        goto free_entry_list;
+      }
+    }
+  }
+
+  /*
+    the threads of the removed messages will be threaded again,
+    without them. A message that is both added and removed is
+    not threaded.
+  */
+
+  if (expunged_list != NULL) {
+    for(i = 0 ; i < carray_count(expunged_list->msg_tab) ; i ++) {
+      struct mailthread_index_entry * entry;
+
+      entry = index_get_entry(index, carray_get(expunged_list->msg_tab, i));
+      if (entry == NULL)
+        continue;
+
+      if (entry->ent_node != NULL) {
+        r = mark_thread(index, root, entry->ent_node,
+            thread_hash, entry_list);
+        if (r != MAIL_NO_ERROR) {
+          res = r;
+          goto free_entry_list;
+        }
+      }
+    }
+
+    for(i = 0 ; i < carray_count(expunged_list->msg_tab) ; i ++) {
+      struct mailthread_index_entry * entry;
+
+      entry = index_get_entry(index, carray_get(expunged_list->msg_tab, i));
+      if (entry == NULL)
+        continue;
+
+      entry_list_remove(entry_list, entry);
+      index_remove_entry(index, entry);
+    }
+  }
+
+  /*
+    collect all the threads that share a message-id or a subject
+    with the messages to thread again, until no more threads are found.
+  */
+
+  for(cur = 0 ; cur < carray_count(entry_list) ; cur ++) {
+    struct mailthread_index_entry * entry;
+    mailmessage * msg;
+
+    entry = carray_get(entry_list, cur);
+    msg = entry->ent_msg;
+
+    if (index_use_id(index)) {
+      char * msgid;
+      clist * ref;
+
+      msgid = get_msg_id(msg);
+      if (msgid != NULL) {
+        r = mark_entry_array(index, root,
+            entry_array_get(index->idx_id_hash, msgid),
+            thread_hash, entry_list);
+        if (r != MAIL_NO_ERROR) {
+          res = r;
+          goto free_entry_list;
+        }
+      }
+
+      ref = get_link_ref(msg);
+      if (ref != NULL) {
+        clistiter * cur_ref;
+
+        for(cur_ref = clist_begin(ref) ; cur_ref != NULL ;
+            cur_ref = clist_next(cur_ref)) {
+          r = mark_entry_array(index, root,
+              entry_array_get(index->idx_id_hash, clist_content(cur_ref)),
+              thread_hash, entry_list);
+          if (r != MAIL_NO_ERROR) {
+            res = r;
+            goto free_entry_list;
+          }
+        }
+      }
+    }
+
+    if (entry->ent_base_subject != NULL) {
+      /* empty subjects are not merged by REFERENCES */
+      if ((index->idx_type == MAIL_THREAD_ORDEREDSUBJECT) ||
+          (* entry->ent_base_subject != '\0')) {
+        r = mark_entry_array(index, root,
+            entry_array_get(index->idx_subject_hash,
+                entry->ent_base_subject),
+            thread_hash, entry_list);
+        if (r != MAIL_NO_ERROR) {
+          res = r;
+          goto free_entry_list;
+        }
+      }
+    }
+  }
+
+  /* thread the collected messages in their arrival order */
+
+  qsort(carray_data(entry_list), carray_count(entry_list),
+      sizeof(struct mailthread_index_entry *),
+      (int (*)(const void *, const void *)) entry_seq_comp);
+
+  msg_tab = carray_new(carray_count(entry_list) + 1);
+  if (msg_tab == NULL) {
+    res = MAIL_ERROR_MEMORY;
+    goto free_entry_list;
+  }
+
+  for(cur = 0 ; cur < carray_count(entry_list) ; cur ++) {
+    struct mailthread_index_entry * entry;
+
+    entry = carray_get(entry_list, cur);
+    r = carray_add(msg_tab, entry->ent_msg, NULL);
+    if (r < 0) {
+      carray_free(msg_tab);
+      res = MAIL_ERROR_MEMORY;
+      goto free_entry_list;
+    }
+  }
+
+  sub_list.msg_tab = msg_tab;
+  r = mail_build_thread(index->idx_type, index->idx_default_from,
+      &sub_list, &sub_root, comp_func);
+  carray_free(msg_tab);
+  if (r != MAIL_NO_ERROR) {
+    res = r;
+    goto free_entry_list;
+  }
+
+  /* replace the collected threads with the new ones */
+
+  i = 0;
+  for(cur = 0 ; cur < carray_count(root->node_children) ; cur ++) {
+    struct mailmessage_tree * top;
+    chashdatum key;
+    chashdatum value;
+
+    top = carray_get(root->node_children, cur);
+
+    key.data = &top;
+    key.len = sizeof(top);
+    if (chash_get(thread_hash, &key, &value) == 0) {
+      mailmessage_tree_free_recursive(top);
+      continue;
+    }
+
+    carray_set(root->node_children, i, top);
+    i ++;
+  }
+  carray_set_size(root->node_children, i);
+
+  for(cur = 0 ; cur < carray_count(sub_root->node_children) ; cur ++) {
+    struct mailmessage_tree * top;
+
+    top = carray_get(sub_root->node_children, cur);
+    r = carray_add(root->node_children, top, NULL);
+    if (r < 0) {
+      mailmessage_tree_free_recursive(sub_root);
+      res = MAIL_ERROR_MEMORY;
+      goto free_entry_list;
+    }
+    /* set parent */
+    top->node_parent = root;
+
+    update_entry_nodes(index, top);
+  }
+  carray_set_size(sub_root->node_children, 0);
+  mailmessage_tree_free(sub_root);
+
+  if (comp_func == NULL)
+    comp_func = mailthread_tree_timecomp;
+
+  r = mail_thread_sort(root, comp_func, FALSE);
+  if (r != MAIL_NO_ERROR) {
+    res = r;
+    goto free_entry_list;
+  }
+
+  carray_free(entry_list);
+  chash_free(thread_hash);
+
+  * ptree = root;
+
+  return MAIL_NO_ERROR;
+
+ free_entry_list:
+  carray_free(entry_list);
+ free_thread_hash:
+  chash_free(thread_hash);
+ free_root:
+  if (* ptree == NULL)
+    mailmessage_tree_free_recursive(root);
+ err:
+  return res;
+}
@@ -876,7 +876,7 @@ static void folder_disconnect(struct storage_ref_info * ref_info,
   
   /* folder is disconnected, session is lost */
   folder_ref_info->lost_session = 1;
-  mailfolder_disconnect(folder);
+  mailfolder_drop_session(folder);
   
   if (folder->fld_shared_session)
     do_storage_disconnect(ref_info);
@@ -79,6 +79,8 @@ struct newsfeed * newsfeed_new(void)
     goto free;
   feed->feed_response_code = 0;
   feed->feed_timeout = 0;
+  feed->feed_etag = NULL;
+  feed->feed_last_modified = NULL;
   
   return feed;
   
@@ -98,6 +100,8 @@ void newsfeed_free(struct newsfeed * feed)
   free(feed->feed_language);
   free(feed->feed_author);
   free(feed->feed_generator);
+  free(feed->feed_etag);
+  free(feed->feed_last_modified);
   
   for(i = 0 ; i < carray_count(feed->feed_item_list) ; i ++) {
     struct newsfeed_item * item;
@@ -297,37 +301,141 @@ struct newsfeed_item * newsfeed_get_item(struct newsfeed * feed, unsigned int n)
   return carray_get(feed->feed_item_list, n);
 }
 
-/* feed_update()
- * Takes initialized feed with url set, fetches the feed from this url,
- * updates rest of Feed struct members and returns HTTP response code
- * we got from url's server. */
-int newsfeed_update(struct newsfeed * feed, time_t last_update)
-{
 #if (defined(HAVE_CURL) && defined(HAVE_EXPAT))
+/* One HTTP transfer of a feed: the curl handle, the parser context
+ * that newsfeed_writefunc() feeds as bytes arrive, and the cache
+ * validators returned by the server. */
+struct newsfeed_transfer {
   CURL * eh;
-  CURLcode curl_res;
-  struct newsfeed_parser_context * feed_ctx;
-  unsigned int res;
-  unsigned int timeout_value;
-  long response_code;
+  struct newsfeed_parser_context * ctx;
+  struct curl_slist * headers;
+  char * etag;
+  char * last_modified;
+  unsigned int index;
+};
+
+/* Stores a copy of the value of the header line if it is the header
+ * called name. Returns 1 if the header matched, 0 if it did not, -1 if
+ * memory is exhausted. */
+static int newsfeed_header_value(const char * line, size_t len,
+    const char * name, char ** result)
+{
+  size_t name_len;
+  size_t begin;
+  size_t end;
+  char * value;
   
-  if (feed->feed_url == NULL) {
-    res = NEWSFEED_ERROR_BADURL;
-    goto err;
+  name_len = strlen(name);
+  if (len <= name_len)
+    return 0;
+  if (line[name_len] != ':')
+    return 0;
+  if (strncasecmp(line, name, name_len) != 0)
+    return 0;
+  
+  begin = name_len + 1;
+  while ((begin < len) && ((line[begin] == ' ') || (line[begin] == '\t')))
+    begin ++;
+  end = len;
+  while ((end > begin) && ((line[end - 1] == '\r') || (line[end - 1] == '\n') ||
+             (line[end - 1] == ' ') || (line[end - 1] == '\t')))
+    end --;
+  
+  value = malloc(end - begin + 1);
+  if (value == NULL)
+    return -1;
+  memcpy(value, line + begin, end - begin);
+  value[end - begin] = '\0';
+  
+  free(* result);
+  * result = value;
+  
+  return 1;
+}
+
+static size_t newsfeed_headerfunc(void * ptr, size_t size, size_t nmemb, void * data)
+{
+  struct newsfeed_transfer * transfer;
+  const char * line;
+  size_t len;
+  
+  transfer = data;
+  line = ptr;
+  len = size * nmemb;
+  
+  /* A status line starts a new response, after a redirect for example,
+   * only the validators of the last response are kept. */
+  if ((len >= 5) && (strncmp(line, "HTTP/", 5) == 0)) {
+    free(transfer->etag);
+    transfer->etag = NULL;
+    free(transfer->last_modified);
+    transfer->last_modified = NULL;
+    return len;
   }
   
-  /* Init curl before anything else. */
-  eh = curl_easy_init();
-  if (eh == NULL) {
-    res = NEWSFEED_ERROR_MEMORY;
-    goto err;
+  if (newsfeed_header_value(line, len, "ETag", &transfer->etag) < 0)
+    return 0;
+  if (newsfeed_header_value(line, len, "Last-Modified",
+          &transfer->last_modified) < 0)
+    return 0;
+  
+  return len;
+}
+
+static int newsfeed_add_header(struct newsfeed_transfer * transfer,
+    const char * name, const char * value)
+{
+  struct curl_slist * headers;
+  char * line;
+  
+  line = malloc(strlen(name) + strlen(value) + 3);
+  if (line == NULL)
+    return -1;
+  strcpy(line, name);
+  strcat(line, ": ");
+  strcat(line, value);
+  
+  headers = curl_slist_append(transfer->headers, line);
+  free(line);
+  if (headers == NULL)
+    return -1;
+  transfer->headers = headers;
+  
+  return 0;
+}
+
+static void newsfeed_transfer_clear(struct newsfeed_transfer * transfer)
+{
+  if (transfer->ctx != NULL) {
+    mmap_string_free(transfer->ctx->str);
+    XML_ParserFree(transfer->ctx->parser);
+    free(transfer->ctx);
+    transfer->ctx = NULL;
+  }
+  if (transfer->headers != NULL) {
+    curl_slist_free_all(transfer->headers);
+    transfer->headers = NULL;
   }
+  free(transfer->etag);
+  transfer->etag = NULL;
+  free(transfer->last_modified);
+  transfer->last_modified = NULL;
+}
+
+/* Prepares the curl handle of the transfer to fetch the given feed.
+ * The handle is reset first, so that it can be reused from one feed
+ * to the next while keeping its connections. */
+static int newsfeed_transfer_start(struct newsfeed_transfer * transfer,
+    struct newsfeed * feed, time_t last_update)
+{
+  struct newsfeed_parser_context * feed_ctx;
+  unsigned int timeout_value;
+  int res;
   
-  /* Curl initialized, create parser context now. */
   feed_ctx = malloc(sizeof(* feed_ctx));
   if (feed_ctx == NULL) {
     res = NEWSFEED_ERROR_MEMORY;
-    goto free_eh;
+    goto err;
   }
   
   feed_ctx->parser = XML_ParserCreate(NULL);
@@ -350,69 +458,361 @@ int newsfeed_update(struct newsfeed * feed, time_t last_update)
    * correct parser later. */
   newsfeed_parser_set_expat_handlers(feed_ctx);
   
+  transfer->ctx = feed_ctx;
+  transfer->headers = NULL;
+  transfer->etag = NULL;
+  transfer->last_modified = NULL;
+  
+  /* Ask the server to answer 304 Not Modified if the copy we have
+   * is still current. */
+  if (feed->feed_etag != NULL) {
+    if (newsfeed_add_header(transfer, "If-None-Match", feed->feed_etag) < 0) {
+      res = NEWSFEED_ERROR_MEMORY;
+      goto clear;
+    }
+  }
+  if (feed->feed_last_modified != NULL) {
+    if (newsfeed_add_header(transfer, "If-Modified-Since",
+            feed->feed_last_modified) < 0) {
+      res = NEWSFEED_ERROR_MEMORY;
+      goto clear;
+    }
+  }
+  
   if (feed->feed_timeout != 0)
     timeout_value = feed->feed_timeout;
   else
     timeout_value = mailstream_network_delay.tv_sec;
   
-  curl_easy_setopt(eh, CURLOPT_URL, feed->feed_url);
-  curl_easy_setopt(eh, CURLOPT_NOPROGRESS, 1);
+  curl_easy_reset(transfer->eh);
+  curl_easy_setopt(transfer->eh, CURLOPT_URL, feed->feed_url);
+  curl_easy_setopt(transfer->eh, CURLOPT_NOPROGRESS, 1);
 #ifdef CURLOPT_MUTE
-  curl_easy_setopt(eh, CURLOPT_MUTE, 1);
+  curl_easy_setopt(transfer->eh, CURLOPT_MUTE, 1);
 #endif
-  curl_easy_setopt(eh, CURLOPT_WRITEFUNCTION, newsfeed_writefunc);
-  curl_easy_setopt(eh, CURLOPT_WRITEDATA, feed_ctx);
-  curl_easy_setopt(eh, CURLOPT_FOLLOWLOCATION, 1);
-  curl_easy_setopt(eh, CURLOPT_MAXREDIRS, 3);
-  curl_easy_setopt(eh, CURLOPT_TIMEOUT, timeout_value);
-  curl_easy_setopt(eh, CURLOPT_NOSIGNAL, 1);
-  curl_easy_setopt(eh, CURLOPT_USERAGENT, "libEtPan!");
+  curl_easy_setopt(transfer->eh, CURLOPT_WRITEFUNCTION, newsfeed_writefunc);
+  curl_easy_setopt(transfer->eh, CURLOPT_WRITEDATA, feed_ctx);
+  curl_easy_setopt(transfer->eh, CURLOPT_HEADERFUNCTION, newsfeed_headerfunc);
+  curl_easy_setopt(transfer->eh, CURLOPT_HEADERDATA, transfer);
+  curl_easy_setopt(transfer->eh, CURLOPT_HTTPHEADER, transfer->headers);
+  curl_easy_setopt(transfer->eh, CURLOPT_FOLLOWLOCATION, 1);
+  curl_easy_setopt(transfer->eh, CURLOPT_MAXREDIRS, 3);
+  curl_easy_setopt(transfer->eh, CURLOPT_TIMEOUT, timeout_value);
+  curl_easy_setopt(transfer->eh, CURLOPT_NOSIGNAL, 1);
+  curl_easy_setopt(transfer->eh, CURLOPT_USERAGENT, "libEtPan!");
   
   /* Use HTTP's If-Modified-Since feature, if application provided
-   * the timestamp of last update. */
-  if (last_update != -1) {
-    curl_easy_setopt(eh, CURLOPT_TIMECONDITION,
+   * the timestamp of last update and no Last-Modified value of the
+   * server is known. */
+  if ((feed->feed_last_modified == NULL) && (last_update != -1)) {
+    curl_easy_setopt(transfer->eh, CURLOPT_TIMECONDITION,
         CURL_TIMECOND_IFMODSINCE);
-    curl_easy_setopt(eh, CURLOPT_TIMEVALUE, last_update);
+    curl_easy_setopt(transfer->eh, CURLOPT_TIMEVALUE, last_update);
   }
         
 #if LIBCURL_VERSION_NUM >= 0x070a00
-  curl_easy_setopt(eh, CURLOPT_SSL_VERIFYPEER, 0);
-  curl_easy_setopt(eh, CURLOPT_SSL_VERIFYHOST, 0);
+  curl_easy_setopt(transfer->eh, CURLOPT_SSL_VERIFYPEER, 0);
+  curl_easy_setopt(transfer->eh, CURLOPT_SSL_VERIFYHOST, 0);
 #endif
+  
+  return NEWSFEED_NO_ERROR;
+  
+ clear:
+  newsfeed_transfer_clear(transfer);
+  return res;
+ free_praser:
+  XML_ParserFree(feed_ctx->parser);
+ free_ctx:
+  free(feed_ctx);
+ err:
+  return res;
+}
 
-  curl_res = curl_easy_perform(eh);
-  if (curl_res != 0) {
+/* Collects the result of a finished transfer and releases its parser.
+ * The validators of the response are remembered in the feed when a
+ * new copy of the feed was received. */
+static int newsfeed_transfer_finish(struct newsfeed_transfer * transfer,
+    CURLcode curl_res)
+{
+  struct newsfeed * feed;
+  long response_code;
+  int res;
+  
+  feed = transfer->ctx->feed;
+  
+  if (curl_res != CURLE_OK) {
     res = curl_error_convert(curl_res);
-    goto free_str;
+    goto clear;
   }
   
-  curl_easy_getinfo(eh, CURLINFO_RESPONSE_CODE, &response_code);
+  response_code = 0;
+  curl_easy_getinfo(transfer->eh, CURLINFO_RESPONSE_CODE, &response_code);
   
-  curl_easy_cleanup(eh);
+  if (transfer->ctx->error != NEWSFEED_NO_ERROR) {
+    res = transfer->ctx->error;
+    goto clear;
+  }
+  
+  feed->feed_response_code = (int) response_code;
   
-  if (feed_ctx->error != NEWSFEED_NO_ERROR) {
-    res = feed_ctx->error;
-    goto free_str;
+  if ((response_code >= 200) && (response_code < 300)) {
+    free(feed->feed_etag);
+    feed->feed_etag = transfer->etag;
+    transfer->etag = NULL;
+    free(feed->feed_last_modified);
+    feed->feed_last_modified = transfer->last_modified;
+    transfer->last_modified = NULL;
   }
   
-  /* Cleanup, we should be done. */
-  mmap_string_free(feed_ctx->str);
-  XML_ParserFree(feed_ctx->parser);
-  free(feed_ctx);
+  res = NEWSFEED_NO_ERROR;
   
-  feed->feed_response_code = (int) response_code;
+ clear:
+  newsfeed_transfer_clear(transfer);
+  return res;
+}
+#endif
+
+/* feed_update()
+ * Takes initialized feed with url set, fetches the feed from this url,
+ * updates rest of Feed struct members and returns HTTP response code
+ * we got from url's server. */
+int newsfeed_update(struct newsfeed * feed, time_t last_update)
+{
+#if (defined(HAVE_CURL) && defined(HAVE_EXPAT))
+  struct newsfeed_transfer transfer;
+  CURLcode curl_res;
+  int res;
   
-  return NEWSFEED_NO_ERROR;;
+  if (feed->feed_url == NULL) {
+    res = NEWSFEED_ERROR_BADURL;
+    goto err;
+  }
+  
+  /* Init curl before anything else. */
+  transfer.eh = curl_easy_init();
+  if (transfer.eh == NULL) {
+    res = NEWSFEED_ERROR_MEMORY;
+    goto err;
+  }
+  transfer.ctx = NULL;
+  transfer.headers = NULL;
+  transfer.etag = NULL;
+  transfer.last_modified = NULL;
+  transfer.index = 0;
+  
+  res = newsfeed_transfer_start(&transfer, feed, last_update);
+  if (res != NEWSFEED_NO_ERROR)
+    goto free_eh;
+  
+  curl_res = curl_easy_perform(transfer.eh);
+  res = newsfeed_transfer_finish(&transfer, curl_res);
   
- free_str:
-  mmap_string_free(feed_ctx->str);
- free_praser:
-  XML_ParserFree(feed_ctx->parser);
- free_ctx:
-  free(feed_ctx);
  free_eh:
-  curl_easy_cleanup(eh);
+  curl_easy_cleanup(transfer.eh);
+ err:
+  return res;
+#else
+  return NEWSFEED_ERROR_INTERNAL;
+#endif
+}
+
+#if (defined(HAVE_CURL) && defined(HAVE_EXPAT))
+/* Removes the finished transfers from the multi handle and stores their
+ * result. Returns the number of transfers that finished. */
+static unsigned int newsfeed_multi_collect(CURLM * mh, int * results)
+{
+  CURLMsg * msg;
+  int queued;
+  unsigned int done;
+  
+  done = 0;
+  while ((msg = curl_multi_info_read(mh, &queued)) != NULL) {
+    struct newsfeed_transfer * transfer;
+    char * priv;
+    
+    if (msg->msg != CURLMSG_DONE)
+      continue;
+    
+    priv = NULL;
+    curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &priv);
+    transfer = (struct newsfeed_transfer *) priv;
+    curl_multi_remove_handle(mh, msg->easy_handle);
+    results[transfer->index] = newsfeed_transfer_finish(transfer, msg->data.result);
+    done ++;
+  }
+  
+  return done;
+}
+
+static void newsfeed_multi_wait(CURLM * mh)
+{
+#if LIBCURL_VERSION_NUM >= 0x071c00
+  curl_multi_wait(mh, NULL, 0, 1000, NULL);
+#else
+  fd_set read_fds;
+  fd_set write_fds;
+  fd_set except_fds;
+  struct timeval delay;
+  int max_fd;
+  
+  FD_ZERO(&read_fds);
+  FD_ZERO(&write_fds);
+  FD_ZERO(&except_fds);
+  max_fd = -1;
+  curl_multi_fdset(mh, &read_fds, &write_fds, &except_fds, &max_fd);
+  delay.tv_sec = 0;
+  delay.tv_usec = 100000;
+  select(max_fd + 1, &read_fds, &write_fds, &except_fds, &delay);
+#endif
+}
+#endif
+
+#define NEWSFEED_DEFAULT_MAX_CONNECTIONS 8
+
+/* feed_update_multi()
+ * Updates several feeds at once. The transfers share a curl multi
+ * handle, so connections to a server are reused from one feed to the
+ * next, and at most max_connections of them are in flight (8 if 0 is
+ * given). Each feed is parsed as its bytes arrive. The ETag and
+ * Last-Modified values stored in the feeds are sent along, and
+ * updated from the responses, so that the application can keep them
+ * between runs with newsfeed_get_etag() and newsfeed_get_last_modified().
+ * results[i] receives what newsfeed_update() would have returned for
+ * feeds[i]. */
+int newsfeed_update_multi(struct newsfeed ** feeds, unsigned int count,
+    unsigned int max_connections, int * results)
+{
+#if (defined(HAVE_CURL) && defined(HAVE_EXPAT))
+  CURLM * mh;
+  CURLMcode mr;
+  struct newsfeed_transfer * slots;
+  unsigned int slot_count;
+  unsigned int next;
+  unsigned int running;
+  unsigned int i;
+  int still_running;
+  int res;
+  
+  if (count == 0)
+    return NEWSFEED_NO_ERROR;
+  
+  if (max_connections == 0)
+    max_connections = NEWSFEED_DEFAULT_MAX_CONNECTIONS;
+  slot_count = max_connections;
+  if (slot_count > count)
+    slot_count = count;
+  
+  mh = curl_multi_init();
+  if (mh == NULL) {
+    res = NEWSFEED_ERROR_MEMORY;
+    goto err;
+  }
+  curl_multi_setopt(mh, CURLMOPT_MAXCONNECTS, (long) max_connections);
+#if LIBCURL_VERSION_NUM >= 0x071e00
+  curl_multi_setopt(mh, CURLMOPT_MAX_TOTAL_CONNECTIONS, (long) max_connections);
+#endif
+  
+  slots = malloc(slot_count * sizeof(* slots));
+  if (slots == NULL) {
+    res = NEWSFEED_ERROR_MEMORY;
+    goto free_mh;
+  }
+  for(i = 0 ; i < slot_count ; i ++) {
+    slots[i].eh = NULL;
+    slots[i].ctx = NULL;
+    slots[i].headers = NULL;
+    slots[i].etag = NULL;
+    slots[i].last_modified = NULL;
+    slots[i].index = 0;
+  }
+  for(i = 0 ; i < slot_count ; i ++) {
+    slots[i].eh = curl_easy_init();
+    if (slots[i].eh == NULL) {
+      res = NEWSFEED_ERROR_MEMORY;
+      goto free_slots;
+    }
+  }
+  
+  next = 0;
+  running = 0;
+  while (1) {
+    /* Start new transfers in the free slots. */
+    for(i = 0 ; (i < slot_count) && (next < count) ; i ++) {
+      struct newsfeed * feed;
+      int r;
+      
+      if (slots[i].ctx != NULL)
+        continue;
+      
+      while ((slots[i].ctx == NULL) && (next < count)) {
+        feed = feeds[next];
+        if (feed->feed_url == NULL) {
+          results[next] = NEWSFEED_ERROR_BADURL;
+          next ++;
+          continue;
+        }
+        
+        r = newsfeed_transfer_start(&slots[i], feed, -1);
+        if (r != NEWSFEED_NO_ERROR) {
+          results[next] = r;
+          next ++;
+          continue;
+        }
+        slots[i].index = next;
+        curl_easy_setopt(slots[i].eh, CURLOPT_PRIVATE, (char *) &slots[i]);
+        
+        mr = curl_multi_add_handle(mh, slots[i].eh);
+        if (mr != CURLM_OK) {
+          newsfeed_transfer_clear(&slots[i]);
+          results[next] = NEWSFEED_ERROR_INTERNAL;
+          next ++;
+          continue;
+        }
+        next ++;
+        running ++;
+      }
+    }
+    
+    if (running == 0)
+      break;
+    
+    mr = curl_multi_perform(mh, &still_running);
+    if ((mr != CURLM_OK) && (mr != CURLM_CALL_MULTI_PERFORM)) {
+      res = NEWSFEED_ERROR_INTERNAL;
+      goto abort;
+    }
+    
+    i = newsfeed_multi_collect(mh, results);
+    running -= i;
+    if ((i == 0) && (still_running > 0))
+      newsfeed_multi_wait(mh);
+  }
+  
+  for(i = 0 ; i < slot_count ; i ++)
+    curl_easy_cleanup(slots[i].eh);
+  free(slots);
+  curl_multi_cleanup(mh);
+  
+  return NEWSFEED_NO_ERROR;
+  
+ abort:
+  for(i = 0 ; i < slot_count ; i ++) {
+    if (slots[i].ctx != NULL) {
+      curl_multi_remove_handle(mh, slots[i].eh);
+      results[slots[i].index] = res;
+      newsfeed_transfer_clear(&slots[i]);
+    }
+  }
+  for( ; next < count ; next ++)
+    results[next] = NEWSFEED_ERROR_CANCELLED;
+ free_slots:
+  for(i = 0 ; i < slot_count ; i ++) {
+    if (slots[i].eh != NULL)
+      curl_easy_cleanup(slots[i].eh);
+  }
+  free(slots);
+ free_mh:
+  curl_multi_cleanup(mh);
  err:
   return res;
 #else
@@ -535,7 +935,10 @@ static int curl_error_convert(int curl_res)
   case CURLE_SSL_ENGINE_SETFAILED:
   case CURLE_SSL_CERTPROBLEM:
   case CURLE_SSL_CIPHER:
+#if LIBCURL_VERSION_NUM < 0x073e00
+  /* same value as CURLE_SSL_PEER_CERTIFICATE since curl 7.62.0 */
   case CURLE_SSL_CACERT:
+#endif
   case CURLE_FTP_SSL_FAILED:
   case CURLE_SSL_ENGINE_INITFAILED:
     return NEWSFEED_ERROR_SSL;
@@ -555,3 +958,58 @@ unsigned int newsfeed_get_timeout(struct newsfeed * feed)
 {
   return feed->feed_timeout;
 }
+
+/* ETag of the last copy of the feed, sent as If-None-Match */
+int newsfeed_set_etag(struct newsfeed * feed, const char * etag)
+{
+  if (etag != feed->feed_etag) {
+    char * dup_etag;
+    
+    if (etag == NULL) {
+      dup_etag = NULL;
+    }
+    else {
+      dup_etag = strdup(etag);
+      if (dup_etag == NULL)
+        return -1;
+    }
+    
+    free(feed->feed_etag);
+    feed->feed_etag = dup_etag;
+  }
+  
+  return 0;
+}
+
+const char * newsfeed_get_etag(struct newsfeed * feed)
+{
+  return feed->feed_etag;
+}
+
+/* Last-Modified of the last copy of the feed, sent as If-Modified-Since */
+int newsfeed_set_last_modified(struct newsfeed * feed,
+    const char * last_modified)
+{
+  if (last_modified != feed->feed_last_modified) {
+    char * dup_last_modified;
+    
+    if (last_modified == NULL) {
+      dup_last_modified = NULL;
+    }
+    else {
+      dup_last_modified = strdup(last_modified);
+      if (dup_last_modified == NULL)
+        return -1;
+    }
+    
+    free(feed->feed_last_modified);
+    feed->feed_last_modified = dup_last_modified;
+  }
+  
+  return 0;
+}
+
+const char * newsfeed_get_last_modified(struct newsfeed * feed)
+{
+  return feed->feed_last_modified;
+}
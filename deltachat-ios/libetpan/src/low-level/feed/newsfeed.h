@@ -69,8 +69,18 @@ time_t newsfeed_get_date(struct newsfeed * feed);
 void newsfeed_set_timeout(struct newsfeed * feed, unsigned int timeout);
 unsigned int newsfeed_get_timeout(struct newsfeed * feed);
 
+int newsfeed_set_etag(struct newsfeed * feed, const char * etag);
+const char * newsfeed_get_etag(struct newsfeed * feed);
+
+int newsfeed_set_last_modified(struct newsfeed * feed,
+    const char * last_modified);
+const char * newsfeed_get_last_modified(struct newsfeed * feed);
+
 int newsfeed_add_item(struct newsfeed * feed, struct newsfeed_item * item);
 
 int newsfeed_update(struct newsfeed * feed, time_t last_update);
 
+int newsfeed_update_multi(struct newsfeed ** feeds, unsigned int count,
+    unsigned int max_connections, int * results);
+
 #endif /* NEWSFEED_H */
@@ -72,6 +72,9 @@ struct newsfeed {
   int feed_response_code;
   
   unsigned int feed_timeout;
+  
+  char * feed_etag;
+  char * feed_last_modified;
 };
 
 struct newsfeed_item {
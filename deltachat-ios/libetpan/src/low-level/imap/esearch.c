@@ -0,0 +1,705 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2018 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include "esearch.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "mailimap.h"
+#include "mailimap_extension.h"
+#include "mailimap_extension_types.h"
+#include "mailimap_sender.h"
+#include "mailimap_parser.h"
+#include "mailimap_keywords.h"
+#include "mailimap_uidset.h"
+
+/*
+   RFC 4731
+
+   search-return-opts   = SP "RETURN" SP "(" [search-return-opt
+                          *(SP search-return-opt)] ")"
+
+   search-return-opt    = "MIN" / "MAX" / "ALL" / "COUNT" /
+                          search-ret-opt-ext
+
+   esearch-response     = "ESEARCH" [search-correlator] [SP "UID"]
+                          *(SP search-return-data)
+
+   search-correlator    = SP "(" "TAG" SP tag-string ")"
+
+   search-return-data   = "MIN" SP nz-number /
+                          "MAX" SP nz-number /
+                          "ALL" SP sequence-set /
+                          "COUNT" SP number /
+                          search-ret-data-ext
+
+   search-ret-data-ext  = search-modifier-name SP search-return-value
+
+   mailbox-data         =/ esearch-response
+
+   RFC 7162
+
+   search-return-data   =/ "MODSEQ" SP mod-sequence-value
+*/
+
+enum {
+  MAILIMAP_ESEARCH_TYPE_ESEARCH
+};
+
+static int
+mailimap_esearch_extension_parse(int calling_parser, mailstream * fd,
+    MMAPString * buffer, struct mailimap_parser_context * parser_ctx, size_t * indx,
+    struct mailimap_extension_data ** result,
+    size_t progr_rate, progress_function * progr_fun);
+
+static void
+mailimap_esearch_extension_data_free(struct mailimap_extension_data * ext_data);
+
+LIBETPAN_EXPORT
+struct mailimap_extension_api mailimap_extension_esearch = {
+  /* name */          "ESEARCH",
+  /* extension_id */  MAILIMAP_EXTENSION_ESEARCH,
+  /* parser */        mailimap_esearch_extension_parse,
+  /* free */          mailimap_esearch_extension_data_free
+};
+
+static int mailimap_esearch_return_options_send(mailstream * fd,
+    int return_options)
+{
+  static struct {
+    int option;
+    const char * name;
+  } options[] = {
+    { MAILIMAP_ESEARCH_RETURN_MIN, "MIN" },
+    { MAILIMAP_ESEARCH_RETURN_MAX, "MAX" },
+    { MAILIMAP_ESEARCH_RETURN_ALL, "ALL" },
+    { MAILIMAP_ESEARCH_RETURN_COUNT, "COUNT" },
+  };
+  unsigned int i;
+  int first;
+  int r;
+  
+  r = mailimap_token_send(fd, "RETURN");
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+  
+  r = mailimap_space_send(fd);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+  
+  r = mailimap_oparenth_send(fd);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+  
+  first = 1;
+  for(i = 0 ; i < sizeof(options) / sizeof(options[0]) ; i ++) {
+    if ((return_options & options[i].option) == 0)
+      continue;
+    
+    if (!first) {
+      r = mailimap_space_send(fd);
+      if (r != MAILIMAP_NO_ERROR)
+        return r;
+    }
+    r = mailimap_token_send(fd, options[i].name);
+    if (r != MAILIMAP_NO_ERROR)
+      return r;
+    first = 0;
+  }
+  
+  r = mailimap_cparenth_send(fd);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+  
+  return MAILIMAP_NO_ERROR;
+}
+
+static int mailimap_esearch_send(mailstream * fd, int return_options,
+    const char * charset, struct mailimap_search_key * key)
+{
+  int r;
+  
+  r = mailimap_token_send(fd, "SEARCH");
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+  
+  r = mailimap_space_send(fd);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+  
+  r = mailimap_esearch_return_options_send(fd, return_options);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+  
+  if (charset != NULL) {
+    r = mailimap_space_send(fd);
+    if (r != MAILIMAP_NO_ERROR)
+      return r;
+    
+    r = mailimap_token_send(fd, "CHARSET");
+    if (r != MAILIMAP_NO_ERROR)
+      return r;
+    
+    r = mailimap_space_send(fd);
+    if (r != MAILIMAP_NO_ERROR)
+      return r;
+    
+    r = mailimap_astring_send(fd, charset);
+    if (r != MAILIMAP_NO_ERROR)
+      return r;
+  }
+  
+  r = mailimap_space_send(fd);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+  
+  r = mailimap_search_key_send(fd, key);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+  
+  return MAILIMAP_NO_ERROR;
+}
+
+static int mailimap_uid_esearch_send(mailstream * fd, int return_options,
+    const char * charset, struct mailimap_search_key * key)
+{
+  int r;
+  
+  r = mailimap_token_send(fd, "UID");
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+  
+  r = mailimap_space_send(fd);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+  
+  return mailimap_esearch_send(fd, return_options, charset, key);
+}
+
+static int esearch(mailimap * session, int uid_search, int return_options,
+    const char * charset, struct mailimap_search_key * key,
+    struct mailimap_esearch_result ** result)
+{
+  struct mailimap_response * response;
+  struct mailimap_esearch_result * esearch_result;
+  clistiter * cur;
+  char tag_str[15];
+  int error_code;
+  int r;
+  
+  if (session->imap_state != MAILIMAP_STATE_SELECTED)
+    return MAILIMAP_ERROR_BAD_STATE;
+  
+  r = mailimap_send_current_tag(session);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+  
+  if (uid_search)
+    r = mailimap_uid_esearch_send(session->imap_stream, return_options,
+        charset, key);
+  else
+    r = mailimap_esearch_send(session->imap_stream, return_options,
+        charset, key);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+  
+  r = mailimap_crlf_send(session->imap_stream);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+  
+  if (mailstream_flush(session->imap_stream) == -1)
+    return MAILIMAP_ERROR_STREAM;
+  
+  if (mailimap_read_line(session) == NULL)
+    return MAILIMAP_ERROR_STREAM;
+  
+  r = mailimap_parse_response(session, &response);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+  
+  if (mailimap_is_163_workaround_enabled(session))
+    snprintf(tag_str, sizeof(tag_str), "C%i", session->imap_tag);
+  else
+    snprintf(tag_str, sizeof(tag_str), "%i", session->imap_tag);
+  
+  /* ESEARCH responses of other commands may be received at the same time */
+  esearch_result = NULL;
+  for (cur = clist_begin(session->imap_response_info->rsp_extension_list);
+       cur != NULL; cur = clist_next(cur)) {
+    struct mailimap_extension_data * ext_data;
+    struct mailimap_esearch_result * current;
+    
+    ext_data = (struct mailimap_extension_data *) clist_content(cur);
+    if (ext_data->ext_extension->ext_id != MAILIMAP_EXTENSION_ESEARCH)
+      continue;
+    if (esearch_result != NULL)
+      continue;
+    
+    current = ext_data->ext_data;
+    if ((current->es_tag != NULL) && (strcmp(current->es_tag, tag_str) != 0))
+      continue;
+    
+    esearch_result = current;
+    ext_data->ext_data = NULL;
+    ext_data->ext_type = -1;
+  }
+  
+  clist_foreach(session->imap_response_info->rsp_extension_list,
+      (clist_func) mailimap_extension_data_free, NULL);
+  clist_free(session->imap_response_info->rsp_extension_list);
+  session->imap_response_info->rsp_extension_list = NULL;
+  
+  error_code = response->rsp_resp_done->rsp_data.rsp_tagged->rsp_cond_state->rsp_type;
+  mailimap_response_free(response);
+  
+  if (error_code != MAILIMAP_RESP_COND_STATE_OK) {
+    if (esearch_result != NULL)
+      mailimap_esearch_result_free(esearch_result);
+    if (uid_search)
+      return MAILIMAP_ERROR_UID_SEARCH;
+    else
+      return MAILIMAP_ERROR_SEARCH;
+  }
+  
+  if (esearch_result == NULL)
+    return MAILIMAP_ERROR_EXTENSION;
+  
+  * result = esearch_result;
+  
+  return MAILIMAP_NO_ERROR;
+}
+
+LIBETPAN_EXPORT
+int mailimap_esearch(mailimap * session, int return_options,
+    const char * charset, struct mailimap_search_key * key,
+    struct mailimap_esearch_result ** result)
+{
+  return esearch(session, 0, return_options, charset, key, result);
+}
+
+LIBETPAN_EXPORT
+int mailimap_uid_esearch(mailimap * session, int return_options,
+    const char * charset, struct mailimap_search_key * key,
+    struct mailimap_esearch_result ** result)
+{
+  return esearch(session, 1, return_options, charset, key, result);
+}
+
+LIBETPAN_EXPORT
+int mailimap_has_esearch(mailimap * session)
+{
+  return mailimap_has_extension(session, "ESEARCH");
+}
+
+/*
+  sequence-set is parsed straight into a mailimap_uidset, without
+  building a list of set items.
+*/
+
+static int mailimap_uidset_parse(mailstream * fd, MMAPString * buffer,
+    struct mailimap_parser_context * parser_ctx, size_t * indx,
+    struct mailimap_uidset ** result)
+{
+  struct mailimap_uidset * uidset;
+  size_t cur_token;
+  int r;
+  int res;
+  
+  cur_token = * indx;
+  
+  uidset = mailimap_uidset_new();
+  if (uidset == NULL) {
+    res = MAILIMAP_ERROR_MEMORY;
+    goto err;
+  }
+  
+  while (1) {
+    uint32_t first;
+    uint32_t last;
+    
+    r = mailimap_nz_number_parse(fd, buffer, parser_ctx, &cur_token, &first);
+    if (r != MAILIMAP_NO_ERROR) {
+      res = r;
+      goto free;
+    }
+    last = first;
+    
+    r = mailimap_colon_parse(fd, buffer, parser_ctx, &cur_token);
+    if (r == MAILIMAP_NO_ERROR) {
+      r = mailimap_nz_number_parse(fd, buffer, parser_ctx, &cur_token, &last);
+    }
+    else if (r == MAILIMAP_ERROR_PARSE) {
+      r = MAILIMAP_NO_ERROR;
+    }
+    if (r != MAILIMAP_NO_ERROR) {
+      res = r;
+      goto free;
+    }
+    
+    r = mailimap_uidset_add_range(uidset, first, last);
+    if (r != MAILIMAP_NO_ERROR) {
+      res = r;
+      goto free;
+    }
+    
+    r = mailimap_char_parse(fd, buffer, &cur_token, ',');
+    if (r == MAILIMAP_ERROR_PARSE)
+      break;
+    if (r != MAILIMAP_NO_ERROR) {
+      res = r;
+      goto free;
+    }
+  }
+  
+  * indx = cur_token;
+  * result = uidset;
+  
+  return MAILIMAP_NO_ERROR;
+  
+ free:
+  mailimap_uidset_free(uidset);
+ err:
+  return res;
+}
+
+/* search-ret-data-ext we don't know about are skipped */
+
+static int mailimap_search_ret_data_ext_skip(mailstream * fd, MMAPString * buffer,
+    struct mailimap_parser_context * parser_ctx, size_t * indx,
+    size_t progr_rate, progress_function * progr_fun)
+{
+  struct mailimap_uidset * uidset;
+  size_t cur_token;
+  char * name;
+  int r;
+  
+  cur_token = * indx;
+  
+  r = mailimap_atom_parse(fd, buffer, parser_ctx, &cur_token, &name,
+      progr_rate, progr_fun);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+  mailimap_atom_free(name);
+  
+  r = mailimap_space_parse(fd, buffer, &cur_token);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+  
+  r = mailimap_oparenth_parse(fd, buffer, parser_ctx, &cur_token);
+  if (r == MAILIMAP_NO_ERROR) {
+    int level;
+    
+    level = 1;
+    while (level > 0) {
+      if (cur_token >= buffer->len)
+        return MAILIMAP_ERROR_PARSE;
+      switch (buffer->str[cur_token]) {
+      case '(':
+        level ++;
+        break;
+      case ')':
+        level --;
+        break;
+      case '\r':
+      case '\n':
+        return MAILIMAP_ERROR_PARSE;
+      }
+      cur_token ++;
+    }
+    
+    * indx = cur_token;
+    
+    return MAILIMAP_NO_ERROR;
+  }
+  
+  /* tagged-ext-simple: sequence-set or number */
+  r = mailimap_uidset_parse(fd, buffer, parser_ctx, &cur_token, &uidset);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+  mailimap_uidset_free(uidset);
+  
+  * indx = cur_token;
+  
+  return MAILIMAP_NO_ERROR;
+}
+
+static int mailimap_search_return_data_parse(mailstream * fd, MMAPString * buffer,
+    struct mailimap_parser_context * parser_ctx, size_t * indx,
+    struct mailimap_esearch_result * esearch_result,
+    size_t progr_rate, progress_function * progr_fun)
+{
+  size_t cur_token;
+  int r;
+  
+  cur_token = * indx;
+  
+  r = mailimap_token_case_insensitive_parse(fd, buffer, &cur_token, "MIN");
+  if (r == MAILIMAP_NO_ERROR) {
+    r = mailimap_space_parse(fd, buffer, &cur_token);
+    if (r == MAILIMAP_NO_ERROR)
+      r = mailimap_nz_number_parse(fd, buffer, parser_ctx, &cur_token,
+          &esearch_result->es_min);
+    if (r == MAILIMAP_NO_ERROR)
+      esearch_result->es_returned |= MAILIMAP_ESEARCH_RETURN_MIN;
+    goto done;
+  }
+  
+  r = mailimap_token_case_insensitive_parse(fd, buffer, &cur_token, "MAX");
+  if (r == MAILIMAP_NO_ERROR) {
+    r = mailimap_space_parse(fd, buffer, &cur_token);
+    if (r == MAILIMAP_NO_ERROR)
+      r = mailimap_nz_number_parse(fd, buffer, parser_ctx, &cur_token,
+          &esearch_result->es_max);
+    if (r == MAILIMAP_NO_ERROR)
+      esearch_result->es_returned |= MAILIMAP_ESEARCH_RETURN_MAX;
+    goto done;
+  }
+  
+  r = mailimap_token_case_insensitive_parse(fd, buffer, &cur_token, "ALL");
+  if (r == MAILIMAP_NO_ERROR) {
+    struct mailimap_uidset * uidset;
+    
+    r = mailimap_space_parse(fd, buffer, &cur_token);
+    if (r == MAILIMAP_NO_ERROR)
+      r = mailimap_uidset_parse(fd, buffer, parser_ctx, &cur_token, &uidset);
+    if (r == MAILIMAP_NO_ERROR) {
+      if (esearch_result->es_all != NULL)
+        mailimap_uidset_free(esearch_result->es_all);
+      esearch_result->es_all = uidset;
+      esearch_result->es_returned |= MAILIMAP_ESEARCH_RETURN_ALL;
+    }
+    goto done;
+  }
+  
+  r = mailimap_token_case_insensitive_parse(fd, buffer, &cur_token, "COUNT");
+  if (r == MAILIMAP_NO_ERROR) {
+    r = mailimap_space_parse(fd, buffer, &cur_token);
+    if (r == MAILIMAP_NO_ERROR)
+      r = mailimap_number_parse(fd, buffer, &cur_token,
+          &esearch_result->es_count);
+    if (r == MAILIMAP_NO_ERROR)
+      esearch_result->es_returned |= MAILIMAP_ESEARCH_RETURN_COUNT;
+    goto done;
+  }
+  
+  r = mailimap_token_case_insensitive_parse(fd, buffer, &cur_token, "MODSEQ");
+  if (r == MAILIMAP_NO_ERROR) {
+    r = mailimap_space_parse(fd, buffer, &cur_token);
+    if (r == MAILIMAP_NO_ERROR)
+      r = mailimap_mod_sequence_value_parse(fd, buffer, parser_ctx, &cur_token,
+          &esearch_result->es_modseq);
+    if (r == MAILIMAP_NO_ERROR)
+      esearch_result->es_returned |= MAILIMAP_ESEARCH_RETURN_MODSEQ;
+    goto done;
+  }
+  
+  r = mailimap_search_ret_data_ext_skip(fd, buffer, parser_ctx, &cur_token,
+      progr_rate, progr_fun);
+  
+ done:
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+  
+  * indx = cur_token;
+  
+  return MAILIMAP_NO_ERROR;
+}
+
+static int mailimap_search_correlator_parse(mailstream * fd, MMAPString * buffer,
+    struct mailimap_parser_context * parser_ctx, size_t * indx,
+    char ** result,
+    size_t progr_rate, progress_function * progr_fun)
+{
+  size_t cur_token;
+  char * tag;
+  char * tag_dup;
+  int r;
+  
+  cur_token = * indx;
+  
+  r = mailimap_space_parse(fd, buffer, &cur_token);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+  
+  r = mailimap_oparenth_parse(fd, buffer, parser_ctx, &cur_token);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+  
+  r = mailimap_token_case_insensitive_parse(fd, buffer, &cur_token, "TAG");
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+  
+  r = mailimap_space_parse(fd, buffer, &cur_token);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+  
+  r = mailimap_string_parse(fd, buffer, parser_ctx, &cur_token, &tag, NULL,
+      progr_rate, progr_fun);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+  
+  r = mailimap_cparenth_parse(fd, buffer, parser_ctx, &cur_token);
+  if (r != MAILIMAP_NO_ERROR) {
+    mailimap_string_free(tag);
+    return r;
+  }
+  
+  tag_dup = strdup(tag);
+  mailimap_string_free(tag);
+  if (tag_dup == NULL)
+    return MAILIMAP_ERROR_MEMORY;
+  
+  * indx = cur_token;
+  * result = tag_dup;
+  
+  return MAILIMAP_NO_ERROR;
+}
+
+static int mailimap_esearch_response_parse(mailstream * fd, MMAPString * buffer,
+    struct mailimap_parser_context * parser_ctx, size_t * indx,
+    struct mailimap_esearch_result ** result,
+    size_t progr_rate, progress_function * progr_fun)
+{
+  struct mailimap_esearch_result * esearch_result;
+  size_t cur_token;
+  size_t final_token;
+  char * tag;
+  int r;
+  int res;
+  
+  cur_token = * indx;
+  
+  r = mailimap_token_case_insensitive_parse(fd, buffer, &cur_token, "ESEARCH");
+  if (r != MAILIMAP_NO_ERROR) {
+    res = r;
+    goto err;
+  }
+  
+  tag = NULL;
+  r = mailimap_search_correlator_parse(fd, buffer, parser_ctx, &cur_token, &tag,
+      progr_rate, progr_fun);
+  if ((r != MAILIMAP_NO_ERROR) && (r != MAILIMAP_ERROR_PARSE)) {
+    res = r;
+    goto err;
+  }
+  
+  esearch_result = mailimap_esearch_result_new(tag, 0);
+  if (esearch_result == NULL) {
+    free(tag);
+    res = MAILIMAP_ERROR_MEMORY;
+    goto err;
+  }
+  
+  final_token = cur_token;
+  r = mailimap_space_parse(fd, buffer, &cur_token);
+  if (r == MAILIMAP_NO_ERROR)
+    r = mailimap_token_case_insensitive_parse(fd, buffer, &cur_token, "UID");
+  if (r == MAILIMAP_NO_ERROR) {
+    esearch_result->es_is_uid = 1;
+    final_token = cur_token;
+  }
+  cur_token = final_token;
+  
+  while (1) {
+    r = mailimap_space_parse(fd, buffer, &cur_token);
+    if (r == MAILIMAP_NO_ERROR)
+      r = mailimap_search_return_data_parse(fd, buffer, parser_ctx, &cur_token,
+          esearch_result, progr_rate, progr_fun);
+    if (r == MAILIMAP_ERROR_PARSE)
+      break;
+    if (r != MAILIMAP_NO_ERROR) {
+      res = r;
+      goto free;
+    }
+    final_token = cur_token;
+  }
+  
+  * indx = final_token;
+  * result = esearch_result;
+  
+  return MAILIMAP_NO_ERROR;
+  
+ free:
+  mailimap_esearch_result_free(esearch_result);
+ err:
+  return res;
+}
+
+static int
+mailimap_esearch_extension_parse(int calling_parser, mailstream * fd,
+    MMAPString * buffer, struct mailimap_parser_context * parser_ctx, size_t * indx,
+    struct mailimap_extension_data ** result,
+    size_t progr_rate, progress_function * progr_fun)
+{
+  struct mailimap_esearch_result * esearch_result;
+  struct mailimap_extension_data * ext_data;
+  size_t cur_token;
+  int r;
+  
+  switch (calling_parser) {
+  case MAILIMAP_EXTENDED_PARSER_MAILBOX_DATA:
+    cur_token = * indx;
+    
+    r = mailimap_esearch_response_parse(fd, buffer, parser_ctx, &cur_token,
+        &esearch_result, progr_rate, progr_fun);
+    if (r != MAILIMAP_NO_ERROR)
+      return r;
+    
+    ext_data = mailimap_extension_data_new(&mailimap_extension_esearch,
+        MAILIMAP_ESEARCH_TYPE_ESEARCH, esearch_result);
+    if (ext_data == NULL) {
+      mailimap_esearch_result_free(esearch_result);
+      return MAILIMAP_ERROR_MEMORY;
+    }
+    
+    * result = ext_data;
+    * indx = cur_token;
+    
+    return MAILIMAP_NO_ERROR;
+    
+  default:
+    return MAILIMAP_ERROR_PARSE;
+  }
+}
+
+static void
+mailimap_esearch_extension_data_free(struct mailimap_extension_data * ext_data)
+{
+  if (ext_data->ext_data != NULL)
+    mailimap_esearch_result_free(ext_data->ext_data);
+  free(ext_data);
+}
@@ -0,0 +1,1029 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2018 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include "idle_manager.h"
+
+#ifdef WIN32
+#	include <win_etpan.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#ifndef WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/select.h>
+#endif
+
+#ifdef LIBETPAN_REENTRANT
+#if defined(HAVE_PTHREAD_H) && !defined(IGNORE_PTHREAD_H)
+#include <pthread.h>
+#define USE_IDLE_MANAGER_THREADS 1
+#endif
+#endif
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#define USE_IDLE_MANAGER_EPOLL 1
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || \
+  defined(__OpenBSD__) || defined(__DragonFly__)
+#include <sys/types.h>
+#include <sys/event.h>
+#include <sys/time.h>
+#define USE_IDLE_MANAGER_KQUEUE 1
+#elif !defined(WIN32)
+#include <poll.h>
+#define USE_IDLE_MANAGER_POLL 1
+#endif
+
+#include "chash.h"
+#include "clist.h"
+#include "mailimap.h"
+#include "mailimap_parser.h"
+#include "idle.h"
+
+#ifdef USE_IDLE_MANAGER_THREADS
+#define LOCK(manager) pthread_mutex_lock(&(manager)->lock)
+#define UNLOCK(manager) pthread_mutex_unlock(&(manager)->lock)
+#else
+#define LOCK(manager) do {} while (0)
+#define UNLOCK(manager) do {} while (0)
+#endif
+
+#define IDLE_MANAGER_MAX_WORKERS 64
+#define IDLE_MANAGER_MAX_EVENTS 64
+
+/* identifier of the wakeup pipe in the events */
+#define IDLE_MANAGER_WAKEUP_ID 0
+
+enum {
+  IDLE_JOB_READ,
+  IDLE_JOB_REFRESH
+};
+
+struct idle_session {
+  mailimap * session;
+  int fd;
+  /* identifier given to the kernel instead of a pointer, so that
+     an event of a session that has just been removed is harmless */
+  unsigned long id;
+  /* queued or being processed, the fd is not armed */
+  int busy;
+  int removing;
+  int job;
+#ifdef USE_IDLE_MANAGER_THREADS
+  /* thread running the callback, valid while processing is set */
+  int processing;
+  pthread_t thread;
+#endif
+};
+
+struct mailimap_idle_manager {
+  mailimap_idle_manager_callback * callback;
+  void * context;
+  
+  /* id -> struct idle_session * */
+  chash * session_hash;
+  unsigned long next_id;
+  /* list of (struct idle_session *) to process */
+  clist * job_list;
+  
+  int wakeup_fd[2];
+#if defined(USE_IDLE_MANAGER_EPOLL) || defined(USE_IDLE_MANAGER_KQUEUE)
+  int event_fd;
+#endif
+  
+  int running;
+  int stopped;
+  
+  unsigned int nb_workers;
+#ifdef USE_IDLE_MANAGER_THREADS
+  pthread_mutex_t lock;
+  pthread_cond_t job_cond;
+  pthread_cond_t done_cond;
+  pthread_t * workers;
+  int workers_quit;
+#endif
+};
+
+#ifndef WIN32
+
+static struct idle_session * session_find_id(struct mailimap_idle_manager * manager,
+    unsigned long id)
+{
+  chashdatum key;
+  chashdatum value;
+  int r;
+  
+  key.data = &id;
+  key.len = sizeof(id);
+  r = chash_get(manager->session_hash, &key, &value);
+  if (r < 0)
+    return NULL;
+  
+  return value.data;
+}
+
+static struct idle_session * session_find(struct mailimap_idle_manager * manager,
+    mailimap * session)
+{
+  chashiter * iter;
+  
+  for(iter = chash_begin(manager->session_hash) ; iter != NULL ;
+      iter = chash_next(manager->session_hash, iter)) {
+    chashdatum value;
+    struct idle_session * entry;
+    
+    chash_value(iter, &value);
+    entry = value.data;
+    if (entry->session == session)
+      return entry;
+  }
+  
+  return NULL;
+}
+
+static void session_remove(struct mailimap_idle_manager * manager,
+    struct idle_session * entry)
+{
+  chashdatum key;
+  
+  key.data = &entry->id;
+  key.len = sizeof(entry->id);
+  chash_delete(manager->session_hash, &key, NULL);
+}
+
+static void wakeup(struct mailimap_idle_manager * manager)
+{
+  char ch;
+  
+  ch = 0;
+  /* the pipe is non-blocking, if it is full, the loop is already
+     going to wake up */
+  if (write(manager->wakeup_fd[1], &ch, 1) < 0) {
+    /* ignore */
+  }
+}
+
+static void wakeup_drain(struct mailimap_idle_manager * manager)
+{
+  char buf[64];
+  
+  while (read(manager->wakeup_fd[0], buf, sizeof(buf)) > 0) {
+    /* drain */
+  }
+}
+
+/* watch the fd for the next readable event only (one-shot) */
+
+static int session_arm(struct mailimap_idle_manager * manager,
+    struct idle_session * entry, int first)
+{
+#if defined(USE_IDLE_MANAGER_EPOLL)
+  struct epoll_event ev;
+  int r;
+  
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN | EPOLLONESHOT;
+  ev.data.u64 = entry->id;
+  r = epoll_ctl(manager->event_fd, first ? EPOLL_CTL_ADD : EPOLL_CTL_MOD,
+      entry->fd, &ev);
+  if (r < 0)
+    return MAILIMAP_ERROR_STREAM;
+  
+  return MAILIMAP_NO_ERROR;
+#elif defined(USE_IDLE_MANAGER_KQUEUE)
+  struct kevent ev;
+  int r;
+  
+  EV_SET(&ev, entry->fd, EVFILT_READ, EV_ADD | EV_ENABLE | EV_ONESHOT,
+      0, 0, (void *) (uintptr_t) entry->id);
+  r = kevent(manager->event_fd, &ev, 1, NULL, 0, NULL);
+  if (r < 0)
+    return MAILIMAP_ERROR_STREAM;
+  
+  return MAILIMAP_NO_ERROR;
+#else
+  /* the poll() set is built again by the loop */
+  wakeup(manager);
+  
+  return MAILIMAP_NO_ERROR;
+#endif
+}
+
+static void session_disarm(struct mailimap_idle_manager * manager,
+    struct idle_session * entry)
+{
+#if defined(USE_IDLE_MANAGER_EPOLL)
+  struct epoll_event ev;
+  
+  memset(&ev, 0, sizeof(ev));
+  epoll_ctl(manager->event_fd, EPOLL_CTL_DEL, entry->fd, &ev);
+#elif defined(USE_IDLE_MANAGER_KQUEUE)
+  struct kevent ev;
+  
+  /* fails if the one-shot event has already been delivered */
+  EV_SET(&ev, entry->fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+  kevent(manager->event_fd, &ev, 1, NULL, 0, NULL);
+#else
+  wakeup(manager);
+#endif
+}
+
+/* must be called with the lock held */
+
+static void session_dispatch(struct mailimap_idle_manager * manager,
+    struct idle_session * entry, int job)
+{
+  int r;
+  
+  entry->busy = 1;
+  entry->job = job;
+  r = clist_append(manager->job_list, entry);
+  if (r < 0) {
+    entry->busy = 0;
+    session_arm(manager, entry, 0);
+    return;
+  }
+#ifdef USE_IDLE_MANAGER_THREADS
+  pthread_cond_signal(&manager->job_cond);
+#endif
+}
+
+static int read_responses(mailimap * session, clist ** result)
+{
+  size_t indx;
+  clist * resp_data_list;
+  struct mailimap_parser_context * parser_ctx;
+  int r;
+  
+  if (mailimap_read_line(session) == NULL)
+    return MAILIMAP_ERROR_STREAM;
+  
+  parser_ctx = mailimap_parser_context_new(session);
+  if (parser_ctx == NULL)
+    return MAILIMAP_ERROR_MEMORY;
+  
+  indx = 0;
+  r = mailimap_struct_multiple_parse(session->imap_stream,
+      session->imap_stream_buffer, parser_ctx,
+      &indx,
+      &resp_data_list,
+      (mailimap_struct_parser *)
+      mailimap_response_data_parse,
+      (mailimap_struct_destructor *)
+      mailimap_response_data_free,
+      session->imap_progr_rate, session->imap_progr_fun);
+  mailimap_parser_context_free(parser_ctx);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+  
+  * result = resp_data_list;
+  
+  return MAILIMAP_NO_ERROR;
+}
+
+static void session_process(struct mailimap_idle_manager * manager,
+    struct idle_session * entry)
+{
+  mailimap * session;
+  int error;
+  int r;
+  
+  session = entry->session;
+  error = MAILIMAP_NO_ERROR;
+  
+  switch (entry->job) {
+  case IDLE_JOB_REFRESH:
+    r = mailimap_idle_done(session);
+    if (r != MAILIMAP_NO_ERROR) {
+      error = r;
+      break;
+    }
+    manager->callback(manager, session,
+        MAILIMAP_IDLE_MANAGER_EVENT_REFRESH, NULL,
+        MAILIMAP_NO_ERROR, manager->context);
+    r = mailimap_idle(session);
+    if (r != MAILIMAP_NO_ERROR) {
+      error = r;
+      break;
+    }
+    break;
+    
+  case IDLE_JOB_READ:
+    /* the socket won't be readable again for the data that is
+       already in the buffer of the stream */
+    do {
+      clist * resp_data_list;
+      
+      r = read_responses(session, &resp_data_list);
+      if (r != MAILIMAP_NO_ERROR) {
+        error = r;
+        break;
+      }
+      manager->callback(manager, session,
+          MAILIMAP_IDLE_MANAGER_EVENT_DATA, resp_data_list,
+          MAILIMAP_NO_ERROR, manager->context);
+      clist_foreach(resp_data_list,
+          (clist_func) mailimap_response_data_free, NULL);
+      clist_free(resp_data_list);
+    } while (session->imap_stream->read_buffer_len > 0);
+    break;
+  }
+  
+  LOCK(manager);
+  entry->busy = 0;
+#ifdef USE_IDLE_MANAGER_THREADS
+  entry->processing = 0;
+#endif
+  if (error != MAILIMAP_NO_ERROR) {
+    session_disarm(manager, entry);
+    session_remove(manager, entry);
+  }
+  else if (!entry->removing) {
+    if (session_arm(manager, entry, 0) != MAILIMAP_NO_ERROR) {
+      error = MAILIMAP_ERROR_STREAM;
+      session_remove(manager, entry);
+    }
+    else if (entry->job == IDLE_JOB_REFRESH) {
+      /* the deadline of the session has changed */
+      wakeup(manager);
+    }
+  }
+#ifdef USE_IDLE_MANAGER_THREADS
+  pthread_cond_broadcast(&manager->done_cond);
+#endif
+  UNLOCK(manager);
+  
+  if (error != MAILIMAP_NO_ERROR) {
+    manager->callback(manager, session,
+        MAILIMAP_IDLE_MANAGER_EVENT_ERROR, NULL,
+        error, manager->context);
+    free(entry);
+  }
+}
+
+/* process the queued jobs in the current thread */
+
+static void process_jobs(struct mailimap_idle_manager * manager)
+{
+  while (1) {
+    struct idle_session * entry;
+    
+    LOCK(manager);
+    if (clist_isempty(manager->job_list)) {
+      UNLOCK(manager);
+      break;
+    }
+    entry = clist_content(clist_begin(manager->job_list));
+    clist_delete(manager->job_list, clist_begin(manager->job_list));
+#ifdef USE_IDLE_MANAGER_THREADS
+    entry->processing = 1;
+    entry->thread = pthread_self();
+#endif
+    UNLOCK(manager);
+    
+    session_process(manager, entry);
+  }
+}
+
+#ifdef USE_IDLE_MANAGER_THREADS
+
+static void * worker_main(void * arg)
+{
+  struct mailimap_idle_manager * manager;
+  
+  manager = arg;
+  
+  LOCK(manager);
+  while (1) {
+    struct idle_session * entry;
+    
+    while (!manager->workers_quit && clist_isempty(manager->job_list))
+      pthread_cond_wait(&manager->job_cond, &manager->lock);
+    if (manager->workers_quit)
+      break;
+    
+    entry = clist_content(clist_begin(manager->job_list));
+    clist_delete(manager->job_list, clist_begin(manager->job_list));
+#ifdef USE_IDLE_MANAGER_THREADS
+    entry->processing = 1;
+    entry->thread = pthread_self();
+#endif
+    UNLOCK(manager);
+    
+    session_process(manager, entry);
+    
+    LOCK(manager);
+  }
+  UNLOCK(manager);
+  
+  return NULL;
+}
+
+static void workers_stop(struct mailimap_idle_manager * manager)
+{
+  unsigned int i;
+  
+  LOCK(manager);
+  manager->workers_quit = 1;
+  pthread_cond_broadcast(&manager->job_cond);
+  UNLOCK(manager);
+  
+  for(i = 0 ; i < manager->nb_workers ; i ++)
+    pthread_join(manager->workers[i], NULL);
+  free(manager->workers);
+  manager->workers = NULL;
+  manager->nb_workers = 0;
+}
+
+static int workers_start(struct mailimap_idle_manager * manager,
+    unsigned int nb_workers)
+{
+  unsigned int i;
+  
+  manager->workers_quit = 0;
+  manager->nb_workers = 0;
+  manager->workers = NULL;
+  if (nb_workers == 0)
+    return 0;
+  
+  manager->workers = malloc(nb_workers * sizeof(* manager->workers));
+  if (manager->workers == NULL)
+    return -1;
+  
+  for(i = 0 ; i < nb_workers ; i ++) {
+    if (pthread_create(&manager->workers[i], NULL, worker_main, manager) != 0)
+      break;
+    manager->nb_workers ++;
+  }
+  if (manager->nb_workers == 0) {
+    free(manager->workers);
+    manager->workers = NULL;
+  }
+  
+  return 0;
+}
+
+#endif
+
+static int set_nonblocking(int fd)
+{
+  int flags;
+  
+  flags = fcntl(fd, F_GETFL, 0);
+  if (flags == -1)
+    return -1;
+  if (fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1)
+    return -1;
+  
+  return 0;
+}
+
+#endif
+
+LIBETPAN_EXPORT
+struct mailimap_idle_manager *
+mailimap_idle_manager_new(unsigned int nb_workers,
+    mailimap_idle_manager_callback * callback, void * context)
+{
+#ifdef WIN32
+  return NULL;
+#else
+  struct mailimap_idle_manager * manager;
+  int r;
+  
+  manager = malloc(sizeof(* manager));
+  if (manager == NULL)
+    goto err;
+  
+  manager->callback = callback;
+  manager->context = context;
+  manager->next_id = IDLE_MANAGER_WAKEUP_ID + 1;
+  manager->running = 0;
+  manager->stopped = 0;
+  manager->nb_workers = 0;
+  
+  manager->session_hash = chash_new(CHASH_DEFAULTSIZE, CHASH_COPYKEY);
+  if (manager->session_hash == NULL)
+    goto free;
+  
+  manager->job_list = clist_new();
+  if (manager->job_list == NULL)
+    goto free_hash;
+  
+  r = pipe(manager->wakeup_fd);
+  if (r < 0)
+    goto free_list;
+  if ((set_nonblocking(manager->wakeup_fd[0]) < 0) ||
+      (set_nonblocking(manager->wakeup_fd[1]) < 0))
+    goto close_pipe;
+  
+#if defined(USE_IDLE_MANAGER_EPOLL)
+  {
+    struct epoll_event ev;
+    
+    manager->event_fd = epoll_create(64);
+    if (manager->event_fd < 0)
+      goto close_pipe;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = IDLE_MANAGER_WAKEUP_ID;
+    r = epoll_ctl(manager->event_fd, EPOLL_CTL_ADD, manager->wakeup_fd[0], &ev);
+    if (r < 0)
+      goto close_event;
+  }
+#elif defined(USE_IDLE_MANAGER_KQUEUE)
+  {
+    struct kevent ev;
+    
+    manager->event_fd = kqueue();
+    if (manager->event_fd < 0)
+      goto close_pipe;
+    EV_SET(&ev, manager->wakeup_fd[0], EVFILT_READ, EV_ADD,
+        0, 0, (void *) (uintptr_t) IDLE_MANAGER_WAKEUP_ID);
+    r = kevent(manager->event_fd, &ev, 1, NULL, 0, NULL);
+    if (r < 0)
+      goto close_event;
+  }
+#endif
+  
+#ifdef USE_IDLE_MANAGER_THREADS
+  /* mailimap_idle_manager_remove() needs a worker to release the
+     session while mailimap_idle_manager_run() is waiting */
+  if (nb_workers == 0)
+    goto close_event;
+  if (nb_workers > IDLE_MANAGER_MAX_WORKERS)
+    nb_workers = IDLE_MANAGER_MAX_WORKERS;
+  if (pthread_mutex_init(&manager->lock, NULL) != 0)
+    goto close_event;
+  if (pthread_cond_init(&manager->job_cond, NULL) != 0)
+    goto destroy_lock;
+  if (pthread_cond_init(&manager->done_cond, NULL) != 0)
+    goto destroy_job_cond;
+  if (workers_start(manager, nb_workers) < 0)
+    goto destroy_done_cond;
+  if (manager->nb_workers == 0)
+    goto destroy_done_cond;
+#endif
+  
+  return manager;
+  
+#ifdef USE_IDLE_MANAGER_THREADS
+ destroy_done_cond:
+  pthread_cond_destroy(&manager->done_cond);
+ destroy_job_cond:
+  pthread_cond_destroy(&manager->job_cond);
+ destroy_lock:
+  pthread_mutex_destroy(&manager->lock);
+#endif
+ close_event:
+#if defined(USE_IDLE_MANAGER_EPOLL) || defined(USE_IDLE_MANAGER_KQUEUE)
+  close(manager->event_fd);
+#endif
+ close_pipe:
+  close(manager->wakeup_fd[0]);
+  close(manager->wakeup_fd[1]);
+ free_list:
+  clist_free(manager->job_list);
+ free_hash:
+  chash_free(manager->session_hash);
+ free:
+  free(manager);
+ err:
+  return NULL;
+#endif
+}
+
+LIBETPAN_EXPORT
+void mailimap_idle_manager_free(struct mailimap_idle_manager * manager)
+{
+#ifndef WIN32
+  chashiter * iter;
+  
+#ifdef USE_IDLE_MANAGER_THREADS
+  workers_stop(manager);
+  pthread_cond_destroy(&manager->done_cond);
+  pthread_cond_destroy(&manager->job_cond);
+  pthread_mutex_destroy(&manager->lock);
+#endif
+  
+  /* sessions that were not removed are left in IDLE */
+  for(iter = chash_begin(manager->session_hash) ; iter != NULL ;
+      iter = chash_next(manager->session_hash, iter)) {
+    chashdatum value;
+    
+    chash_value(iter, &value);
+    free(value.data);
+  }
+  chash_free(manager->session_hash);
+  clist_free(manager->job_list);
+  
+#if defined(USE_IDLE_MANAGER_EPOLL) || defined(USE_IDLE_MANAGER_KQUEUE)
+  close(manager->event_fd);
+#endif
+  close(manager->wakeup_fd[0]);
+  close(manager->wakeup_fd[1]);
+  free(manager);
+#endif
+}
+
+LIBETPAN_EXPORT
+int mailimap_idle_manager_add(struct mailimap_idle_manager * manager,
+    mailimap * session)
+{
+#ifdef WIN32
+  return MAILIMAP_ERROR_INVAL;
+#else
+  struct idle_session * entry;
+  chashdatum key;
+  chashdatum value;
+  int fd;
+  int r;
+  int res;
+  
+  entry = malloc(sizeof(* entry));
+  if (entry == NULL) {
+    res = MAILIMAP_ERROR_MEMORY;
+    goto err;
+  }
+  
+  fd = mailimap_idle_get_fd(session);
+  if (fd < 0) {
+    res = MAILIMAP_ERROR_STREAM;
+    goto free;
+  }
+#if !USE_POLL
+  /* the stream of the session is read with select() */
+  if (fd >= FD_SETSIZE) {
+    res = MAILIMAP_ERROR_INVAL;
+    goto free;
+  }
+#endif
+  
+  r = mailimap_idle(session);
+  if (r != MAILIMAP_NO_ERROR) {
+    res = r;
+    goto free;
+  }
+  
+  entry->session = session;
+  entry->fd = fd;
+  entry->busy = 0;
+  entry->removing = 0;
+  entry->job = IDLE_JOB_READ;
+#ifdef USE_IDLE_MANAGER_THREADS
+  entry->processing = 0;
+#endif
+  
+  LOCK(manager);
+  entry->id = manager->next_id ++;
+  key.data = &entry->id;
+  key.len = sizeof(entry->id);
+  value.data = entry;
+  value.len = 0;
+  r = chash_set(manager->session_hash, &key, &value, NULL);
+  if (r < 0) {
+    UNLOCK(manager);
+    res = MAILIMAP_ERROR_MEMORY;
+    goto done;
+  }
+  
+  r = session_arm(manager, entry, 1);
+  if (r != MAILIMAP_NO_ERROR) {
+    session_remove(manager, entry);
+    UNLOCK(manager);
+    res = r;
+    goto done;
+  }
+  if (session->imap_stream->read_buffer_len > 0) {
+    /* responses were received with the continuation */
+    session_dispatch(manager, entry, IDLE_JOB_READ);
+  }
+  UNLOCK(manager);
+  
+  return MAILIMAP_NO_ERROR;
+  
+ done:
+  mailimap_idle_done(session);
+ free:
+  free(entry);
+ err:
+  return res;
+#endif
+}
+
+LIBETPAN_EXPORT
+int mailimap_idle_manager_remove(struct mailimap_idle_manager * manager,
+    mailimap * session)
+{
+#ifdef WIN32
+  return MAILIMAP_ERROR_INVAL;
+#else
+  struct idle_session * entry;
+  
+  LOCK(manager);
+  entry = session_find(manager, session);
+  while ((entry != NULL) && entry->busy) {
+#ifdef USE_IDLE_MANAGER_THREADS
+    if (entry->processing && pthread_equal(entry->thread, pthread_self())) {
+      /* called from the callback, the thread would wait for itself */
+      UNLOCK(manager);
+      return MAILIMAP_ERROR_INVAL;
+    }
+    entry->removing = 1;
+    pthread_cond_wait(&manager->done_cond, &manager->lock);
+    /* the session might have been dropped on error */
+    entry = session_find(manager, session);
+#else
+    /* called from the callback */
+    UNLOCK(manager);
+    return MAILIMAP_ERROR_INVAL;
+#endif
+  }
+  if (entry == NULL) {
+    UNLOCK(manager);
+    return MAILIMAP_ERROR_INVAL;
+  }
+  session_disarm(manager, entry);
+  session_remove(manager, entry);
+  UNLOCK(manager);
+  
+  free(entry);
+  
+  return mailimap_idle_done(session);
+#endif
+}
+
+#ifndef WIN32
+
+/* dispatches the sessions that need DONE/IDLE to be sent again and
+   returns the delay until the next one in milliseconds, -1 if there's
+   none. Must be called with the lock held. */
+
+static int refresh_sessions(struct mailimap_idle_manager * manager)
+{
+  chashiter * iter;
+  long min_delay;
+  
+  min_delay = -1;
+  for(iter = chash_begin(manager->session_hash) ; iter != NULL ;
+      iter = chash_next(manager->session_hash, iter)) {
+    chashdatum value;
+    struct idle_session * entry;
+    long delay;
+    
+    chash_value(iter, &value);
+    entry = value.data;
+    if (entry->removing)
+      continue;
+    
+    if (entry->busy) {
+      /* the loop is woken up once the deadline has been moved */
+      if (entry->job == IDLE_JOB_REFRESH)
+        continue;
+      delay = mailimap_idle_get_done_delay(entry->session);
+      if (delay <= 0)
+        delay = 1;
+    }
+    else {
+      delay = mailimap_idle_get_done_delay(entry->session);
+      if (delay <= 0) {
+        /* the fd stays armed, its events are ignored while busy */
+        session_dispatch(manager, entry, IDLE_JOB_REFRESH);
+        continue;
+      }
+    }
+    if ((min_delay == -1) || (delay < min_delay))
+      min_delay = delay;
+  }
+  
+  if (min_delay == -1)
+    return -1;
+  if (min_delay > 3600)
+    min_delay = 3600;
+  
+  return (int) (min_delay * 1000);
+}
+
+/* must be called with the lock held */
+
+static void session_readable(struct mailimap_idle_manager * manager,
+    unsigned long id)
+{
+  struct idle_session * entry;
+  
+  if (id == IDLE_MANAGER_WAKEUP_ID) {
+    wakeup_drain(manager);
+    return;
+  }
+  
+  entry = session_find_id(manager, id);
+  if (entry == NULL)
+    return;
+  if (entry->busy || entry->removing)
+    return;
+  
+  session_dispatch(manager, entry, IDLE_JOB_READ);
+}
+
+#endif
+
+LIBETPAN_EXPORT
+int mailimap_idle_manager_run(struct mailimap_idle_manager * manager)
+{
+#ifdef WIN32
+  return MAILIMAP_ERROR_INVAL;
+#else
+  int res;
+#if defined(USE_IDLE_MANAGER_EPOLL)
+  struct epoll_event events[IDLE_MANAGER_MAX_EVENTS];
+#elif defined(USE_IDLE_MANAGER_KQUEUE)
+  struct kevent events[IDLE_MANAGER_MAX_EVENTS];
+#else
+  struct pollfd * fds;
+  unsigned long * fds_id;
+  unsigned int fds_size;
+  
+  fds = NULL;
+  fds_id = NULL;
+  fds_size = 0;
+#endif
+  
+  LOCK(manager);
+  if (manager->running) {
+    UNLOCK(manager);
+    return MAILIMAP_ERROR_INVAL;
+  }
+  manager->running = 1;
+  UNLOCK(manager);
+  
+  res = MAILIMAP_NO_ERROR;
+  while (1) {
+    int timeout;
+    int count;
+    int has_jobs;
+    int i;
+#if defined(USE_IDLE_MANAGER_POLL)
+    unsigned int nfds;
+    chashiter * iter;
+#endif
+    
+    LOCK(manager);
+    if (manager->stopped) {
+      UNLOCK(manager);
+      break;
+    }
+    timeout = refresh_sessions(manager);
+#if defined(USE_IDLE_MANAGER_POLL)
+    if (fds_size < chash_count(manager->session_hash) + 1) {
+      struct pollfd * new_fds;
+      unsigned long * new_fds_id;
+      
+      fds_size = chash_count(manager->session_hash) + 1;
+      new_fds = realloc(fds, fds_size * sizeof(* fds));
+      if (new_fds != NULL)
+        fds = new_fds;
+      new_fds_id = realloc(fds_id, fds_size * sizeof(* fds_id));
+      if (new_fds_id != NULL)
+        fds_id = new_fds_id;
+      if ((new_fds == NULL) || (new_fds_id == NULL)) {
+        UNLOCK(manager);
+        res = MAILIMAP_ERROR_MEMORY;
+        break;
+      }
+    }
+    nfds = 0;
+    fds[nfds].fd = manager->wakeup_fd[0];
+    fds[nfds].events = POLLIN;
+    fds[nfds].revents = 0;
+    fds_id[nfds] = IDLE_MANAGER_WAKEUP_ID;
+    nfds ++;
+    for(iter = chash_begin(manager->session_hash) ; iter != NULL ;
+        iter = chash_next(manager->session_hash, iter)) {
+      chashdatum value;
+      struct idle_session * entry;
+      
+      chash_value(iter, &value);
+      entry = value.data;
+      if (entry->busy || entry->removing)
+        continue;
+      fds[nfds].fd = entry->fd;
+      fds[nfds].events = POLLIN;
+      fds[nfds].revents = 0;
+      fds_id[nfds] = entry->id;
+      nfds ++;
+    }
+#endif
+    has_jobs = !clist_isempty(manager->job_list);
+    UNLOCK(manager);
+    
+    if (has_jobs && (manager->nb_workers == 0)) {
+      process_jobs(manager);
+      continue;
+    }
+    
+#if defined(USE_IDLE_MANAGER_EPOLL)
+    count = epoll_wait(manager->event_fd, events, IDLE_MANAGER_MAX_EVENTS,
+        timeout);
+#elif defined(USE_IDLE_MANAGER_KQUEUE)
+    if (timeout < 0) {
+      count = kevent(manager->event_fd, NULL, 0,
+          events, IDLE_MANAGER_MAX_EVENTS, NULL);
+    }
+    else {
+      struct timespec ts;
+      
+      ts.tv_sec = timeout / 1000;
+      ts.tv_nsec = (timeout % 1000) * 1000000;
+      count = kevent(manager->event_fd, NULL, 0,
+          events, IDLE_MANAGER_MAX_EVENTS, &ts);
+    }
+#else
+    count = poll(fds, nfds, timeout);
+#endif
+    if (count < 0) {
+      if (errno == EINTR)
+        continue;
+      res = MAILIMAP_ERROR_STREAM;
+      break;
+    }
+    
+    LOCK(manager);
+#if defined(USE_IDLE_MANAGER_EPOLL)
+    for(i = 0 ; i < count ; i ++)
+      session_readable(manager, (unsigned long) events[i].data.u64);
+#elif defined(USE_IDLE_MANAGER_KQUEUE)
+    for(i = 0 ; i < count ; i ++)
+      session_readable(manager, (unsigned long) (uintptr_t) events[i].udata);
+#else
+    for(i = 0 ; i < (int) nfds ; i ++) {
+      if (fds[i].revents == 0)
+        continue;
+      session_readable(manager, fds_id[i]);
+    }
+#endif
+    UNLOCK(manager);
+    
+    if (manager->nb_workers == 0)
+      process_jobs(manager);
+  }
+  
+#if defined(USE_IDLE_MANAGER_POLL)
+  free(fds_id);
+  free(fds);
+#endif
+  
+  LOCK(manager);
+  manager->running = 0;
+  manager->stopped = 0;
+  UNLOCK(manager);
+  
+  return res;
+#endif
+}
+
+LIBETPAN_EXPORT
+void mailimap_idle_manager_stop(struct mailimap_idle_manager * manager)
+{
+#ifndef WIN32
+  LOCK(manager);
+  manager->stopped = 1;
+  UNLOCK(manager);
+  wakeup(manager);
+#endif
+}
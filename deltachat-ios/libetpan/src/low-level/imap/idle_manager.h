@@ -0,0 +1,146 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2018 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#ifndef MAILIMAP_IDLE_MANAGER_H
+
+#define MAILIMAP_IDLE_MANAGER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <libetpan/mailimap_types.h>
+
+/*
+  IDLE manager: waits on many IDLE sessions from a single thread
+  using epoll (Linux), kqueue (BSD, Mac OS X) or poll, and hands
+  readable sessions over to a small pool of worker threads.
+*/
+
+enum {
+  MAILIMAP_IDLE_MANAGER_EVENT_DATA,      /* untagged responses received */
+  MAILIMAP_IDLE_MANAGER_EVENT_REFRESH,   /* DONE was sent, IDLE is sent next */
+  MAILIMAP_IDLE_MANAGER_EVENT_ERROR      /* session was removed from the manager */
+};
+
+struct mailimap_idle_manager;
+
+/*
+  the callback is run from a worker thread. At most one callback runs
+  at a time for a given session.
+
+  - MAILIMAP_IDLE_MANAGER_EVENT_DATA: resp_data_list is a list of
+    (struct mailimap_response_data *), EXISTS, EXPUNGE, FETCH, ...
+    It is freed after the callback returns.
+
+  - MAILIMAP_IDLE_MANAGER_EVENT_REFRESH: resp_data_list is NULL,
+    responses received while leaving IDLE were stored in
+    session->imap_selection_info and session->imap_response_info.
+    The session is out of IDLE during the callback, other commands
+    can be sent. IDLE is sent again when the callback returns.
+
+  - MAILIMAP_IDLE_MANAGER_EVENT_ERROR: resp_data_list is NULL,
+    error is the error code. The session is no longer in IDLE and has
+    already been removed from the manager.
+*/
+
+typedef void mailimap_idle_manager_callback(struct mailimap_idle_manager * manager,
+    mailimap * session, int event_type, clist * resp_data_list,
+    int error, void * context);
+
+/*
+  mailimap_idle_manager_new() creates an IDLE manager.
+
+  @param nb_workers is the number of worker threads. It must be at
+    least 1 when libetpan is built with threads, NULL is returned
+    otherwise. Without threads, it is ignored and the sessions are
+    processed in the thread running mailimap_idle_manager_run().
+*/
+
+LIBETPAN_EXPORT
+struct mailimap_idle_manager *
+mailimap_idle_manager_new(unsigned int nb_workers,
+    mailimap_idle_manager_callback * callback, void * context);
+
+/*
+  mailimap_idle_manager_free() releases the manager. It must not be
+  running and all the sessions should have been removed before.
+*/
+
+LIBETPAN_EXPORT
+void mailimap_idle_manager_free(struct mailimap_idle_manager * manager);
+
+/*
+  mailimap_idle_manager_add() sends IDLE on the session and starts
+  watching it. The session must have a selected mailbox and must not
+  be used by the caller until it is removed from the manager.
+  DONE and IDLE are sent again every session->imap_idle_maxdelay seconds
+  (see mailimap_idle_set_delay()).
+  The streams are read with select(), MAILIMAP_ERROR_INVAL is returned
+  when the socket of the session is not below FD_SETSIZE.
+*/
+
+LIBETPAN_EXPORT
+int mailimap_idle_manager_add(struct mailimap_idle_manager * manager,
+    mailimap * session);
+
+/*
+  mailimap_idle_manager_remove() stops watching the session, waits for
+  its pending callback to finish and sends DONE.
+  It must not be called from the callback running for that same session,
+  MAILIMAP_ERROR_INVAL is returned in that case. Removal can be done
+  from the callback of another session or from any other thread.
+*/
+
+LIBETPAN_EXPORT
+int mailimap_idle_manager_remove(struct mailimap_idle_manager * manager,
+    mailimap * session);
+
+/*
+  mailimap_idle_manager_run() waits for events until
+  mailimap_idle_manager_stop() is called.
+*/
+
+LIBETPAN_EXPORT
+int mailimap_idle_manager_run(struct mailimap_idle_manager * manager);
+
+/*
+  mailimap_idle_manager_stop() can be called from any thread,
+  including from the callback.
+*/
+
+LIBETPAN_EXPORT
+void mailimap_idle_manager_stop(struct mailimap_idle_manager * manager);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
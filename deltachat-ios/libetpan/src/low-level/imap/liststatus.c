@@ -0,0 +1,643 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2018 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include "liststatus.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mailimap.h"
+#include "mailimap_sender.h"
+#include "chash.h"
+
+/*
+   RFC 5819
+
+   return-option =/ "STATUS" SP "(" status-att *(SP status-att) ")"
+
+   the STATUS responses are sent as untagged responses after the LIST
+   response of each selectable mailbox.
+*/
+
+/* number of STATUS commands sent before the responses are read */
+#define STATUS_PIPELINE_DEPTH 32
+
+LIBETPAN_EXPORT
+struct mailimap_list_status_item *
+mailimap_list_status_item_new(struct mailimap_mailbox_list * ls_mailbox,
+    struct mailimap_mailbox_data_status * ls_status)
+{
+  struct mailimap_list_status_item * item;
+
+  item = malloc(sizeof(* item));
+  if (item == NULL)
+    return NULL;
+
+  item->ls_mailbox = ls_mailbox;
+  item->ls_status = ls_status;
+
+  return item;
+}
+
+LIBETPAN_EXPORT
+void mailimap_list_status_item_free(struct mailimap_list_status_item * item)
+{
+  if (item->ls_status != NULL)
+    mailimap_mailbox_data_status_free(item->ls_status);
+  mailimap_mailbox_list_free(item->ls_mailbox);
+  free(item);
+}
+
+LIBETPAN_EXPORT
+void mailimap_list_status_list_free(clist * list)
+{
+  clist_foreach(list, (clist_func) mailimap_list_status_item_free, NULL);
+  clist_free(list);
+}
+
+LIBETPAN_EXPORT
+void mailimap_status_pipelined_list_free(clist * list)
+{
+  clistiter * cur;
+
+  for(cur = clist_begin(list) ; cur != NULL ; cur = clist_next(cur)) {
+    struct mailimap_mailbox_data_status * status;
+
+    status = clist_content(cur);
+    if (status != NULL)
+      mailimap_mailbox_data_status_free(status);
+  }
+  clist_free(list);
+}
+
+LIBETPAN_EXPORT
+int mailimap_has_list_status(mailimap * session)
+{
+  return mailimap_has_extension(session, "LIST-STATUS");
+}
+
+/*
+  reads the responses of count pipelined STATUS commands, the first
+  one was sent with tag first_tag.
+*/
+
+/*
+  mailimap_parse_response() returns MAILIMAP_ERROR_PROTOCOL for a tagged
+  BAD, but also for a response that could not be parsed or that has an
+  unexpected tag. This checks the tagged line that was read last.
+*/
+
+static int is_tagged_bad(mailimap * session)
+{
+  MMAPString * buffer;
+  char tag_str[16];
+  size_t tag_len;
+  size_t end;
+  size_t begin;
+
+  /* set only once the response has been parsed */
+  if (session->imap_response == NULL)
+    return 0;
+
+  buffer = session->imap_stream_buffer;
+  end = buffer->len;
+  while ((end > 0) &&
+      ((buffer->str[end - 1] == '\r') || (buffer->str[end - 1] == '\n')))
+    end --;
+  begin = end;
+  while ((begin > 0) && (buffer->str[begin - 1] != '\n'))
+    begin --;
+
+  if (mailimap_is_163_workaround_enabled(session))
+    snprintf(tag_str, sizeof(tag_str), "C%i ", session->imap_tag);
+  else
+    snprintf(tag_str, sizeof(tag_str), "%i ", session->imap_tag);
+  tag_len = strlen(tag_str);
+
+  if (end - begin < tag_len + 3)
+    return 0;
+  if (strncmp(buffer->str + begin, tag_str, tag_len) != 0)
+    return 0;
+
+  return (strncasecmp(buffer->str + begin + tag_len, "BAD", 3) == 0);
+}
+
+static int status_pipelined_read(mailimap * session, int first_tag,
+    int count, clist * result)
+{
+  int last_tag;
+  int i;
+  int r;
+  int res;
+
+  last_tag = session->imap_tag;
+  res = MAILIMAP_NO_ERROR;
+
+  for(i = 0 ; i < count ; i ++) {
+    struct mailimap_response * response;
+    struct mailimap_mailbox_data_status * status;
+    int error_code;
+
+    /* the tag of the response is checked against the current tag */
+    session->imap_tag = first_tag + i;
+
+    if (mailimap_read_line(session) == NULL) {
+      res = MAILIMAP_ERROR_STREAM;
+      goto restore_tag;
+    }
+
+    r = mailimap_parse_response(session, &response);
+    switch (r) {
+    case MAILIMAP_NO_ERROR:
+      status = session->imap_response_info->rsp_status;
+      session->imap_response_info->rsp_status = NULL;
+      error_code = response->rsp_resp_done->rsp_data.rsp_tagged->rsp_cond_state->rsp_type;
+      mailimap_response_free(response);
+      if ((error_code != MAILIMAP_RESP_COND_STATE_OK) && (status != NULL)) {
+        mailimap_mailbox_data_status_free(status);
+        status = NULL;
+      }
+      break;
+
+    case MAILIMAP_ERROR_PROTOCOL:
+      if (!is_tagged_bad(session)) {
+        /* the responses are out of sync with the commands */
+        res = r;
+        goto restore_tag;
+      }
+      /* BAD for this mailbox, the following responses can still be read */
+      status = NULL;
+      break;
+
+    default:
+      res = r;
+      goto restore_tag;
+    }
+
+    r = clist_append(result, status);
+    if (r < 0) {
+      if (status != NULL)
+        mailimap_mailbox_data_status_free(status);
+      /* keep reading to stay in sync with the server */
+      res = MAILIMAP_ERROR_MEMORY;
+    }
+  }
+
+ restore_tag:
+  session->imap_tag = last_tag;
+  return res;
+}
+
+static int status_pipelined(mailimap * session, clist * mb_list,
+    struct mailimap_status_att_list * status_att_list,
+    clist * result)
+{
+  clistiter * cur;
+  int r;
+
+  cur = clist_begin(mb_list);
+  while (cur != NULL) {
+    int first_tag;
+    int count;
+
+    first_tag = session->imap_tag + 1;
+    count = 0;
+    while ((cur != NULL) && (count < STATUS_PIPELINE_DEPTH)) {
+      char * mb;
+
+      mb = clist_content(cur);
+
+      r = mailimap_send_current_tag(session);
+      if (r != MAILIMAP_NO_ERROR)
+        return r;
+
+      r = mailimap_status_send(session->imap_stream, mb, status_att_list);
+      if (r != MAILIMAP_NO_ERROR)
+        return r;
+
+      r = mailimap_crlf_send(session->imap_stream);
+      if (r != MAILIMAP_NO_ERROR)
+        return r;
+
+      count ++;
+      cur = clist_next(cur);
+    }
+
+    if (mailstream_flush(session->imap_stream) == -1)
+      return MAILIMAP_ERROR_STREAM;
+
+    r = status_pipelined_read(session, first_tag, count, result);
+    if (r != MAILIMAP_NO_ERROR)
+      return r;
+  }
+
+  return MAILIMAP_NO_ERROR;
+}
+
+LIBETPAN_EXPORT
+int mailimap_status_pipelined(mailimap * session, clist * mb_list,
+    struct mailimap_status_att_list * status_att_list,
+    clist ** result)
+{
+  clist * status_list;
+  int r;
+
+  if ((session->imap_state != MAILIMAP_STATE_AUTHENTICATED) &&
+      (session->imap_state != MAILIMAP_STATE_SELECTED))
+    return MAILIMAP_ERROR_BAD_STATE;
+
+  status_list = clist_new();
+  if (status_list == NULL)
+    return MAILIMAP_ERROR_MEMORY;
+
+  r = status_pipelined(session, mb_list, status_att_list, status_list);
+  if (r != MAILIMAP_NO_ERROR) {
+    mailimap_status_pipelined_list_free(status_list);
+    return r;
+  }
+
+  * result = status_list;
+
+  return MAILIMAP_NO_ERROR;
+}
+
+static int mailbox_is_selectable(struct mailimap_mailbox_list * mb_list)
+{
+  clistiter * cur;
+
+  if (mb_list->mb_flag == NULL)
+    return 1;
+
+  if ((mb_list->mb_flag->mbf_type == MAILIMAP_MBX_LIST_FLAGS_SFLAG) &&
+      (mb_list->mb_flag->mbf_sflag == MAILIMAP_MBX_LIST_SFLAG_NOSELECT))
+    return 0;
+
+  for(cur = clist_begin(mb_list->mb_flag->mbf_oflags) ; cur != NULL ;
+      cur = clist_next(cur)) {
+    struct mailimap_mbx_list_oflag * oflag;
+
+    oflag = clist_content(cur);
+    if ((oflag->of_type == MAILIMAP_MBX_LIST_OFLAG_FLAG_EXT) &&
+        (oflag->of_flag_ext != NULL) &&
+        ((strcasecmp(oflag->of_flag_ext, "NonExistent") == 0) ||
+         (strcasecmp(oflag->of_flag_ext, "NoSelect") == 0)))
+      return 0;
+  }
+
+  return 1;
+}
+
+/* INBOX is case-insensitive */
+static void mailbox_name_key(const char * name, chashdatum * key)
+{
+  if (strcasecmp(name, "INBOX") == 0)
+    name = "INBOX";
+  key->data = (void *) name;
+  key->len = (unsigned int) strlen(name);
+}
+
+/*
+  the mailbox of a STATUS response is kept as it was sent by the
+  server, this returns the name as it is in the LIST response.
+*/
+
+static char * status_mailbox_name(const char * mailbox)
+{
+  char * name;
+  const char * p;
+  char * q;
+
+  if (mailbox[0] == '{') {
+    /* literal */
+    p = strchr(mailbox, '\n');
+    if (p == NULL)
+      return strdup(mailbox);
+    return strdup(p + 1);
+  }
+
+  if (mailbox[0] != '"')
+    return strdup(mailbox);
+
+  name = malloc(strlen(mailbox) + 1);
+  if (name == NULL)
+    return NULL;
+
+  q = name;
+  for(p = mailbox + 1 ; (* p != '\0') && (* p != '"') ; p ++) {
+    if ((* p == '\\') && (p[1] != '\0'))
+      p ++;
+    * q = * p;
+    q ++;
+  }
+  * q = '\0';
+
+  return name;
+}
+
+/*
+  builds the result from the LIST responses, the STATUS responses are
+  attached to the mailboxes with the same name.
+*/
+
+static int list_status_items(clist * mb_list, clist * status_list,
+    clist ** result)
+{
+  clist * items;
+  chash * items_hash;
+  clistiter * cur;
+  int r;
+  int res;
+
+  items = clist_new();
+  if (items == NULL) {
+    res = MAILIMAP_ERROR_MEMORY;
+    goto err;
+  }
+
+  items_hash = chash_new(CHASH_DEFAULTSIZE, CHASH_COPYKEY);
+  if (items_hash == NULL) {
+    res = MAILIMAP_ERROR_MEMORY;
+    goto free_items;
+  }
+
+  for(cur = clist_begin(mb_list) ; cur != NULL ; cur = clist_next(cur)) {
+    struct mailimap_list_status_item * item;
+    chashdatum key;
+    chashdatum value;
+
+    item = mailimap_list_status_item_new(clist_content(cur), NULL);
+    if (item == NULL) {
+      res = MAILIMAP_ERROR_MEMORY;
+      goto free_hash;
+    }
+    cur->data = NULL;
+
+    r = clist_append(items, item);
+    if (r < 0) {
+      mailimap_list_status_item_free(item);
+      res = MAILIMAP_ERROR_MEMORY;
+      goto free_hash;
+    }
+
+    mailbox_name_key(item->ls_mailbox->mb_name, &key);
+    value.data = item;
+    value.len = 0;
+    r = chash_set(items_hash, &key, &value, NULL);
+    if (r < 0) {
+      res = MAILIMAP_ERROR_MEMORY;
+      goto free_hash;
+    }
+  }
+
+  for(cur = clist_begin(status_list) ; cur != NULL ; cur = clist_next(cur)) {
+    struct mailimap_mailbox_data_status * status;
+    struct mailimap_list_status_item * item;
+    char * name;
+    chashdatum key;
+    chashdatum value;
+
+    status = clist_content(cur);
+    if (status == NULL)
+      continue;
+
+    name = status_mailbox_name(status->st_mailbox);
+    if (name == NULL) {
+      res = MAILIMAP_ERROR_MEMORY;
+      goto free_hash;
+    }
+    mailbox_name_key(name, &key);
+    r = chash_get(items_hash, &key, &value);
+    free(name);
+    if (r < 0)
+      continue;
+
+    item = value.data;
+    if (item->ls_status != NULL)
+      mailimap_mailbox_data_status_free(item->ls_status);
+    item->ls_status = status;
+    cur->data = NULL;
+  }
+
+  chash_free(items_hash);
+
+  * result = items;
+
+  return MAILIMAP_NO_ERROR;
+
+ free_hash:
+  chash_free(items_hash);
+ free_items:
+  mailimap_list_status_list_free(items);
+ err:
+  return res;
+}
+
+static void mailbox_list_free(clist * list)
+{
+  clistiter * cur;
+
+  for(cur = clist_begin(list) ; cur != NULL ; cur = clist_next(cur)) {
+    struct mailimap_mailbox_list * mb_list;
+
+    mb_list = clist_content(cur);
+    if (mb_list != NULL)
+      mailimap_mailbox_list_free(mb_list);
+  }
+  clist_free(list);
+}
+
+static int list_status_extended(mailimap * session, const char * mb,
+    const char * list_mb,
+    struct mailimap_status_att_list * status_att_list,
+    clist ** result)
+{
+  struct mailimap_response * response;
+  clist * mb_list;
+  clist * status_list;
+  int error_code;
+  int r;
+  int res;
+
+  r = mailimap_send_current_tag(session);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_list_status_send(session->imap_stream, mb, list_mb,
+      status_att_list);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_crlf_send(session->imap_stream);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  if (mailstream_flush(session->imap_stream) == -1)
+    return MAILIMAP_ERROR_STREAM;
+
+  if (mailimap_read_line(session) == NULL)
+    return MAILIMAP_ERROR_STREAM;
+
+  r = mailimap_parse_response(session, &response);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  error_code = response->rsp_resp_done->rsp_data.rsp_tagged->rsp_cond_state->rsp_type;
+  mailimap_response_free(response);
+
+  if (error_code != MAILIMAP_RESP_COND_STATE_OK)
+    return MAILIMAP_ERROR_LIST;
+
+  mb_list = session->imap_response_info->rsp_mailbox_list;
+  session->imap_response_info->rsp_mailbox_list = NULL;
+  status_list = session->imap_response_info->rsp_status_list;
+  session->imap_response_info->rsp_status_list = NULL;
+
+  /* the last STATUS response is kept apart from the others */
+  if (session->imap_response_info->rsp_status != NULL) {
+    r = clist_append(status_list, session->imap_response_info->rsp_status);
+    if (r < 0) {
+      res = MAILIMAP_ERROR_MEMORY;
+      goto free_lists;
+    }
+    session->imap_response_info->rsp_status = NULL;
+  }
+
+  r = list_status_items(mb_list, status_list, result);
+  if (r != MAILIMAP_NO_ERROR) {
+    res = r;
+    goto free_lists;
+  }
+
+  mailimap_status_pipelined_list_free(status_list);
+  mailbox_list_free(mb_list);
+
+  return MAILIMAP_NO_ERROR;
+
+ free_lists:
+  mailimap_status_pipelined_list_free(status_list);
+  mailbox_list_free(mb_list);
+  return res;
+}
+
+static int list_status_pipelined(mailimap * session, const char * mb,
+    const char * list_mb,
+    struct mailimap_status_att_list * status_att_list,
+    clist ** result)
+{
+  clist * mb_list;
+  clist * names;
+  clist * status_list;
+  clistiter * cur;
+  int r;
+  int res;
+
+  r = mailimap_list(session, mb, list_mb, &mb_list);
+  if (r != MAILIMAP_NO_ERROR) {
+    res = r;
+    goto err;
+  }
+
+  names = clist_new();
+  if (names == NULL) {
+    res = MAILIMAP_ERROR_MEMORY;
+    goto free_mb_list;
+  }
+
+  for(cur = clist_begin(mb_list) ; cur != NULL ; cur = clist_next(cur)) {
+    struct mailimap_mailbox_list * mailbox;
+
+    mailbox = clist_content(cur);
+    if (!mailbox_is_selectable(mailbox))
+      continue;
+
+    r = clist_append(names, mailbox->mb_name);
+    if (r < 0) {
+      res = MAILIMAP_ERROR_MEMORY;
+      goto free_names;
+    }
+  }
+
+  status_list = clist_new();
+  if (status_list == NULL) {
+    res = MAILIMAP_ERROR_MEMORY;
+    goto free_names;
+  }
+
+  r = status_pipelined(session, names, status_att_list, status_list);
+  if (r != MAILIMAP_NO_ERROR) {
+    res = r;
+    goto free_status_list;
+  }
+
+  r = list_status_items(mb_list, status_list, result);
+  if (r != MAILIMAP_NO_ERROR) {
+    res = r;
+    goto free_status_list;
+  }
+
+  mailimap_status_pipelined_list_free(status_list);
+  clist_free(names);
+  mailbox_list_free(mb_list);
+
+  return MAILIMAP_NO_ERROR;
+
+ free_status_list:
+  mailimap_status_pipelined_list_free(status_list);
+ free_names:
+  clist_free(names);
+ free_mb_list:
+  mailbox_list_free(mb_list);
+ err:
+  return res;
+}
+
+LIBETPAN_EXPORT
+int mailimap_list_status(mailimap * session, const char * mb,
+    const char * list_mb,
+    struct mailimap_status_att_list * status_att_list,
+    clist ** result)
+{
+  if ((session->imap_state != MAILIMAP_STATE_AUTHENTICATED) &&
+      (session->imap_state != MAILIMAP_STATE_SELECTED))
+    return MAILIMAP_ERROR_BAD_STATE;
+
+  if (mailimap_has_list_status(session))
+    return list_status_extended(session, mb, list_mb, status_att_list,
+        result);
+
+  return list_status_pipelined(session, mb, list_mb, status_att_list,
+      result);
+}
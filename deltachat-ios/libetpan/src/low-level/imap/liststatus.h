@@ -0,0 +1,116 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2018 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef LISTSTATUS_H
+
+#define LISTSTATUS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <libetpan/libetpan-config.h>
+#include <libetpan/mailimap_types.h>
+
+/*
+  mailimap_list_status_item is a mailbox returned by LIST together
+  with its STATUS
+
+  - mailbox is the LIST response for the mailbox
+
+  - status is the STATUS response for the mailbox, it is NULL when
+    the mailbox can't be selected or when the server refused the STATUS
+*/
+
+struct mailimap_list_status_item {
+  struct mailimap_mailbox_list * ls_mailbox;
+  struct mailimap_mailbox_data_status * ls_status; /* can be NULL */
+};
+
+LIBETPAN_EXPORT
+struct mailimap_list_status_item *
+mailimap_list_status_item_new(struct mailimap_mailbox_list * ls_mailbox,
+    struct mailimap_mailbox_data_status * ls_status);
+
+LIBETPAN_EXPORT
+void mailimap_list_status_item_free(struct mailimap_list_status_item * item);
+
+LIBETPAN_EXPORT
+void mailimap_list_status_list_free(clist * list);
+
+/*
+  mailimap_list_status() lists the mailboxes and returns the requested
+  status of each of them.
+
+  when the server supports LIST-STATUS (RFC 5819), this is a single
+  LIST ... RETURN (STATUS (...)) command. otherwise, the mailboxes are
+  listed and the STATUS commands are pipelined, several of them are
+  sent before the responses are read.
+
+  @param mb and list_mb are the same as for mailimap_list()
+  @param status_att_list is the list of status attributes to request
+  @param result is a list of (struct mailimap_list_status_item *),
+    it should be freed with mailimap_list_status_list_free()
+*/
+
+LIBETPAN_EXPORT
+int mailimap_list_status(mailimap * session, const char * mb,
+    const char * list_mb,
+    struct mailimap_status_att_list * status_att_list,
+    clist ** result);
+
+/*
+  mailimap_status_pipelined() requests the status of several mailboxes,
+  the STATUS commands are pipelined.
+
+  @param mb_list is a list of mailbox names (char *)
+  @param result is a list of (struct mailimap_mailbox_data_status *)
+    in the same order as mb_list, an element is NULL when the server
+    refused the STATUS for that mailbox. it should be freed with
+    mailimap_status_pipelined_list_free()
+*/
+
+LIBETPAN_EXPORT
+int mailimap_status_pipelined(mailimap * session, clist * mb_list,
+    struct mailimap_status_att_list * status_att_list,
+    clist ** result);
+
+LIBETPAN_EXPORT
+void mailimap_status_pipelined_list_free(clist * list);
+
+LIBETPAN_EXPORT
+int mailimap_has_list_status(mailimap * session);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -44,6 +44,7 @@
 #include "mail.h"
 #include "condstore.h"
 #include "condstore_private.h"
+#include "mailmetrics.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -311,8 +312,13 @@ static void mailbox_data_store(mailimap * session,
 
   case MAILIMAP_MAILBOX_DATA_STATUS:
     if (session->imap_response_info) {
-      if (session->imap_response_info->rsp_status != NULL)
-        mailimap_mailbox_data_status_free(session->imap_response_info->rsp_status);
+      if (session->imap_response_info->rsp_status != NULL) {
+        /* LIST-STATUS returns a STATUS response per mailbox */
+        r = clist_append(session->imap_response_info->rsp_status_list,
+            session->imap_response_info->rsp_status);
+        if (r < 0)
+          mailimap_mailbox_data_status_free(session->imap_response_info->rsp_status);
+      }
       session->imap_response_info->rsp_status = mb_data->mbd_data.mbd_status;
 #if 0
       if (session->imap_selection_info != NULL) {
@@ -2459,6 +2465,10 @@ int mailimap_send_current_tag(mailimap * session)
   if (r != MAILIMAP_NO_ERROR)
     return r;
 
+  /* the name of the command will be found when it's written to the stream */
+  if (session->imap_metrics != NULL)
+    mailmetrics_command_begin_unnamed(session->imap_metrics, session->imap_stream);
+
   return MAILIMAP_NO_ERROR;
 }
 
@@ -2512,6 +2522,9 @@ int mailimap_parse_response(mailimap * session,
   if (r != MAILIMAP_NO_ERROR)
     return r;
 
+  if (session->imap_metrics != NULL)
+    mailmetrics_command_end(session->imap_metrics, session->imap_stream);
+
 #if 0
   mailimap_response_print(response);
 #endif
@@ -2654,6 +2667,7 @@ mailimap * mailimap_new(size_t imap_progr_rate,
 
   f->imap_msg_body_handler = NULL;
   f->imap_msg_body_handler_context = NULL;
+  f->imap_msg_body_handler_threshold = 0;
 
 	f->imap_timeout = 0;
 
@@ -2661,6 +2675,7 @@ mailimap * mailimap_new(size_t imap_progr_rate,
   f->imap_logger_context = NULL;
   f->is_163_workaround_enabled = 0;
   f->is_rambler_workaround_enabled = 0;
+  f->imap_metrics = NULL;
   return f;
   
  free_stream_buffer:
@@ -2693,6 +2708,8 @@ void mailimap_free(mailimap * session)
     mailimap_selection_info_free(session->imap_selection_info);
   if (session->imap_connection_info)
     mailimap_connection_info_free(session->imap_connection_info);
+  if (session->imap_metrics != NULL)
+    mailmetrics_free(session->imap_metrics);
 
   free(session);
 }
@@ -2738,12 +2755,25 @@ void mailimap_set_msg_body_handler(mailimap * session,
   session->imap_msg_body_handler_context = context;
 }
 
+LIBETPAN_EXPORT
+void mailimap_set_msg_body_handler_threshold(mailimap * session,
+                                             size_t threshold)
+{
+  session->imap_msg_body_handler_threshold = threshold;
+}
+
 static inline void imap_logger(mailstream * s, int log_type,
     const char * str, size_t size, void * context)
 {
   mailimap * session;
 
   session = context;
+  if ((session->imap_metrics != NULL) &&
+      ((log_type == MAILSTREAM_LOG_TYPE_DATA_SENT) ||
+       (log_type == MAILSTREAM_LOG_TYPE_DATA_SENT_PRIVATE)))
+    mailmetrics_data_sent(session->imap_metrics, s, str, size,
+        log_type == MAILSTREAM_LOG_TYPE_DATA_SENT);
+
   if (session->imap_logger == NULL)
     return;
 
@@ -2758,6 +2788,25 @@ void mailimap_set_logger(mailimap * session, void (* logger)(mailimap * session,
   session->imap_logger_context = logger_context;
 }
 
+LIBETPAN_EXPORT
+int mailimap_enable_metrics(mailimap * session)
+{
+  if (session->imap_metrics != NULL)
+    return MAILIMAP_NO_ERROR;
+
+  session->imap_metrics = mailmetrics_new();
+  if (session->imap_metrics == NULL)
+    return MAILIMAP_ERROR_MEMORY;
+
+  return MAILIMAP_NO_ERROR;
+}
+
+LIBETPAN_EXPORT
+struct mailmetrics * mailimap_get_metrics(mailimap * session)
+{
+  return session->imap_metrics;
+}
+
 LIBETPAN_EXPORT    
 void mailimap_set_163_workaround_enabled(mailimap * session, int enabled) {
 	session->is_163_workaround_enabled = enabled;
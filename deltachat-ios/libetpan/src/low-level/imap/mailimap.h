@@ -52,6 +52,7 @@ extern "C" {
 #include <libetpan/annotatemore.h>
 #include <libetpan/uidplus.h>
 #include <libetpan/idle.h>
+#include <libetpan/idle_manager.h>
 #include <libetpan/quota.h>
 #include <libetpan/namespace.h>
 #include <libetpan/mailimap_id.h>
@@ -63,6 +64,10 @@ extern "C" {
 #include <libetpan/condstore.h>
 #include <libetpan/qresync.h>
 #include <libetpan/mailimap_sort.h>
+#include <libetpan/mailimap_uidset.h>
+#include <libetpan/esearch.h>
+#include <libetpan/liststatus.h>
+#include <libetpan/multiappend.h>
 #include <libetpan/mailimap_compress.h>
 #include <libetpan/mailimap_oauth2.h>
 
@@ -836,6 +841,22 @@ void mailimap_set_msg_body_handler(mailimap * session,
                                    mailimap_msg_body_handler * handler,
                                    void * context);
 
+/*
+    mailimap_set_msg_body_handler_threshold() set the size from which
+      a message body is given to the callback set by
+      mailimap_set_msg_body_handler().
+
+    @param session    IMAP session
+    @param threshold  literals smaller than threshold are kept in memory
+      and returned in the FETCH response as usual. Larger literals are
+      given to the callback and returned with an empty content.
+      The default value is 0: every message body is given to the callback.
+*/
+
+LIBETPAN_EXPORT
+void mailimap_set_msg_body_handler_threshold(mailimap * session,
+                                             size_t threshold);
+
 /*
     mailimap_set_timeout() set the network timeout of the IMAP session.
 
@@ -870,6 +891,30 @@ LIBETPAN_EXPORT
 void mailimap_set_logger(mailimap * session, void (* logger)(mailimap * session, int log_type,
     const char * str, size_t size, void * context), void * logger_context);
 
+/*
+    mailimap_enable_metrics() starts to record the number and the latency
+    of the commands sent on the IMAP session.
+
+    @param session    IMAP session
+    @return the return code is one of MAILIMAP_ERROR_XXX or
+      MAILIMAP_NO_ERROR codes
+*/
+
+LIBETPAN_EXPORT
+int mailimap_enable_metrics(mailimap * session);
+
+/*
+    mailimap_get_metrics() returns the statistics of the commands of the
+    IMAP session, NULL if mailimap_enable_metrics() was not called.
+    mailmetrics_dup() makes a snapshot that can be kept after the session
+    is freed. The I/O statistics are given by mailstream_get_metrics().
+
+    @param session    IMAP session
+*/
+
+LIBETPAN_EXPORT
+struct mailmetrics * mailimap_get_metrics(mailimap * session);
+
 #ifndef LIBETPAN_HAS_MAILIMAP_163_WORKAROUND
   #define LIBETPAN_HAS_MAILIMAP_163_WORKAROUND	1
 #endif
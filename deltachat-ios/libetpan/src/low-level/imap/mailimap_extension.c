@@ -38,8 +38,15 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <ctype.h>
+#ifdef LIBETPAN_REENTRANT
+#if defined(HAVE_PTHREAD_H) && !defined(IGNORE_PTHREAD_H)
+#include <pthread.h>
+#endif
+#endif
 
 #include "clist.h"
+#include "chash.h"
 #include "annotatemore.h"
 #include "acl.h"
 #include "uidplus.h"
@@ -54,6 +61,7 @@
 #include "condstore.h"
 #include "qresync.h"
 #include "mailimap_sort.h"
+#include "esearch.h"
 
 /*
   the list of registered extensions (struct mailimap_extension_api *)
@@ -63,47 +71,402 @@
 
 static clist * mailimap_extension_list = NULL;
 
-static struct mailimap_extension_api * internal_extension_list[] = {
-  &mailimap_extension_annotatemore,
-  &mailimap_extension_acl,
-  &mailimap_extension_uidplus,
-  &mailimap_extension_quota,
-  &mailimap_extension_namespace,
-  &mailimap_extension_xlist,
-  &mailimap_extension_xgmlabels,
-  &mailimap_extension_xgmmsgid,
-  &mailimap_extension_xgmthrid,
-  &mailimap_extension_id,
-  &mailimap_extension_enable,
-  &mailimap_extension_condstore,
-  &mailimap_extension_qresync,
-  &mailimap_extension_sort
+static const char * annotatemore_keywords[] = {
+  "ANNOTATION", "ANNOTATEMORE", NULL
+};
+static const char * acl_keywords[] = {
+  "ACL", "LISTRIGHTS", "MYRIGHTS", NULL
+};
+static const char * uidplus_keywords[] = {
+  "APPENDUID", "COPYUID", "UIDNOTSTICKY", NULL
+};
+static const char * quota_keywords[] = {
+  "QUOTA", "QUOTAROOT", NULL
+};
+static const char * namespace_keywords[] = {
+  "NAMESPACE", NULL
+};
+static const char * xlist_keywords[] = {
+  "XLIST", NULL
+};
+static const char * xgmlabels_keywords[] = {
+  "X-GM-LABELS", NULL
+};
+static const char * xgmmsgid_keywords[] = {
+  "X-GM-MSGID", NULL
+};
+static const char * xgmthrid_keywords[] = {
+  "X-GM-THRID", NULL
+};
+static const char * id_keywords[] = {
+  "ID", NULL
 };
+static const char * enable_keywords[] = {
+  "ENABLED", NULL
+};
+static const char * condstore_keywords[] = {
+  "MODSEQ", "HIGHESTMODSEQ", "NOMODSEQ", "MODIFIED", "SEARCH", NULL
+};
+static const char * qresync_keywords[] = {
+  "CLOSED", "VANISHED", NULL
+};
+static const char * sort_keywords[] = {
+  "SORT", NULL
+};
+static const char * esearch_keywords[] = {
+  "ESEARCH", NULL
+};
+
+static struct {
+  struct mailimap_extension_api * extension;
+  const char * const * keywords;
+} internal_extension_list[] = {
+  { &mailimap_extension_annotatemore, annotatemore_keywords },
+  { &mailimap_extension_acl,          acl_keywords },
+  { &mailimap_extension_uidplus,      uidplus_keywords },
+  { &mailimap_extension_quota,        quota_keywords },
+  { &mailimap_extension_namespace,    namespace_keywords },
+  { &mailimap_extension_xlist,        xlist_keywords },
+  { &mailimap_extension_xgmlabels,    xgmlabels_keywords },
+  { &mailimap_extension_xgmmsgid,     xgmmsgid_keywords },
+  { &mailimap_extension_xgmthrid,     xgmthrid_keywords },
+  { &mailimap_extension_id,           id_keywords },
+  { &mailimap_extension_enable,       enable_keywords },
+  { &mailimap_extension_condstore,    condstore_keywords },
+  { &mailimap_extension_qresync,      qresync_keywords },
+  { &mailimap_extension_sort,         sort_keywords },
+  { &mailimap_extension_esearch,      esearch_keywords }
+};
+
+/*
+  the keyword index maps the upper case leading keyword of an item
+  to the list of extensions (clist of struct mailimap_extension_api *)
+  that declared it, in the order they are tried.
+  extensions without keywords are kept in keywordless_extension_list
+  and are tried for every item, after the matching ones.
+
+  the index is built on first use, extended by
+  mailimap_extension_register() and dropped by
+  mailimap_extension_register_keywords() and
+  mailimap_extension_unregister_all().
+
+  the keywords of the registered extensions are kept in
+  extension_keywords, (struct mailimap_extension_api *) ->
+  (const char * const *), they are not part of
+  struct mailimap_extension_api to keep its layout.
+*/
+
+#define MAX_KEYWORD_SIZE 64
+
+static chash * keyword_index = NULL;
+static clist * keywordless_extension_list = NULL;
+static chash * extension_keywords = NULL;
+
+#ifdef LIBETPAN_REENTRANT
+#if defined(HAVE_PTHREAD_H) && !defined(IGNORE_PTHREAD_H)
+static pthread_mutex_t keyword_index_lock = PTHREAD_MUTEX_INITIALIZER;
+#define INDEX_LOCK() pthread_mutex_lock(&keyword_index_lock)
+#define INDEX_UNLOCK() pthread_mutex_unlock(&keyword_index_lock)
+#else
+#define INDEX_LOCK() do {} while (0)
+#define INDEX_UNLOCK() do {} while (0)
+#endif
+#else
+#define INDEX_LOCK() do {} while (0)
+#define INDEX_UNLOCK() do {} while (0)
+#endif
+
+static void keyword_index_free(void)
+{
+  chashiter * iter;
+
+  if (keyword_index != NULL) {
+    for(iter = chash_begin(keyword_index) ; iter != NULL ;
+        iter = chash_next(keyword_index, iter)) {
+      chashdatum value;
+
+      chash_value(iter, &value);
+      clist_free(value.data);
+    }
+    chash_free(keyword_index);
+    keyword_index = NULL;
+  }
+
+  if (keywordless_extension_list != NULL) {
+    clist_free(keywordless_extension_list);
+    keywordless_extension_list = NULL;
+  }
+}
+
+/* must be called with the index lock held */
+
+static const char * const *
+get_extension_keywords(struct mailimap_extension_api * extension)
+{
+  chashdatum key;
+  chashdatum value;
+  int r;
+
+  if (extension_keywords == NULL)
+    return NULL;
+
+  key.data = &extension;
+  key.len = sizeof(extension);
+  r = chash_get(extension_keywords, &key, &value);
+  if (r < 0)
+    return NULL;
+
+  return value.data;
+}
+
+static int keyword_index_add(struct mailimap_extension_api * extension,
+    const char * const * keywords)
+{
+  const char * const * keyword;
+  int r;
+
+  if (keywords == NULL)
+    goto keywordless;
+
+  /* keywords the lookup can not match make the extension a fallback */
+  for(keyword = keywords ; * keyword != NULL ; keyword ++) {
+    if ((** keyword == '\0') || (strlen(* keyword) >= MAX_KEYWORD_SIZE))
+      goto keywordless;
+  }
+
+  for(keyword = keywords ; * keyword != NULL ; keyword ++) {
+    char upper[MAX_KEYWORD_SIZE];
+    chashdatum key;
+    chashdatum value;
+    clist * list;
+    size_t i;
+
+    for(i = 0 ; (* keyword)[i] != '\0' ; i ++)
+      upper[i] = (char) toupper((unsigned char) (* keyword)[i]);
+
+    key.data = upper;
+    key.len = (unsigned int) i;
+    r = chash_get(keyword_index, &key, &value);
+    if (r == 0) {
+      list = value.data;
+      /* an extension may declare the same keyword twice */
+      if (clist_content(clist_end(list)) == extension)
+        continue;
+    }
+    else {
+      list = clist_new();
+      if (list == NULL)
+        return MAILIMAP_ERROR_MEMORY;
+
+      value.data = list;
+      value.len = 0;
+      r = chash_set(keyword_index, &key, &value, NULL);
+      if (r < 0) {
+        clist_free(list);
+        return MAILIMAP_ERROR_MEMORY;
+      }
+    }
+
+    r = clist_append(list, extension);
+    if (r < 0)
+      return MAILIMAP_ERROR_MEMORY;
+  }
+
+  return MAILIMAP_NO_ERROR;
+
+ keywordless:
+  r = clist_append(keywordless_extension_list, extension);
+  if (r < 0)
+    return MAILIMAP_ERROR_MEMORY;
+
+  return MAILIMAP_NO_ERROR;
+}
+
+/* must be called with the index lock held */
+
+static int keyword_index_build(void)
+{
+  clistiter * cur;
+  unsigned int i;
+  int r;
+  int res;
+
+  keyword_index = chash_new(CHASH_DEFAULTSIZE, CHASH_COPYKEY);
+  if (keyword_index == NULL) {
+    res = MAILIMAP_ERROR_MEMORY;
+    goto err;
+  }
+
+  keywordless_extension_list = clist_new();
+  if (keywordless_extension_list == NULL) {
+    res = MAILIMAP_ERROR_MEMORY;
+    goto free;
+  }
+
+  for(i = 0 ; i < sizeof(internal_extension_list) / sizeof(* internal_extension_list) ; i ++) {
+    r = keyword_index_add(internal_extension_list[i].extension,
+        internal_extension_list[i].keywords);
+    if (r != MAILIMAP_NO_ERROR) {
+      res = r;
+      goto free;
+    }
+  }
+
+  if (mailimap_extension_list != NULL) {
+    for(cur = clist_begin(mailimap_extension_list) ;
+        cur != NULL ; cur = clist_next(cur)) {
+      r = keyword_index_add(clist_content(cur),
+          get_extension_keywords(clist_content(cur)));
+      if (r != MAILIMAP_NO_ERROR) {
+        res = r;
+        goto free;
+      }
+    }
+  }
+
+  return MAILIMAP_NO_ERROR;
+
+ free:
+  keyword_index_free();
+ err:
+  return res;
+}
+
+/*
+  reads the keyword starting at indx, as an atom in upper case,
+  without consuming it.
+*/
+
+static int is_keyword_char(char ch)
+{
+  unsigned char uch = (unsigned char) ch;
+
+  if ((uch <= 0x20) || (uch >= 0x7f))
+    return 0;
+
+  switch (ch) {
+  case '(':
+  case ')':
+  case '[':
+  case ']':
+  case '{':
+  case '"':
+  case '%':
+  case '*':
+  case '\\':
+    return 0;
+  }
+
+  return 1;
+}
+
+static size_t keyword_peek(MMAPString * buffer, size_t indx,
+    char * keyword)
+{
+  size_t cur_token;
+  size_t len;
+
+  cur_token = indx;
+  /* the extension parsers accept leading spaces (UNSTRICT_SYNTAX) */
+  while ((cur_token < buffer->len) &&
+      ((buffer->str[cur_token] == ' ') || (buffer->str[cur_token] == '\t')))
+    cur_token ++;
+
+  len = 0;
+  while ((cur_token < buffer->len) && is_keyword_char(buffer->str[cur_token])) {
+    if (len + 1 >= MAX_KEYWORD_SIZE)
+      return 0;
+    keyword[len] = (char) toupper((unsigned char) buffer->str[cur_token]);
+    len ++;
+    cur_token ++;
+  }
+
+  return len;
+}
 
 LIBETPAN_EXPORT
 int
 mailimap_extension_register(struct mailimap_extension_api * extension)
 {
+  int r;
+
   if (mailimap_extension_list == NULL) {
     mailimap_extension_list = clist_new();
     if (mailimap_extension_list == NULL)
       return MAILIMAP_ERROR_MEMORY;
   }
 
-  return clist_append(mailimap_extension_list, extension);
+  r = clist_append(mailimap_extension_list, extension);
+  if (r < 0)
+    return r;
+
+  INDEX_LOCK();
+  if (keyword_index != NULL) {
+    r = keyword_index_add(extension, get_extension_keywords(extension));
+    /* rebuild on next use */
+    if (r != MAILIMAP_NO_ERROR)
+      keyword_index_free();
+  }
+  INDEX_UNLOCK();
+
+  return 0;
+}
+
+LIBETPAN_EXPORT
+int
+mailimap_extension_register_keywords(struct mailimap_extension_api * extension,
+    const char * const * keywords)
+{
+  chashdatum key;
+  chashdatum value;
+  int r;
+  int res;
+
+  INDEX_LOCK();
+  if (extension_keywords == NULL) {
+    extension_keywords = chash_new(CHASH_DEFAULTSIZE, CHASH_COPYKEY);
+    if (extension_keywords == NULL) {
+      res = MAILIMAP_ERROR_MEMORY;
+      goto unlock;
+    }
+  }
+
+  key.data = &extension;
+  key.len = sizeof(extension);
+  value.data = (void *) keywords;
+  value.len = 0;
+  r = chash_set(extension_keywords, &key, &value, NULL);
+  if (r < 0) {
+    res = MAILIMAP_ERROR_MEMORY;
+    goto unlock;
+  }
+
+  /* the extension may already be indexed, rebuild on next use */
+  keyword_index_free();
+  res = MAILIMAP_NO_ERROR;
+
+ unlock:
+  INDEX_UNLOCK();
+  return res;
 }
 
 LIBETPAN_EXPORT
 void
 mailimap_extension_unregister_all(void)
 {
+  INDEX_LOCK();
+  keyword_index_free();
+  if (extension_keywords != NULL) {
+    chash_free(extension_keywords);
+    extension_keywords = NULL;
+  }
+  INDEX_UNLOCK();
+
   clist_free(mailimap_extension_list);
   mailimap_extension_list = NULL;
 }
 
-LIBETPAN_EXPORT
-int
-mailimap_extension_data_parse(int calling_parser,
+static int extension_list_parse(clist * list, int calling_parser,
         mailstream * fd, MMAPString * buffer, struct mailimap_parser_context * parser_ctx,
         size_t * indx, struct mailimap_extension_data ** result,
         size_t progr_rate,
@@ -111,33 +474,72 @@ mailimap_extension_data_parse(int calling_parser,
 {
   clistiter * cur;
   int r;
-  unsigned int i;
-  
-  for(i = 0 ; i < sizeof(internal_extension_list) / sizeof(* internal_extension_list) ; i ++) {
+
+  for (cur = clist_begin(list); cur != NULL; cur = clist_next(cur)) {
     struct mailimap_extension_api * ext;
-    
-    ext = internal_extension_list[i];
+
+    ext = clist_content(cur);
     r = ext->ext_parser(calling_parser, fd, buffer, parser_ctx, indx, result,
         progr_rate, progr_fun);
     if (r != MAILIMAP_ERROR_PARSE)
       return r;
   }
-  
-  if (mailimap_extension_list == NULL)
-    return MAILIMAP_ERROR_PARSE;
 
-  for (cur = clist_begin(mailimap_extension_list);
-        cur != NULL; cur = clist_next(cur)) {
-    struct mailimap_extension_api * ext;
-    
-    ext = clist_content(cur);
-    r = ext->ext_parser(calling_parser, fd, buffer, parser_ctx, indx, result,
-        progr_rate, progr_fun);
+  return MAILIMAP_ERROR_PARSE;
+}
+
+/*
+  only the extensions that declared the leading keyword of the item
+  are called, then the ones that did not declare any keyword.
+*/
+
+LIBETPAN_EXPORT
+int
+mailimap_extension_data_parse(int calling_parser,
+        mailstream * fd, MMAPString * buffer, struct mailimap_parser_context * parser_ctx,
+        size_t * indx, struct mailimap_extension_data ** result,
+        size_t progr_rate,
+        progress_function * progr_fun)
+{
+  char keyword[MAX_KEYWORD_SIZE];
+  clist * matching;
+  clist * keywordless;
+  size_t len;
+  int r;
+
+  INDEX_LOCK();
+  if (keyword_index == NULL) {
+    r = keyword_index_build();
+    if (r != MAILIMAP_NO_ERROR) {
+      INDEX_UNLOCK();
+      return r;
+    }
+  }
+
+  matching = NULL;
+  len = keyword_peek(buffer, * indx, keyword);
+  if (len > 0) {
+    chashdatum key;
+    chashdatum value;
+
+    key.data = keyword;
+    key.len = (unsigned int) len;
+    r = chash_get(keyword_index, &key, &value);
+    if (r == 0)
+      matching = value.data;
+  }
+  keywordless = keywordless_extension_list;
+  INDEX_UNLOCK();
+
+  if (matching != NULL) {
+    r = extension_list_parse(matching, calling_parser, fd, buffer, parser_ctx,
+        indx, result, progr_rate, progr_fun);
     if (r != MAILIMAP_ERROR_PARSE)
       return r;
   }
 
-  return MAILIMAP_ERROR_PARSE;
+  return extension_list_parse(keywordless, calling_parser, fd, buffer, parser_ctx,
+      indx, result, progr_rate, progr_fun);
 }
 
 LIBETPAN_EXPORT
@@ -40,6 +40,13 @@
 #include "mailimap_helper.h"
 
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#ifdef WIN32
+#	include "win_etpan.h"
+#else
+#	include <unistd.h>
+#endif
 #include "mailimap.h"
 
 LIBETPAN_EXPORT
@@ -162,6 +169,272 @@ err:
 	return res;
 }
 
+/* writes the body given by the parser to a file descriptor */
+
+#define FD_SINK_BUFFER_SIZE 4096
+
+struct fd_sink {
+  int fd;
+  int decode_base64;
+  int error;
+  size_t written;
+  
+  /* pending base64 characters */
+  unsigned char quantum[4];
+  int quantum_len;
+  int base64_end;
+  
+  char buffer[FD_SINK_BUFFER_SIZE];
+  size_t buffer_len;
+};
+
+static int fd_sink_flush(struct fd_sink * sink)
+{
+  size_t cur;
+  
+  cur = 0;
+  while (cur < sink->buffer_len) {
+    ssize_t r;
+    
+    r = write(sink->fd, sink->buffer + cur, sink->buffer_len - cur);
+    if (r < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    cur += r;
+  }
+  sink->written += sink->buffer_len;
+  sink->buffer_len = 0;
+  
+  return 0;
+}
+
+static int fd_sink_write(struct fd_sink * sink, const char * bytes, size_t length)
+{
+  while (length > 0) {
+    size_t count;
+    
+    if (sink->buffer_len == FD_SINK_BUFFER_SIZE) {
+      if (fd_sink_flush(sink) < 0)
+        return -1;
+    }
+    
+    count = FD_SINK_BUFFER_SIZE - sink->buffer_len;
+    if (count > length)
+      count = length;
+    memcpy(sink->buffer + sink->buffer_len, bytes, count);
+    sink->buffer_len += count;
+    bytes += count;
+    length -= count;
+  }
+  
+  return 0;
+}
+
+static int base64_value(char ch)
+{
+  if ((ch >= 'A') && (ch <= 'Z'))
+    return ch - 'A';
+  if ((ch >= 'a') && (ch <= 'z'))
+    return ch - 'a' + 26;
+  if ((ch >= '0') && (ch <= '9'))
+    return ch - '0' + 52;
+  if (ch == '+')
+    return 62;
+  if (ch == '/')
+    return 63;
+  return -1;
+}
+
+/* writes the bytes of an incomplete quantum, at the end of the data */
+
+static int fd_sink_base64_finish(struct fd_sink * sink)
+{
+  char out[2];
+  
+  if (sink->quantum_len < 2) {
+    sink->quantum_len = 0;
+    return 0;
+  }
+  
+  out[0] = (char) ((sink->quantum[0] << 2) | (sink->quantum[1] >> 4));
+  out[1] = (char) ((sink->quantum[1] << 4) | (sink->quantum[2] >> 2));
+  if (fd_sink_write(sink, out, sink->quantum_len - 1) < 0)
+    return -1;
+  sink->quantum_len = 0;
+  
+  return 0;
+}
+
+static int fd_sink_base64_write(struct fd_sink * sink,
+    const char * bytes, size_t length)
+{
+  size_t i;
+  
+  for(i = 0 ; i < length ; i ++) {
+    int value;
+    
+    if (sink->base64_end)
+      break;
+    
+    if (bytes[i] == '=') {
+      if (fd_sink_base64_finish(sink) < 0)
+        return -1;
+      sink->base64_end = 1;
+      break;
+    }
+    
+    /* line breaks and invalid characters are skipped */
+    value = base64_value(bytes[i]);
+    if (value < 0)
+      continue;
+    
+    sink->quantum[sink->quantum_len] = (unsigned char) value;
+    sink->quantum_len ++;
+    if (sink->quantum_len == 4) {
+      char out[3];
+      
+      out[0] = (char) ((sink->quantum[0] << 2) | (sink->quantum[1] >> 4));
+      out[1] = (char) ((sink->quantum[1] << 4) | (sink->quantum[2] >> 2));
+      out[2] = (char) ((sink->quantum[2] << 6) | sink->quantum[3]);
+      if (fd_sink_write(sink, out, 3) < 0)
+        return -1;
+      sink->quantum_len = 0;
+    }
+  }
+  
+  return 0;
+}
+
+static bool fd_sink_handler(int msg_att_type, struct mailimap_msg_att_body_section * section,
+    const char * bytes, size_t length, void * context)
+{
+  struct fd_sink * sink;
+  int r;
+  
+  sink = context;
+  
+  /* keep on reading the response after an error so that the session
+     stays usable */
+  if (sink->error)
+    return true;
+  
+  if (sink->decode_base64)
+    r = fd_sink_base64_write(sink, bytes, length);
+  else
+    r = fd_sink_write(sink, bytes, length);
+  if (r < 0)
+    sink->error = 1;
+  
+  return true;
+}
+
+LIBETPAN_EXPORT
+int mailimap_uid_fetch_section_to_fd(mailimap * session, uint32_t uid,
+    struct mailimap_section * section, int encoding,
+    int fd, size_t * result_len)
+{
+  int r;
+  int res;
+  clist * fetch_list;
+  struct mailimap_fetch_att * fetch_att;
+  struct mailimap_fetch_type * fetch_type;
+  struct mailimap_set * set;
+  struct fd_sink * sink;
+  mailimap_msg_body_handler * old_handler;
+  void * old_handler_context;
+  size_t old_threshold;
+  
+  sink = malloc(sizeof(* sink));
+  if (sink == NULL) {
+    res = MAILIMAP_ERROR_MEMORY;
+    goto err;
+  }
+  sink->fd = fd;
+  sink->decode_base64 = (encoding == MAILIMAP_BODY_FLD_ENC_BASE64);
+  sink->error = 0;
+  sink->written = 0;
+  sink->quantum_len = 0;
+  sink->base64_end = 0;
+  sink->buffer_len = 0;
+  
+  set = mailimap_set_new_single(uid);
+  if (set == NULL) {
+    res = MAILIMAP_ERROR_MEMORY;
+    goto free_sink;
+  }
+  
+  fetch_att = mailimap_fetch_att_new_body_peek_section(section);
+  if (fetch_att == NULL) {
+    res = MAILIMAP_ERROR_MEMORY;
+    goto free_set;
+  }
+  
+  fetch_type = mailimap_fetch_type_new_fetch_att(fetch_att);
+  if (fetch_type == NULL) {
+    fetch_att->att_section = NULL;
+    mailimap_fetch_att_free(fetch_att);
+    res = MAILIMAP_ERROR_MEMORY;
+    goto free_set;
+  }
+  
+  old_handler = session->imap_msg_body_handler;
+  old_handler_context = session->imap_msg_body_handler_context;
+  old_threshold = session->imap_msg_body_handler_threshold;
+  mailimap_set_msg_body_handler(session, fd_sink_handler, sink);
+  mailimap_set_msg_body_handler_threshold(session, 0);
+  
+  r = mailimap_uid_fetch(session, set, fetch_type, &fetch_list);
+  
+  mailimap_set_msg_body_handler(session, old_handler, old_handler_context);
+  mailimap_set_msg_body_handler_threshold(session, old_threshold);
+  
+  /* the section belongs to the caller */
+  fetch_att->att_section = NULL;
+  mailimap_fetch_type_free(fetch_type);
+  
+  if (r != MAILIMAP_NO_ERROR) {
+    res = r;
+    goto free_set;
+  }
+  
+  if (clist_isempty(fetch_list)) {
+    res = MAILIMAP_ERROR_FETCH;
+    goto free_list;
+  }
+  
+  if (!sink->error && sink->decode_base64) {
+    if (fd_sink_base64_finish(sink) < 0)
+      sink->error = 1;
+  }
+  if (!sink->error) {
+    if (fd_sink_flush(sink) < 0)
+      sink->error = 1;
+  }
+  if (sink->error) {
+    res = MAILIMAP_ERROR_FETCH;
+    goto free_list;
+  }
+  
+  * result_len = sink->written;
+  
+  mailimap_fetch_list_free(fetch_list);
+  mailimap_set_free(set);
+  free(sink);
+  
+  return MAILIMAP_NO_ERROR;
+  
+ free_list:
+  mailimap_fetch_list_free(fetch_list);
+ free_set:
+  mailimap_set_free(set);
+ free_sink:
+  free(sink);
+ err:
+  return res;
+}
+
 LIBETPAN_EXPORT
 int mailimap_fetch_envelope(mailimap * session,
     uint32_t first, uint32_t last,
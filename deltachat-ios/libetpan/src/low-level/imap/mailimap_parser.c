@@ -5972,8 +5972,6 @@ static int mailimap_literal_parse_progress(mailstream * fd, MMAPString * buffer,
   bool use_msg_body_handler;
   
   cur_token = * indx;
-  use_msg_body_handler = (parser_ctx->msg_body_handler != NULL
-                          && parser_ctx->msg_body_parse_in_progress);
   
   r = mailimap_oaccolade_parse(fd, buffer, parser_ctx, &cur_token);
   if (r != MAILIMAP_NO_ERROR) {
@@ -6020,6 +6018,10 @@ static int mailimap_literal_parse_progress(mailstream * fd, MMAPString * buffer,
     goto err;
   }
   
+  use_msg_body_handler = (parser_ctx->msg_body_handler != NULL
+                          && parser_ctx->msg_body_parse_in_progress
+                          && number >= parser_ctx->msg_body_handler_threshold);
+  
   if (use_msg_body_handler) {
     literal = mmap_string_new("");
   }
@@ -8290,6 +8292,234 @@ mailimap_msg_att_body_section_parse_progress(mailstream * fd, MMAPString * buffe
   return res;
 }
 
+/*
+   literal8        = "~{" number "}" CRLF *OCTET
+                       ; <number> represents the number of OCTETs
+                       ; in the response string.
+*/
+
+static int mailimap_literal8_parse_progress(mailstream * fd, MMAPString * buffer, struct mailimap_parser_context * parser_ctx,
+                                            size_t * indx, char ** result,
+                                            size_t * result_len,
+                                            size_t progr_rate,
+                                            progress_function * progr_fun,
+                                            mailprogress_function * body_progr_fun,
+                                            mailprogress_function * items_progr_fun,
+                                            void * context,
+                                            mailimap_msg_att_handler * msg_att_handler,
+                                            void * msg_att_context)
+{
+  size_t cur_token;
+  int r;
+
+  cur_token = * indx;
+
+  r = mailimap_unstrict_char_parse(fd, buffer, parser_ctx, &cur_token, '~');
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_literal_parse_progress(fd, buffer, parser_ctx, &cur_token,
+                                      result, result_len,
+                                      progr_rate, progr_fun,
+                                      body_progr_fun, items_progr_fun, context,
+                                      msg_att_handler, msg_att_context);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  * indx = cur_token;
+
+  return MAILIMAP_NO_ERROR;
+}
+
+/*
+  "BINARY" section-binary ["<" number ">"] SP (nstring / literal8)
+
+  section-binary is parsed as a section, it only contains a part number.
+*/
+
+static int
+mailimap_msg_att_binary_section_parse_progress(mailstream * fd, MMAPString * buffer, struct mailimap_parser_context * parser_ctx,
+                                               size_t * indx,
+                                               struct mailimap_msg_att_body_section **
+                                               result,
+                                               size_t progr_rate,
+                                               progress_function * progr_fun,
+                                               mailprogress_function * body_progr_fun,
+                                               mailprogress_function * items_progr_fun,
+                                               void * context,
+                                               mailimap_msg_att_handler * msg_att_handler,
+                                               void * msg_att_context)
+{
+  size_t cur_token;
+  uint32_t number;
+  struct mailimap_section * section;
+  char * body_part;
+  struct mailimap_msg_att_body_section * msg_att_body_section;
+  int r;
+  int res;
+  size_t length;
+
+  cur_token = * indx;
+
+  section = NULL;
+  number = 0;
+  body_part = NULL;
+  length = 0;
+
+  r = mailimap_token_case_insensitive_parse(fd, buffer, &cur_token,
+					    "BINARY");
+  if (r != MAILIMAP_NO_ERROR) {
+    res = r;
+    goto err;
+  }
+
+  r = mailimap_section_parse(fd, buffer, parser_ctx, &cur_token, &section,
+			     progr_rate, progr_fun);
+  if (r != MAILIMAP_NO_ERROR) {
+    res = r;
+    goto err;
+  }
+
+  r = mailimap_lower_parse(fd, buffer, parser_ctx, &cur_token);
+  switch (r) {
+  case MAILIMAP_NO_ERROR:
+    r = mailimap_number_parse(fd, buffer, &cur_token, &number);
+    if (r != MAILIMAP_NO_ERROR) {
+      res = r;
+      goto free_section;
+    }
+
+    r = mailimap_greater_parse(fd, buffer, parser_ctx, &cur_token);
+    if (r != MAILIMAP_NO_ERROR) {
+      res = r;
+      goto free_section;
+    }
+    break;
+
+  case MAILIMAP_ERROR_PARSE:
+    break;
+
+  default:
+    res = r;
+    goto free_section;
+  }
+
+  r = mailimap_space_parse(fd, buffer, &cur_token);
+  if (r != MAILIMAP_NO_ERROR) {
+    res = r;
+    goto free_section;
+  }
+
+  msg_att_body_section =
+    mailimap_msg_att_body_section_new(section, number, NULL, 0);
+  if (msg_att_body_section == NULL) {
+    res = MAILIMAP_ERROR_MEMORY;
+    goto free_section;
+  }
+
+  parser_ctx->msg_body_parse_in_progress = true;
+  parser_ctx->msg_body_att_type = MAILIMAP_MSG_ATT_BINARY_SECTION;
+  parser_ctx->msg_body_section = msg_att_body_section;
+
+  r = mailimap_literal8_parse_progress(fd, buffer, parser_ctx, &cur_token, &body_part, &length,
+                                       progr_rate, progr_fun, body_progr_fun, items_progr_fun, context, msg_att_handler, msg_att_context);
+  if (r == MAILIMAP_ERROR_PARSE) {
+    r = mailimap_nstring_parse_progress(fd, buffer, parser_ctx, &cur_token, &body_part, &length,
+                                        progr_rate, progr_fun, body_progr_fun, items_progr_fun, context, msg_att_handler, msg_att_context);
+  }
+
+  parser_ctx->msg_body_parse_in_progress = false;
+  parser_ctx->msg_body_att_type = 0;
+  parser_ctx->msg_body_section = NULL;
+
+  if (r != MAILIMAP_NO_ERROR) {
+    res = r;
+    goto free_att_body_section;
+  }
+
+  msg_att_body_section->sec_body_part = body_part;
+  msg_att_body_section->sec_length = length;
+
+  * result = msg_att_body_section;
+  * indx = cur_token;
+
+  return MAILIMAP_NO_ERROR;
+
+ free_att_body_section:
+  msg_att_body_section->sec_section = NULL;
+  mailimap_msg_att_body_section_free(msg_att_body_section);
+ free_section:
+  if (section != NULL)
+    mailimap_section_free(section);
+ err:
+  return res;
+}
+
+/*
+  "BINARY.SIZE" section-binary SP number
+*/
+
+static int
+mailimap_msg_att_binary_size_parse(mailstream * fd, MMAPString * buffer, struct mailimap_parser_context * parser_ctx,
+                                   size_t * indx,
+                                   struct mailimap_msg_att_body_section ** result,
+                                   size_t progr_rate,
+                                   progress_function * progr_fun)
+{
+  size_t cur_token;
+  uint32_t number;
+  struct mailimap_section * section;
+  struct mailimap_msg_att_body_section * msg_att_body_section;
+  int r;
+  int res;
+
+  cur_token = * indx;
+
+  r = mailimap_token_case_insensitive_parse(fd, buffer, &cur_token,
+					    "BINARY.SIZE");
+  if (r != MAILIMAP_NO_ERROR) {
+    res = r;
+    goto err;
+  }
+
+  r = mailimap_section_parse(fd, buffer, parser_ctx, &cur_token, &section,
+			     progr_rate, progr_fun);
+  if (r != MAILIMAP_NO_ERROR) {
+    res = r;
+    goto err;
+  }
+
+  r = mailimap_space_parse(fd, buffer, &cur_token);
+  if (r != MAILIMAP_NO_ERROR) {
+    res = r;
+    goto free_section;
+  }
+
+  r = mailimap_number_parse(fd, buffer, &cur_token, &number);
+  if (r != MAILIMAP_NO_ERROR) {
+    res = r;
+    goto free_section;
+  }
+
+  msg_att_body_section =
+    mailimap_msg_att_body_section_new(section, 0, NULL, number);
+  if (msg_att_body_section == NULL) {
+    res = MAILIMAP_ERROR_MEMORY;
+    goto free_section;
+  }
+
+  * result = msg_att_body_section;
+  * indx = cur_token;
+
+  return MAILIMAP_NO_ERROR;
+
+ free_section:
+  if (section != NULL)
+    mailimap_section_free(section);
+ err:
+  return res;
+}
+
 /*
   "UID" SP uniqueid
 */
@@ -8330,6 +8560,10 @@ mailimap_msg_att_uid_parse(mailstream * fd, MMAPString * buffer, struct mailimap
                      "BODY" section ["<" number ">"] SP nstring /
                      "UID" SP uniqueid
                        ; MUST NOT change for a message
+
+   msg-att-static  =/ "BINARY" section-binary ["<" number ">"] SP
+                      (nstring / literal8)
+                      / "BINARY.SIZE" section-binary SP number
 */
 
 static int
@@ -8446,6 +8680,23 @@ mailimap_msg_att_static_parse_progress(mailstream * fd, MMAPString * buffer, str
       type = MAILIMAP_MSG_ATT_BODY_SECTION;
   }
 
+  if (r == MAILIMAP_ERROR_PARSE) {
+    r = mailimap_msg_att_binary_size_parse(fd, buffer, parser_ctx, &cur_token,
+                                           &body_section,
+                                           progr_rate, progr_fun);
+    if (r == MAILIMAP_NO_ERROR)
+      type = MAILIMAP_MSG_ATT_BINARY_SIZE;
+  }
+
+  if (r == MAILIMAP_ERROR_PARSE) {
+    r = mailimap_msg_att_binary_section_parse_progress(fd, buffer, parser_ctx, &cur_token,
+                                                       &body_section,
+                                                       progr_rate, progr_fun,
+                                                       body_progr_fun, items_progr_fun, context, msg_att_handler, msg_att_context);
+    if (r == MAILIMAP_NO_ERROR)
+      type = MAILIMAP_MSG_ATT_BINARY_SECTION;
+  }
+
   if (r == MAILIMAP_ERROR_PARSE) {
     r = mailimap_msg_att_uid_parse(fd, buffer, parser_ctx, &cur_token,
 				   &uid);
@@ -8693,8 +8944,10 @@ mailimap_quoted_parse(mailstream * fd, MMAPString * buffer, struct mailimap_pars
 
   cur_token = * indx;
 
+  /* the size of a quoted string is not known in advance */
   use_msg_body_handler = (parser_ctx->msg_body_handler != NULL
-                          && parser_ctx->msg_body_parse_in_progress);
+                          && parser_ctx->msg_body_parse_in_progress
+                          && parser_ctx->msg_body_handler_threshold == 0);
 
 #ifdef UNSTRICT_SYNTAX
   r = mailimap_space_parse(fd, buffer, &cur_token);
@@ -798,6 +798,24 @@ static void mailimap_msg_att_static_print(struct mailimap_msg_att_static *
   case MAILIMAP_MSG_ATT_UID:
     printf("uid { %i }\n", msg_att_static->att_data.att_uid);
     break;
+
+  case MAILIMAP_MSG_ATT_BINARY_SECTION:
+    print_indent();
+    printf("binary-section {\n");
+    indent();
+    print_indent();
+    mailimap_section_print(msg_att_static->att_data.att_binary_section->sec_section);
+    printf("origin-octet: %i\n", msg_att_static->att_data.att_binary_section->sec_origin_octet);
+    printf("length: %lu\n", (unsigned long) msg_att_static->att_data.att_binary_section->sec_length);
+    unindent();
+    print_indent();
+    printf("}\n");
+    break;
+
+  case MAILIMAP_MSG_ATT_BINARY_SIZE:
+    print_indent();
+    printf("binary-size { %lu }\n", (unsigned long) msg_att_static->att_data.att_binary_size->sec_length);
+    break;
   }
 
   unindent();
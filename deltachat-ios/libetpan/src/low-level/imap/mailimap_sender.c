@@ -169,6 +169,10 @@ static int mailimap_set_item_send(mailstream * fd,
 
 static int mailimap_status_att_send(mailstream * fd, int * status_att);
 
+static int
+mailimap_status_att_list_send(mailstream * fd,
+    struct mailimap_status_att_list * status_att_list);
+
 
 
 static int
@@ -367,6 +371,27 @@ int mailimap_append_send(mailstream * fd,
   r = mailimap_mailbox_send(fd, mailbox);
   if (r != MAILIMAP_NO_ERROR)
     return r;
+
+  return mailimap_append_message_send(fd, flag_list, date_time,
+      literal_size, 0);
+}
+
+/*
+   RFC 3502
+
+   append-message  = SP [flag-list SP] [date-time SP] literal
+
+   sent as [SP flag-list] [SP date-time] SP literal, a message follows
+   the mailbox or the previous message of a MULTIAPPEND.
+*/
+
+int mailimap_append_message_send(mailstream * fd,
+    struct mailimap_flag_list * flag_list,
+    struct mailimap_date_time * date_time,
+    size_t literal_size, int literalplus_enabled)
+{
+  int r;
+
   if (flag_list != NULL) {
     r = mailimap_space_send(fd);
     if (r != MAILIMAP_NO_ERROR)
@@ -387,7 +412,10 @@ int mailimap_append_send(mailstream * fd,
   r = mailimap_space_send(fd);
   if (r != MAILIMAP_NO_ERROR)
     return r;
-  r = mailimap_literal_count_send(fd, literal_size);
+  if (literalplus_enabled)
+    r = mailimap_literalplus_count_send(fd, literal_size);
+  else
+    r = mailimap_literal_count_send(fd, literal_size);
   if (r != MAILIMAP_NO_ERROR)
     return r;
 
@@ -1280,6 +1308,49 @@ mailimap_fetch_att_list_send(mailstream * fd, clist * fetch_att_list)
                      "BODY" [".PEEK"] section ["<" number "." nz-number ">"]
 */
 
+/*
+=>   fetch-att       =/ "BINARY" [".PEEK"] section-binary [partial]
+
+=>   section-binary  = "[" [section-part] "]"
+
+=>   partial         = "<" number "." nz-number ">"
+*/
+
+static int mailimap_fetch_att_binary_send(mailstream * fd,
+    struct mailimap_fetch_att * fetch_att)
+{
+  int r;
+
+  if (fetch_att->att_type == MAILIMAP_FETCH_ATT_BINARY_PEEK_SECTION)
+    r = mailimap_token_send(fd, "BINARY.PEEK");
+  else
+    r = mailimap_token_send(fd, "BINARY");
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+  r = mailimap_section_send(fd, fetch_att->att_section);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+  if (fetch_att->att_size != 0) {
+    r = mailimap_char_send(fd, '<');
+    if (r != MAILIMAP_NO_ERROR)
+      return r;
+    r = mailimap_number_send(fd, fetch_att->att_offset);
+    if (r != MAILIMAP_NO_ERROR)
+      return r;
+    r = mailimap_char_send(fd, '.');
+    if (r != MAILIMAP_NO_ERROR)
+      return r;
+    r = mailimap_number_send(fd, fetch_att->att_size);
+    if (r != MAILIMAP_NO_ERROR)
+      return r;
+    r = mailimap_char_send(fd, '>');
+    if (r != MAILIMAP_NO_ERROR)
+      return r;
+  }
+
+  return MAILIMAP_NO_ERROR;
+}
+
 static int mailimap_fetch_att_send(mailstream * fd,
 				struct mailimap_fetch_att * fetch_att)
 {
@@ -1375,6 +1446,16 @@ static int mailimap_fetch_att_send(mailstream * fd,
     if (r != MAILIMAP_NO_ERROR)
       return r;
     return MAILIMAP_NO_ERROR;
+
+  case MAILIMAP_FETCH_ATT_BINARY_SECTION:
+  case MAILIMAP_FETCH_ATT_BINARY_PEEK_SECTION:
+    return mailimap_fetch_att_binary_send(fd, fetch_att);
+
+  case MAILIMAP_FETCH_ATT_BINARY_SIZE_SECTION:
+    r = mailimap_token_send(fd, "BINARY.SIZE");
+    if (r != MAILIMAP_NO_ERROR)
+      return r;
+    return mailimap_section_send(fd, fetch_att->att_section);
   
   default:
     /* should not happen */
@@ -1572,6 +1653,67 @@ int mailimap_list_send(mailstream * fd,
   return MAILIMAP_NO_ERROR;
 }
 
+/*
+   RFC 5819
+
+   list            = "LIST" SP mailbox SP list-mailbox
+                     SP "RETURN" SP "(" "STATUS" SP
+                     "(" status-att *(SP status-att) ")" ")"
+*/
+
+int mailimap_list_status_send(mailstream * fd, const char * mb,
+    const char * list_mb,
+    struct mailimap_status_att_list * status_att_list)
+{
+  int r;
+
+  r = mailimap_list_send(fd, mb, list_mb);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_space_send(fd);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_token_send(fd, "RETURN");
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_space_send(fd);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_oparenth_send(fd);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_token_send(fd, "STATUS");
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_space_send(fd);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_oparenth_send(fd);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_status_att_list_send(fd, status_att_list);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_cparenth_send(fd);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  r = mailimap_cparenth_send(fd);
+  if (r != MAILIMAP_NO_ERROR)
+    return r;
+
+  return MAILIMAP_NO_ERROR;
+}
+
 /*
 =>   list-mailbox    = 1*list-char / string
 */
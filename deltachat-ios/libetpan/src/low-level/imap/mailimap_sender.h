@@ -49,6 +49,11 @@ int mailimap_append_send(mailstream * fd,
 			 struct mailimap_date_time * date_time,
 			 size_t literal_size);
 
+int mailimap_append_message_send(mailstream * fd,
+    struct mailimap_flag_list * flag_list,
+    struct mailimap_date_time * date_time,
+    size_t literal_size, int literalplus_enabled);
+
 int mailimap_authenticate_send(mailstream * fd,
 				const char * auth_type);
 
@@ -140,6 +145,11 @@ int
 mailimap_status_send(mailstream * fd, const char * mb,
 		     struct mailimap_status_att_list * status_att_list);
 
+int
+mailimap_list_status_send(mailstream * fd, const char * mb,
+    const char * list_mb,
+    struct mailimap_status_att_list * status_att_list);
+
 int
   mailimap_store_send(mailstream * fd,
   struct mailimap_set * set, int use_unchangedsince, uint64_t mod_sequence_valzer,
@@ -1913,6 +1913,12 @@ mailimap_msg_att_static_new(int att_type, struct mailimap_envelope * att_env,
   case MAILIMAP_MSG_ATT_UID:
     item->att_data.att_uid = att_uid;
     break;
+  case MAILIMAP_MSG_ATT_BINARY_SECTION:
+    item->att_data.att_binary_section = att_body_section;
+    break;
+  case MAILIMAP_MSG_ATT_BINARY_SIZE:
+    item->att_data.att_binary_size = att_body_section;
+    break;
   }
 
   return item;
@@ -1955,6 +1961,14 @@ mailimap_msg_att_static_free(struct mailimap_msg_att_static * item)
     if (item->att_data.att_body_section != NULL)
       mailimap_msg_att_body_section_free(item->att_data.att_body_section);
     break;
+  case MAILIMAP_MSG_ATT_BINARY_SECTION:
+    if (item->att_data.att_binary_section != NULL)
+      mailimap_msg_att_body_section_free(item->att_data.att_binary_section);
+    break;
+  case MAILIMAP_MSG_ATT_BINARY_SIZE:
+    if (item->att_data.att_binary_size != NULL)
+      mailimap_msg_att_body_section_free(item->att_data.att_binary_size);
+    break;
   }
   free(item);
 }
@@ -3170,9 +3184,14 @@ mailimap_response_info_new(void)
     goto free_expunged;
   resp_info->rsp_atom = NULL;
   resp_info->rsp_value = NULL;
+  resp_info->rsp_status_list = clist_new();
+  if (resp_info->rsp_status_list == NULL)
+    goto free_fetch_list;
   
   return resp_info;
 
+ free_fetch_list:
+  clist_free(resp_info->rsp_fetch_list);
  free_expunged:
   clist_free(resp_info->rsp_expunged);
  free_search_result:
@@ -3223,6 +3242,11 @@ mailimap_response_info_free(struct mailimap_response_info * resp_info)
     mailimap_mailbox_data_search_free(resp_info->rsp_search_result);
   if (resp_info->rsp_status != NULL)
     mailimap_mailbox_data_status_free(resp_info->rsp_status);
+  if (resp_info->rsp_status_list != NULL) {
+    clist_foreach(resp_info->rsp_status_list,
+        (clist_func) mailimap_mailbox_data_status_free, NULL);
+    clist_free(resp_info->rsp_status_list);
+  }
   if (resp_info->rsp_expunged != NULL) {
     clist_foreach(resp_info->rsp_expunged,
 		   (clist_func) mailimap_number_alloc_free, NULL);
@@ -3259,6 +3283,7 @@ mailimap_parser_context_new(mailimap * session)
 
   ctx->msg_body_handler = session->imap_msg_body_handler;
   ctx->msg_body_handler_context = session->imap_msg_body_handler_context;
+  ctx->msg_body_handler_threshold = session->imap_msg_body_handler_threshold;
   ctx->msg_body_parse_in_progress = false;
   ctx->msg_body_section = NULL;
   ctx->msg_body_att_type = 0;
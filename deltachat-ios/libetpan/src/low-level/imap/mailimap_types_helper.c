@@ -599,6 +599,45 @@ mailimap_fetch_att_new_body_peek_section_partial(struct mailimap_section * secti
 				offset, size, NULL);
 }
 
+LIBETPAN_EXPORT
+struct mailimap_fetch_att *
+mailimap_fetch_att_new_binary_section(struct mailimap_section * section)
+{
+  return mailimap_fetch_att_new(MAILIMAP_FETCH_ATT_BINARY_SECTION, section, 0, 0, NULL);
+}
+
+LIBETPAN_EXPORT
+struct mailimap_fetch_att *
+mailimap_fetch_att_new_binary_peek_section(struct mailimap_section * section)
+{
+  return mailimap_fetch_att_new(MAILIMAP_FETCH_ATT_BINARY_PEEK_SECTION, section, 0, 0, NULL);
+}
+
+LIBETPAN_EXPORT
+struct mailimap_fetch_att *
+mailimap_fetch_att_new_binary_section_partial(struct mailimap_section * section,
+					      uint32_t offset, uint32_t size)
+{
+  return mailimap_fetch_att_new(MAILIMAP_FETCH_ATT_BINARY_SECTION, section,
+				offset, size, NULL);
+}
+
+LIBETPAN_EXPORT
+struct mailimap_fetch_att *
+mailimap_fetch_att_new_binary_peek_section_partial(struct mailimap_section * section,
+						   uint32_t offset, uint32_t size)
+{
+  return mailimap_fetch_att_new(MAILIMAP_FETCH_ATT_BINARY_PEEK_SECTION, section,
+				offset, size, NULL);
+}
+
+LIBETPAN_EXPORT
+struct mailimap_fetch_att *
+mailimap_fetch_att_new_binary_size_section(struct mailimap_section * section)
+{
+  return mailimap_fetch_att_new(MAILIMAP_FETCH_ATT_BINARY_SIZE_SECTION, section, 0, 0, NULL);
+}
+
 LIBETPAN_EXPORT
 struct mailimap_fetch_att *
 mailimap_fetch_att_new_extension(char * ext_keyword)
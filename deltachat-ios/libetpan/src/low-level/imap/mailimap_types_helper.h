@@ -351,6 +351,42 @@ struct mailimap_fetch_att *
 mailimap_fetch_att_new_body_peek_section_partial(struct mailimap_section * section,
 						 uint32_t offset, uint32_t size);
 
+/*
+  these functions create a mailimap_fetch_att structure to request
+  a given part of a message with its content transfer encoding
+  removed by the server (BINARY extension, RFC 3516).
+  the section must only contain a part number.
+  the content is returned as MAILIMAP_MSG_ATT_BINARY_SECTION.
+*/
+
+LIBETPAN_EXPORT
+struct mailimap_fetch_att *
+mailimap_fetch_att_new_binary_section(struct mailimap_section * section);
+
+LIBETPAN_EXPORT
+struct mailimap_fetch_att *
+mailimap_fetch_att_new_binary_peek_section(struct mailimap_section * section);
+
+LIBETPAN_EXPORT
+struct mailimap_fetch_att *
+mailimap_fetch_att_new_binary_section_partial(struct mailimap_section * section,
+					      uint32_t offset, uint32_t size);
+
+LIBETPAN_EXPORT
+struct mailimap_fetch_att *
+mailimap_fetch_att_new_binary_peek_section_partial(struct mailimap_section * section,
+						   uint32_t offset, uint32_t size);
+
+/*
+  this function creates a mailimap_fetch_att structure to request
+  the decoded size of a given part of a message (BINARY extension).
+  the size is returned as MAILIMAP_MSG_ATT_BINARY_SIZE.
+*/
+
+LIBETPAN_EXPORT
+struct mailimap_fetch_att *
+mailimap_fetch_att_new_binary_size_section(struct mailimap_section * section);
+
 /*
  creates a mailimap_fetch_att extension
 */
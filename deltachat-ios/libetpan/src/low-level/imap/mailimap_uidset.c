@@ -0,0 +1,524 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2018 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include "mailimap_uidset.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "mailimap_types_helper.h"
+
+#define UIDSET_DEFAULT_SIZE 4
+
+LIBETPAN_EXPORT
+struct mailimap_uidset * mailimap_uidset_new(void)
+{
+  struct mailimap_uidset * uidset;
+  
+  uidset = malloc(sizeof(* uidset));
+  if (uidset == NULL)
+    return NULL;
+  
+  uidset->set_ranges = NULL;
+  uidset->set_count = 0;
+  uidset->set_allocated = 0;
+  
+  return uidset;
+}
+
+LIBETPAN_EXPORT
+void mailimap_uidset_free(struct mailimap_uidset * uidset)
+{
+  free(uidset->set_ranges);
+  free(uidset);
+}
+
+static int uidset_reserve(struct mailimap_uidset * uidset, unsigned int count)
+{
+  struct mailimap_uidset_range * ranges;
+  unsigned int size;
+  
+  if (count <= uidset->set_allocated)
+    return 0;
+  
+  size = uidset->set_allocated;
+  if (size == 0)
+    size = UIDSET_DEFAULT_SIZE;
+  while (size < count)
+    size *= 2;
+  
+  ranges = realloc(uidset->set_ranges, size * sizeof(* ranges));
+  if (ranges == NULL)
+    return -1;
+  
+  uidset->set_ranges = ranges;
+  uidset->set_allocated = size;
+  
+  return 0;
+}
+
+/* index of the first range that ends at uid - 1 or after */
+
+static unsigned int uidset_touching_index(struct mailimap_uidset * uidset,
+    uint32_t uid)
+{
+  unsigned int left;
+  unsigned int right;
+  
+  left = 0;
+  right = uidset->set_count;
+  while (left < right) {
+    unsigned int middle;
+    
+    middle = left + (right - left) / 2;
+    if ((uint64_t) uidset->set_ranges[middle].rg_last + 1 < uid)
+      left = middle + 1;
+    else
+      right = middle;
+  }
+  
+  return left;
+}
+
+/* index of the first range that ends at uid or after */
+
+static unsigned int uidset_overlapping_index(struct mailimap_uidset * uidset,
+    uint32_t uid)
+{
+  unsigned int left;
+  unsigned int right;
+  
+  left = 0;
+  right = uidset->set_count;
+  while (left < right) {
+    unsigned int middle;
+    
+    middle = left + (right - left) / 2;
+    if (uidset->set_ranges[middle].rg_last < uid)
+      left = middle + 1;
+    else
+      right = middle;
+  }
+  
+  return left;
+}
+
+LIBETPAN_EXPORT
+int mailimap_uidset_add_range(struct mailimap_uidset * uidset,
+    uint32_t first, uint32_t last)
+{
+  struct mailimap_uidset_range * ranges;
+  unsigned int count;
+  unsigned int i;
+  unsigned int j;
+  
+  if (first > last) {
+    uint32_t tmp;
+    
+    tmp = first;
+    first = last;
+    last = tmp;
+  }
+  
+  count = uidset->set_count;
+  
+  /* UIDs are usually added in increasing order */
+  if (count > 0) {
+    struct mailimap_uidset_range * range;
+    
+    range = &uidset->set_ranges[count - 1];
+    if ((first >= range->rg_first) &&
+        ((uint64_t) first <= (uint64_t) range->rg_last + 1)) {
+      if (last > range->rg_last)
+        range->rg_last = last;
+      return MAILIMAP_NO_ERROR;
+    }
+  }
+  if ((count == 0) ||
+      ((uint64_t) first > (uint64_t) uidset->set_ranges[count - 1].rg_last + 1)) {
+    if (uidset_reserve(uidset, count + 1) < 0)
+      return MAILIMAP_ERROR_MEMORY;
+    uidset->set_ranges[count].rg_first = first;
+    uidset->set_ranges[count].rg_last = last;
+    uidset->set_count ++;
+    return MAILIMAP_NO_ERROR;
+  }
+  
+  /* ranges from i to j - 1 are merged with the new one */
+  i = uidset_touching_index(uidset, first);
+  j = i;
+  while ((j < count) &&
+      ((uint64_t) uidset->set_ranges[j].rg_first <= (uint64_t) last + 1))
+    j ++;
+  
+  if (i == j) {
+    if (uidset_reserve(uidset, count + 1) < 0)
+      return MAILIMAP_ERROR_MEMORY;
+    ranges = uidset->set_ranges;
+    memmove(&ranges[i + 1], &ranges[i], (count - i) * sizeof(* ranges));
+    ranges[i].rg_first = first;
+    ranges[i].rg_last = last;
+    uidset->set_count ++;
+    return MAILIMAP_NO_ERROR;
+  }
+  
+  ranges = uidset->set_ranges;
+  if (first < ranges[i].rg_first)
+    ranges[i].rg_first = first;
+  if (last < ranges[j - 1].rg_last)
+    last = ranges[j - 1].rg_last;
+  ranges[i].rg_last = last;
+  memmove(&ranges[i + 1], &ranges[j], (count - j) * sizeof(* ranges));
+  uidset->set_count -= j - i - 1;
+  
+  return MAILIMAP_NO_ERROR;
+}
+
+LIBETPAN_EXPORT
+int mailimap_uidset_add(struct mailimap_uidset * uidset, uint32_t uid)
+{
+  return mailimap_uidset_add_range(uidset, uid, uid);
+}
+
+LIBETPAN_EXPORT
+int mailimap_uidset_remove_range(struct mailimap_uidset * uidset,
+    uint32_t first, uint32_t last)
+{
+  struct mailimap_uidset_range * ranges;
+  unsigned int count;
+  unsigned int i;
+  unsigned int j;
+  
+  if (first > last) {
+    uint32_t tmp;
+    
+    tmp = first;
+    first = last;
+    last = tmp;
+  }
+  
+  count = uidset->set_count;
+  i = uidset_overlapping_index(uidset, first);
+  if ((i == count) || (uidset->set_ranges[i].rg_first > last))
+    return MAILIMAP_NO_ERROR;
+  
+  ranges = uidset->set_ranges;
+  if ((ranges[i].rg_first < first) && (ranges[i].rg_last > last)) {
+    /* split the range */
+    if (uidset_reserve(uidset, count + 1) < 0)
+      return MAILIMAP_ERROR_MEMORY;
+    ranges = uidset->set_ranges;
+    memmove(&ranges[i + 2], &ranges[i + 1], (count - i - 1) * sizeof(* ranges));
+    ranges[i + 1].rg_first = last + 1;
+    ranges[i + 1].rg_last = ranges[i].rg_last;
+    ranges[i].rg_last = first - 1;
+    uidset->set_count ++;
+    return MAILIMAP_NO_ERROR;
+  }
+  
+  if (ranges[i].rg_first < first) {
+    ranges[i].rg_last = first - 1;
+    i ++;
+  }
+  
+  j = i;
+  while ((j < count) && (ranges[j].rg_last <= last))
+    j ++;
+  if ((j < count) && (ranges[j].rg_first <= last))
+    ranges[j].rg_first = last + 1;
+  
+  memmove(&ranges[i], &ranges[j], (count - j) * sizeof(* ranges));
+  uidset->set_count -= j - i;
+  
+  return MAILIMAP_NO_ERROR;
+}
+
+LIBETPAN_EXPORT
+int mailimap_uidset_remove(struct mailimap_uidset * uidset, uint32_t uid)
+{
+  return mailimap_uidset_remove_range(uidset, uid, uid);
+}
+
+LIBETPAN_EXPORT
+int mailimap_uidset_contains(struct mailimap_uidset * uidset, uint32_t uid)
+{
+  unsigned int i;
+  
+  i = uidset_overlapping_index(uidset, uid);
+  if (i == uidset->set_count)
+    return 0;
+  
+  return uidset->set_ranges[i].rg_first <= uid;
+}
+
+LIBETPAN_EXPORT
+uint32_t mailimap_uidset_count(struct mailimap_uidset * uidset)
+{
+  uint32_t count;
+  unsigned int i;
+  
+  count = 0;
+  for(i = 0 ; i < uidset->set_count ; i ++)
+    count += uidset->set_ranges[i].rg_last - uidset->set_ranges[i].rg_first + 1;
+  
+  return count;
+}
+
+LIBETPAN_EXPORT
+struct mailimap_uidset * mailimap_uidset_union(struct mailimap_uidset * a,
+    struct mailimap_uidset * b)
+{
+  struct mailimap_uidset * result;
+  unsigned int i;
+  unsigned int j;
+  
+  result = mailimap_uidset_new();
+  if (result == NULL)
+    goto err;
+  
+  /* ranges are added in increasing order of their first UID, each
+     addition is an append or an extension of the last range */
+  i = 0;
+  j = 0;
+  while ((i < a->set_count) || (j < b->set_count)) {
+    struct mailimap_uidset_range * range;
+    
+    if ((j == b->set_count) ||
+        ((i < a->set_count) &&
+            (a->set_ranges[i].rg_first <= b->set_ranges[j].rg_first))) {
+      range = &a->set_ranges[i];
+      i ++;
+    }
+    else {
+      range = &b->set_ranges[j];
+      j ++;
+    }
+    
+    if (mailimap_uidset_add_range(result,
+            range->rg_first, range->rg_last) != MAILIMAP_NO_ERROR)
+      goto free;
+  }
+  
+  return result;
+  
+ free:
+  mailimap_uidset_free(result);
+ err:
+  return NULL;
+}
+
+LIBETPAN_EXPORT
+struct mailimap_uidset * mailimap_uidset_intersection(struct mailimap_uidset * a,
+    struct mailimap_uidset * b)
+{
+  struct mailimap_uidset * result;
+  unsigned int i;
+  unsigned int j;
+  
+  result = mailimap_uidset_new();
+  if (result == NULL)
+    goto err;
+  
+  i = 0;
+  j = 0;
+  while ((i < a->set_count) && (j < b->set_count)) {
+    uint32_t first;
+    uint32_t last;
+    
+    first = a->set_ranges[i].rg_first;
+    if (b->set_ranges[j].rg_first > first)
+      first = b->set_ranges[j].rg_first;
+    last = a->set_ranges[i].rg_last;
+    if (b->set_ranges[j].rg_last < last)
+      last = b->set_ranges[j].rg_last;
+    
+    if (first <= last) {
+      if (mailimap_uidset_add_range(result, first, last) != MAILIMAP_NO_ERROR)
+        goto free;
+    }
+    
+    if (a->set_ranges[i].rg_last < b->set_ranges[j].rg_last)
+      i ++;
+    else
+      j ++;
+  }
+  
+  return result;
+  
+ free:
+  mailimap_uidset_free(result);
+ err:
+  return NULL;
+}
+
+LIBETPAN_EXPORT
+struct mailimap_uidset * mailimap_uidset_difference(struct mailimap_uidset * a,
+    struct mailimap_uidset * b)
+{
+  struct mailimap_uidset * result;
+  unsigned int i;
+  unsigned int j;
+  
+  result = mailimap_uidset_new();
+  if (result == NULL)
+    goto err;
+  
+  j = 0;
+  for(i = 0 ; i < a->set_count ; i ++) {
+    uint32_t first;
+    uint32_t last;
+    unsigned int k;
+    int covered;
+    
+    first = a->set_ranges[i].rg_first;
+    last = a->set_ranges[i].rg_last;
+    
+    while ((j < b->set_count) && (b->set_ranges[j].rg_last < first))
+      j ++;
+    
+    covered = 0;
+    for(k = j ; (k < b->set_count) && (b->set_ranges[k].rg_first <= last) ; k ++) {
+      if (b->set_ranges[k].rg_first > first) {
+        if (mailimap_uidset_add_range(result,
+                first, b->set_ranges[k].rg_first - 1) != MAILIMAP_NO_ERROR)
+          goto free;
+      }
+      if (b->set_ranges[k].rg_last >= last) {
+        covered = 1;
+        break;
+      }
+      first = b->set_ranges[k].rg_last + 1;
+    }
+    
+    if (!covered) {
+      if (mailimap_uidset_add_range(result, first, last) != MAILIMAP_NO_ERROR)
+        goto free;
+    }
+  }
+  
+  return result;
+  
+ free:
+  mailimap_uidset_free(result);
+ err:
+  return NULL;
+}
+
+LIBETPAN_EXPORT
+struct mailimap_set * mailimap_uidset_to_set(struct mailimap_uidset * uidset)
+{
+  struct mailimap_set * set;
+  unsigned int i;
+  int r;
+  
+  set = mailimap_set_new_empty();
+  if (set == NULL)
+    goto err;
+  
+  for(i = 0 ; i < uidset->set_count ; i ++) {
+    r = mailimap_set_add_interval(set, uidset->set_ranges[i].rg_first,
+        uidset->set_ranges[i].rg_last);
+    if (r != MAILIMAP_NO_ERROR)
+      goto free;
+  }
+  
+  return set;
+  
+ free:
+  mailimap_set_free(set);
+ err:
+  return NULL;
+}
+
+LIBETPAN_EXPORT
+struct mailimap_uidset * mailimap_uidset_new_from_set(struct mailimap_set * set)
+{
+  struct mailimap_uidset * uidset;
+  clistiter * cur;
+  
+  uidset = mailimap_uidset_new();
+  if (uidset == NULL)
+    goto err;
+  
+  for(cur = clist_begin(set->set_list) ; cur != NULL ; cur = clist_next(cur)) {
+    struct mailimap_set_item * item;
+    uint32_t first;
+    uint32_t last;
+    
+    item = clist_content(cur);
+    first = item->set_first;
+    if (first == 0)
+      first = UINT32_MAX;
+    last = item->set_last;
+    if (last == 0)
+      last = UINT32_MAX;
+    
+    if (mailimap_uidset_add_range(uidset, first, last) != MAILIMAP_NO_ERROR)
+      goto free;
+  }
+  
+  return uidset;
+  
+ free:
+  mailimap_uidset_free(uidset);
+ err:
+  return NULL;
+}
+
+LIBETPAN_EXPORT
+struct mailimap_uidset * mailimap_uidset_new_from_list(clist * list)
+{
+  struct mailimap_uidset * uidset;
+  clistiter * cur;
+  
+  uidset = mailimap_uidset_new();
+  if (uidset == NULL)
+    goto err;
+  
+  for(cur = clist_begin(list) ; cur != NULL ; cur = clist_next(cur)) {
+    uint32_t * uid;
+    
+    uid = clist_content(cur);
+    if (mailimap_uidset_add(uidset, * uid) != MAILIMAP_NO_ERROR)
+      goto free;
+  }
+  
+  return uidset;
+  
+ free:
+  mailimap_uidset_free(uidset);
+ err:
+  return NULL;
+}
@@ -0,0 +1,473 @@
+/*
+ * libEtPan! -- a mail stuff library
+ *
+ * Copyright (C) 2001, 2018 - DINH Viet Hoa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the libEtPan! project nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include "multiappend.h"
+
+#ifdef WIN32
+#	include "win_etpan.h"
+#else
+#	include <unistd.h>
+#	include <sys/mman.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+
+#include "mailimap.h"
+#include "mailimap_sender.h"
+#include "mailimap_parser.h"
+#include "mailstream_helper.h"
+
+/*
+   RFC 3502
+
+   append          = "APPEND" SP mailbox 1*append-message
+
+   append-message  = SP [flag-list SP] [date-time SP] literal
+*/
+
+LIBETPAN_EXPORT
+struct mailimap_append_message *
+mailimap_append_message_new(struct mailimap_flag_list * am_flag_list,
+    struct mailimap_date_time * am_date_time,
+    const char * am_literal, size_t am_literal_size)
+{
+  struct mailimap_append_message * message;
+
+  message = malloc(sizeof(* message));
+  if (message == NULL)
+    return NULL;
+
+  message->am_flag_list = am_flag_list;
+  message->am_date_time = am_date_time;
+  message->am_literal = am_literal;
+  message->am_literal_size = am_literal_size;
+  message->am_fd = -1;
+  message->am_offset = 0;
+  message->am_writer = NULL;
+  message->am_writer_context = NULL;
+
+  return message;
+}
+
+LIBETPAN_EXPORT
+struct mailimap_append_message *
+mailimap_append_message_new_fd(struct mailimap_flag_list * am_flag_list,
+    struct mailimap_date_time * am_date_time,
+    int am_fd, off_t am_offset, size_t am_literal_size)
+{
+  struct mailimap_append_message * message;
+
+  message = mailimap_append_message_new(am_flag_list, am_date_time,
+      NULL, am_literal_size);
+  if (message == NULL)
+    return NULL;
+
+  message->am_fd = am_fd;
+  message->am_offset = am_offset;
+
+  return message;
+}
+
+LIBETPAN_EXPORT
+struct mailimap_append_message *
+mailimap_append_message_new_writer(struct mailimap_flag_list * am_flag_list,
+    struct mailimap_date_time * am_date_time,
+    int (* am_writer)(int (* do_write)(void *, const char *, size_t),
+                      void * data, void * context),
+    void * am_writer_context)
+{
+  struct mailimap_append_message * message;
+
+  message = mailimap_append_message_new(am_flag_list, am_date_time,
+      NULL, 0);
+  if (message == NULL)
+    return NULL;
+
+  message->am_writer = am_writer;
+  message->am_writer_context = am_writer_context;
+
+  return message;
+}
+
+LIBETPAN_EXPORT
+void mailimap_append_message_free(struct mailimap_append_message * message)
+{
+  if (message->am_flag_list != NULL)
+    mailimap_flag_list_free(message->am_flag_list);
+  if (message->am_date_time != NULL)
+    mailimap_date_time_free(message->am_date_time);
+  free(message);
+}
+
+LIBETPAN_EXPORT
+int mailimap_has_multiappend(mailimap * session)
+{
+  return mailimap_has_extension(session, "MULTIAPPEND");
+}
+
+/* content of a message while it is being sent */
+
+struct append_item {
+  const char * data;
+  size_t size;
+  size_t fixed_size; /* size once line endings are converted to CRLF */
+  void * mapping;
+  size_t mapping_size;
+};
+
+static int append_item_map(struct mailimap_append_message * message,
+    struct append_item * item)
+{
+  item->size = message->am_literal_size;
+  item->mapping = NULL;
+  item->mapping_size = 0;
+
+  if (message->am_writer != NULL) {
+    struct mailstream_data_writer size_writer;
+
+    /* the message will be written a second time while it is sent */
+    mailstream_data_writer_init(&size_writer, NULL, 0);
+    if (message->am_writer(mailstream_data_writer_write, &size_writer,
+            message->am_writer_context) != 0)
+      return MAILIMAP_ERROR_APPEND;
+    mailstream_data_writer_finish(&size_writer);
+
+    item->data = NULL;
+    item->size = 0;
+    item->fixed_size = size_writer.dw_size;
+
+    return MAILIMAP_NO_ERROR;
+  }
+
+  if ((message->am_literal != NULL) || (message->am_literal_size == 0)) {
+    item->data = message->am_literal;
+  }
+  else {
+    size_t delta;
+    void * mapping;
+
+    /* the offset of a mapping must be a multiple of the page size */
+    delta = (size_t) (message->am_offset % sysconf(_SC_PAGESIZE));
+
+    mapping = mmap(NULL, message->am_literal_size + delta, PROT_READ,
+        MAP_PRIVATE, message->am_fd, message->am_offset - delta);
+    if (mapping == MAP_FAILED)
+      return MAILIMAP_ERROR_APPEND;
+#ifdef MADV_SEQUENTIAL
+    madvise(mapping, message->am_literal_size + delta, MADV_SEQUENTIAL);
+#endif
+
+    item->mapping = mapping;
+    item->mapping_size = message->am_literal_size + delta;
+    item->data = (char *) mapping + delta;
+  }
+
+  item->fixed_size = mailstream_get_data_crlf_size(item->data, item->size);
+
+  return MAILIMAP_NO_ERROR;
+}
+
+static void append_item_unmap(struct append_item * item)
+{
+  if (item->mapping != NULL)
+    munmap(item->mapping, item->mapping_size);
+}
+
+static int append_continue_wait(mailimap * session)
+{
+  struct mailimap_response * response;
+  struct mailimap_continue_req * cont_req;
+  size_t indx;
+  int r;
+
+  if (mailstream_flush(session->imap_stream) == -1)
+    return MAILIMAP_ERROR_STREAM;
+
+  if (mailimap_read_line(session) == NULL)
+    return MAILIMAP_ERROR_STREAM;
+
+  indx = 0;
+
+  r = mailimap_continue_req_parse(session->imap_stream,
+      session->imap_stream_buffer, NULL,
+      &indx, &cont_req,
+      session->imap_progr_rate, session->imap_progr_fun);
+  if (r == MAILIMAP_NO_ERROR)
+    mailimap_continue_req_free(cont_req);
+
+  if (r == MAILIMAP_ERROR_PARSE) {
+    r = mailimap_parse_response(session, &response);
+    if (r != MAILIMAP_NO_ERROR)
+      return r;
+    mailimap_response_free(response);
+
+    return MAILIMAP_ERROR_APPEND;
+  }
+
+  return r;
+}
+
+static int append_writer_send(mailimap * session,
+    struct mailimap_append_message * message, size_t fixed_size)
+{
+  struct mailstream_data_writer data_writer;
+
+  mailstream_data_writer_init(&data_writer, session->imap_stream, 0);
+  if (message->am_writer(mailstream_data_writer_write, &data_writer,
+          message->am_writer_context) != 0)
+    return MAILIMAP_ERROR_STREAM;
+  if (mailstream_data_writer_finish(&data_writer) == -1)
+    return MAILIMAP_ERROR_STREAM;
+
+  /* the size of the literal has already been sent */
+  if (data_writer.dw_size != fixed_size)
+    return MAILIMAP_ERROR_STREAM;
+
+  return MAILIMAP_NO_ERROR;
+}
+
+static int append_literal_send(mailimap * session,
+    const char * literal, size_t literal_size)
+{
+  if (session->imap_body_progress_fun != NULL)
+    return mailimap_literal_data_send_with_context(session->imap_stream,
+        literal, literal_size,
+        session->imap_body_progress_fun,
+        session->imap_progress_context);
+  else
+    return mailimap_literal_data_send(session->imap_stream,
+        literal, literal_size,
+        session->imap_progr_rate, session->imap_progr_fun);
+}
+
+/*
+  sends a single APPEND command with the given messages, all of them
+  are mapped before anything is sent since the command can't be
+  interrupted once started.
+*/
+
+static int append_messages(mailimap * session, const char * mailbox,
+    struct mailimap_append_message ** messages, unsigned int count)
+{
+  struct mailimap_response * response;
+  struct append_item * items;
+  unsigned int mapped;
+  unsigned int i;
+  int literalplus;
+  int error_code;
+  int r;
+  int res;
+
+  items = malloc(count * sizeof(* items));
+  if (items == NULL) {
+    res = MAILIMAP_ERROR_MEMORY;
+    goto err;
+  }
+
+  for(mapped = 0 ; mapped < count ; mapped ++) {
+    r = append_item_map(messages[mapped], &items[mapped]);
+    if (r != MAILIMAP_NO_ERROR) {
+      res = r;
+      goto unmap;
+    }
+  }
+
+  literalplus = mailimap_has_extension(session, "LITERAL+");
+
+  r = mailimap_send_current_tag(session);
+  if (r != MAILIMAP_NO_ERROR) {
+    res = r;
+    goto unmap;
+  }
+
+  r = mailimap_token_send(session->imap_stream, "APPEND");
+  if (r != MAILIMAP_NO_ERROR) {
+    res = r;
+    goto unmap;
+  }
+
+  r = mailimap_space_send(session->imap_stream);
+  if (r != MAILIMAP_NO_ERROR) {
+    res = r;
+    goto unmap;
+  }
+
+  r = mailimap_mailbox_send(session->imap_stream, mailbox);
+  if (r != MAILIMAP_NO_ERROR) {
+    res = r;
+    goto unmap;
+  }
+
+  for(i = 0 ; i < count ; i ++) {
+    r = mailimap_append_message_send(session->imap_stream,
+        messages[i]->am_flag_list, messages[i]->am_date_time,
+        items[i].fixed_size, literalplus);
+    if (r != MAILIMAP_NO_ERROR) {
+      res = r;
+      goto unmap;
+    }
+
+    if (!literalplus) {
+      r = append_continue_wait(session);
+      if (r != MAILIMAP_NO_ERROR) {
+        res = r;
+        goto unmap;
+      }
+    }
+
+    if (messages[i]->am_writer != NULL)
+      r = append_writer_send(session, messages[i], items[i].fixed_size);
+    else
+      r = append_literal_send(session, items[i].data, items[i].size);
+    if (r != MAILIMAP_NO_ERROR) {
+      res = r;
+      goto unmap;
+    }
+  }
+
+  r = mailimap_crlf_send(session->imap_stream);
+  if (r != MAILIMAP_NO_ERROR) {
+    res = r;
+    goto unmap;
+  }
+
+  if (mailstream_flush(session->imap_stream) == -1) {
+    res = MAILIMAP_ERROR_STREAM;
+    goto unmap;
+  }
+
+  if (mailimap_read_line(session) == NULL) {
+    res = MAILIMAP_ERROR_STREAM;
+    goto unmap;
+  }
+
+  r = mailimap_parse_response(session, &response);
+  if (r != MAILIMAP_NO_ERROR) {
+    res = r;
+    goto unmap;
+  }
+
+  error_code = response->rsp_resp_done->rsp_data.rsp_tagged->rsp_cond_state->rsp_type;
+
+  mailimap_response_free(response);
+
+  switch (error_code) {
+  case MAILIMAP_RESP_COND_STATE_OK:
+    res = MAILIMAP_NO_ERROR;
+    break;
+
+  default:
+    res = MAILIMAP_ERROR_APPEND;
+    break;
+  }
+
+ unmap:
+  for(i = 0 ; i < mapped ; i ++)
+    append_item_unmap(&items[i]);
+  free(items);
+ err:
+  return res;
+}
+
+LIBETPAN_EXPORT
+int mailimap_multiappend(mailimap * session, const char * mailbox,
+    clist * message_list)
+{
+  struct mailimap_append_message ** messages;
+  unsigned int count;
+  unsigned int i;
+  clistiter * cur;
+  int r;
+
+  if ((session->imap_state != MAILIMAP_STATE_AUTHENTICATED) &&
+      (session->imap_state != MAILIMAP_STATE_SELECTED))
+    return MAILIMAP_ERROR_BAD_STATE;
+
+  count = clist_count(message_list);
+  if (count == 0)
+    return MAILIMAP_ERROR_INVAL;
+
+  messages = malloc(count * sizeof(* messages));
+  if (messages == NULL)
+    return MAILIMAP_ERROR_MEMORY;
+
+  i = 0;
+  for(cur = clist_begin(message_list) ; cur != NULL ; cur = clist_next(cur)) {
+    messages[i] = clist_content(cur);
+    i ++;
+  }
+
+  if (mailimap_has_multiappend(session)) {
+    r = append_messages(session, mailbox, messages, count);
+  }
+  else {
+    r = MAILIMAP_NO_ERROR;
+    for(i = 0 ; i < count ; i ++) {
+      r = append_messages(session, mailbox, &messages[i], 1);
+      if (r != MAILIMAP_NO_ERROR)
+        break;
+    }
+  }
+
+  free(messages);
+
+  return r;
+}
+
+LIBETPAN_EXPORT
+int mailimap_append_fd(mailimap * session, const char * mailbox,
+    struct mailimap_flag_list * flag_list,
+    struct mailimap_date_time * date_time,
+    int fd, off_t offset, size_t literal_size)
+{
+  struct mailimap_append_message message;
+  struct mailimap_append_message * messages[1];
+
+  if ((session->imap_state != MAILIMAP_STATE_AUTHENTICATED) &&
+      (session->imap_state != MAILIMAP_STATE_SELECTED))
+    return MAILIMAP_ERROR_BAD_STATE;
+
+  message.am_flag_list = flag_list;
+  message.am_date_time = date_time;
+  message.am_literal = NULL;
+  message.am_literal_size = literal_size;
+  message.am_fd = fd;
+  message.am_offset = offset;
+  message.am_writer = NULL;
+  message.am_writer_context = NULL;
+  messages[0] = &message;
+
+  return append_messages(session, mailbox, messages, 1);
+}
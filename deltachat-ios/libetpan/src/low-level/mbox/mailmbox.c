@@ -59,6 +59,7 @@
 #include "libetpan-config.h"
 
 #include "mmapstring.h"
+#include "mailmapview.h"
 #include "mailmbox_parse.h"
 #include "maillock.h"
 
@@ -143,6 +144,7 @@ int mailmbox_read_unlock(struct mailmbox_folder * folder)
 int mailmbox_map(struct mailmbox_folder * folder)
 {
   char * str;
+  struct mailmapview * view;
   struct stat buf;
   int res;
   int r;
@@ -163,12 +165,22 @@ int mailmbox_map(struct mailmbox_folder * folder)
     res = MAILMBOX_ERROR_FILE;
     goto err;
   }
+
+  /* fetched messages can keep the mapping after the file is unmapped */
+  view = mailmapview_new(str, buf.st_size);
+  if (view == NULL) {
+    res = MAILMBOX_ERROR_MEMORY;
+    goto unmap;
+  }
   
   folder->mb_mapping = str;
   folder->mb_mapping_size = buf.st_size;
+  folder->mb_view = view;
 
   return MAILMBOX_NO_ERROR;
 
+ unmap:
+  munmap(str, buf.st_size);
  err:
   return res;
 }
@@ -179,7 +191,9 @@ int mailmbox_map(struct mailmbox_folder * folder)
 
 void mailmbox_unmap(struct mailmbox_folder * folder)
 {
-  munmap(folder->mb_mapping, folder->mb_mapping_size);
+  if (folder->mb_view != NULL)
+    mailmapview_unref(folder->mb_view);
+  folder->mb_view = NULL;
   folder->mb_mapping = NULL;
   folder->mb_mapping_size = 0;
 }
@@ -490,6 +504,56 @@ static size_t get_fixed_message_size(const char * message, size_t size,
   return fixed_size;
 }
 
+/*
+  tells if write_fixed_message() with no uid would give the message
+  unchanged
+*/
+
+static int is_fixed_message(const char * message, size_t size)
+{
+  size_t cur_token;
+  size_t left;
+  const char * next;
+  int r;
+
+  cur_token = 0;
+
+  /* headers */
+
+  while (1) {
+    if (cur_token + strlen(UID_HEADER) <= size) {
+      if (message[cur_token] == 'X') {
+	if (strncasecmp(message + cur_token, UID_HEADER,
+			strlen(UID_HEADER)) == 0)
+	  return FALSE;
+      }
+    }
+
+    r = mailimf_ignore_field_parse(message, size, &cur_token);
+    if (r != MAILIMF_NO_ERROR)
+      break;
+  }
+
+  /* body */
+
+  left = size - cur_token;
+  next = message + cur_token;
+  while (left > 0) {
+    size_t count;
+    size_t fixed_count;
+
+    if (!get_fixed_line_size(next, left, &next, &count, &fixed_count))
+      return FALSE;
+
+    if (fixed_count != count)
+      return FALSE;
+
+    left -= count;
+  }
+
+  return TRUE;
+}
+
 static inline char * write_fixed_line(char * str,
     const char * line, size_t length,
     const char ** pnext_line, size_t * pcount)
@@ -906,9 +970,9 @@ int mailmbox_fetch_msg_headers_no_lock(struct mailmbox_folder * folder,
   return res;
 }
 
-int mailmbox_fetch_msg(struct mailmbox_folder * folder,
-		       uint32_t num, char ** result,
-		       size_t * result_len)
+static int fetch_msg(struct mailmbox_folder * folder,
+    uint32_t num, int mapped, char ** result,
+    size_t * result_len)
 {
   MMAPString * mmapstr;
   int res;
@@ -929,6 +993,23 @@ int mailmbox_fetch_msg(struct mailmbox_folder * folder,
     res = r;
     goto unlock;
   }
+
+  /* a writable mapping could be changed through the result, or
+     truncated by an expunge while the result is held */
+  if (mapped && folder->mb_read_only &&
+      (len > 0) && is_fixed_message(data, len)) {
+    /* the message is given from the mapping of the file */
+    * result = mailmapview_get_str(folder->mb_view, data - folder->mb_mapping);
+    if (* result == NULL) {
+      res = MAILMBOX_ERROR_MEMORY;
+      goto unlock;
+    }
+    * result_len = len;
+
+    mailmbox_read_unlock(folder);
+
+    return MAILMBOX_NO_ERROR;
+  }
   
   /* size with no uid */
   fixed_size = get_fixed_message_size(data, len, 0, 1 /* force no uid */);
@@ -970,6 +1051,19 @@ int mailmbox_fetch_msg(struct mailmbox_folder * folder,
   return res;
 }
 
+int mailmbox_fetch_msg(struct mailmbox_folder * folder,
+		       uint32_t num, char ** result,
+		       size_t * result_len)
+{
+  return fetch_msg(folder, num, 0, result, result_len);
+}
+
+int mailmbox_fetch_msg_mapped(struct mailmbox_folder * folder,
+    uint32_t num, char ** result, size_t * result_len)
+{
+  return fetch_msg(folder, num, 1, result, result_len);
+}
+
 int mailmbox_fetch_msg_headers(struct mailmbox_folder * folder,
 			       uint32_t num, char ** result,
 			       size_t * result_len)
@@ -1366,6 +1460,14 @@ int mailmbox_expunge_no_lock(struct mailmbox_folder * folder)
 
   r = rename(tmp_file, folder->mb_filename);
   if (r < 0) {
+    /* the copy rewrites the file in place, results that still hold
+       the mapping would change under their owner */
+    if ((folder->mb_view != NULL) && mailmapview_is_shared(folder->mb_view)) {
+      unlink(tmp_file);
+      res = MAILMBOX_ERROR_FILE;
+      goto err;
+    }
+    
     mailmbox_unmap(folder);
     mailmbox_close(folder);
     
@@ -59,6 +59,18 @@ int mailmbox_fetch_msg(struct mailmbox_folder * folder,
 		       uint32_t num, char ** result,
 		       size_t * result_len);
 
+/*
+  mailmbox_fetch_msg_mapped() is mailmbox_fetch_msg() for callers that
+  only read the message with its length. When the folder is read-only
+  and the message does not need to be changed, the result points into
+  the mapping of the mailbox without a copy and is not terminated
+  by '\0'. It must not be modified.
+  The result must be freed with mailmbox_fetch_result_free().
+*/
+
+int mailmbox_fetch_msg_mapped(struct mailmbox_folder * folder,
+    uint32_t num, char ** result, size_t * result_len);
+
 int mailmbox_fetch_msg_headers(struct mailmbox_folder * folder,
 			       uint32_t num, char ** result,
 			       size_t * result_len);
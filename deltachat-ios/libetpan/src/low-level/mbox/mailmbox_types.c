@@ -210,6 +210,7 @@ struct mailmbox_folder * mailmbox_folder_new(const char * mb_filename)
   
   folder->mb_mapping = NULL;
   folder->mb_mapping_size = 0;
+  folder->mb_view = NULL;
 
   folder->mb_written_uid = 0;
   folder->mb_max_uid = 0;
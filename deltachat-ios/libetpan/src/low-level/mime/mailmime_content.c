@@ -45,6 +45,8 @@
 #include "mailmime.h"
 #include "mailmime_types.h"
 #include "mmapstring.h"
+#include "charconv.h"
+#include "mailparallel.h"
 
 #ifndef TRUE
 #define TRUE 1
@@ -2261,3 +2263,214 @@ int mailmime_get_section_id(struct mailmime * mime,
  err:
   return res;
 }
+
+/* below this size, decoding is faster than starting threads */
+#define PARTS_DECODE_PARALLEL_MIN_SIZE (64 * 1024)
+
+struct parts_decode_state {
+  struct mailmime_decoded_content ** jobs;
+  const char * to_charset;
+};
+
+static int parts_decode_collect(struct mailmime * mime, carray * list)
+{
+  struct mailmime_decoded_content * content;
+  clistiter * cur;
+  int r;
+
+  switch (mime->mm_type) {
+  case MAILMIME_SINGLE:
+    if (mime->mm_data.mm_single == NULL)
+      return MAILIMF_NO_ERROR;
+
+    content = mailmime_decoded_content_new(mime, NULL, 0, MAILIMF_NO_ERROR);
+    if (content == NULL)
+      return MAILIMF_ERROR_MEMORY;
+    r = carray_add(list, content, NULL);
+    if (r < 0) {
+      mailmime_decoded_content_free(content);
+      return MAILIMF_ERROR_MEMORY;
+    }
+    return MAILIMF_NO_ERROR;
+
+  case MAILMIME_MULTIPLE:
+    for(cur = clist_begin(mime->mm_data.mm_multipart.mm_mp_list) ;
+        cur != NULL ; cur = clist_next(cur)) {
+      r = parts_decode_collect(clist_content(cur), list);
+      if (r != MAILIMF_NO_ERROR)
+        return r;
+    }
+    return MAILIMF_NO_ERROR;
+
+  case MAILMIME_MESSAGE:
+    if (mime->mm_data.mm_message.mm_msg_mime == NULL)
+      return MAILIMF_NO_ERROR;
+    return parts_decode_collect(mime->mm_data.mm_message.mm_msg_mime, list);
+
+  default:
+    return MAILIMF_NO_ERROR;
+  }
+}
+
+static size_t parts_decode_length(struct mailmime_decoded_content * content)
+{
+  struct mailmime_data * data;
+
+  data = content->dc_mime->mm_data.mm_single;
+  if (data->dt_type != MAILMIME_DATA_TEXT)
+    return 0;
+
+  return data->dt_data.dt_text.dt_length;
+}
+
+static int parts_decode_compare(const void * a, const void * b)
+{
+  size_t length_a;
+  size_t length_b;
+
+  length_a = parts_decode_length(* (struct mailmime_decoded_content **) a);
+  length_b = parts_decode_length(* (struct mailmime_decoded_content **) b);
+  if (length_a > length_b)
+    return -1;
+  if (length_a < length_b)
+    return 1;
+  return 0;
+}
+
+static void parts_decode_convert(struct mailmime_decoded_content * content,
+    const char * to_charset)
+{
+  struct mailmime_content * content_type;
+  const char * charset;
+  char * converted;
+  size_t converted_len;
+  int r;
+
+  content_type = content->dc_mime->mm_content_type;
+  if (content_type == NULL) {
+    charset = "us-ascii";
+  }
+  else {
+    if (content_type->ct_type->tp_type != MAILMIME_TYPE_DISCRETE_TYPE)
+      return;
+    if (content_type->ct_type->tp_data.tp_discrete_type->dt_type !=
+        MAILMIME_DISCRETE_TYPE_TEXT)
+      return;
+    charset = mailmime_content_charset_get(content_type);
+  }
+
+  if (strcasecmp(charset, to_charset) == 0)
+    return;
+
+  r = charconv_buffer(to_charset, charset,
+      content->dc_data, content->dc_length, &converted, &converted_len);
+  if (r != MAIL_CHARCONV_NO_ERROR)
+    return;
+
+  mailmime_decoded_part_free(content->dc_data);
+  content->dc_data = converted;
+  content->dc_length = converted_len;
+}
+
+static void parts_decode_job(unsigned int indx, void * data)
+{
+  struct parts_decode_state * state;
+  struct mailmime_decoded_content * content;
+  struct mailmime_data * mime_data;
+  size_t cur_token;
+  int encoding;
+  int r;
+
+  state = data;
+  content = state->jobs[indx];
+  mime_data = content->dc_mime->mm_data.mm_single;
+
+  if (mime_data->dt_type != MAILMIME_DATA_TEXT) {
+    content->dc_error = MAILIMF_ERROR_INVAL;
+    return;
+  }
+
+  if (mime_data->dt_encoded)
+    encoding = mime_data->dt_encoding;
+  else
+    encoding = MAILMIME_MECHANISM_8BIT;
+
+  cur_token = 0;
+  r = mailmime_part_parse(mime_data->dt_data.dt_text.dt_data,
+      mime_data->dt_data.dt_text.dt_length, &cur_token, encoding,
+      &content->dc_data, &content->dc_length);
+  if (r != MAILIMF_NO_ERROR) {
+    content->dc_data = NULL;
+    content->dc_length = 0;
+    content->dc_error = r;
+    return;
+  }
+
+  if (state->to_charset != NULL)
+    parts_decode_convert(content, state->to_charset);
+}
+
+int mailmime_parts_decode(struct mailmime * mime, const char * to_charset,
+                          unsigned int nb_threads, carray ** result)
+{
+  struct parts_decode_state state;
+  carray * list;
+  unsigned int count;
+  unsigned int i;
+  size_t total_length;
+  int r;
+  int res;
+
+  list = carray_new(16);
+  if (list == NULL) {
+    res = MAILIMF_ERROR_MEMORY;
+    goto err;
+  }
+
+  r = parts_decode_collect(mime, list);
+  if (r != MAILIMF_NO_ERROR) {
+    res = r;
+    goto free_list;
+  }
+
+  count = carray_count(list);
+  state.jobs = malloc((count + 1) * sizeof(* state.jobs));
+  if (state.jobs == NULL) {
+    res = MAILIMF_ERROR_MEMORY;
+    goto free_list;
+  }
+  state.to_charset = to_charset;
+
+  /* starting with the biggest parts balances the threads */
+  total_length = 0;
+  for(i = 0 ; i < count ; i ++) {
+    state.jobs[i] = carray_get(list, i);
+    total_length += parts_decode_length(state.jobs[i]);
+  }
+  qsort(state.jobs, count, sizeof(* state.jobs), parts_decode_compare);
+
+  if (total_length < PARTS_DECODE_PARALLEL_MIN_SIZE)
+    nb_threads = 1;
+
+  mail_parallel_run(count, nb_threads, parts_decode_job, &state);
+
+  free(state.jobs);
+
+  * result = list;
+
+  return MAILIMF_NO_ERROR;
+
+ free_list:
+  mailmime_decoded_content_list_free(list);
+ err:
+  return res;
+}
+
+void mailmime_decoded_content_list_free(carray * list)
+{
+  unsigned int i;
+
+  for(i = 0 ; i < carray_count(list) ; i ++)
+    mailmime_decoded_content_free(carray_get(list, i));
+  carray_free(list);
+}
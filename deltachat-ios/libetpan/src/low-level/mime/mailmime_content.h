@@ -42,6 +42,7 @@ extern "C" {
 #endif
 
 #include <libetpan/mailmime_types.h>
+#include <libetpan/carray.h>
 
 LIBETPAN_EXPORT
 char * mailmime_content_charset_get(struct mailmime_content * content);
@@ -166,6 +167,34 @@ LIBETPAN_EXPORT
 int mailmime_get_section_id(struct mailmime * mime,
 			    struct mailmime_section ** result);
 
+/*
+ mailmime_parts_decode()
+
+ This function decodes all the single parts of a MIME tree at once.
+ The parts are independent, they are decoded by several threads,
+ the biggest ones first.
+
+ @param mime       MIME tree, as returned by mailmime_parse().
+ @param to_charset If not NULL, the content of text parts is also
+                   converted from their charset to this one. The
+                   content is left unconverted when the conversion fails.
+ @param nb_threads Number of threads to use, 0 means the number of
+                   online processors.
+ @param result     Array of (struct mailmime_decoded_content *), in the
+                   order of the MIME tree. Must be freed with
+                   mailmime_decoded_content_list_free().
+
+ @return the return code is one of MAILIMF_ERROR_XXX or
+   MAILIMF_NO_ERROR codes. The error of a single part is given in
+   its dc_error field.
+ */
+LIBETPAN_EXPORT
+int mailmime_parts_decode(struct mailmime * mime, const char * to_charset,
+                          unsigned int nb_threads, carray ** result);
+
+LIBETPAN_EXPORT
+void mailmime_decoded_content_list_free(carray * list);
+
 #ifdef __cplusplus
 }
 #endif
@@ -734,6 +734,31 @@ void mailmime_decoded_part_free(char * part)
   mmap_string_unref(part);
 }
 
+struct mailmime_decoded_content *
+mailmime_decoded_content_new(struct mailmime * dc_mime,
+    char * dc_data, size_t dc_length, int dc_error)
+{
+  struct mailmime_decoded_content * content;
+
+  content = malloc(sizeof(* content));
+  if (content == NULL)
+    return NULL;
+
+  content->dc_mime = dc_mime;
+  content->dc_data = dc_data;
+  content->dc_length = dc_length;
+  content->dc_error = dc_error;
+
+  return content;
+}
+
+void mailmime_decoded_content_free(struct mailmime_decoded_content * content)
+{
+  if (content->dc_data != NULL)
+    mailmime_decoded_part_free(content->dc_data);
+  free(content);
+}
+
 struct mailmime_data * mailmime_data_new(int dt_type, int dt_encoding,
     int dt_encoded, const char * dt_data, size_t dt_length, char * dt_filename)
 {
@@ -1165,89 +1165,161 @@ static int mailmime_text_content_write_driver(int (* do_write)(void *, const cha
 }
 
 
+/*
+  the encoders write their output in blocks, rather than calling
+  do_write() for each group of characters.
+*/
+
+#define WRITE_BUFFER_SIZE 4096
+
+struct write_buffer {
+  int (* do_write)(void *, const char *, size_t);
+  void * data;
+  size_t len;
+  char buf[WRITE_BUFFER_SIZE];
+};
+
+static inline void write_buffer_init(struct write_buffer * wb,
+    int (* do_write)(void *, const char *, size_t), void * data)
+{
+  wb->do_write = do_write;
+  wb->data = data;
+  wb->len = 0;
+}
+
+static int write_buffer_flush(struct write_buffer * wb)
+{
+  int r;
+
+  if (wb->len == 0)
+    return MAILIMF_NO_ERROR;
+
+  r = wb->do_write(wb->data, wb->buf, wb->len);
+  if (r == 0)
+    return MAILIMF_ERROR_FILE;
+  wb->len = 0;
+
+  return MAILIMF_NO_ERROR;
+}
+
+/* do_write() function that adds to the buffer */
+
+static int write_buffer_do_write(void * data, const char * str, size_t length)
+{
+  struct write_buffer * wb;
+
+  wb = data;
+
+  if (wb->len + length > WRITE_BUFFER_SIZE) {
+    if (write_buffer_flush(wb) != MAILIMF_NO_ERROR)
+      return 0;
+  }
+
+  if (length > WRITE_BUFFER_SIZE)
+    return wb->do_write(wb->data, str, length);
+
+  memcpy(wb->buf + wb->len, str, length);
+  wb->len += length;
+
+  return (int) length;
+}
+
+static inline int write_buffer_append(struct write_buffer * wb, int * col,
+    const char * str, size_t length)
+{
+  return mailimf_string_write_driver(write_buffer_do_write, wb, col,
+      str, length);
+}
+
 static const char base64_encoding[] =
 "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
 #define BASE64_MAX_COL 76
 
+/* encodes count bytes, returns the number of characters written */
+
+static size_t base64_encode_block(char * out, const unsigned char * p,
+    size_t count)
+{
+  char * q;
+  unsigned int a;
+  unsigned int b;
+
+  q = out;
+  while (count >= 3) {
+    q[0] = base64_encoding[p[0] >> 2];
+    q[1] = base64_encoding[((p[0] & 3) << 4) | (p[1] >> 4)];
+    q[2] = base64_encoding[((p[1] & 0xF) << 2) | (p[2] >> 6)];
+    q[3] = base64_encoding[p[2] & 0x3F];
+    q += 4;
+    p += 3;
+    count -= 3;
+  }
+
+  if (count > 0) {
+    a = p[0];
+    b = (count == 2) ? p[1] : 0;
+    q[0] = base64_encoding[a >> 2];
+    q[1] = base64_encoding[((a & 3) << 4) | (b >> 4)];
+    if (count == 2)
+      q[2] = base64_encoding[(b & 0xF) << 2];
+    else
+      q[2] = '=';
+    q[3] = '=';
+    q += 4;
+  }
+
+  return q - out;
+}
+
 int mailmime_base64_write_driver(int (* do_write)(void *, const char *, size_t), void * data, int * col,
     const char * text, size_t size)
 {
-  int a;
-  int b;
-  int c;
+  struct write_buffer wb;
+  const unsigned char * p;
   size_t remains;
-  const char * p;
   size_t count;
-  char ogroup[4];
+  size_t written;
   int r;
 
+  write_buffer_init(&wb, do_write, data);
+
   remains = size;
-  p = text;
+  p = (const unsigned char *) text;
 
   while (remains > 0) {
-    switch (remains) {
-    case 1:
-      a = (unsigned char) p[0];
-      b = 0;
-      c = 0;
-      count = 1;
-      break;
-    case 2:
-      a = (unsigned char) p[0];
-      b = (unsigned char) p[1];
-      c = 0;
-      count = 2;
-      break;
-    default:
-      a = (unsigned char) p[0];
-      b = (unsigned char) p[1];
-      c = (unsigned char) p[2];
-      count = 3;
-      break;
+    if (* col + 4 > BASE64_MAX_COL) {
+      r = write_buffer_append(&wb, col, "\r\n", 2);
+      if (r != MAILIMF_NO_ERROR)
+	return r;
     }
 
-    ogroup[0]= base64_encoding[a >> 2];
-    ogroup[1]= base64_encoding[((a & 3) << 4) | (b >> 4)];
-    ogroup[2]= base64_encoding[((b & 0xF) << 2) | (c >> 6)];
-    ogroup[3]= base64_encoding[c & 0x3F];
-
-    switch (count) {
-    case 1:
-      ogroup[2]= '=';
-      ogroup[3]= '=';
-      break;
-    case 2:
-      ogroup[3]= '=';
-      break;
-    }
+    /* as many groups of 3 bytes as the line can take */
+    count = ((BASE64_MAX_COL - * col) / 4) * 3;
+    if (count > remains)
+      count = remains;
 
-    if (* col + 4 > BASE64_MAX_COL) {
-      r = mailimf_string_write_driver(do_write, data, col, "\r\n", 2);
+    if (wb.len + BASE64_MAX_COL > WRITE_BUFFER_SIZE) {
+      r = write_buffer_flush(&wb);
       if (r != MAILIMF_NO_ERROR)
-	return r;
-#if 0
-      * col = 0;
-#endif
+        return r;
     }
-    
-    r = mailimf_string_write_driver(do_write, data, col, ogroup, 4);
-    if (r != MAILIMF_NO_ERROR)
-      return r;
+
+    written = base64_encode_block(wb.buf + wb.len, p, count);
+    wb.len += written;
+    * col += (int) written;
 
     remains -= count;
     p += count;
   }
 
-  r = mailimf_string_write_driver(do_write, data, col, "\r\n", 2);
+  r = write_buffer_append(&wb, col, "\r\n", 2);
+  if (r != MAILIMF_NO_ERROR)
+    return r;
 
-  return MAILIMF_NO_ERROR;
+  return write_buffer_flush(&wb);
 }
 
-#if 0
-#define MAX_WRITE_SIZE 512
-#endif
-
 enum {
   STATE_INIT,
   STATE_CR,
@@ -1255,30 +1327,13 @@ enum {
   STATE_SPACE_CR
 };
 
-#if 0
-static inline int write_try_buf(int (* do_write)(void *, const char *, size_t), void * data, int * col,
-				char ** pstart, size_t * plen)
-{
-  int r;
-
-  if (* plen >= MAX_WRITE_SIZE) {
-    r = mailimf_string_write_driver(do_write, data, col, * pstart, * plen);
-    if (r != MAILIMF_NO_ERROR)
-      return r;
-    * plen = 0;
-  }
-
-  return MAILIMF_NO_ERROR;
-}
-#endif
-
-static inline int write_remaining(int (* do_write)(void *, const char *, size_t), void * data, int * col,
+static inline int write_remaining(struct write_buffer * wb, int * col,
 				  const char ** pstart, size_t * plen)
 {
   int r;
 
   if (* plen > 0) {
-    r = mailimf_string_write_driver(do_write, data, col, * pstart, * plen);
+    r = write_buffer_append(wb, col, * pstart, * plen);
     if (r != MAILIMF_NO_ERROR)
       return r;
     * plen = 0;
@@ -1294,6 +1349,7 @@ static inline int write_remaining(int (* do_write)(void *, const char *, size_t)
 int mailmime_quoted_printable_write_driver(int (* do_write)(void *, const char *, size_t), void * data, int * col, int istext,
                                            const char * text, size_t size)
 {
+  struct write_buffer wb;
   size_t i;
   const char * start;
   size_t len;
@@ -1301,6 +1357,8 @@ int mailmime_quoted_printable_write_driver(int (* do_write)(void *, const char *
   int r;
   int state;
   
+  write_buffer_init(&wb, do_write, data);
+  
   start = text;
   len = 0;
   state = STATE_INIT;
@@ -1310,12 +1368,12 @@ int mailmime_quoted_printable_write_driver(int (* do_write)(void *, const char *
     unsigned char ch;
     
     if (* col + len > QP_MAX_COL) {
-      r = write_remaining(do_write, data, col, &start, &len);
+      r = write_remaining(&wb, col, &start, &len);
       if (r != MAILIMF_NO_ERROR)
         return r;
       start = text + i;
       
-      r = mailimf_string_write_driver(do_write, data, col, "=\r\n", 3);
+      r = write_buffer_append(&wb, col, "=\r\n", 3);
       if (r != MAILIMF_NO_ERROR)
         return r;
     }
@@ -1356,14 +1414,14 @@ int mailmime_quoted_printable_write_driver(int (* do_write)(void *, const char *
           case '?':
           case '_':
           case 'F': /* there is no more 'From' at the beginning of a line */
-            r = write_remaining(do_write, data, col, &start, &len);
+            r = write_remaining(&wb, col, &start, &len);
             if (r != MAILIMF_NO_ERROR)
               return r;
             start = text + i + 1;
             
             snprintf(hexstr, 6, "=%02X", ch);
             
-            r = mailimf_string_write_driver(do_write, data, col, hexstr, 3);
+            r = write_buffer_append(&wb, col, hexstr, 3);
             if (r != MAILIMF_NO_ERROR)
               return r;
             i ++;
@@ -1371,12 +1429,12 @@ int mailmime_quoted_printable_write_driver(int (* do_write)(void *, const char *
             
           default:
             if (istext && (ch == '\n')) {
-              r = write_remaining(do_write, data, col, &start, &len);
+              r = write_remaining(&wb, col, &start, &len);
               if (r != MAILIMF_NO_ERROR)
                 return r;
               start = text + i + 1;
               
-              r = mailimf_string_write_driver(do_write, data, col, "\r\n", 2);
+              r = write_buffer_append(&wb, col, "\r\n", 2);
               if (r != MAILIMF_NO_ERROR)
                 return r;
               i ++;
@@ -1388,14 +1446,14 @@ int mailmime_quoted_printable_write_driver(int (* do_write)(void *, const char *
                 i ++;
               }
               else {
-                r = write_remaining(do_write, data, col, &start, &len);
+                r = write_remaining(&wb, col, &start, &len);
                 if (r != MAILIMF_NO_ERROR)
                   return r;
                 start = text + i + 1;
                 
                 snprintf(hexstr, 6, "=%02X", ch);
                 
-                r = mailimf_string_write_driver(do_write, data, col, hexstr, 3);
+                r = write_buffer_append(&wb, col, hexstr, 3);
                 if (r != MAILIMF_NO_ERROR)
                   return r;
                 i ++;
@@ -1409,11 +1467,11 @@ int mailmime_quoted_printable_write_driver(int (* do_write)(void *, const char *
       case STATE_CR:
         switch (ch) {
           case '\n':
-            r = write_remaining(do_write, data, col, &start, &len);
+            r = write_remaining(&wb, col, &start, &len);
             if (r != MAILIMF_NO_ERROR)
               return r;
             start = text + i + 1;
-            r = mailimf_string_write_driver(do_write, data, col, "\r\n", 2);
+            r = write_buffer_append(&wb, col, "\r\n", 2);
             if (r != MAILIMF_NO_ERROR)
               return r;
             i ++;
@@ -1421,12 +1479,12 @@ int mailmime_quoted_printable_write_driver(int (* do_write)(void *, const char *
             break;
             
           default:
-            r = write_remaining(do_write, data, col, &start, &len);
+            r = write_remaining(&wb, col, &start, &len);
             if (r != MAILIMF_NO_ERROR)
               return r;
             start = text + i;
             snprintf(hexstr, 6, "=%02X", '\r');
-            r = mailimf_string_write_driver(do_write, data, col, hexstr, 3);
+            r = write_buffer_append(&wb, col, hexstr, 3);
             if (r != MAILIMF_NO_ERROR)
               return r;
             state = STATE_INIT;
@@ -1442,12 +1500,12 @@ int mailmime_quoted_printable_write_driver(int (* do_write)(void *, const char *
             break;
             
           case '\n':
-            r = write_remaining(do_write, data, col, &start, &len);
+            r = write_remaining(&wb, col, &start, &len);
             if (r != MAILIMF_NO_ERROR)
               return r;
             start = text + i + 1;
             snprintf(hexstr, 6, "=%02X\r\n", text[i - 1]);
-            r = mailimf_string_write_driver(do_write, data, col, hexstr, strlen(hexstr));
+            r = write_buffer_append(&wb, col, hexstr, strlen(hexstr));
             if (r != MAILIMF_NO_ERROR)
               return r;
             state = STATE_INIT;
@@ -1475,12 +1533,12 @@ int mailmime_quoted_printable_write_driver(int (* do_write)(void *, const char *
       case STATE_SPACE_CR:
         switch (ch) {
           case '\n':
-            r = write_remaining(do_write, data, col, &start, &len);
+            r = write_remaining(&wb, col, &start, &len);
             if (r != MAILIMF_NO_ERROR)
               return r;
             start = text + i + 1;
             snprintf(hexstr, 6, "=%02X\r\n", text[i - 2]);
-            r = mailimf_string_write_driver(do_write, data, col, hexstr, strlen(hexstr));
+            r = write_buffer_append(&wb, col, hexstr, strlen(hexstr));
             if (r != MAILIMF_NO_ERROR)
               return r;
             state = STATE_INIT;
@@ -1488,12 +1546,12 @@ int mailmime_quoted_printable_write_driver(int (* do_write)(void *, const char *
             break;
             
           default:
-            r = write_remaining(do_write, data, col, &start, &len);
+            r = write_remaining(&wb, col, &start, &len);
             if (r != MAILIMF_NO_ERROR)
               return r;
             start = text + i + 1;
             snprintf(hexstr, 6, "%c=%02X", text[i - 2], '\r');
-            r = mailimf_string_write_driver(do_write, data, col, hexstr, strlen(hexstr));
+            r = write_buffer_append(&wb, col, hexstr, strlen(hexstr));
             if (r != MAILIMF_NO_ERROR)
               return r;
             state = STATE_INIT;
@@ -1504,9 +1562,18 @@ int mailmime_quoted_printable_write_driver(int (* do_write)(void *, const char *
     }
   }
   
-  r = write_remaining(do_write, data, col, &start, &len);
+  r = write_remaining(&wb, col, &start, &len);
   if (r != MAILIMF_NO_ERROR)
     return r;
   
-  return MAILIMF_NO_ERROR;
+  return write_buffer_flush(&wb);
+}
+
+int mailmime_writer(int (* do_write)(void *, const char *, size_t), void * data,
+    void * context)
+{
+  int col;
+
+  col = 0;
+  return mailmime_write_driver(do_write, data, &col, context);
 }
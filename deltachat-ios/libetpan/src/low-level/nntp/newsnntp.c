@@ -54,6 +54,7 @@
 #include "connect.h"
 #include "mail.h"
 #include "clist.h"
+#include "mailmetrics.h"
 
 /*
   NNTP Protocol
@@ -114,6 +115,8 @@ newsnntp * newsnntp_new(size_t progr_rate, progress_function * progr_fun)
   f->nntp_logger = NULL;
   f->nntp_logger_context = NULL;
 
+  f->nntp_metrics = NULL;
+
   return f;
 
  free_stream_buffer:
@@ -131,6 +134,8 @@ void newsnntp_free(newsnntp * f)
 
   mmap_string_free(f->nntp_response_buffer);
   mmap_string_free(f->nntp_stream_buffer);
+  if (f->nntp_metrics != NULL)
+    mailmetrics_free(f->nntp_metrics);
 
   free(f);
 }
@@ -526,6 +531,9 @@ static void send_data(newsnntp * f, const char * message, size_t size)
 {
   mailstream_send_data(f->nntp_stream, message, size,
 		       f->nntp_progr_rate, f->nntp_progr_fun);
+
+  if (f->nntp_metrics != NULL)
+    mailmetrics_command_begin(f->nntp_metrics, f->nntp_stream, "MESSAGE");
 }
 
 
@@ -1696,7 +1704,216 @@ static int newsnntp_xover_resp(newsnntp * f, clist ** result)
   }
 }
 
+#define NNTP_XOVER_DEFAULT_STEP 5000
+#define NNTP_XOVER_DEFAULT_DEPTH 4
+
+/*
+  splits an overview line in place. The strings of item point into
+  line, the additional fields are appended to others.
+  returns 1 if the line was parsed, 0 if it does not have the
+  mandatory fields, -1 if memory is exhausted.
+*/
+
+static int xover_parse_line(char * line,
+    struct newsnntp_xover_resp_item * item, clist * others)
+{
+  char * fields[8];
+  unsigned int count;
+  char * p;
+
+  count = 0;
+  fields[count ++] = line;
+  while ((count < 8) && ((p = strchr(line, '\t')) != NULL)) {
+    * p = 0;
+    line = p + 1;
+    fields[count ++] = line;
+  }
+  if (count < 8)
+    return 0;
+
+  /* the last mandatory field may be followed by other fields */
+  p = strchr(line, '\t');
+  if (p != NULL) {
+    * p = 0;
+    line = p + 1;
+    while (1) {
+      p = strchr(line, '\t');
+      if (p != NULL)
+        * p = 0;
+      if (clist_append(others, line) < 0)
+        return -1;
+      if (p == NULL)
+        break;
+      line = p + 1;
+    }
+  }
+
+  item->ovr_article = (uint32_t) strtoul(fields[0], NULL, 10);
+  item->ovr_subject = fields[1];
+  item->ovr_author = fields[2];
+  item->ovr_date = fields[3];
+  item->ovr_message_id = fields[4];
+  item->ovr_references = fields[5];
+  item->ovr_size = (size_t) strtoul(fields[6], NULL, 10);
+  item->ovr_line_count = (uint32_t) strtoul(fields[7], NULL, 10);
+  item->ovr_others = clist_isempty(others) ? NULL : others;
+
+  return 1;
+}
+
+/*
+  reads the response to one XOVER request of the pipeline. When
+  handler is NULL, the overview lines are only skipped.
+*/
+
+static int xover_foreach_resp(newsnntp * f, clist * others,
+    newsnntp_xover_handler * handler, void * context)
+{
+  char * line;
+  int r;
+  int res;
+
+  line = read_line(f);
+  if (line == NULL)
+    return NEWSNNTP_ERROR_STREAM;
+
+  r = parse_response(f, line);
 
+  switch (r) {
+  case 480:
+    return NEWSNNTP_ERROR_REQUEST_AUTHORIZATION_USERNAME;
+      
+  case 381:
+    return NEWSNNTP_WARNING_REQUEST_AUTHORIZATION_PASSWORD;
+      
+  case 224:
+    break;
+
+  case 412:
+    return NEWSNNTP_ERROR_NO_NEWSGROUP_SELECTED;
+
+  case 420:
+  case 423:
+    /* no article in this part of the range */
+    return NEWSNNTP_NO_ERROR;
+
+  case 502:
+    return NEWSNNTP_ERROR_NO_PERMISSION;
+
+  default:
+    return NEWSNNTP_ERROR_UNEXPECTED_RESPONSE;
+  }
+
+  res = NEWSNNTP_NO_ERROR;
+  while (1) {
+    struct newsnntp_xover_resp_item item;
+
+    line = read_line(f);
+    if (line == NULL)
+      return NEWSNNTP_ERROR_STREAM;
+
+    if (mailstream_is_end_multiline(line))
+      break;
+
+    if ((handler == NULL) || (res != NEWSNNTP_NO_ERROR))
+      continue;
+
+    r = xover_parse_line(line, &item, others);
+    if (r < 0)
+      res = NEWSNNTP_ERROR_MEMORY;
+    else if (r > 0)
+      res = handler(&item, context);
+
+    while (!clist_isempty(others))
+      clist_delete(others, clist_begin(others));
+  }
+
+  return res;
+}
+
+int newsnntp_xover_range_foreach(newsnntp * f,
+    uint32_t rangeinf, uint32_t rangesup,
+    uint32_t step, unsigned int depth,
+    newsnntp_xover_handler * handler, void * context)
+{
+  char command[NNTP_STRING_SIZE];
+  clist * others;
+  uint32_t next_inf;
+  unsigned int pending;
+  int sent_all;
+  int res;
+  int r;
+
+  if (step == 0)
+    step = NNTP_XOVER_DEFAULT_STEP;
+  if (depth == 0)
+    depth = NNTP_XOVER_DEFAULT_DEPTH;
+
+  if (rangeinf > rangesup)
+    return NEWSNNTP_NO_ERROR;
+
+  others = clist_new();
+  if (others == NULL)
+    return NEWSNNTP_ERROR_MEMORY;
+
+  res = NEWSNNTP_NO_ERROR;
+  next_inf = rangeinf;
+  sent_all = FALSE;
+  pending = 0;
+
+  while (1) {
+    /* keep up to depth requests in flight */
+    if (!sent_all && (res == NEWSNNTP_NO_ERROR) && (pending < depth)) {
+      mailstream_set_privacy(f->nntp_stream, 1);
+      while (!sent_all && (pending < depth)) {
+        uint32_t next_sup;
+
+        if (rangesup - next_inf < step - 1)
+          next_sup = rangesup;
+        else
+          next_sup = next_inf + (step - 1);
+
+        snprintf(command, NNTP_STRING_SIZE, "XOVER %u-%u\r\n",
+            next_inf, next_sup);
+        if (mailstream_write(f->nntp_stream, command, strlen(command)) == -1) {
+          res = NEWSNNTP_ERROR_STREAM;
+          goto free;
+        }
+        if (f->nntp_metrics != NULL)
+          mailmetrics_command_begin(f->nntp_metrics, f->nntp_stream, command);
+        pending ++;
+
+        if (next_sup == rangesup)
+          sent_all = TRUE;
+        else
+          next_inf = next_sup + 1;
+      }
+      if (mailstream_flush(f->nntp_stream) == -1) {
+        res = NEWSNNTP_ERROR_STREAM;
+        goto free;
+      }
+    }
+
+    if (pending == 0)
+      break;
+
+    /* once an error occurred, the remaining responses are only read
+       to keep the session usable */
+    r = xover_foreach_resp(f, others,
+        (res == NEWSNNTP_NO_ERROR) ? handler : NULL, context);
+    pending --;
+    if (r == NEWSNNTP_ERROR_STREAM) {
+      res = r;
+      goto free;
+    }
+    if ((r != NEWSNNTP_NO_ERROR) && (res == NEWSNNTP_NO_ERROR))
+      res = r;
+  }
+
+ free:
+  clist_free(others);
+  return res;
+}
 
 
 
@@ -1817,6 +2034,9 @@ static int parse_response(newsnntp * f, char * response)
 {
   int code;
 
+  if (f->nntp_metrics != NULL)
+    mailmetrics_command_end(f->nntp_metrics, f->nntp_stream);
+
   code = (int) strtol(response, &response, 10);
 
   if (response == NULL) {
@@ -2545,6 +2765,11 @@ static int send_command_private(newsnntp * f, char * command, int can_be_publish
   if (r == -1)
     return -1;
 
+  /* don't record the credentials as the name of the command */
+  if (f->nntp_metrics != NULL)
+    mailmetrics_command_begin(f->nntp_metrics, f->nntp_stream,
+        can_be_published ? command : "AUTH");
+
   return 0;
 }
 
@@ -2567,6 +2792,23 @@ void newsnntp_set_logger(newsnntp * session, void (* logger)(newsnntp * session,
   session->nntp_logger_context = logger_context;
 }
 
+int newsnntp_enable_metrics(newsnntp * session)
+{
+  if (session->nntp_metrics != NULL)
+    return NEWSNNTP_NO_ERROR;
+
+  session->nntp_metrics = mailmetrics_new();
+  if (session->nntp_metrics == NULL)
+    return NEWSNNTP_ERROR_MEMORY;
+
+  return NEWSNNTP_NO_ERROR;
+}
+
+struct mailmetrics * newsnntp_get_metrics(newsnntp * session)
+{
+  return session->nntp_metrics;
+}
+
 void newsnntp_set_progress_callback(newsnntp * f, mailprogress_function * progr_fun, void * context)
 {
 	f->nntp_progress_fun = progr_fun;
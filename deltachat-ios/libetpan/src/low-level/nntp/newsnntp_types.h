@@ -46,6 +46,7 @@ extern "C" {
 
 #include <libetpan/mailstream.h>
 #include <libetpan/mmapstring.h>
+#include <libetpan/mailmetrics.h>
 
 enum {
   NEWSNNTP_NO_ERROR = 0,
@@ -98,6 +99,8 @@ struct newsnntp
   
   mailprogress_function * nntp_progress_fun;
   void * nntp_progress_context;
+
+  struct mailmetrics * nntp_metrics;
 };
 
 struct newsnntp_group_info
@@ -148,6 +151,15 @@ struct newsnntp_xover_resp_item {
   clist * ovr_others;
 };
 
+/*
+  handler called by newsnntp_xover_range_foreach() for each overview
+  line. Any return value other than NEWSNNTP_NO_ERROR stops the
+  iteration and is returned by newsnntp_xover_range_foreach().
+*/
+
+typedef int newsnntp_xover_handler(struct newsnntp_xover_resp_item * item,
+                                   void * context);
+
 #ifdef __cplusplus
 }
 #endif
@@ -51,6 +51,7 @@
 #include <string.h>
 #include "md5.h"
 #include "mail.h"
+#include "mailmetrics.h"
 #include <stdlib.h>
 
 #ifdef USE_SASL
@@ -257,6 +258,8 @@ mailpop3 * mailpop3_new(size_t progr_rate, progress_function * progr_fun)
   
   f->pop3_logger = NULL;
   f->pop3_logger_context = NULL;
+
+  f->pop3_metrics = NULL;
   
   return f;
 
@@ -284,6 +287,8 @@ void mailpop3_free(mailpop3 * f)
 
   mmap_string_free(f->pop3_response_buffer);
   mmap_string_free(f->pop3_stream_buffer);
+  if (f->pop3_metrics != NULL)
+    mailmetrics_free(f->pop3_metrics);
 
   free(f);
 }
@@ -1051,6 +1056,9 @@ static char * cut_token(char * line)
 static int parse_response(mailpop3 * f, char * response)
 {
   char * msg;
+
+  if (f->pop3_metrics != NULL)
+    mailmetrics_command_end(f->pop3_metrics, f->pop3_stream);
   
   if (response == NULL) {
     f->pop3_response = NULL;
@@ -1100,6 +1108,8 @@ static int parse_auth(mailpop3 * f, char * response)
   char * msg;
   
   if (response == NULL) {
+    if (f->pop3_metrics != NULL)
+      mailmetrics_command_end(f->pop3_metrics, f->pop3_stream);
     f->pop3_response = NULL;
     return RESPONSE_ERR;
   }
@@ -1117,6 +1127,9 @@ static int parse_auth(mailpop3 * f, char * response)
     else
       f->pop3_response = NULL;
 
+    if (f->pop3_metrics != NULL)
+      mailmetrics_command_end(f->pop3_metrics, f->pop3_stream);
+
     return RESPONSE_AUTH_CONT;
   }
   else {
@@ -1380,6 +1393,11 @@ static int send_command_private(mailpop3 * f, char * command, int can_be_publish
   if (r == -1)
     return -1;
 
+  /* don't record the credentials as the name of the command */
+  if (f->pop3_metrics != NULL)
+    mailmetrics_command_begin(f->pop3_metrics, f->pop3_stream,
+        can_be_published ? command : "AUTH");
+
   return 0;
 }
 
@@ -1685,3 +1703,22 @@ void mailpop3_set_logger(mailpop3 * session, void (* logger)(mailpop3 * session,
   session->pop3_logger = logger;
   session->pop3_logger_context = logger_context;
 }
+
+LIBETPAN_EXPORT
+int mailpop3_enable_metrics(mailpop3 * session)
+{
+  if (session->pop3_metrics != NULL)
+    return MAILPOP3_NO_ERROR;
+
+  session->pop3_metrics = mailmetrics_new();
+  if (session->pop3_metrics == NULL)
+    return MAILPOP3_ERROR_MEMORY;
+
+  return MAILPOP3_NO_ERROR;
+}
+
+LIBETPAN_EXPORT
+struct mailmetrics * mailpop3_get_metrics(mailpop3 * session)
+{
+  return session->pop3_metrics;
+}
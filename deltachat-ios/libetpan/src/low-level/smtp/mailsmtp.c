@@ -44,6 +44,7 @@
 #include "connect.h"
 #include "base64.h"
 #include "mail.h"
+#include "mailmetrics.h"
 
 #ifdef HAVE_SYS_SOCKET_H
 #	include <sys/socket.h>
@@ -142,6 +143,8 @@ mailsmtp * mailsmtp_new(size_t progr_rate,
 
   session->smtp_logger = NULL;
   session->smtp_logger_context = NULL;
+
+  session->smtp_metrics = NULL;
   
   return session;
 
@@ -167,6 +170,8 @@ void mailsmtp_free(mailsmtp * session)
 
   mmap_string_free(session->line_buffer);
   mmap_string_free(session->response_buffer);
+  if (session->smtp_metrics != NULL)
+    mailmetrics_free(session->smtp_metrics);
   free(session);
 }
 
@@ -411,6 +416,7 @@ int mailsmtp_data(mailsmtp * session)
 }
 
 static int send_data(mailsmtp * session, const char * message, size_t size);
+static int data_message_response(mailsmtp * session);
 
 int mailsmtp_data_message(mailsmtp * session,
 			   const char * message,
@@ -422,6 +428,42 @@ int mailsmtp_data_message(mailsmtp * session,
   if (r == -1)
     return MAILSMTP_ERROR_STREAM;
 
+  return data_message_response(session);
+}
+
+int mailsmtp_data_message_writer(mailsmtp * session,
+    int (* writer)(int (* do_write)(void *, const char *, size_t),
+                   void * data, void * context),
+    void * context)
+{
+  struct mailstream_data_writer data_writer;
+  int r;
+
+  mailstream_data_writer_init(&data_writer, session->stream, 1);
+
+  r = writer(mailstream_data_writer_write, &data_writer, context);
+  if (r != 0)
+    return MAILSMTP_ERROR_STREAM;
+
+  if (mailstream_data_writer_finish(&data_writer) == -1)
+    return MAILSMTP_ERROR_STREAM;
+
+  if (mailstream_write(session->stream, "\r\n.\r\n", 5) == -1)
+    return MAILSMTP_ERROR_STREAM;
+
+  if (mailstream_flush(session->stream) == -1)
+    return MAILSMTP_ERROR_STREAM;
+
+  if (session->smtp_metrics != NULL)
+    mailmetrics_command_begin(session->smtp_metrics, session->stream, "MESSAGE");
+
+  return data_message_response(session);
+}
+
+static int data_message_response(mailsmtp * session)
+{
+  int r;
+
   r = read_response(session);
 
   switch(r) {
@@ -1047,6 +1089,9 @@ static int read_response(mailsmtp * session)
   }
   while ((code & SMTP_STATUS_CONTINUE) != 0);
 
+  if (session->smtp_metrics != NULL)
+    mailmetrics_command_end(session->smtp_metrics, session->stream);
+
   session->response = session->response_buffer->str;
 	session->response_code = code;
     
@@ -1074,6 +1119,11 @@ static int send_command_private(mailsmtp * f, char * command, int can_be_publish
   if (r == -1)
     return -1;
 
+  /* don't record the credentials as the name of the command */
+  if (f->smtp_metrics != NULL)
+    mailmetrics_command_begin(f->smtp_metrics, f->stream,
+        can_be_published ? command : "AUTH");
+
   return 0;
 }
 
@@ -1093,6 +1143,9 @@ static int send_data(mailsmtp * session, const char * message, size_t size)
   if (mailstream_flush(session->stream) == -1)
     return -1;
 
+  if (session->smtp_metrics != NULL)
+    mailmetrics_command_begin(session->smtp_metrics, session->stream, "MESSAGE");
+
   return 0;
 }
 
@@ -1501,6 +1554,25 @@ void mailsmtp_set_logger(mailsmtp * session, void (* logger)(mailsmtp * session,
   session->smtp_logger_context = logger_context;
 }
 
+LIBETPAN_EXPORT
+int mailsmtp_enable_metrics(mailsmtp * session)
+{
+  if (session->smtp_metrics != NULL)
+    return MAILSMTP_NO_ERROR;
+
+  session->smtp_metrics = mailmetrics_new();
+  if (session->smtp_metrics == NULL)
+    return MAILSMTP_ERROR_MEMORY;
+
+  return MAILSMTP_NO_ERROR;
+}
+
+LIBETPAN_EXPORT
+struct mailmetrics * mailsmtp_get_metrics(mailsmtp * session)
+{
+  return session->smtp_metrics;
+}
+
 int mailsmtp_send_command(mailsmtp * f, char * command)
 {
   return send_command(f, command);
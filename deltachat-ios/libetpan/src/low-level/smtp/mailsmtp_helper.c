@@ -208,6 +208,103 @@ int mailsmtp_send(mailsmtp * session,
 
 
 
+LIBETPAN_EXPORT
+int mailesmtp_send_writer(mailsmtp * session,
+    const char * from,
+    int return_full,
+    const char * envid,
+    clist * addresses,
+    int (* writer)(int (* do_write)(void *, const char *, size_t),
+                   void * data, void * context),
+    void * context)
+{
+  int r;
+  clistiter * l;
+  size_t size;
+
+  if (!session->esmtp)
+    return mailsmtp_send_writer(session, from, addresses, writer, context);
+
+  size = 0;
+  if ((session->esmtp & MAILSMTP_ESMTP_SIZE) != 0) {
+    struct mailstream_data_writer size_writer;
+
+    /* nothing is sent, only the size of the message is computed */
+    mailstream_data_writer_init(&size_writer, NULL, 0);
+    r = writer(mailstream_data_writer_write, &size_writer, context);
+    if (r != 0)
+      return MAILSMTP_ERROR_MEMORY;
+    mailstream_data_writer_finish(&size_writer);
+    size = size_writer.dw_size;
+
+    if (session->smtp_max_msg_size != 0) {
+      if (size > session->smtp_max_msg_size) {
+        return MAILSMTP_ERROR_EXCEED_STORAGE_ALLOCATION;
+      }
+    }
+  }
+
+  r = mailesmtp_mail_size(session, from, return_full, envid, size);
+  if (r != MAILSMTP_NO_ERROR)
+    return r;
+
+  for(l = clist_begin(addresses) ; l != NULL; l = clist_next(l)) {
+    struct esmtp_address * addr;
+
+    addr = clist_content(l);
+
+    r = mailesmtp_rcpt(session, addr->address, addr->notify, addr->orcpt);
+    if (r != MAILSMTP_NO_ERROR)
+      return r;
+  }
+
+  r = mailsmtp_data(session);
+  if (r != MAILSMTP_NO_ERROR)
+    return r;
+
+  r = mailsmtp_data_message_writer(session, writer, context);
+  if (r != MAILSMTP_NO_ERROR)
+    return r;
+
+  return MAILSMTP_NO_ERROR;
+}
+
+LIBETPAN_EXPORT
+int mailsmtp_send_writer(mailsmtp * session,
+    const char * from,
+    clist * addresses,
+    int (* writer)(int (* do_write)(void *, const char *, size_t),
+                   void * data, void * context),
+    void * context)
+{
+  int r;
+  clistiter * l;
+
+  r = mailsmtp_mail(session, from);
+  if (r != MAILSMTP_NO_ERROR)
+    return r;
+
+  for(l = clist_begin(addresses) ; l != NULL; l = clist_next(l)) {
+    struct esmtp_address * addr;
+
+    addr = clist_content(l);
+
+    r = mailsmtp_rcpt(session, addr->address);
+    if (r != MAILSMTP_NO_ERROR)
+      return r;
+  }
+
+  r = mailsmtp_data(session);
+  if (r != MAILSMTP_NO_ERROR)
+    return r;
+
+  r = mailsmtp_data_message_writer(session, writer, context);
+  if (r != MAILSMTP_NO_ERROR)
+    return r;
+
+  return MAILSMTP_NO_ERROR;
+}
+
 /* esmtp addresses and smtp addresses */
 
 static struct esmtp_address * esmtp_address_new(char * addr,
@@ -43,6 +43,7 @@ extern "C" {
 
 #include <libetpan/mailstream.h>
 #include <libetpan/mmapstring.h>
+#include <libetpan/mailmetrics.h>
 
 enum {
   MAILSMTP_NO_ERROR = 0,
@@ -136,6 +137,8 @@ struct mailsmtp {
   
   void (* smtp_logger)(mailsmtp * session, int log_type, const char * str, size_t size, void * context);
   void * smtp_logger_context;
+
+  struct mailmetrics * smtp_metrics;
 };
 
 #define MAILSMTP_DSN_NOTIFY_SUCCESS 1